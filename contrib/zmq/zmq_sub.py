@@ -12,9 +12,11 @@ zmqSubSocket = zmqContext.socket(zmq.SUB)
 zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"hashblock")
 zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"hashtx")
 zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"hashtxlock")
+zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"hashmasternodewinner")
 zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"rawblock")
 zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"rawtx")
 zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"rawtxlock")
+zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"rawbudgetvote")
 zmqSubSocket.connect("tcp://127.0.0.1:%i" % port)
 
 try:
@@ -46,6 +48,12 @@ try:
         elif topic == "rawtxlock":
             print('- RAW TX LOCK ('+sequence+') -')
             print(binascii.hexlify(body).decode("utf-8"))
+        elif topic == "hashmasternodewinner":
+            print('- HASH MASTERNODE WINNER ('+sequence+') -')
+            print(binascii.hexlify(body).decode("utf-8"))
+        elif topic == "rawbudgetvote":
+            print('- RAW BUDGET VOTE ('+sequence+') -')
+            print(binascii.hexlify(body).decode("utf-8"))
 
 except KeyboardInterrupt:
     zmqContext.destroy()
@@ -27,6 +27,10 @@ if [ "x${ENABLE_BITCOIND}${ENABLE_UTILS}${ENABLE_WALLET}" = "x111" ]; then
   ${BUILDDIR}/qa/rpc-tests/httpbasics.py --srcdir "${BUILDDIR}/src"
   ${BUILDDIR}/qa/rpc-tests/mempool_coinbase_spends.py --srcdir "${BUILDDIR}/src"
   ${BUILDDIR}/qa/rpc-tests/proxy_test.py --srcdir "${BUILDDIR}/src"
+  ${BUILDDIR}/qa/rpc-tests/mempool_persist.py --srcdir "${BUILDDIR}/src"
+  ${BUILDDIR}/qa/rpc-tests/rpcbatch.py --srcdir "${BUILDDIR}/src"
+  ${BUILDDIR}/qa/rpc-tests/verifydb.py --srcdir "${BUILDDIR}/src"
+  ${BUILDDIR}/qa/rpc-tests/addressindex.py --srcdir "${BUILDDIR}/src"
   #${BUILDDIR}/qa/rpc-tests/forknotify.py --srcdir "${BUILDDIR}/src"
 else
   echo "No rpc tests to run. Wallet, utils, and bitcoind must all be enabled"
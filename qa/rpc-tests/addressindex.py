@@ -0,0 +1,80 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018 The Basex developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test that the address index and the spent index follow a block being
+# connected, disconnected and connected again.
+#
+
+from test_framework import BitcoinTestFramework
+from bitcoinrpc.authproxy import JSONRPCException
+from util import *
+from decimal import Decimal
+
+class AddressIndexTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 1)
+
+    def setup_network(self):
+        self.nodes = []
+        self.nodes.append(start_node(0, self.options.tmpdir, ["-addressindex", "-spentindex"]))
+        self.is_network_split = False
+
+    def check_indexes(self, address, txid, prevout, height):
+        node = self.nodes[0]
+        if txid is None:
+            assert_equal(node.getaddressbalance(address)['balance'], 0)
+            assert_equal(node.getaddressutxos(address), [])
+            assert_equal(node.getaddresstxids(address), [])
+            assert_raises(JSONRPCException, node.getspentinfo, prevout)
+            return
+        balance = node.getaddressbalance({"addresses": [address]})
+        assert_equal(balance['balance'], Decimal("10"))
+        assert_equal(balance['received'], Decimal("10"))
+        utxos = node.getaddressutxos(address)
+        assert_equal(len(utxos), 1)
+        assert_equal(utxos[0]['address'], address)
+        assert_equal(utxos[0]['txid'], txid)
+        assert_equal(utxos[0]['amount'], Decimal("10"))
+        assert_equal(utxos[0]['height'], height)
+        assert_equal(node.getaddresstxids(address), [txid])
+        spent = node.getspentinfo(prevout)
+        assert_equal(spent['txid'], txid)
+        assert_equal(spent['index'], 0)
+        assert_equal(spent['height'], height)
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.setgenerate(True, 101)
+        address = node.getnewaddress()
+
+        txid = node.sendtoaddress(address, 10)
+        vin = node.getrawtransaction(txid, 1)['vin'][0]
+        prevout = {"txid": vin['txid'], "index": vin['vout']}
+
+        # Nothing is indexed for the mempool
+        self.check_indexes(address, None, prevout, 0)
+
+        node.setgenerate(True, 1)
+        height = node.getblockcount()
+        blockhash = node.getbestblockhash()
+        self.check_indexes(address, txid, prevout, height)
+
+        # Disconnecting the block takes its records out of both indexes
+        node.invalidateblock(blockhash)
+        assert_equal(node.getblockcount(), height - 1)
+        self.check_indexes(address, None, prevout, 0)
+
+        # and connecting it again puts them back
+        node.reconsiderblock(blockhash)
+        assert_equal(node.getbestblockhash(), blockhash)
+        self.check_indexes(address, txid, prevout, height)
+
+        print "Success"
+
+if __name__ == '__main__':
+    AddressIndexTest().main()
@@ -0,0 +1,56 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018 The Basex developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test that the mempool is saved on shutdown and loaded on restart,
+# including chains of unconfirmed transactions.
+#
+
+from test_framework import BitcoinTestFramework
+from util import *
+from decimal import Decimal
+
+class MempoolPersistTest(BitcoinTestFramework):
+
+    def setup_network(self):
+        self.nodes = []
+        self.nodes.append(start_node(0, self.options.tmpdir))
+        self.is_network_split = False
+
+    def run_test(self):
+        node0_address = self.nodes[0].getnewaddress()
+
+        # A chain of transactions, each spending the one before it. Their
+        # txids are in no particular order, so a dump in txid order would
+        # almost surely put a child before its parent.
+        utxo = self.nodes[0].listunspent()[0]
+        txid, amount = utxo['txid'], utxo['amount']
+        vout = utxo['vout']
+        chain = []
+        for i in range(10):
+            amount -= Decimal("0.01")
+            rawtx = self.nodes[0].createrawtransaction([{ "txid" : txid, "vout" : vout }], { node0_address : amount })
+            signresult = self.nodes[0].signrawtransaction(rawtx)
+            assert_equal(signresult["complete"], True)
+            txid = self.nodes[0].sendrawtransaction(signresult["hex"])
+            vout = 0
+            chain.append(txid)
+        assert_equal(sorted(self.nodes[0].getrawmempool()), sorted(chain))
+
+        # Without the wallet, which would otherwise put its own transactions back
+        stop_node(self.nodes[0], 0)
+        self.nodes[0] = start_node(0, self.options.tmpdir, ["-disablewallet"])
+        assert_equal(sorted(self.nodes[0].getrawmempool()), sorted(chain))
+
+        # Not saved with -persistmempool=0, and nothing loaded with it either
+        stop_node(self.nodes[0], 0)
+        self.nodes[0] = start_node(0, self.options.tmpdir, ["-disablewallet", "-persistmempool=0"])
+        assert_equal(self.nodes[0].getrawmempool(), [])
+        stop_node(self.nodes[0], 0)
+        self.nodes[0] = start_node(0, self.options.tmpdir, ["-disablewallet"])
+        assert_equal(sorted(self.nodes[0].getrawmempool()), sorted(chain))
+
+if __name__ == '__main__':
+    MempoolPersistTest().main()
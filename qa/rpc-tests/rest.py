@@ -9,7 +9,9 @@
 
 from test_framework import BitcoinTestFramework
 from util import *
+import binascii
 import json
+import struct
 
 try:
     import http.client as httplib
@@ -29,6 +31,15 @@ def http_get_call(host, port, path, response_object = 0):
         
     return conn.getresponse().read()
 
+def http_post_call(host, port, path, requestdata = '', response_object = 0):
+    conn = httplib.HTTPConnection(host, port)
+    conn.request('POST', path, requestdata)
+
+    if response_object:
+        return conn.getresponse()
+
+    return conn.getresponse().read()
+
 
 class RESTTest (BitcoinTestFramework):
     FORMAT_SEPARATOR = "."
@@ -82,6 +93,70 @@ class RESTTest (BitcoinTestFramework):
         json_obj = json.loads(json_string)
         for tx in txs:
             assert_equal(tx in json_obj['tx'], True)
+
+        # the raw block matches getblock
+        response = http_get_call(url.hostname, url.port, '/rest/block/'+newblockhash[0]+self.FORMAT_SEPARATOR+'hex', True)
+        assert_equal(response.status, 200)
+        assert_equal(response.read().strip(), self.nodes[0].getblock(newblockhash[0], False))
+
+        # headers: one 80 byte header per block, along the active chain
+        response = http_get_call(url.hostname, url.port, '/rest/headers/1/'+newblockhash[0]+self.FORMAT_SEPARATOR+'bin', True)
+        assert_equal(response.status, 200)
+        assert_equal(len(response.read()), 80)
+        json_string = http_get_call(url.hostname, url.port, '/rest/headers/5/'+bb_hash+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal(len(json_obj), 2) #the best block at the start, and the new block
+        assert_equal(json_obj[0]['hash'], bb_hash)
+        assert_equal(json_obj[1]['hash'], newblockhash[0])
+        response = http_get_call(url.hostname, url.port, '/rest/headers/0/'+bb_hash+self.FORMAT_SEPARATOR+'json', True)
+        assert_equal(response.status, 400)
+
+        # chain info
+        json_string = http_get_call(url.hostname, url.port, '/rest/chaininfo'+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal(json_obj['bestblockhash'], newblockhash[0])
+
+        # getutxos: an output of the mined transactions, unspent
+        json_string = http_get_call(url.hostname, url.port, '/rest/getutxos/'+txs[0]+'-0'+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal(json_obj['chaintipHash'], newblockhash[0])
+        assert_equal(len(json_obj['bitmap']), 1)
+        response = http_get_call(url.hostname, url.port, '/rest/getutxos'+self.FORMAT_SEPARATOR+'json', True)
+        assert_equal(response.status, 400) #empty request
+
+        # mempool: a new transaction shows up with checkmempool only
+        txid = self.nodes[0].sendtoaddress(self.nodes[2].getnewaddress(), 1)
+        self.sync_all()
+        json_string = http_get_call(url.hostname, url.port, '/rest/mempool/info'+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal(json_obj['size'], 1)
+        json_string = http_get_call(url.hostname, url.port, '/rest/mempool/contents'+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal(list(json_obj.keys()), [txid])
+        raw = self.nodes[0].getrawtransaction(txid, 1)
+        vout = [o['n'] for o in raw['vout'] if o['value'] == 1][0]
+        json_string = http_get_call(url.hostname, url.port, '/rest/getutxos/'+txid+'-'+str(vout)+self.FORMAT_SEPARATOR+'json')
+        assert_equal(json.loads(json_string)['bitmap'], "0")
+        json_string = http_get_call(url.hostname, url.port, '/rest/getutxos/checkmempool/'+txid+'-'+str(vout)+self.FORMAT_SEPARATOR+'json')
+        assert_equal(json.loads(json_string)['bitmap'], "1")
+
+        # getutxos with the outpoints posted in binary and hex: checkmempool, then the vector of outpoints
+        bin_request = b'\x01' + b'\x01' + binascii.unhexlify(txid)[::-1] + struct.pack('<I', vout)
+        response = http_post_call(url.hostname, url.port, '/rest/getutxos'+self.FORMAT_SEPARATOR+'bin', bin_request, True)
+        assert_equal(response.status, 200)
+        output = response.read()
+        assert_equal(struct.unpack('<i', output[0:4])[0], self.nodes[0].getblockcount())
+        assert_equal(binascii.hexlify(output[4:36][::-1]), self.nodes[0].getbestblockhash())
+        assert_equal(output[36:38], b'\x01\x01') #one bitmap byte, the outpoint is unspent in the mempool
+        response = http_post_call(url.hostname, url.port, '/rest/getutxos'+self.FORMAT_SEPARATOR+'hex', binascii.hexlify(bin_request), True)
+        assert_equal(response.status, 200)
+        assert_equal(response.read().strip(), binascii.hexlify(output))
+        response = http_post_call(url.hostname, url.port, '/rest/getutxos/'+txid+'-'+str(vout)+self.FORMAT_SEPARATOR+'bin', bin_request, True)
+        assert_equal(response.status, 400) #inputs in both the URI and the body
+
+        # masternodes: none in this test
+        json_string = http_get_call(url.hostname, url.port, '/rest/masternodes'+self.FORMAT_SEPARATOR+'json')
+        assert_equal(json.loads(json_string), [])
                 
         
 
@@ -0,0 +1,76 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018 The Basex developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test that the calls of a JSON-RPC batch run in request order
+#
+
+from test_framework import BitcoinTestFramework
+from util import *
+
+class RPCBatchTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 1)
+
+    def setup_network(self):
+        self.nodes = [ start_node(0, self.options.tmpdir) ]
+        self.is_network_split = False
+
+    def batch(self, calls):
+        replies = self.nodes[0]._batch([ {"method": c[0], "params": c[1:], "id": i} for i, c in enumerate(calls) ])
+        assert_equal([ r["id"] for r in replies ], range(len(calls)))
+        return replies
+
+    def run_test(self):
+        self.nodes[0].setgenerate(True, 10)
+        assert_equal(self.nodes[0].getblockcount(), 10)
+
+        # Reads after a write see the write, even when they could run in parallel
+        replies = self.batch([
+            ("getblockhash", 10),
+            ("getblockhash", 9),
+            ("setgenerate", True, 1),
+            ("getblockhash", 11),
+            ("getblock", self.nodes[0].getblockhash(10)),
+            ("getblockcount",),
+            ("getbestblockhash",),
+        ])
+        for r in replies:
+            assert_equal(r["error"], None)
+        assert_equal(replies[0]["result"], self.nodes[0].getblockhash(10))
+        assert_equal(replies[1]["result"], self.nodes[0].getblockhash(9))
+        assert_equal(replies[4]["result"]["nextblockhash"], replies[3]["result"])
+        assert_equal(replies[5]["result"], 11)
+        assert_equal(replies[6]["result"], replies[3]["result"])
+
+        # A block invalidated in the middle of the batch is gone for the calls after it only
+        besthash = self.nodes[0].getbestblockhash()
+        replies = self.batch([
+            ("getblockhash", 11),
+            ("invalidateblock", besthash),
+            ("getblockhash", 11),
+            ("getblockcount",),
+            ("reconsiderblock", besthash),
+            ("getblockhash", 11),
+            ("getbestblockhash",),
+        ])
+        assert_equal(replies[0]["result"], besthash)
+        assert_equal(replies[1]["error"], None)
+        assert(replies[2]["error"] is not None)
+        assert_equal(replies[3]["result"], 10)
+        assert_equal(replies[4]["error"], None)
+        assert_equal(replies[5]["result"], besthash)
+        assert_equal(replies[6]["result"], besthash)
+
+        # Unknown methods and malformed entries fail on their own
+        replies = self.nodes[0]._batch([ {"method": "getblockcount", "id": 0}, {"method": "nosuchmethod", "id": 1}, {"method": "getblockhash", "params": [11], "id": 2} ])
+        assert_equal(replies[0]["result"], 11)
+        assert(replies[1]["error"] is not None)
+        assert_equal(replies[2]["result"], besthash)
+
+if __name__ == '__main__':
+    RPCBatchTest().main()
@@ -0,0 +1,88 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018 The Basex developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test the block verification at startup with -checkthreads and -checkbackground
+#
+from test_framework import BitcoinTestFramework
+from util import *
+import time
+
+class VerifyDBTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 1)
+
+    def setup_network(self):
+        self.nodes = []
+        self.is_network_split = False
+        self.nodes.append(start_node(0, self.options.tmpdir))
+
+    def restart_node(self, extra_args):
+        stop_node(self.nodes[0], 0)
+        self.nodes[0] = start_node(0, self.options.tmpdir, extra_args)
+
+    def wait_verification(self):
+        # The background verification runs on after startup
+        for i in range(600):
+            verification = self.nodes[0].getblockchaininfo()['blockverification']
+            if verification['state'] != 'running':
+                return verification
+            time.sleep(0.1)
+        raise AssertionError("block verification did not finish")
+
+    def run_test(self):
+        self.nodes[0].setgenerate(True, 50)
+        assert_equal(self.nodes[0].getblockcount(), 50)
+
+        # At level 4 every block can be disconnected, so nothing is left for the background
+        self.restart_node(["-checkblocks=0", "-checkthreads=3", "-checkbackground"])
+        verification = self.nodes[0].getblockchaininfo()['blockverification']
+        assert_equal(verification['state'], 'done')
+        assert_equal(verification['background'], False)
+        assert_equal(verification['checked'], 50)
+        assert_equal(verification['total'], 50)
+        assert_equal(verification['height'], 1)
+
+        # verifychain checks exactly the blocks asked for
+        assert(self.nodes[0].verifychain(4, 20))
+        verification = self.nodes[0].getblockchaininfo()['blockverification']
+        assert_equal(verification['checked'], 20)
+        assert_equal(verification['total'], 20)
+        assert_equal(verification['height'], 31)
+        assert_equal(verification['progress'], 1)
+
+        # Disconnecting only the top 10, the other 40 go to the background at level 2
+        self.restart_node(["-checkblocks=0", "-checkthreads=3", "-checkbackground", "-checkdisconnectblocks=10"])
+        verification = self.wait_verification()
+        assert_equal(verification['state'], 'done')
+        assert_equal(verification['background'], True)
+        assert_equal(verification['level'], 2)
+        assert_equal(verification['checked'], 40)
+        assert_equal(verification['total'], 40)
+        assert_equal(verification['height'], 1)
+        assert_equal(verification['progress'], 1)
+
+        # Stopped in the middle of a pass, the next start resumes where it was left
+        self.restart_node(["-checkblocks=0", "-checkthreads=3", "-checkbackground", "-checkdisconnectblocks=10", "-checkbackgroundlimit=20"])
+        verification = self.wait_verification()
+        assert_equal(verification['state'], 'interrupted')
+        assert_equal(verification['checked'], 20)
+        assert_equal(verification['total'], 40)
+        assert_equal(verification['height'], 21)
+
+        self.restart_node(["-checkblocks=0", "-checkthreads=3", "-checkbackground", "-checkdisconnectblocks=10"])
+        verification = self.wait_verification()
+        assert_equal(verification['state'], 'done')
+        assert_equal(verification['background'], True)
+        assert_equal(verification['checked'], 20)
+        assert_equal(verification['total'], 20)
+        assert_equal(verification['height'], 1)
+        assert_equal(verification['progress'], 1)
+        print "Success"
+
+if __name__ == '__main__':
+    VerifyDBTest().main()
@@ -0,0 +1,233 @@
+// Copyright (c) 2018 The Basex developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ADDRESSINDEX_H
+#define BITCOIN_ADDRESSINDEX_H
+
+#include "amount.h"
+#include "script/script.h"
+#include "serialize.h"
+#include "uint256.h"
+
+/** Address types stored in the address and spent indexes */
+enum AddressIndexType {
+    ADDRESS_INDEX_NONE = 0,
+    ADDRESS_INDEX_PUBKEYHASH = 1, //! P2PKH, and P2PK under the key's hash
+    ADDRESS_INDEX_SCRIPTHASH = 2,
+};
+
+/**
+ * The address index keys are compared bytewise by LevelDB, so the block
+ * height and the position in the block are written big endian to make a
+ * cursor walk an address' history in chain order.
+ */
+template <typename Stream>
+inline void SerializeBigEndian32(Stream& s, uint32_t n)
+{
+    unsigned char buf[4] = {(unsigned char)(n >> 24), (unsigned char)(n >> 16), (unsigned char)(n >> 8), (unsigned char)n};
+    s.write((char*)buf, sizeof(buf));
+}
+
+template <typename Stream>
+inline uint32_t UnserializeBigEndian32(Stream& s)
+{
+    unsigned char buf[4];
+    s.read((char*)buf, sizeof(buf));
+    return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | (uint32_t)buf[3];
+}
+
+/** Key of the 'a' records: one entry per credit or debit of an address */
+struct CAddressIndexKey {
+    unsigned int type;
+    uint160 hashBytes;
+    int blockHeight;
+    unsigned int txindex;
+    uint256 txhash;
+    unsigned int index;
+    bool spending;
+
+    CAddressIndexKey(unsigned int addressType, const uint160& addressHash, int height, unsigned int blockindex,
+        const uint256& txid, unsigned int indexValue, bool isSpending)
+    {
+        type = addressType;
+        hashBytes = addressHash;
+        blockHeight = height;
+        txindex = blockindex;
+        txhash = txid;
+        index = indexValue;
+        spending = isSpending;
+    }
+
+    CAddressIndexKey()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        type = ADDRESS_INDEX_NONE;
+        hashBytes = 0;
+        blockHeight = 0;
+        txindex = 0;
+        txhash = 0;
+        index = 0;
+        spending = false;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 66;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, (unsigned char)type, nType, nVersion);
+        hashBytes.Serialize(s, nType, nVersion);
+        SerializeBigEndian32(s, blockHeight);
+        SerializeBigEndian32(s, txindex);
+        txhash.Serialize(s, nType, nVersion);
+        ::Serialize(s, index, nType, nVersion);
+        ::Serialize(s, spending, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        unsigned char chType;
+        ::Unserialize(s, chType, nType, nVersion);
+        type = chType;
+        hashBytes.Unserialize(s, nType, nVersion);
+        blockHeight = UnserializeBigEndian32(s);
+        txindex = UnserializeBigEndian32(s);
+        txhash.Unserialize(s, nType, nVersion);
+        ::Unserialize(s, index, nType, nVersion);
+        ::Unserialize(s, spending, nType, nVersion);
+    }
+};
+
+/** Prefix of CAddressIndexKey, used to seek to the first record of an address (from a height) */
+struct CAddressIndexIteratorKey {
+    unsigned int type;
+    uint160 hashBytes;
+    int blockHeight;
+    bool fHeight;
+
+    CAddressIndexIteratorKey(unsigned int addressType, const uint160& addressHash)
+        : type(addressType), hashBytes(addressHash), blockHeight(0), fHeight(false) {}
+
+    CAddressIndexIteratorKey(unsigned int addressType, const uint160& addressHash, int height)
+        : type(addressType), hashBytes(addressHash), blockHeight(height), fHeight(true) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return fHeight ? 25 : 21;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, (unsigned char)type, nType, nVersion);
+        hashBytes.Serialize(s, nType, nVersion);
+        if (fHeight)
+            SerializeBigEndian32(s, blockHeight);
+    }
+};
+
+/** Key of the 'u' records: the unspent outputs of an address */
+struct CAddressUnspentKey {
+    unsigned int type;
+    uint160 hashBytes;
+    uint256 txhash;
+    unsigned int index;
+
+    CAddressUnspentKey(unsigned int addressType, const uint160& addressHash, const uint256& txid, unsigned int indexValue)
+    {
+        type = addressType;
+        hashBytes = addressHash;
+        txhash = txid;
+        index = indexValue;
+    }
+
+    CAddressUnspentKey()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        type = ADDRESS_INDEX_NONE;
+        hashBytes = 0;
+        txhash = 0;
+        index = 0;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 57;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, (unsigned char)type, nType, nVersion);
+        hashBytes.Serialize(s, nType, nVersion);
+        txhash.Serialize(s, nType, nVersion);
+        ::Serialize(s, index, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        unsigned char chType;
+        ::Unserialize(s, chType, nType, nVersion);
+        type = chType;
+        hashBytes.Unserialize(s, nType, nVersion);
+        txhash.Unserialize(s, nType, nVersion);
+        ::Unserialize(s, index, nType, nVersion);
+    }
+};
+
+/** Value of the 'u' records. A null value in an index update erases the output. */
+struct CAddressUnspentValue {
+    CAmount satoshis;
+    CScript script;
+    int blockHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(satoshis);
+        READWRITE(script);
+        READWRITE(blockHeight);
+    }
+
+    CAddressUnspentValue(CAmount sats, const CScript& scriptPubKey, int height)
+    {
+        satoshis = sats;
+        script = scriptPubKey;
+        blockHeight = height;
+    }
+
+    CAddressUnspentValue()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        satoshis = -1;
+        script.clear();
+        blockHeight = 0;
+    }
+
+    bool IsNull() const
+    {
+        return satoshis == -1;
+    }
+};
+
+#endif // BITCOIN_ADDRESSINDEX_H
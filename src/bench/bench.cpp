@@ -0,0 +1,97 @@
+// Copyright (c) 2015 The Bitcoin developers
+// Copyright (c) 2017-2018 The Basex developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "clientversion.h"
+#include "utiltime.h"
+
+#include <iostream>
+#include <vector>
+
+#include <univalue.h>
+
+using namespace benchmark;
+
+BenchRunner::BenchmarkMap& BenchRunner::benchmarks()
+{
+    static BenchmarkMap benchmarks_map;
+    return benchmarks_map;
+}
+
+static double gettimedouble(void)
+{
+    return GetTimeMicros() * 0.000001;
+}
+
+BenchRunner::BenchRunner(std::string name, BenchFunction func)
+{
+    benchmarks().insert(std::make_pair(name, func));
+}
+
+void BenchRunner::RunAll(double elapsedTimeForOne, const std::string& strFilter, bool fCSV)
+{
+    std::vector<State> vResults;
+    for (BenchmarkMap::iterator it = benchmarks().begin(); it != benchmarks().end(); ++it) {
+        if (it->first.find(strFilter) == std::string::npos)
+            continue;
+        State state(it->first, elapsedTimeForOne);
+        BenchFunction& func = it->second;
+        func(state);
+        vResults.push_back(state);
+    }
+
+    if (fCSV) {
+        std::cout << "Benchmark" << "," << "count" << "," << "min" << "," << "max" << "," << "average" << "\n";
+        for (std::vector<State>::const_iterator it = vResults.begin(); it != vResults.end(); ++it)
+            std::cout << it->GetName() << "," << it->GetCount() << "," << it->GetMinTime() << "," << it->GetMaxTime() << "," << it->GetAverageTime() << "\n";
+        return;
+    }
+
+    UniValue benchmarks(UniValue::VARR);
+    for (std::vector<State>::const_iterator it = vResults.begin(); it != vResults.end(); ++it) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("name", it->GetName()));
+        entry.push_back(Pair("iterations", it->GetCount()));
+        entry.push_back(Pair("min", it->GetMinTime()));
+        entry.push_back(Pair("max", it->GetMaxTime()));
+        entry.push_back(Pair("average", it->GetAverageTime()));
+        benchmarks.push_back(entry);
+    }
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("version", FormatFullVersion()));
+    result.push_back(Pair("maxtime", elapsedTimeForOne));
+    result.push_back(Pair("benchmarks", benchmarks));
+    std::cout << result.write(2) << "\n";
+}
+
+bool State::KeepRunning()
+{
+    double now;
+    if (count == 0) {
+        beginTime = now = gettimedouble();
+    } else {
+        // timeCheckCount is used to avoid calling gettime most of the time,
+        // so benchmarks that run very quickly get consistent results.
+        if ((count + 1) % timeCheckCount != 0) {
+            ++count;
+            return true; // keep going
+        }
+        now = gettimedouble();
+        double elapsedOne = (now - lastTime) / timeCheckCount;
+        if (elapsedOne < minTime) minTime = elapsedOne;
+        if (elapsedOne > maxTime) maxTime = elapsedOne;
+        if (elapsedOne * timeCheckCount < maxElapsed / 16) timeCheckCount *= 2;
+    }
+    lastTime = now;
+    ++count;
+
+    if (now - beginTime < maxElapsed) return true; // Keep going
+
+    --count;
+
+    average = count > 0 ? (now - beginTime) / count : 0;
+    return false;
+}
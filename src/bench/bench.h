@@ -0,0 +1,94 @@
+// Copyright (c) 2015 The Bitcoin developers
+// Copyright (c) 2017-2018 The Basex developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BENCH_BENCH_H
+#define BITCOIN_BENCH_BENCH_H
+
+#include <limits>
+#include <map>
+#include <string>
+
+#include <stdint.h>
+
+#include <boost/function.hpp>
+#include <boost/preprocessor/cat.hpp>
+#include <boost/preprocessor/stringize.hpp>
+
+// Simple micro-benchmarking framework; API mostly matches a subset of the Google Benchmark
+// framework (see https://github.com/google/benchmark)
+// Why not use the Google Benchmark framework? Because adding Yet Another Dependency
+// (that uses cmake as its build system and has lots of features we don't need) isn't
+// worth it.
+
+/*
+ * Usage:
+
+static void CODE_TO_TIME(benchmark::State& state)
+{
+    ... do any setup needed...
+    while (state.KeepRunning()) {
+       ... do stuff you want to time...
+    }
+    ... do any cleanup needed...
+}
+
+BENCHMARK(CODE_TO_TIME);
+
+ * Results are printed as JSON (or CSV with -format=csv) once all selected
+ * benchmarks have run, so runs from different releases can be compared.
+ */
+
+namespace benchmark
+{
+class State
+{
+    std::string name;
+    double maxElapsed;
+    double beginTime;
+    double lastTime, minTime, maxTime;
+    double average;
+    int64_t count;
+    uint64_t timeCheckCount;
+
+public:
+    State(std::string _name, double _maxElapsed) : name(_name), maxElapsed(_maxElapsed), average(0), count(0), timeCheckCount(1)
+    {
+        minTime = std::numeric_limits<double>::max();
+        maxTime = std::numeric_limits<double>::min();
+    }
+    bool KeepRunning();
+
+    //! Results, valid once KeepRunning() returned false (times in seconds per iteration)
+    const std::string& GetName() const { return name; }
+    int64_t GetCount() const { return count; }
+    double GetMinTime() const { return count > 0 && minTime <= maxTime ? minTime : average; }
+    double GetMaxTime() const { return count > 0 && minTime <= maxTime ? maxTime : average; }
+    double GetAverageTime() const { return average; }
+};
+
+typedef boost::function<void(State&)> BenchFunction;
+
+class BenchRunner
+{
+    typedef std::map<std::string, BenchFunction> BenchmarkMap;
+    static BenchmarkMap& benchmarks();
+
+public:
+    BenchRunner(std::string name, BenchFunction func);
+
+    /**
+     * Run every benchmark whose name contains strFilter for about
+     * elapsedTimeForOne seconds each and print the results to stdout,
+     * as JSON or, if fCSV is set, as CSV.
+     */
+    static void RunAll(double elapsedTimeForOne = 1.0, const std::string& strFilter = "", bool fCSV = false);
+};
+}
+
+// BENCHMARK(foo) expands to:  benchmark::BenchRunner bench_11foo("foo", foo);
+#define BENCHMARK(n) \
+    benchmark::BenchRunner BOOST_PP_CAT(bench_, BOOST_PP_CAT(__LINE__, n))(BOOST_PP_STRINGIZE(n), n);
+
+#endif // BITCOIN_BENCH_BENCH_H
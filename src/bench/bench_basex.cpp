@@ -0,0 +1,45 @@
+// Copyright (c) 2015 The Bitcoin developers
+// Copyright (c) 2017-2018 The Basex developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "util.h"
+
+#include <iostream>
+
+#include <boost/lexical_cast.hpp>
+
+int main(int argc, char** argv)
+{
+    SetupEnvironment();
+    fPrintToDebugLog = false; // don't want to write to debug.log file
+
+    ParseParameters(argc, argv);
+    if (mapArgs.count("-?") || mapArgs.count("-h") || mapArgs.count("-help")) {
+        std::cout << "Usage: bench_basex [options]\n\n"
+                  << "  -filter=<str>     Only run benchmarks whose name contains <str>\n"
+                  << "  -format=<fmt>     Output format, json or csv (default: json)\n"
+                  << "  -maxtime=<secs>   Time to spend on each benchmark (default: 1.0)\n";
+        return 0;
+    }
+
+    std::string strFormat = GetArg("-format", "json");
+    if (strFormat != "json" && strFormat != "csv") {
+        std::cerr << "Error: unknown -format " << strFormat << "\n";
+        return 1;
+    }
+    double dMaxTime = 1.0;
+    try {
+        dMaxTime = boost::lexical_cast<double>(GetArg("-maxtime", "1.0"));
+    } catch (const boost::bad_lexical_cast&) {
+        std::cerr << "Error: invalid -maxtime\n";
+        return 1;
+    }
+
+    SelectParams(CBaseChainParams::MAIN);
+
+    benchmark::BenchRunner::RunAll(dMaxTime, GetArg("-filter", ""), strFormat == "csv");
+}
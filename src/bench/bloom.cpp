@@ -0,0 +1,48 @@
+// Copyright (c) 2017-2018 The Basex developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "bloom.h"
+
+#include <vector>
+
+// Inserting 1000 20-byte keys into a filter sized for them, then querying
+// them back, like an SPV peer's filter loaded with its wallet's keys.
+static const unsigned int BENCH_BLOOM_ELEMENTS = 1000;
+
+static void BloomFilterInsert(benchmark::State& state)
+{
+    std::vector<unsigned char> data(20);
+    while (state.KeepRunning()) {
+        CBloomFilter filter(BENCH_BLOOM_ELEMENTS, 0.0001, 0, BLOOM_UPDATE_ALL);
+        for (unsigned int i = 0; i < BENCH_BLOOM_ELEMENTS; i++) {
+            data[0] = i & 0xff;
+            data[1] = (i >> 8) & 0xff;
+            filter.insert(data);
+        }
+    }
+}
+
+static void BloomFilterContains(benchmark::State& state)
+{
+    CBloomFilter filter(BENCH_BLOOM_ELEMENTS, 0.0001, 0, BLOOM_UPDATE_ALL);
+    std::vector<unsigned char> data(20);
+    for (unsigned int i = 0; i < BENCH_BLOOM_ELEMENTS; i++) {
+        data[0] = i & 0xff;
+        data[1] = (i >> 8) & 0xff;
+        filter.insert(data);
+    }
+
+    while (state.KeepRunning()) {
+        for (unsigned int i = 0; i < BENCH_BLOOM_ELEMENTS; i++) {
+            data[0] = i & 0xff;
+            data[1] = (i >> 8) & 0xff;
+            filter.contains(data);
+        }
+    }
+}
+
+BENCHMARK(BloomFilterInsert);
+BENCHMARK(BloomFilterContains);
@@ -0,0 +1,63 @@
+// Copyright (c) 2017-2018 The Basex developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "primitives/block.h"
+#include "streams.h"
+#include "version.h"
+
+// (De)serialization of a full block through CDataStream, as done for every
+// block received from the network or read from disk. The block is synthetic:
+// 1000 transactions with two inputs and two pay-to-pubkey-hash outputs each.
+static const int BENCH_BLOCK_TRANSACTIONS = 1000;
+
+static CBlock BuildBenchBlock()
+{
+    CBlock block;
+    block.nVersion = 4;
+    block.nTime = 1500000000;
+    block.nBits = 0x1b00ffff;
+    for (int i = 0; i < BENCH_BLOCK_TRANSACTIONS; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(2);
+        for (unsigned int j = 0; j < tx.vin.size(); j++) {
+            tx.vin[j].prevout = COutPoint(uint256(i * 2 + j + 1), j);
+            tx.vin[j].scriptSig = CScript() << std::vector<unsigned char>(72, 0x30) << std::vector<unsigned char>(33, 0x02);
+        }
+        tx.vout.resize(2);
+        for (unsigned int j = 0; j < tx.vout.size(); j++) {
+            tx.vout[j].nValue = (i + 1) * COIN;
+            tx.vout[j].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i & 0xff) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        block.vtx.push_back(tx);
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+static void SerializeBlockTest(benchmark::State& state)
+{
+    CBlock block = BuildBenchBlock();
+    while (state.KeepRunning()) {
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << block;
+    }
+}
+
+static void DeserializeBlockTest(benchmark::State& state)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << BuildBenchBlock();
+    const std::vector<char> data(stream.begin(), stream.end());
+
+    while (state.KeepRunning()) {
+        CDataStream ss(data, SER_NETWORK, PROTOCOL_VERSION);
+        CBlock block;
+        ss >> block;
+    }
+}
+
+BENCHMARK(SerializeBlockTest);
+BENCHMARK(DeserializeBlockTest);
@@ -0,0 +1,51 @@
+// Copyright (c) 2017-2018 The Basex developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "checkqueue.h"
+
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+// Throughput of the script check queue itself: each iteration pushes a block
+// worth of trivial checks, two per transaction like ConnectBlock, through
+// three worker threads plus the waiting thread.
+static const int BENCH_CHECKQUEUE_THREADS = 3;
+static const int BENCH_CHECKQUEUE_TRANSACTIONS = 1000;
+
+namespace
+{
+struct CBenchCheck {
+    bool operator()()
+    {
+        return true;
+    }
+    void swap(CBenchCheck& x) {}
+};
+}
+
+static void CCheckQueueSpeed(benchmark::State& state)
+{
+    CCheckQueue<CBenchCheck> queue(128);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < BENCH_CHECKQUEUE_THREADS; i++)
+        threadGroup.create_thread(boost::bind(&CCheckQueue<CBenchCheck>::Thread, &queue));
+
+    while (state.KeepRunning()) {
+        CCheckQueueControl<CBenchCheck> control(&queue);
+        for (int i = 0; i < BENCH_CHECKQUEUE_TRANSACTIONS; i++) {
+            std::vector<CBenchCheck> vChecks(2);
+            control.Add(vChecks);
+        }
+        control.Wait();
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BENCHMARK(CCheckQueueSpeed);
@@ -0,0 +1,47 @@
+// Copyright (c) 2017-2018 The Basex developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "wallet.h"
+
+#include <set>
+#include <vector>
+
+// Selecting coins for a 50 BSA payment from wallets holding 1000, 10000 and
+// 100000 confirmed outputs of deterministic, uneven values, so that neither
+// a single coin nor an exact subset is found right away.
+static void CoinSelection(benchmark::State& state, unsigned int nCoins)
+{
+    CWallet wallet;
+    std::vector<CWalletTx> vWtx;
+    vWtx.reserve(nCoins);
+    for (unsigned int i = 0; i < nCoins; i++) {
+        CMutableTransaction tx;
+        tx.nLockTime = i; // so all transactions get different hashes
+        tx.vout.resize(1);
+        tx.vout[0].nValue = (i % 97 + 1) * CENT + 1234;
+        vWtx.push_back(CWalletTx(&wallet, tx));
+    }
+
+    std::vector<COutput> vCoins;
+    vCoins.reserve(nCoins);
+    for (unsigned int i = 0; i < nCoins; i++)
+        vCoins.push_back(COutput(&vWtx[i], 0, 6 * 24, true));
+
+    std::set<std::pair<const CWalletTx*, unsigned int> > setCoinsRet;
+    CAmount nValueRet;
+    while (state.KeepRunning()) {
+        LOCK(wallet.cs_wallet);
+        wallet.SelectCoinsMinConf(50 * COIN, 1, 6, vCoins, setCoinsRet, nValueRet);
+    }
+}
+
+static void CoinSelection_1000(benchmark::State& state) { CoinSelection(state, 1000); }
+static void CoinSelection_10000(benchmark::State& state) { CoinSelection(state, 10000); }
+static void CoinSelection_100000(benchmark::State& state) { CoinSelection(state, 100000); }
+
+BENCHMARK(CoinSelection_1000);
+BENCHMARK(CoinSelection_10000);
+BENCHMARK(CoinSelection_100000);
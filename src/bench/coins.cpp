@@ -0,0 +1,56 @@
+// Copyright (c) 2017-2018 The Basex developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "coins.h"
+#include "primitives/transaction.h"
+
+#include <vector>
+
+// A block connecting on top of the chainstate cache: fetch the coins of 1000
+// earlier transactions through the tip cache, spend one output of each, add
+// the new coins, and flush the block's cache into the tip cache. The tip cache
+// is recreated each iteration so every iteration does the same work.
+static const int BENCH_COINS_TRANSACTIONS = 1000;
+
+static void CCoinsViewCacheFetchFlush(benchmark::State& state)
+{
+    CCoinsView viewDummy;
+    CCoinsViewCache viewChain(&viewDummy);
+
+    std::vector<CTransaction> vPrev;
+    for (int i = 0; i < BENCH_COINS_TRANSACTIONS; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.n = i;
+        tx.vout.resize(2);
+        tx.vout[0].nValue = 10 * COIN;
+        tx.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i & 0xff) << OP_EQUALVERIFY << OP_CHECKSIG;
+        tx.vout[1] = tx.vout[0];
+        vPrev.push_back(tx);
+        viewChain.ModifyCoins(vPrev.back().GetHash())->FromTx(vPrev.back(), 1);
+    }
+
+    int nHeight = 2;
+    while (state.KeepRunning()) {
+        CCoinsViewCache viewTip(&viewChain);
+        CCoinsViewCache view(&viewTip);
+        for (std::vector<CTransaction>::const_iterator it = vPrev.begin(); it != vPrev.end(); ++it) {
+            const uint256& hash = it->GetHash();
+            if (!view.AccessCoins(hash))
+                continue;
+            view.ModifyCoins(hash)->Spend(nHeight % 2);
+        }
+        for (std::vector<CTransaction>::const_iterator it = vPrev.begin(); it != vPrev.end(); ++it) {
+            CMutableTransaction tx(*it);
+            tx.nLockTime = nHeight;
+            view.ModifyCoins(CTransaction(tx).GetHash())->FromTx(tx, nHeight);
+        }
+        view.Flush();
+        nHeight++;
+    }
+}
+
+BENCHMARK(CCoinsViewCacheFetchFlush);
@@ -0,0 +1,46 @@
+// Copyright (c) 2017-2018 The Basex developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "hash.h"
+#include "uint256.h"
+
+#include <vector>
+
+// HashQuark over a serialized block header, which is what CBlockHeader::GetHash
+// hashes for every header received, and over a larger buffer.
+static void HashQuark_80(benchmark::State& state)
+{
+    std::vector<unsigned char> in(80, 0);
+    uint256 hash;
+    while (state.KeepRunning()) {
+        hash = HashQuark(in.begin(), in.end());
+        in[0] = hash.GetLow64() & 0xff;
+    }
+}
+
+static void HashQuark_1024(benchmark::State& state)
+{
+    std::vector<unsigned char> in(1024, 0);
+    uint256 hash;
+    while (state.KeepRunning()) {
+        hash = HashQuark(in.begin(), in.end());
+        in[0] = hash.GetLow64() & 0xff;
+    }
+}
+
+static void Hash_1024(benchmark::State& state)
+{
+    std::vector<unsigned char> in(1024, 0);
+    uint256 hash;
+    while (state.KeepRunning()) {
+        hash = Hash(in.begin(), in.end());
+        in[0] = hash.GetLow64() & 0xff;
+    }
+}
+
+BENCHMARK(HashQuark_80);
+BENCHMARK(HashQuark_1024);
+BENCHMARK(Hash_1024);
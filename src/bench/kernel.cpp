@@ -0,0 +1,93 @@
+// Copyright (c) 2017-2018 The Basex developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "kernel.h"
+#include "main.h"
+
+#include <vector>
+
+namespace
+{
+/**
+ * A fake active chain, one block a minute with a new stake modifier each,
+ * long enough for GetKernelStakeModifier to find the modifier for its first
+ * block. The chain is torn down again when the benchmark finishes.
+ */
+class CKernelBenchChain
+{
+public:
+    CBlock blockFrom;
+    CTransaction txPrev;
+    COutPoint prevout;
+
+    CKernelBenchChain()
+    {
+        LOCK(cs_main);
+        blockFrom.nVersion = 4;
+        blockFrom.nTime = 1500000000;
+        blockFrom.nBits = 0x1b00ffff;
+
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1000 * COIN;
+        txPrev = tx;
+        prevout = COutPoint(txPrev.GetHash(), 0);
+
+        CBlockIndex* pprev = NULL;
+        for (int i = 0; i < 200; i++) {
+            CBlockIndex* pindex = new CBlockIndex();
+            pindex->nHeight = i;
+            pindex->nTime = blockFrom.nTime + i * 60;
+            pindex->pprev = pprev;
+            pindex->SetStakeModifier(i + 1, true);
+            uint256 hash = i == 0 ? blockFrom.GetHash() : uint256(i);
+            pindex->phashBlock = &mapBlockIndex.insert(std::make_pair(hash, pindex)).first->first;
+            vIndex.push_back(pindex);
+            pprev = pindex;
+        }
+        chainActive.SetTip(pprev);
+    }
+
+    ~CKernelBenchChain()
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(NULL);
+        for (std::vector<CBlockIndex*>::iterator it = vIndex.begin(); it != vIndex.end(); ++it) {
+            mapBlockIndex.erase((*it)->GetBlockHash());
+            delete *it;
+        }
+    }
+
+private:
+    std::vector<CBlockIndex*> vIndex;
+};
+}
+
+// Checking a single kernel, as done for every received proof-of-stake block
+static void CheckStakeKernelHash_Check(benchmark::State& state)
+{
+    CKernelBenchChain chain;
+    uint256 hashProofOfStake;
+    while (state.KeepRunning()) {
+        unsigned int nTimeTx = chain.blockFrom.nTime + 60 * 60;
+        CheckStakeKernelHash(chain.blockFrom.nBits, chain.blockFrom, chain.txPrev, chain.prevout, nTimeTx, 0, true, hashProofOfStake);
+    }
+}
+
+// Searching 60 timestamps for a kernel, as the staker does for each input
+static void CheckStakeKernelHash_Search(benchmark::State& state)
+{
+    CKernelBenchChain chain;
+    uint256 hashProofOfStake;
+    while (state.KeepRunning()) {
+        unsigned int nTimeTx = chain.blockFrom.nTime + 60 * 60;
+        CheckStakeKernelHash(chain.blockFrom.nBits, chain.blockFrom, chain.txPrev, chain.prevout, nTimeTx, 60, false, hashProofOfStake);
+    }
+}
+
+BENCHMARK(CheckStakeKernelHash_Check);
+BENCHMARK(CheckStakeKernelHash_Search);
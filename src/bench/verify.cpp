@@ -0,0 +1,116 @@
+// Copyright (c) 2017-2018 The Basex developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "ecwrapper.h"
+#include "hash.h"
+#include "key.h"
+#include "masternode-helpers.h"
+#include "pubkey.h"
+
+#include <assert.h>
+
+// Signature verification through CPubKey (libsecp256k1 unless configured
+// --without-libsecp256k1-verify) compared with the OpenSSL CECKey path it
+// replaces.
+
+static uint256 BenchHash()
+{
+    static const char* strMessage = "basex signature benchmark";
+    return Hash(strMessage, strMessage + strlen(strMessage));
+}
+
+static void ECDSAVerify(benchmark::State& state)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    uint256 hash = BenchHash();
+    std::vector<unsigned char> vchSig;
+    bool fSigned = key.Sign(hash, vchSig);
+    assert(fSigned);
+
+    while (state.KeepRunning()) {
+        bool fOk = pubkey.Verify(hash, vchSig);
+        assert(fOk);
+    }
+}
+
+static void ECDSAVerifyOpenSSL(benchmark::State& state)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    uint256 hash = BenchHash();
+    std::vector<unsigned char> vchSig;
+    bool fSigned = key.Sign(hash, vchSig);
+    assert(fSigned);
+
+    while (state.KeepRunning()) {
+        CECKey eckey;
+        bool fOk = eckey.SetPubKey(pubkey.begin(), pubkey.size()) && eckey.Verify(hash, vchSig);
+        assert(fOk);
+    }
+}
+
+static void ECDSARecoverCompact(benchmark::State& state)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    uint256 hash = BenchHash();
+    std::vector<unsigned char> vchSig;
+    bool fSigned = key.SignCompact(hash, vchSig);
+    assert(fSigned);
+
+    while (state.KeepRunning()) {
+        CPubKey pubkey;
+        bool fOk = pubkey.RecoverCompact(hash, vchSig);
+        assert(fOk);
+    }
+}
+
+static void ECDSARecoverCompactOpenSSL(benchmark::State& state)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    uint256 hash = BenchHash();
+    std::vector<unsigned char> vchSig;
+    bool fSigned = key.SignCompact(hash, vchSig);
+    assert(fSigned);
+    int recid = (vchSig[0] - 27) & 3;
+
+    while (state.KeepRunning()) {
+        CECKey eckey;
+        bool fOk = eckey.Recover(hash, &vchSig[1], recid);
+        assert(fOk);
+        std::vector<unsigned char> pubkey;
+        eckey.GetPubKey(pubkey, true);
+    }
+}
+
+// A masternode message seen again, as happens when it is relayed by several
+// peers: the recovered key comes from the masternode key cache.
+static void MasternodeVerifyMessage(benchmark::State& state)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    std::string strMessage = "basex masternode ping benchmark";
+    std::string strError;
+    std::vector<unsigned char> vchSig;
+    bool fSigned = masternodeSigner.SignMessage(strMessage, strError, vchSig, key);
+    assert(fSigned);
+
+    while (state.KeepRunning()) {
+        bool fOk = masternodeSigner.VerifyMessage(pubkey, vchSig, strMessage, strError);
+        assert(fOk);
+    }
+}
+
+BENCHMARK(ECDSAVerify);
+BENCHMARK(ECDSAVerifyOpenSSL);
+BENCHMARK(ECDSARecoverCompact);
+BENCHMARK(ECDSARecoverCompactOpenSSL);
+BENCHMARK(MasternodeVerifyMessage);
@@ -0,0 +1,140 @@
+// Copyright (c) 2017-2018 The Basex developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "key.h"
+#include "script/interpreter.h"
+#include "script/standard.h"
+
+#include <assert.h>
+#include <limits>
+
+static CMutableTransaction BuildCreditingTransaction(const CScript& scriptPubKey)
+{
+    CMutableTransaction txCredit;
+    txCredit.nVersion = 1;
+    txCredit.nLockTime = 0;
+    txCredit.vin.resize(1);
+    txCredit.vout.resize(1);
+    txCredit.vin[0].prevout.SetNull();
+    txCredit.vin[0].scriptSig = CScript() << CScriptNum(0) << CScriptNum(0);
+    txCredit.vin[0].nSequence = std::numeric_limits<unsigned int>::max();
+    txCredit.vout[0].scriptPubKey = scriptPubKey;
+    txCredit.vout[0].nValue = 1;
+
+    return txCredit;
+}
+
+static CMutableTransaction BuildSpendingTransaction(const CScript& scriptSig, const CMutableTransaction& txCredit)
+{
+    CMutableTransaction txSpend;
+    txSpend.nVersion = 1;
+    txSpend.nLockTime = 0;
+    txSpend.vin.resize(1);
+    txSpend.vout.resize(1);
+    txSpend.vin[0].prevout.hash = txCredit.GetHash();
+    txSpend.vin[0].prevout.n = 0;
+    txSpend.vin[0].scriptSig = scriptSig;
+    txSpend.vin[0].nSequence = std::numeric_limits<unsigned int>::max();
+    txSpend.vout[0].scriptPubKey = CScript();
+    txSpend.vout[0].nValue = txCredit.vout[0].nValue;
+
+    return txSpend;
+}
+
+// Verifying a pay-to-pubkey-hash input with the standard flags, without the
+// signature cache.
+static void VerifyScriptP2PKH(benchmark::State& state)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    CScript scriptPubKey = GetScriptForDestination(pubkey.GetID());
+
+    CMutableTransaction txCredit = BuildCreditingTransaction(scriptPubKey);
+    CMutableTransaction txSpend = BuildSpendingTransaction(CScript(), txCredit);
+
+    uint256 sighash = SignatureHash(scriptPubKey, txSpend, 0, SIGHASH_ALL);
+    std::vector<unsigned char> vchSig;
+    bool fSigned = key.Sign(sighash, vchSig);
+    assert(fSigned);
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    txSpend.vin[0].scriptSig = CScript() << vchSig << ToByteVector(pubkey);
+
+    const CTransaction tx(txSpend);
+    while (state.KeepRunning()) {
+        ScriptError err;
+        bool fSuccess = VerifyScript(tx.vin[0].scriptSig, scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, 0), &err);
+        assert(fSuccess && err == SCRIPT_ERR_OK);
+    }
+}
+
+BENCHMARK(VerifyScriptP2PKH);
+
+/** Signature checker that accepts every signature, to time the interpreter alone */
+class AcceptingSignatureChecker : public BaseSignatureChecker
+{
+public:
+    bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const
+    {
+        return true;
+    }
+};
+
+static std::vector<unsigned char> SignInput(const CKey& key, const CScript& scriptCode, const CMutableTransaction& txSpend)
+{
+    uint256 sighash = SignatureHash(scriptCode, txSpend, 0, SIGHASH_ALL);
+    std::vector<unsigned char> vchSig;
+    bool fSigned = key.Sign(sighash, vchSig);
+    assert(fSigned);
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    return vchSig;
+}
+
+// Evaluating a pay-to-pubkey-hash input with the signature check stubbed out,
+// which leaves the interpreter's own cost: stack handling, hashing and opcode
+// dispatch.
+static void EvalScriptP2PKH(benchmark::State& state)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    CScript scriptPubKey = GetScriptForDestination(pubkey.GetID());
+
+    CMutableTransaction txSpend = BuildSpendingTransaction(CScript(), BuildCreditingTransaction(scriptPubKey));
+    CScript scriptSig = CScript() << SignInput(key, scriptPubKey, txSpend) << ToByteVector(pubkey);
+
+    while (state.KeepRunning()) {
+        ScriptError err;
+        bool fSuccess = VerifyScript(scriptSig, scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, AcceptingSignatureChecker(), &err);
+        assert(fSuccess && err == SCRIPT_ERR_OK);
+    }
+}
+
+// The same for a 2-of-3 multisig input paid to script hash.
+static void EvalScriptP2SHMultisig(benchmark::State& state)
+{
+    std::vector<CKey> vKeys(3);
+    std::vector<CPubKey> vPubKeys;
+    for (unsigned int i = 0; i < vKeys.size(); i++) {
+        vKeys[i].MakeNewKey(true);
+        vPubKeys.push_back(vKeys[i].GetPubKey());
+    }
+    CScript redeemScript = GetScriptForMultisig(2, vPubKeys);
+    CScript scriptPubKey = GetScriptForDestination(CScriptID(redeemScript));
+
+    CMutableTransaction txSpend = BuildSpendingTransaction(CScript(), BuildCreditingTransaction(scriptPubKey));
+    CScript scriptSig = CScript() << OP_0 << SignInput(vKeys[0], redeemScript, txSpend) << SignInput(vKeys[1], redeemScript, txSpend);
+    scriptSig << std::vector<unsigned char>(redeemScript.begin(), redeemScript.end());
+
+    while (state.KeepRunning()) {
+        ScriptError err;
+        bool fSuccess = VerifyScript(scriptSig, scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, AcceptingSignatureChecker(), &err);
+        assert(fSuccess && err == SCRIPT_ERR_OK);
+    }
+}
+
+BENCHMARK(EvalScriptP2PKH);
+BENCHMARK(EvalScriptP2SHMultisig);
@@ -0,0 +1,75 @@
+// Copyright (c) 2018 The Basex developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "db.h"
+#include "key.h"
+#include "random.h"
+#include "util.h"
+#include "wallet.h"
+#include "walletdb.h"
+
+#include <assert.h>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+static const unsigned int WALLET_DB_RECORDS = 1000;
+
+// Use a real on-disk environment rather than bitdb.MakeMock(): the mock env
+// keeps everything in memory and hides the log flush and checkpoint cost that
+// batching is meant to save.
+static void SetupDiskDB()
+{
+    static bool fSetup = false;
+    if (!fSetup) {
+        boost::filesystem::path pathTemp = GetTempPath() / strprintf("bench_basex_%lu_%i", (unsigned long)GetTime(), (int)(GetRand(100000)));
+        boost::filesystem::create_directories(pathTemp);
+        mapArgs["-datadir"] = pathTemp.string();
+        fSetup = true;
+    }
+}
+
+// Each iteration writes WALLET_DB_RECORDS key pool records the way block
+// connection does: one short lived CWalletDB handle per record. Divide the
+// record count by the reported time per iteration for records/sec.
+static void WalletDBWrite(benchmark::State& state, bool fBatch)
+{
+    SetupDiskDB();
+    const std::string strFile = fBatch ? "wallet_bench_batch.dat" : "wallet_bench.dat";
+
+    std::vector<CKeyPool> vPool;
+    for (unsigned int i = 0; i < WALLET_DB_RECORDS; i++) {
+        CKey key;
+        key.MakeNewKey(true);
+        vPool.push_back(CKeyPool(key.GetPubKey()));
+    }
+
+    while (state.KeepRunning()) {
+        CDBBatch* pbatch = fBatch ? new CDBBatch(strFile) : NULL;
+        for (unsigned int i = 0; i < WALLET_DB_RECORDS; i++) {
+            CWalletDB walletdb(strFile);
+            walletdb.WritePool(i, vPool[i]);
+        }
+        if (pbatch) {
+            bool fCommitted = pbatch->Commit();
+            assert(fCommitted);
+            delete pbatch;
+        }
+    }
+}
+
+static void WalletDBWriteSingle(benchmark::State& state)
+{
+    WalletDBWrite(state, false);
+}
+
+static void WalletDBWriteBatch(benchmark::State& state)
+{
+    WalletDBWrite(state, true);
+}
+
+BENCHMARK(WalletDBWriteSingle);
+BENCHMARK(WalletDBWriteBatch);
@@ -15,10 +15,14 @@
 #include "protocol.h"
 #include "uint256.h"
 
+#include <map>
 #include <vector>
 
 typedef unsigned char MessageStartChars[MESSAGE_START_SIZE];
 
+/** Block hash -> hash of the UTXO set snapshot taken at that block, as reported by dumptxoutset */
+typedef std::map<uint256, uint256> MapAssumeUTXO;
+
 struct CDNSSeedData {
     std::string name, host;
     CDNSSeedData(const std::string& strName, const std::string& strHost) : name(strName), host(strHost) {}
@@ -91,6 +95,8 @@ public:
     const std::vector<unsigned char>& Base58Prefix(Base58Type type) const { return base58Prefixes[type]; }
     const std::vector<CAddress>& FixedSeeds() const { return vFixedSeeds; }
     virtual const Checkpoints::CCheckpointData& Checkpoints() const = 0;
+    /** UTXO set snapshots that -loadtxoutset accepts without further configuration */
+    const MapAssumeUTXO& AssumeUTXO() const { return mapAssumeUTXO; }
     int PoolMaxTransactions() const { return nPoolMaxTransactions; }
     std::string SporkKey() const { return strSporkKey; }
     std::string MasternodePoolDummyAddress() const { return strMasternodePoolDummyAddress; }
@@ -126,6 +132,7 @@ protected:
     std::string strNetworkID;
     CBlock genesis;
     std::vector<CAddress> vFixedSeeds;
+    MapAssumeUTXO mapAssumeUTXO;
     bool fMiningRequiresPeers;
     bool fAllowMinDifficultyBlocks;
     bool fDefaultConsistencyChecks;
@@ -5,6 +5,7 @@
 
 #include "coins.h"
 
+#include "hash.h"
 #include "random.h"
 
 #include <assert.h>
@@ -58,12 +59,73 @@ bool CCoins::Spend(int nPos)
     return Spend(out, undo);
 }
 
+static uint256 GetOutputHash(const uint256& txid, const CCoins& coins, unsigned int n)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << txid;
+    ss << VARINT(n);
+    ss << VARINT(coins.nHeight * 2 + (coins.fCoinBase ? 1 : 0));
+    ss << coins.vout[n];
+    return ss.GetHash();
+}
+
+void CCoinsCommitment::AddOutput(const uint256& txid, const CCoins& coins, unsigned int n)
+{
+    const CTxOut& out = coins.vout[n];
+    hashOutputs += GetOutputHash(txid, coins, n);
+    nTransactionOutputs++;
+    nSerializedSize += ::GetSerializeSize(out, SER_NETWORK, PROTOCOL_VERSION);
+    nTotalAmount += out.nValue;
+}
+
+void CCoinsCommitment::RemoveOutput(const uint256& txid, const CCoins& coins, unsigned int n)
+{
+    const CTxOut& out = coins.vout[n];
+    hashOutputs -= GetOutputHash(txid, coins, n);
+    nTransactionOutputs--;
+    nSerializedSize -= ::GetSerializeSize(out, SER_NETWORK, PROTOCOL_VERSION);
+    nTotalAmount -= out.nValue;
+}
+
+void CCoinsCommitment::AddCoins(const uint256& txid, const CCoins& coins)
+{
+    if (coins.IsPruned())
+        return;
+    nTransactions++;
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        if (!coins.vout[i].IsNull())
+            AddOutput(txid, coins, i);
+    }
+}
+
+void CCoinsCommitment::RemoveCoins(const uint256& txid, const CCoins& coins)
+{
+    if (coins.IsPruned())
+        return;
+    nTransactions--;
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        if (!coins.vout[i].IsNull())
+            RemoveOutput(txid, coins, i);
+    }
+}
+
+CCoinsCommitment& CCoinsCommitment::operator+=(const CCoinsCommitment& other)
+{
+    hashOutputs += other.hashOutputs;
+    nTransactions += other.nTransactions;
+    nTransactionOutputs += other.nTransactionOutputs;
+    nSerializedSize += other.nSerializedSize;
+    nTotalAmount += other.nTotalAmount;
+    return *this;
+}
+
 
 bool CCoinsView::GetCoins(const uint256& txid, CCoins& coins) const { return false; }
 bool CCoinsView::HaveCoins(const uint256& txid) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(0); }
-bool CCoinsView::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) { return false; }
+bool CCoinsView::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsCommitment& commitmentDelta) { return false; }
 bool CCoinsView::GetStats(CCoinsStats& stats) const { return false; }
+bool CCoinsView::GetCommitment(CCoinsCommitment& commitment) const { return false; }
 
 
 CCoinsViewBacked::CCoinsViewBacked(CCoinsView* viewIn) : base(viewIn) {}
@@ -71,8 +133,9 @@ bool CCoinsViewBacked::GetCoins(const uint256& txid, CCoins& coins) const { retu
 bool CCoinsViewBacked::HaveCoins(const uint256& txid) const { return base->HaveCoins(txid); }
 uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
 void CCoinsViewBacked::SetBackend(CCoinsView& viewIn) { base = &viewIn; }
-bool CCoinsViewBacked::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) { return base->BatchWrite(mapCoins, hashBlock); }
+bool CCoinsViewBacked::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsCommitment& commitmentDelta) { return base->BatchWrite(mapCoins, hashBlock, commitmentDelta); }
 bool CCoinsViewBacked::GetStats(CCoinsStats& stats) const { return base->GetStats(stats); }
+bool CCoinsViewBacked::GetCommitment(CCoinsCommitment& commitment) const { return base->GetCommitment(commitment); }
 
 CCoinsKeyHasher::CCoinsKeyHasher() : salt(GetRandHash()) {}
 
@@ -162,7 +225,7 @@ void CCoinsViewCache::SetBestBlock(const uint256& hashBlockIn)
     hashBlock = hashBlockIn;
 }
 
-bool CCoinsViewCache::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlockIn)
+bool CCoinsViewCache::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlockIn, const CCoinsCommitment& commitmentDeltaIn)
 {
     assert(!hasModifier);
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
@@ -196,13 +259,23 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlockIn
         mapCoins.erase(itOld);
     }
     hashBlock = hashBlockIn;
+    commitmentDelta += commitmentDeltaIn;
+    return true;
+}
+
+bool CCoinsViewCache::GetCommitment(CCoinsCommitment& commitment) const
+{
+    if (!base->GetCommitment(commitment))
+        return false;
+    commitment += commitmentDelta;
     return true;
 }
 
 bool CCoinsViewCache::Flush()
 {
-    bool fOk = base->BatchWrite(cacheCoins, hashBlock);
+    bool fOk = base->BatchWrite(cacheCoins, hashBlock, commitmentDelta);
     cacheCoins.clear();
+    commitmentDelta.SetNull();
     return fOk;
 }
 
@@ -244,8 +317,9 @@ bool CCoinsViewCache::HaveInputs(const CTransaction& tx) const
     return true;
 }
 
-double CCoinsViewCache::GetPriority(const CTransaction& tx, int nHeight) const
+double CCoinsViewCache::GetPriority(const CTransaction& tx, int nHeight, CAmount& inChainInputValue) const
 {
+    inChainInputValue = 0;
     if (tx.IsCoinBase() || tx.IsCoinStake())
         return 0.0;
     double dResult = 0.0;
@@ -253,8 +327,9 @@ double CCoinsViewCache::GetPriority(const CTransaction& tx, int nHeight) const
         const CCoins* coins = AccessCoins(txin.prevout.hash);
         assert(coins);
         if (!coins->IsAvailable(txin.prevout.n)) continue;
-        if (coins->nHeight < nHeight) {
+        if (coins->nHeight <= nHeight) {
             dResult += coins->vout[txin.prevout.n].nValue * (nHeight - coins->nHeight);
+            inChainInputValue += coins->vout[txin.prevout.n].nValue;
         }
     }
     return tx.ComputePriority(dResult);
@@ -318,6 +318,71 @@ struct CCoinsCacheEntry {
 
 typedef boost::unordered_map<uint256, CCoinsCacheEntry, CCoinsKeyHasher> CCoinsMap;
 
+/**
+ * Running summary of the unspent output set. Every output is hashed on its
+ * own and the hashes are summed modulo 2^256, so the summary does not depend
+ * on the order outputs were created and spent in, and the changes a cache
+ * holds can be added onto the summary of its base.
+ */
+class CCoinsCommitment
+{
+public:
+    uint256 hashOutputs;
+    int64_t nTransactions;
+    int64_t nTransactionOutputs;
+    int64_t nSerializedSize; //! serialized size of the unspent CTxOuts
+    CAmount nTotalAmount;
+
+    CCoinsCommitment()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        hashOutputs = 0;
+        nTransactions = 0;
+        nTransactionOutputs = 0;
+        nSerializedSize = 0;
+        nTotalAmount = 0;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(hashOutputs);
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nSerializedSize);
+        READWRITE(nTotalAmount);
+    }
+
+    //! Add or remove output n of coins, which must be unspent
+    void AddOutput(const uint256& txid, const CCoins& coins, unsigned int n);
+    void RemoveOutput(const uint256& txid, const CCoins& coins, unsigned int n);
+
+    //! Add or remove all unspent outputs of coins
+    void AddCoins(const uint256& txid, const CCoins& coins);
+    void RemoveCoins(const uint256& txid, const CCoins& coins);
+
+    CCoinsCommitment& operator+=(const CCoinsCommitment& other);
+
+    friend bool operator==(const CCoinsCommitment& a, const CCoinsCommitment& b)
+    {
+        return a.hashOutputs == b.hashOutputs &&
+               a.nTransactions == b.nTransactions &&
+               a.nTransactionOutputs == b.nTransactionOutputs &&
+               a.nSerializedSize == b.nSerializedSize &&
+               a.nTotalAmount == b.nTotalAmount;
+    }
+    friend bool operator!=(const CCoinsCommitment& a, const CCoinsCommitment& b)
+    {
+        return !(a == b);
+    }
+};
+
 struct CCoinsStats {
     int nHeight;
     uint256 hashBlock;
@@ -326,6 +391,7 @@ struct CCoinsStats {
     uint64_t nSerializedSize;
     uint256 hashSerialized;
     CAmount nTotalAmount;
+    CCoinsCommitment commitment; //! recomputed from the scanned outputs
 
     CCoinsStats() : nHeight(0), hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), hashSerialized(0), nTotalAmount(0) {}
 };
@@ -346,12 +412,16 @@ public:
     virtual uint256 GetBestBlock() const;
 
     //! Do a bulk modification (multiple CCoins changes + BestBlock change).
-    //! The passed mapCoins can be modified.
-    virtual bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+    //! The passed mapCoins can be modified. commitmentDelta is the change
+    //! of the unspent output summary that the CCoins changes make.
+    virtual bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsCommitment& commitmentDelta);
 
     //! Calculate statistics about the unspent transaction output set
     virtual bool GetStats(CCoinsStats& stats) const;
 
+    //! Retrieve the running summary of the unspent output set, if it is maintained
+    virtual bool GetCommitment(CCoinsCommitment& commitment) const;
+
     //! As we use CCoinsViews polymorphically, have a virtual destructor
     virtual ~CCoinsView() {}
 };
@@ -369,8 +439,9 @@ public:
     bool HaveCoins(const uint256& txid) const;
     uint256 GetBestBlock() const;
     void SetBackend(CCoinsView& viewIn);
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsCommitment& commitmentDelta);
     bool GetStats(CCoinsStats& stats) const;
+    bool GetCommitment(CCoinsCommitment& commitment) const;
 };
 
 class CCoinsViewCache;
@@ -421,6 +492,9 @@ protected:
     mutable uint256 hashBlock;
     mutable CCoinsMap cacheCoins;
 
+    /* Changes to the unspent output summary not yet pushed to the base. */
+    CCoinsCommitment commitmentDelta;
+
 public:
     CCoinsViewCache(CCoinsView* baseIn);
     ~CCoinsViewCache();
@@ -430,7 +504,15 @@ public:
     bool HaveCoins(const uint256& txid) const;
     uint256 GetBestBlock() const;
     void SetBestBlock(const uint256& hashBlock);
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsCommitment& commitmentDeltaIn);
+    bool GetCommitment(CCoinsCommitment& commitment) const;
+
+    /**
+     * The changes to the unspent output summary made through this cache.
+     * Whoever adds or spends outputs records them here; they are pushed to
+     * the base view together with the coins on Flush.
+     */
+    CCoinsCommitment& GetCommitmentDelta() { return commitmentDelta; }
 
     /**
      * Return a pointer to CCoins in the cache, or NULL if not found. This is
@@ -469,8 +551,12 @@ public:
     //! Check whether all prevouts of the transaction are present in the UTXO set represented by this view
     bool HaveInputs(const CTransaction& tx) const;
 
-    //! Return priority of tx at height nHeight
-    double GetPriority(const CTransaction& tx, int nHeight) const;
+    /**
+     * Return priority of tx at height nHeight. Also calculate the sum of the values of the inputs
+     * that are already in the chain. These are the inputs that will age and increase priority as
+     * new blocks are added to the chain.
+     */
+    double GetPriority(const CTransaction& tx, int nHeight, CAmount& inChainInputValue) const;
 
     const CTxOut& GetOutputFor(const CTxIn& input) const;
 
@@ -218,7 +218,7 @@ void CDBEnv::CheckpointLSN(const std::string& strFile)
 }
 
 
-CDB::CDB(const std::string& strFilename, const char* pszMode) : pdb(NULL), activeTxn(NULL)
+CDB::CDB(const std::string& strFilename, const char* pszMode) : pdb(NULL), activeTxn(NULL), fBatchTxn(false)
 {
     int ret;
     fReadOnly = (!strchr(pszMode, '+') && !strchr(pszMode, 'w'));
@@ -273,6 +273,13 @@ CDB::CDB(const std::string& strFilename, const char* pszMode) : pdb(NULL), activ
 
             bitdb.mapDb[strFile] = pdb;
         }
+
+        // Join this thread's open batch on the file, if any
+        std::map<std::string, CDBEnv::CBatch>::iterator mi = bitdb.mapBatch.find(strFile);
+        if (mi != bitdb.mapBatch.end() && mi->second.owner == boost::this_thread::get_id()) {
+            activeTxn = mi->second.ptxn;
+            fBatchTxn = true;
+        }
     }
 }
 
@@ -293,17 +300,110 @@ void CDB::Close()
 {
     if (!pdb)
         return;
-    if (activeTxn)
+    if (activeTxn && !fBatchTxn)
         activeTxn->abort();
     activeTxn = NULL;
     pdb = NULL;
 
-    Flush();
+    // The batch checkpoints once when it commits
+    if (!fBatchTxn)
+        Flush();
+    fBatchTxn = false;
+
+    {
+        LOCK(bitdb.cs_db);
+        --bitdb.mapFileUseCount[strFile];
+    }
+}
+
+CDBBatch::CDBBatch(const std::string& strFileIn) : strFile(strFileIn), fActive(false)
+{
+    if (strFile.empty())
+        return;
+
+    LOCK(bitdb.cs_db);
+    std::map<std::string, CDBEnv::CBatch>::iterator mi = bitdb.mapBatch.find(strFile);
+    if (mi != bitdb.mapBatch.end()) {
+        // Nested in a batch of this thread; another thread's batch would
+        // have to be serialized by the caller's lock
+        assert(mi->second.owner == boost::this_thread::get_id());
+        mi->second.nDepth++;
+        fActive = true;
+        return;
+    }
+
+    if (!bitdb.Open(GetDataDir()))
+        throw runtime_error("CDBBatch : Failed to open database environment.");
+    DbTxn* ptxn = bitdb.TxnBegin();
+    if (!ptxn) {
+        LogPrintf("CDBBatch : failed to begin transaction on %s, writing unbatched\n", strFile);
+        return;
+    }
+
+    CDBEnv::CBatch batch;
+    batch.ptxn = ptxn;
+    batch.owner = boost::this_thread::get_id();
+    batch.nDepth = 1;
+    batch.fAbort = false;
+    bitdb.mapBatch[strFile] = batch;
+    // Keep the file from being closed by the flush thread while the batch is open
+    ++bitdb.mapFileUseCount[strFile];
+    fActive = true;
+}
+
+CDBBatch::~CDBBatch()
+{
+    if (fActive)
+        Finish(false);
+}
+
+bool CDBBatch::Commit()
+{
+    if (!fActive)
+        return true;
+    fActive = false;
+    return Finish(true);
+}
+
+bool CDBBatch::Finish(bool fCommit)
+{
+    DbTxn* ptxn;
+    bool fAbort;
+    {
+        LOCK(bitdb.cs_db);
+        std::map<std::string, CDBEnv::CBatch>::iterator mi = bitdb.mapBatch.find(strFile);
+        assert(mi != bitdb.mapBatch.end());
+        if (!fCommit)
+            mi->second.fAbort = true;
+        if (--mi->second.nDepth > 0)
+            return fCommit;
+        ptxn = mi->second.ptxn;
+        fAbort = mi->second.fAbort;
+        bitdb.mapBatch.erase(mi);
+    }
+
+    bool fResult = false;
+    if (fAbort) {
+        int ret = ptxn->abort();
+        if (ret != 0)
+            LogPrintf("CDBBatch : Error %d rolling back transaction on %s: %s\n", ret, strFile, DbEnv::strerror(ret));
+        else
+            LogPrintf("CDBBatch : rolled back transaction on %s\n", strFile);
+    } else {
+        int ret = ptxn->commit(0);
+        if (ret == 0) {
+            bitdb.dbenv.txn_checkpoint(0, 0, 0);
+            fResult = true;
+        } else {
+            LogPrintf("CDBBatch : Error %d committing transaction on %s: %s\n", ret, strFile, DbEnv::strerror(ret));
+        }
+    }
 
     {
         LOCK(bitdb.cs_db);
         --bitdb.mapFileUseCount[strFile];
     }
+    return fResult;
 }
 
 void CDBEnv::CloseDb(const string& strFile)
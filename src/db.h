@@ -17,6 +17,7 @@
 #include <vector>
 
 #include <boost/filesystem/path.hpp>
+#include <boost/thread/thread.hpp>
 
 #include <db_cxx.h>
 
@@ -47,6 +48,15 @@ public:
     std::map<std::string, int> mapFileUseCount;
     std::map<std::string, Db*> mapDb;
 
+    /** An open CDBBatch: its transaction, the thread that owns it, its nesting depth and whether a nested batch rolled back */
+    struct CBatch {
+        DbTxn* ptxn;
+        boost::thread::id owner;
+        int nDepth;
+        bool fAbort;
+    };
+    std::map<std::string, CBatch> mapBatch;
+
     CDBEnv();
     ~CDBEnv();
     void MakeMock();
@@ -101,6 +111,7 @@ protected:
     std::string strFile;
     DbTxn* activeTxn;
     bool fReadOnly;
+    bool fBatchTxn; //! activeTxn belongs to a CDBBatch and is committed by it
 
     explicit CDB(const std::string& strFilename, const char* pszMode = "r+");
     ~CDB() { Close(); }
@@ -224,7 +235,7 @@ protected:
         if (!pdb)
             return NULL;
         Dbc* pcursor = NULL;
-        int ret = pdb->cursor(NULL, &pcursor, 0);
+        int ret = pdb->cursor(activeTxn, &pcursor, 0);
         if (ret != 0)
             return NULL;
         return pcursor;
@@ -281,7 +292,7 @@ public:
 
     bool TxnCommit()
     {
-        if (!pdb || !activeTxn)
+        if (!pdb || !activeTxn || fBatchTxn)
             return false;
         int ret = activeTxn->commit(0);
         activeTxn = NULL;
@@ -290,7 +301,7 @@ public:
 
     bool TxnAbort()
     {
-        if (!pdb || !activeTxn)
+        if (!pdb || !activeTxn || fBatchTxn)
             return false;
         int ret = activeTxn->abort();
         activeTxn = NULL;
@@ -311,4 +322,40 @@ public:
     bool static Rewrite(const std::string& strFile, const char* pszSkip = NULL);
 };
 
+
+/**
+ * RAII scope that groups the writes to one database file into a single
+ * transaction. While it is open, every CDB handle the owning thread opens on
+ * strFile joins the transaction and skips its flush on close. The outermost
+ * batch commits and checkpoints once in Commit(); nested batches join it.
+ * A batch that goes out of scope without Commit(), for example because an
+ * exception unwound it, rolls the whole transaction back, including the
+ * writes of the batches it is nested in. Callers must hold whatever lock
+ * serializes writers to the file (cs_wallet for the wallet) for the
+ * lifetime of the batch, so that no other thread waits on the batch's page
+ * locks while holding it. An empty file name, as used by wallets without a
+ * file, is a no-op.
+ */
+class CDBBatch
+{
+public:
+    explicit CDBBatch(const std::string& strFileIn);
+    ~CDBBatch();
+
+    /**
+     * Commit the batch. A nested batch leaves the commit to the outermost
+     * one. Returns false if the writes were rolled back instead.
+     */
+    bool Commit();
+
+private:
+    std::string strFile;
+    bool fActive;
+
+    bool Finish(bool fCommit);
+
+    CDBBatch(const CDBBatch&);
+    void operator=(const CDBBatch&);
+};
+
 #endif // BITCOIN_DB_H
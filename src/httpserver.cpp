@@ -0,0 +1,849 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2018 The Basex developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "httpserver.h"
+
+#include "chainparamsbase.h"
+#include "netbase.h"
+#include "rpcprotocol.h" // For HTTP status codes
+#include "serialize.h"
+#include "sync.h"
+#include "ui_interface.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <deque>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#include <event2/buffer.h>
+#include <event2/event.h>
+#include <event2/http.h>
+#include <event2/keyvalq_struct.h>
+#include <event2/thread.h>
+#include <event2/util.h>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+
+/** Maximum size of http request (request line + headers) */
+static const size_t MAX_HEADERS_SIZE = 8192;
+/** Bytes of a chunked reply that may wait for the client before the worker blocks */
+static const uint64_t MAX_REPLY_STREAM_BACKLOG = 4 * 1024 * 1024;
+
+/** HTTP request work item */
+class HTTPWorkItem
+{
+public:
+    HTTPWorkItem(HTTPRequest* req, const std::string& path, const HTTPRequestHandler& func) : req(req), path(path), func(func), nTimeQueued(GetTimeMicros())
+    {
+    }
+    ~HTTPWorkItem()
+    {
+        delete req;
+    }
+
+    HTTPRequest* req;
+    std::string path;
+    HTTPRequestHandler func;
+    int64_t nTimeQueued;
+};
+
+/**
+ * Bounded queue of work items run by the worker threads. It also keeps the
+ * queue depth and latency counters reported by getrpcinfo.
+ */
+class HTTPWorkQueue
+{
+private:
+    boost::mutex cs;
+    boost::condition_variable cond;
+    std::deque<HTTPWorkItem*> queue;
+    bool running;
+    size_t maxDepth;
+    int64_t nTimeoutMicros;
+    HTTPServerStats stats;
+
+public:
+    HTTPWorkQueue(size_t maxDepth, int64_t nTimeout) : running(true), maxDepth(maxDepth), nTimeoutMicros(nTimeout * 1000000)
+    {
+        stats.nQueueDepthLimit = maxDepth;
+    }
+
+    /** Pending requests are answered with an error when the queue is destroyed */
+    ~HTTPWorkQueue()
+    {
+        BOOST_FOREACH (HTTPWorkItem* item, queue)
+            delete item;
+    }
+
+    /** Enqueue a work item, taking ownership if it fits */
+    bool Enqueue(HTTPWorkItem* item)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (queue.size() >= maxDepth) {
+            stats.nRejected++;
+            return false;
+        }
+        queue.push_back(item);
+        stats.nQueueDepthPeak = std::max(stats.nQueueDepthPeak, queue.size());
+        cond.notify_one();
+        return true;
+    }
+
+    /** Thread function */
+    void Run()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            stats.nThreads++;
+        }
+        while (true) {
+            HTTPWorkItem* item = NULL;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                while (running && queue.empty())
+                    cond.wait(lock);
+                if (!running)
+                    break;
+                item = queue.front();
+                queue.pop_front();
+            }
+
+            int64_t nTimeStart = GetTimeMicros();
+            int64_t nQueueTime = nTimeStart - item->nTimeQueued;
+            bool fTimedOut = nTimeoutMicros > 0 && nQueueTime > nTimeoutMicros;
+            if (fTimedOut) {
+                // The client has likely given up already; don't tie up a worker for it
+                LogPrint("http", "Request for %s timed out after %dms in the work queue\n", item->req->GetURI(), nQueueTime / 1000);
+                item->req->WriteReply(HTTP_SERVICE_UNAVAILABLE, "Request timed out in the work queue");
+            } else {
+                item->func(item->req, item->path);
+            }
+            int64_t nExecTime = GetTimeMicros() - nTimeStart;
+            delete item;
+
+            boost::unique_lock<boost::mutex> lock(cs);
+            stats.nQueueTimeTotal += nQueueTime;
+            stats.nQueueTimeMax = std::max(stats.nQueueTimeMax, nQueueTime);
+            if (fTimedOut) {
+                stats.nTimedOut++;
+            } else {
+                stats.nRequests++;
+                stats.nExecTimeTotal += nExecTime;
+                stats.nExecTimeMax = std::max(stats.nExecTimeMax, nExecTime);
+            }
+        }
+        boost::unique_lock<boost::mutex> lock(cs);
+        stats.nThreads--;
+    }
+
+    /** Interrupt and exit loops */
+    void Interrupt()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        running = false;
+        cond.notify_all();
+    }
+
+    void GetStats(HTTPServerStats& statsOut)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        statsOut = stats;
+        statsOut.nQueueDepth = queue.size();
+    }
+};
+
+struct HTTPPathHandler {
+    HTTPPathHandler() {}
+    HTTPPathHandler(std::string prefix, bool exactMatch, HTTPRequestHandler handler) : prefix(prefix), exactMatch(exactMatch), handler(handler)
+    {
+    }
+    std::string prefix;
+    bool exactMatch;
+    HTTPRequestHandler handler;
+};
+
+/** HTTP module state */
+
+//! libevent event loop
+static struct event_base* eventBase = NULL;
+//! HTTP server
+static struct evhttp* eventHTTP = NULL;
+//! List of subnets to allow RPC connections from
+static std::vector<CSubNet> rpc_allow_subnets;
+//! Work queue for handling longer requests off the event loop thread
+static HTTPWorkQueue* workQueue = NULL;
+//! Handlers for (sub)paths
+static CCriticalSection cs_pathHandlers;
+static std::vector<HTTPPathHandler> pathHandlers;
+//! Bound listening sockets
+static std::vector<evhttp_bound_socket*> boundSockets;
+//! Whether connections are kept open between requests (-rpckeepalive)
+static bool fHTTPKeepAlive = true;
+//! Seconds a chunked reply may go without the client reading anything
+static int nHTTPServerTimeout = DEFAULT_HTTP_SERVER_TIMEOUT;
+
+static boost::thread threadHTTP;
+static boost::thread_group* threadGroupHTTP = NULL;
+
+/** Check if a network address is allowed to access the HTTP server */
+static bool ClientAllowed(const CNetAddr& netaddr)
+{
+    if (!netaddr.IsValid())
+        return false;
+    BOOST_FOREACH (const CSubNet& subnet, rpc_allow_subnets)
+        if (subnet.Match(netaddr))
+            return true;
+    return false;
+}
+
+/** Initialize ACL list for HTTP server */
+static bool InitHTTPAllowList()
+{
+    rpc_allow_subnets.clear();
+    rpc_allow_subnets.push_back(CSubNet("127.0.0.0/8")); // always allow IPv4 local subnet
+    rpc_allow_subnets.push_back(CSubNet("::1"));         // always allow IPv6 localhost
+    if (mapMultiArgs.count("-rpcallowip")) {
+        const std::vector<std::string>& vAllow = mapMultiArgs["-rpcallowip"];
+        BOOST_FOREACH (std::string strAllow, vAllow) {
+            CSubNet subnet(strAllow);
+            if (!subnet.IsValid()) {
+                uiInterface.ThreadSafeMessageBox(
+                    strprintf("Invalid -rpcallowip subnet specification: %s. Valid are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24).", strAllow),
+                    "", CClientUIInterface::MSG_ERROR);
+                return false;
+            }
+            rpc_allow_subnets.push_back(subnet);
+        }
+    }
+    std::string strAllowed;
+    BOOST_FOREACH (const CSubNet& subnet, rpc_allow_subnets)
+        strAllowed += subnet.ToString() + " ";
+    LogPrint("http", "Allowing HTTP connections from: %s\n", strAllowed);
+    return true;
+}
+
+/** HTTP request method as string - use for logging only */
+static std::string RequestMethodString(HTTPRequest::RequestMethod m)
+{
+    switch (m) {
+    case HTTPRequest::GET:
+        return "GET";
+    case HTTPRequest::POST:
+        return "POST";
+    case HTTPRequest::HEAD:
+        return "HEAD";
+    case HTTPRequest::PUT:
+        return "PUT";
+    default:
+        return "unknown";
+    }
+}
+
+/** HTTP request callback */
+static void http_request_cb(struct evhttp_request* req, void* arg)
+{
+    HTTPRequest* hreq = new HTTPRequest(req);
+
+    LogPrint("http", "Received a %s request for %s from %s\n",
+        RequestMethodString(hreq->GetRequestMethod()), hreq->GetURI(), hreq->GetPeer().ToString());
+
+    // Early address-based allow check
+    if (!ClientAllowed(hreq->GetPeer())) {
+        hreq->WriteReply(HTTP_FORBIDDEN);
+        delete hreq;
+        return;
+    }
+
+    // Early reject unknown HTTP methods
+    if (hreq->GetRequestMethod() == HTTPRequest::UNKNOWN) {
+        hreq->WriteReply(HTTP_BAD_METHOD);
+        delete hreq;
+        return;
+    }
+
+    // Find registered handler for prefix
+    std::string strURI = hreq->GetURI();
+    std::string path;
+    HTTPPathHandler handler;
+    bool fFound = false;
+    {
+        LOCK(cs_pathHandlers);
+        BOOST_FOREACH (const HTTPPathHandler& i, pathHandlers) {
+            bool match = false;
+            if (i.exactMatch)
+                match = (strURI == i.prefix);
+            else
+                match = (strURI.substr(0, i.prefix.size()) == i.prefix);
+            if (match) {
+                path = strURI.substr(i.prefix.size());
+                handler = i;
+                fFound = true;
+                break;
+            }
+        }
+    }
+
+    // Dispatch to worker thread
+    if (fFound) {
+        HTTPWorkItem* item = new HTTPWorkItem(hreq, path, handler.handler);
+        assert(workQueue);
+        if (!workQueue->Enqueue(item)) {
+            LogPrintf("WARNING: request rejected because http work queue depth exceeded, it can be increased with the -rpcworkqueue= setting\n");
+            item->req->WriteReply(HTTP_SERVICE_UNAVAILABLE, "Work queue depth exceeded");
+            delete item;
+        }
+    } else {
+        hreq->WriteReply(HTTP_NOT_FOUND);
+        delete hreq;
+    }
+}
+
+/** Callback to reject HTTP requests after shutdown. */
+static void http_reject_request_cb(struct evhttp_request* req, void*)
+{
+    LogPrint("http", "Rejecting request while shutting down\n");
+    evhttp_send_error(req, HTTP_SERVICE_UNAVAILABLE, NULL);
+}
+
+/** Event dispatcher thread */
+static void ThreadHTTP(struct event_base* base)
+{
+    RenameThread("basex-http");
+    LogPrint("http", "Entering http event loop\n");
+    event_base_dispatch(base);
+    // Event loop will be interrupted by InterruptHTTPServer()
+    LogPrint("http", "Exited http event loop\n");
+}
+
+/** Bind HTTP server to specified addresses */
+static bool HTTPBindAddresses(struct evhttp* http)
+{
+    int defaultPort = GetArg("-rpcport", BaseParams().RPCPort());
+    std::vector<std::pair<std::string, uint16_t> > endpoints;
+
+    // Determine what addresses to bind to
+    if (!mapArgs.count("-rpcallowip")) { // Default to loopback if not allowing external IPs
+        endpoints.push_back(std::make_pair("::1", defaultPort));
+        endpoints.push_back(std::make_pair("127.0.0.1", defaultPort));
+        if (mapArgs.count("-rpcbind")) {
+            LogPrintf("WARNING: option -rpcbind was ignored because -rpcallowip was not specified, refusing to allow everyone to connect\n");
+        }
+    } else if (mapArgs.count("-rpcbind")) { // Specific bind address
+        BOOST_FOREACH (const std::string& strRPCBind, mapMultiArgs["-rpcbind"]) {
+            int port = defaultPort;
+            std::string host;
+            SplitHostPort(strRPCBind, port, host);
+            endpoints.push_back(std::make_pair(host, port));
+        }
+    } else { // No specific bind address specified, bind to any
+        endpoints.push_back(std::make_pair("::", defaultPort));
+        endpoints.push_back(std::make_pair("0.0.0.0", defaultPort));
+    }
+
+    // Bind addresses
+    for (std::vector<std::pair<std::string, uint16_t> >::iterator i = endpoints.begin(); i != endpoints.end(); ++i) {
+        LogPrintf("Binding RPC on address %s port %i\n", i->first, i->second);
+        evhttp_bound_socket* bind_handle = evhttp_bind_socket_with_handle(http, i->first.empty() ? NULL : i->first.c_str(), i->second);
+        if (bind_handle) {
+            boundSockets.push_back(bind_handle);
+        } else {
+            LogPrintf("Binding RPC on address %s port %i failed.\n", i->first, i->second);
+        }
+    }
+    return !boundSockets.empty();
+}
+
+/** Simple wrapper to set thread name and run work queue */
+static void HTTPWorkQueueRun(HTTPWorkQueue* queue)
+{
+    RenameThread("basex-httpworker");
+    queue->Run();
+}
+
+/** libevent event log callback */
+static void libevent_log_cb(int severity, const char* msg)
+{
+    if (severity >= EVENT_LOG_WARN) // Log warn messages and higher without debug category
+        LogPrintf("libevent: %s\n", msg);
+    else
+        LogPrint("libevent", "libevent: %s\n", msg);
+}
+
+bool InitHTTPServer()
+{
+    struct evhttp* http = 0;
+    struct event_base* base = 0;
+
+    if (!InitHTTPAllowList())
+        return false;
+
+    if (GetBoolArg("-rpcssl", false)) {
+        uiInterface.ThreadSafeMessageBox(
+            "SSL mode for RPC (-rpcssl) is no longer supported.",
+            "", CClientUIInterface::MSG_ERROR);
+        return false;
+    }
+
+    // Redirect libevent's logging to our own log
+    event_set_log_callback(&libevent_log_cb);
+#ifdef WIN32
+    evthread_use_windows_threads();
+#else
+    evthread_use_pthreads();
+#endif
+
+    base = event_base_new(); // XXX RAII
+    if (!base) {
+        LogPrintf("Couldn't create an event_base: exiting\n");
+        return false;
+    }
+
+    /* Create a new evhttp object to handle requests. */
+    http = evhttp_new(base); // XXX RAII
+    if (!http) {
+        LogPrintf("couldn't create evhttp. Exiting.\n");
+        event_base_free(base);
+        return false;
+    }
+
+    int nTimeout = GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT);
+    evhttp_set_timeout(http, nTimeout);
+    evhttp_set_max_headers_size(http, MAX_HEADERS_SIZE);
+    evhttp_set_max_body_size(http, MAX_SIZE);
+    evhttp_set_gencb(http, http_request_cb, NULL);
+
+    if (!HTTPBindAddresses(http)) {
+        uiInterface.ThreadSafeMessageBox(
+            _("Unable to bind any endpoint for RPC server"),
+            "", CClientUIInterface::MSG_ERROR);
+        evhttp_free(http);
+        event_base_free(base);
+        return false;
+    }
+
+    LogPrint("http", "Initialized HTTP server\n");
+    int workQueueDepth = std::max((long)GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
+    LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
+
+    fHTTPKeepAlive = GetBoolArg("-rpckeepalive", true);
+    nHTTPServerTimeout = nTimeout;
+    workQueue = new HTTPWorkQueue(workQueueDepth, nTimeout);
+    eventBase = base;
+    eventHTTP = http;
+    return true;
+}
+
+bool StartHTTPServer()
+{
+    LogPrint("http", "Starting HTTP server\n");
+    int rpcThreads = std::max((long)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
+    LogPrintf("HTTP: starting %d worker threads\n", rpcThreads);
+    threadHTTP = boost::thread(boost::bind(&ThreadHTTP, eventBase));
+
+    threadGroupHTTP = new boost::thread_group();
+    for (int i = 0; i < rpcThreads; i++)
+        threadGroupHTTP->create_thread(boost::bind(&HTTPWorkQueueRun, workQueue));
+    return true;
+}
+
+void InterruptHTTPServer()
+{
+    LogPrint("http", "Interrupting HTTP server\n");
+    if (eventHTTP) {
+        // Unlisten sockets
+        BOOST_FOREACH (evhttp_bound_socket* socket, boundSockets) {
+            evhttp_del_accept_socket(eventHTTP, socket);
+        }
+        boundSockets.clear();
+        // Reject requests on current connections
+        evhttp_set_gencb(eventHTTP, http_reject_request_cb, NULL);
+    }
+    if (workQueue)
+        workQueue->Interrupt();
+}
+
+void StopHTTPServer()
+{
+    LogPrint("http", "Stopping HTTP server\n");
+    if (threadGroupHTTP) {
+        LogPrint("http", "Waiting for HTTP worker threads to exit\n");
+        threadGroupHTTP->join_all();
+        delete threadGroupHTTP;
+        threadGroupHTTP = NULL;
+    }
+    delete workQueue;
+    workQueue = NULL;
+    if (eventBase) {
+        LogPrint("http", "Waiting for HTTP event thread to exit\n");
+        // Give the event loop a few seconds to send back the last replies, then break it
+        if (!threadHTTP.timed_join(boost::posix_time::milliseconds(2000))) {
+            LogPrintf("HTTP event loop did not exit within allotted time, sending loopbreak\n");
+            event_base_loopbreak(eventBase);
+            threadHTTP.join();
+        }
+    }
+    if (eventHTTP) {
+        evhttp_free(eventHTTP);
+        eventHTTP = NULL;
+    }
+    if (eventBase) {
+        event_base_free(eventBase);
+        eventBase = NULL;
+    }
+    LogPrint("http", "Stopped HTTP server\n");
+}
+
+bool GetHTTPServerStats(HTTPServerStats& stats)
+{
+    if (!workQueue)
+        return false;
+    workQueue->GetStats(stats);
+    return true;
+}
+
+/** A reply handed from a worker to the event thread, which owns the connection */
+struct HTTPReplyEvent {
+    struct evhttp_request* req;
+    int nStatus;
+
+    HTTPReplyEvent(struct evhttp_request* req, int nStatus) : req(req), nStatus(nStatus) {}
+};
+
+static void http_reply_cb(evutil_socket_t, short, void* arg)
+{
+    HTTPReplyEvent* reply = static_cast<HTTPReplyEvent*>(arg);
+    evhttp_send_reply(reply->req, reply->nStatus, NULL, NULL);
+    delete reply;
+}
+
+/**
+ * State of a chunked reply, shared between the worker producing it and the
+ * event thread sending it. Only one drain event is pending at a time, so
+ * chunks go out in order. The event thread deletes it once the worker has
+ * ended the reply.
+ */
+struct HTTPReplyStream {
+    boost::mutex cs;
+    boost::condition_variable cond;
+    struct evhttp_request* req; //! NULL once ended or the connection closed
+    int nStatus;
+    std::string strPending;
+    bool fStarted;
+    bool fEnd;
+    bool fScheduled;
+    bool fFailed;
+    uint64_t nQueued;  //! bytes handed over by the worker
+    uint64_t nSent;    //! bytes handed to libevent
+    uint64_t nFlushed; //! bytes written to the socket
+
+    HTTPReplyStream(struct evhttp_request* req, int nStatus) : req(req), nStatus(nStatus), fStarted(false), fEnd(false), fScheduled(false),
+                                                               fFailed(false), nQueued(0), nSent(0), nFlushed(0) {}
+};
+
+static void http_stream_close_cb(struct evhttp_connection*, void* arg)
+{
+    HTTPReplyStream* stream = static_cast<HTTPReplyStream*>(arg);
+    boost::unique_lock<boost::mutex> lock(stream->cs);
+    // libevent frees the request right after this
+    stream->req = NULL;
+    stream->fFailed = true;
+    stream->cond.notify_all();
+}
+
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+static void http_stream_written_cb(struct evhttp_connection*, void* arg)
+{
+    HTTPReplyStream* stream = static_cast<HTTPReplyStream*>(arg);
+    boost::unique_lock<boost::mutex> lock(stream->cs);
+    stream->nFlushed = stream->nSent;
+    stream->cond.notify_all();
+}
+#endif
+
+static void http_stream_cb(evutil_socket_t, short, void* arg)
+{
+    HTTPReplyStream* stream = static_cast<HTTPReplyStream*>(arg);
+    bool fDelete;
+    {
+        boost::unique_lock<boost::mutex> lock(stream->cs);
+        stream->fScheduled = false;
+        if (stream->req) {
+            struct evhttp_connection* evcon = evhttp_request_get_connection(stream->req);
+            if (!stream->fStarted) {
+                evhttp_send_reply_start(stream->req, stream->nStatus, NULL);
+                if (evcon)
+                    evhttp_connection_set_closecb(evcon, http_stream_close_cb, stream);
+                stream->fStarted = true;
+            }
+            if (!stream->strPending.empty()) {
+                struct evbuffer* buf = evbuffer_new();
+                evbuffer_add(buf, stream->strPending.data(), stream->strPending.size());
+                stream->nSent += stream->strPending.size();
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+                evhttp_send_reply_chunk_with_cb(stream->req, buf, http_stream_written_cb, stream);
+#else
+                evhttp_send_reply_chunk(stream->req, buf);
+                stream->nFlushed = stream->nSent;
+#endif
+                evbuffer_free(buf);
+                stream->strPending.clear();
+            }
+            if (stream->fEnd) {
+                if (evcon)
+                    evhttp_connection_set_closecb(evcon, NULL, NULL);
+                evhttp_send_reply_end(stream->req);
+                stream->req = NULL;
+            }
+        }
+        fDelete = stream->fEnd;
+        stream->cond.notify_all();
+    }
+    if (fDelete)
+        delete stream;
+}
+
+/** Schedule a drain of the stream on the event thread, unless one is pending. Requires stream->cs. */
+static bool ScheduleReplyStream(HTTPReplyStream* stream)
+{
+    if (stream->fScheduled)
+        return true;
+    struct timeval tv = {0, 0};
+    if (!eventBase || event_base_once(eventBase, -1, EV_TIMEOUT, http_stream_cb, stream, &tv) != 0) {
+        LogPrintf("%s: unable to hand the reply to the event loop\n", __func__);
+        return false;
+    }
+    stream->fScheduled = true;
+    return true;
+}
+
+HTTPRequest::HTTPRequest(struct evhttp_request* req) : req(req),
+                                                       replySent(false),
+                                                       stream(NULL)
+{
+}
+
+HTTPRequest::~HTTPRequest()
+{
+    if (stream) {
+        WriteReplyEnd();
+    } else if (!replySent) {
+        // Keep track of whether reply was sent to avoid request leaks
+        LogPrintf("%s: Unhandled request\n", __func__);
+        WriteReply(HTTP_INTERNAL_SERVER_ERROR, "Unhandled request");
+    }
+    // evhttpd cleans up the request, as long as a reply was sent.
+}
+
+std::pair<bool, std::string> HTTPRequest::GetHeader(const std::string& hdr)
+{
+    const struct evkeyvalq* headers = evhttp_request_get_input_headers(req);
+    assert(headers);
+    const char* val = evhttp_find_header(headers, hdr.c_str());
+    if (val)
+        return std::make_pair(true, std::string(val));
+    else
+        return std::make_pair(false, std::string());
+}
+
+std::string HTTPRequest::ReadBody()
+{
+    struct evbuffer* buf = evhttp_request_get_input_buffer(req);
+    if (!buf)
+        return "";
+    size_t size = evbuffer_get_length(buf);
+    /** Trivial implementation: if this is ever a performance bottleneck,
+     * internal copying can be avoided in multi-segment buffers by using
+     * evbuffer_peek and an awkward loop. Though in that case, it'd be even
+     * better to not copy into an intermediate string but use a stream
+     * abstraction to consume the evbuffer on the fly in the parsing algorithm.
+     */
+    const char* data = (const char*)evbuffer_pullup(buf, size);
+    if (!data) // returns NULL in case of empty buffer
+        return "";
+    std::string rv(data, size);
+    evbuffer_drain(buf, size);
+    return rv;
+}
+
+void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
+{
+    struct evkeyvalq* headers = evhttp_request_get_output_headers(req);
+    assert(headers);
+    evhttp_add_header(headers, hdr.c_str(), value.c_str());
+}
+
+/** Closure sent to main thread to request a reply to be sent to
+ * a HTTP request.
+ * Replies must be sent in the main loop in the main http thread,
+ * this cannot be done from worker threads.
+ */
+void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
+{
+    assert(!replySent && req && !stream);
+    if (!fHTTPKeepAlive)
+        WriteHeader("Connection", "close");
+    struct evbuffer* evb = evhttp_request_get_output_buffer(req);
+    assert(evb);
+    evbuffer_add(evb, strReply.data(), strReply.size());
+
+    HTTPReplyEvent* reply = new HTTPReplyEvent(req, nStatus);
+    struct timeval tv = {0, 0};
+    if (!eventBase || event_base_once(eventBase, -1, EV_TIMEOUT, http_reply_cb, reply, &tv) != 0) {
+        LogPrintf("%s: unable to hand the reply to the event loop\n", __func__);
+        delete reply;
+    }
+    replySent = true;
+    req = NULL; // transferred back to main thread
+}
+
+void HTTPRequest::WriteReplyStart(int nStatus)
+{
+    assert(!replySent && req && !stream);
+    if (!fHTTPKeepAlive)
+        WriteHeader("Connection", "close");
+    // The status line and headers go out with the first chunk
+    stream = new HTTPReplyStream(req, nStatus);
+}
+
+bool HTTPRequest::WriteReplyChunk(const std::string& strChunk)
+{
+    assert(stream);
+    boost::unique_lock<boost::mutex> lock(stream->cs);
+    uint64_t nFlushedLast = stream->nFlushed;
+    boost::system_time deadline = boost::get_system_time() + boost::posix_time::seconds(nHTTPServerTimeout);
+    while (!stream->fFailed && stream->nQueued - stream->nFlushed > MAX_REPLY_STREAM_BACKLOG) {
+        if (stream->nFlushed != nFlushedLast) {
+            // The client is reading, if slowly
+            nFlushedLast = stream->nFlushed;
+            deadline = boost::get_system_time() + boost::posix_time::seconds(nHTTPServerTimeout);
+        }
+        if (!stream->cond.timed_wait(lock, deadline) && stream->nFlushed == nFlushedLast) {
+            LogPrint("http", "%s: client did not read the reply for %d seconds\n", __func__, nHTTPServerTimeout);
+            stream->fFailed = true;
+        }
+    }
+    if (stream->fFailed)
+        return false;
+    stream->strPending += strChunk;
+    stream->nQueued += strChunk.size();
+    if (!ScheduleReplyStream(stream))
+        stream->fFailed = true;
+    return !stream->fFailed;
+}
+
+void HTTPRequest::WriteReplyEnd()
+{
+    assert(stream);
+    HTTPReplyStream* streamEnded = stream;
+    stream = NULL;
+    replySent = true;
+    req = NULL; // transferred back to main thread
+    boost::unique_lock<boost::mutex> lock(streamEnded->cs);
+    streamEnded->fEnd = true;
+    if (!ScheduleReplyStream(streamEnded)) {
+        // Nothing will drain it any more
+        lock.unlock();
+        delete streamEnded;
+    }
+}
+
+CService HTTPRequest::GetPeer()
+{
+    evhttp_connection* con = evhttp_request_get_connection(req);
+    CService peer;
+    if (con) {
+        // evhttp retains ownership over returned address string
+        const char* address = "";
+        uint16_t port = 0;
+        evhttp_connection_get_peer(con, (char**)&address, &port);
+        LookupNumeric(address, peer, port);
+    }
+    return peer;
+}
+
+std::string HTTPRequest::GetURI()
+{
+    return evhttp_request_get_uri(req);
+}
+
+HTTPRequest::RequestMethod HTTPRequest::GetRequestMethod()
+{
+    switch (evhttp_request_get_command(req)) {
+    case EVHTTP_REQ_GET:
+        return GET;
+        break;
+    case EVHTTP_REQ_POST:
+        return POST;
+        break;
+    case EVHTTP_REQ_HEAD:
+        return HEAD;
+        break;
+    case EVHTTP_REQ_PUT:
+        return PUT;
+        break;
+    default:
+        return UNKNOWN;
+        break;
+    }
+}
+
+bool HTTPJSONStream::WriteChunk(const std::string& strChunk)
+{
+    if (fEnding && !fReplyStarted) {
+        // It all fit in the buffer
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strChunk + "\n");
+        fReplySent = true;
+        return true;
+    }
+    if (!fReplyStarted) {
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReplyStart(HTTP_OK);
+        fReplyStarted = true;
+    }
+    if (fEnding) {
+        fReplySent = true;
+        return req->WriteReplyChunk(strChunk + "\n");
+    }
+    return req->WriteReplyChunk(strChunk);
+}
+
+bool HTTPJSONStream::End()
+{
+    fEnding = true;
+    bool fRet = Flush();
+    if (fReplyStarted) {
+        // The last flush may have found the buffer empty
+        if (fRet && !fReplySent)
+            fRet = req->WriteReplyChunk("\n");
+        req->WriteReplyEnd();
+    }
+    return fRet;
+}
+
+void RegisterHTTPHandler(const std::string& prefix, bool exactMatch, const HTTPRequestHandler& handler)
+{
+    LogPrint("http", "Registering HTTP handler for %s (exactmatch %d)\n", prefix, exactMatch);
+    LOCK(cs_pathHandlers);
+    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler));
+}
+
+void UnregisterHTTPHandler(const std::string& prefix, bool exactMatch)
+{
+    LOCK(cs_pathHandlers);
+    std::vector<HTTPPathHandler>::iterator i = pathHandlers.begin();
+    std::vector<HTTPPathHandler>::iterator iend = pathHandlers.end();
+    for (; i != iend; ++i)
+        if (i->prefix == prefix && i->exactMatch == exactMatch)
+            break;
+    if (i != iend) {
+        LogPrint("http", "Unregistering HTTP handler for %s (exactmatch %d)\n", prefix, exactMatch);
+        pathHandlers.erase(i);
+    }
+}
@@ -0,0 +1,159 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2018 The Basex developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_HTTPSERVER_H
+#define BITCOIN_HTTPSERVER_H
+
+#include "jsonstream.h"
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+
+#include <boost/function.hpp>
+
+static const int DEFAULT_HTTP_THREADS = 4;
+static const int DEFAULT_HTTP_WORKQUEUE = 16;
+static const int DEFAULT_HTTP_SERVER_TIMEOUT = 30;
+
+struct evhttp_request;
+class CService;
+class HTTPRequest;
+struct HTTPReplyStream;
+
+/**
+ * The HTTP server reads and parses requests on a single libevent thread and
+ * hands them to -rpcthreads workers through a queue of at most -rpcworkqueue
+ * entries. A request that finds the queue full is answered 503 right away
+ * instead of waiting behind slow calls.
+ */
+
+/** Initialize the HTTP server and bind to the -rpcbind/-rpcallowip endpoints */
+bool InitHTTPServer();
+/** Start the event thread and the worker threads */
+bool StartHTTPServer();
+/** Stop accepting connections and wake up the workers */
+void InterruptHTTPServer();
+/** Join the threads and free the server. Requests still queued get a 500 reply. */
+void StopHTTPServer();
+
+/** Handler for requests to a registered path: the part of the URI after the prefix is passed along */
+typedef boost::function<bool(HTTPRequest* req, const std::string&)> HTTPRequestHandler;
+
+/** Register a handler for a URI prefix, or for the exact URI if exactMatch */
+void RegisterHTTPHandler(const std::string& prefix, bool exactMatch, const HTTPRequestHandler& handler);
+/** Unregister a handler registered with RegisterHTTPHandler */
+void UnregisterHTTPHandler(const std::string& prefix, bool exactMatch);
+
+/** Work queue and latency counters of the HTTP server, times in microseconds */
+struct HTTPServerStats {
+    int nThreads;
+    size_t nQueueDepth;
+    size_t nQueueDepthLimit;
+    size_t nQueueDepthPeak;
+    uint64_t nRequests; //! requests run by a worker
+    uint64_t nRejected; //! requests refused because the queue was full
+    uint64_t nTimedOut; //! requests that waited in the queue longer than -rpcservertimeout
+    int64_t nQueueTimeTotal;
+    int64_t nQueueTimeMax;
+    int64_t nExecTimeTotal;
+    int64_t nExecTimeMax;
+
+    HTTPServerStats() : nThreads(0), nQueueDepth(0), nQueueDepthLimit(0), nQueueDepthPeak(0), nRequests(0), nRejected(0),
+                        nTimedOut(0), nQueueTimeTotal(0), nQueueTimeMax(0), nExecTimeTotal(0), nExecTimeMax(0) {}
+};
+
+/** Get the counters of the running HTTP server; returns false if it is not running */
+bool GetHTTPServerStats(HTTPServerStats& stats);
+
+/** In-flight HTTP request. Thin C++ wrapper around evhttp_request. */
+class HTTPRequest
+{
+private:
+    struct evhttp_request* req;
+    bool replySent;
+    HTTPReplyStream* stream;
+
+public:
+    HTTPRequest(struct evhttp_request* req);
+    ~HTTPRequest();
+
+    enum RequestMethod {
+        UNKNOWN,
+        GET,
+        POST,
+        HEAD,
+        PUT
+    };
+
+    /** Get requested URI */
+    std::string GetURI();
+
+    /** Get CService (address:ip) for the origin of the http request */
+    CService GetPeer();
+
+    /** Get request method */
+    RequestMethod GetRequestMethod();
+
+    /**
+     * Get the request header specified by hdr, or an empty string.
+     * Return an pair (isPresent,string).
+     */
+    std::pair<bool, std::string> GetHeader(const std::string& hdr);
+
+    /** Read request body. This consumes the body, so a second call returns an empty string. */
+    std::string ReadBody();
+
+    /** Write output header. Must be called before WriteReply. */
+    void WriteHeader(const std::string& hdr, const std::string& value);
+
+    /**
+     * Write HTTP reply. The reply is handed to the event thread, which sends
+     * it; the request must not be used after this call.
+     */
+    void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start a chunked reply, for a body that is produced piece by piece.
+     * Headers must be written before this call. Chunks are sent in order by
+     * the event thread as they are handed over.
+     */
+    void WriteReplyStart(int nStatus);
+
+    /**
+     * Send the next piece of a chunked reply. Blocks while the client is
+     * too far behind; returns false if the connection is gone or made no
+     * progress for -rpcservertimeout seconds.
+     */
+    bool WriteReplyChunk(const std::string& strChunk);
+
+    /** Finish a chunked reply. The request must not be used after this call. */
+    void WriteReplyEnd();
+};
+
+/**
+ * Sends JSON as the body of a 200 reply. Output that fits in one flush goes
+ * out as a plain reply; anything larger becomes a chunked reply, started at
+ * the first flush.
+ */
+class HTTPJSONStream : public CJSONStream
+{
+private:
+    HTTPRequest* req;
+    bool fReplyStarted;
+    bool fEnding;
+    bool fReplySent;
+
+protected:
+    bool WriteChunk(const std::string& strChunk);
+
+public:
+    HTTPJSONStream(HTTPRequest* req) : req(req), fReplyStarted(false), fEnding(false), fReplySent(false) {}
+
+    /** Write out the rest of the output, followed by a newline, and finish the reply */
+    bool End();
+};
+
+#endif // BITCOIN_HTTPSERVER_H
@@ -17,6 +17,7 @@
 #include "amount.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
+#include "httpserver.h"
 #include "key.h"
 #include "main.h"
 #include "masternode-budget.h"
@@ -32,6 +33,7 @@
 #include "spork.h"
 #include "sporkdb.h"
 #include "txdb.h"
+#include "txoutsnapshot.h"
 #include "torcontrol.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -70,6 +72,7 @@ CWallet* pwalletMain = NULL;
 int nWalletBackups = 10;
 #endif
 volatile bool fFeeEstimatesInitialized = false;
+static bool fDumpMempoolLater = false;
 volatile bool fRestartRequested = false; // true: restart false: shutdown
 extern std::list<uint256> listAccCheckpointsNoDB;
 
@@ -86,6 +89,9 @@ static CZMQNotificationInterface* pzmqNotificationInterface = NULL;
 #define MIN_CORE_FILEDESCRIPTORS 150
 #endif
 
+/** Connections (the outbound ones) that -dbmaxopenfiles must leave file descriptors for */
+static const int MIN_CONNECTIONS_AFTER_DB_FILES = 16;
+
 /** Used to pass flags to the Bind() function */
 enum BindFlags {
     BF_NONE = 0,
@@ -159,7 +165,6 @@ public:
     // Writes do not need similar protection, as failure to write is handled by the caller.
 };
 
-static CCoinsViewDB* pcoinsdbview = NULL;
 static CCoinsViewErrorCatcher* pcoinscatcher = NULL;
 
 /** Preparing steps before shutting down or restarting the wallet */
@@ -193,6 +198,9 @@ void PrepareShutdown()
     DumpMasternodePayments();
     UnregisterNodeSignals(GetNodeSignals());
 
+    if (fDumpMempoolLater && GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL))
+        DumpMempool();
+
     if (fFeeEstimatesInitialized) {
         boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
         CAutoFile est_fileout(fopen(est_path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
@@ -315,6 +323,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), 500));
     strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), 3));
+    strUsage += HelpMessageOpt("-checkbackground", strprintf(_("Check the blocks of -checkblocks that are too old to disconnect from the coin database at levels 0-2 in the background after startup, resuming after a restart (not with pruning, default: %u)"), DEFAULT_VERIFY_BACKGROUND));
+    strUsage += HelpMessageOpt("-checkthreads=<n>", strprintf(_("Set the number of block verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_VERIFY_THREADS, DEFAULT_VERIFY_THREADS));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file (default: %s)"), "basex.conf"));
     if (mode == HMM_BITCOIND) {
 #if !defined(WIN32)
@@ -323,19 +333,32 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-dbmaxopenfiles=<n>", strprintf(_("Number of files each LevelDB database keeps open (default: %u)"), DEFAULT_LEVELDB_MAX_OPEN_FILES) + " " + _("The -db* database options apply to all of blocktree, chainstate and sporks, or as <name>:<value> to one of them; can be specified multiple times"));
+    strUsage += HelpMessageOpt("-dbbloombits=<n>", strprintf(_("Bloom filter bits per key of LevelDB tables, 0 for none (default: %u)"), DEFAULT_LEVELDB_BLOOM_BITS));
+    strUsage += HelpMessageOpt("-dbwritebuffer=<n>", _("LevelDB write buffer size in megabytes; the rest of the database's share of -dbcache goes to its block cache (default: a quarter of the share)"));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-maxreorg=<n>", strprintf(_("Set the Maximum reorg depth (default: %u)"), Params(CBaseChainParams::MAIN).MaxReorganizationDepth()));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+    strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
+    strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
+    strUsage += HelpMessageOpt("-persistmempool", strprintf(_("Whether to save the mempool on shutdown and load on restart (default: %u)"), DEFAULT_PERSIST_MEMPOOL));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "basexd.pid"));
 #endif
+    strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by pruning (deleting) old blocks. This mode disables wallet rescans and is incompatible with -txindex and -masternode. "
+                                                         "Warning: Reverting this setting requires re-downloading the entire blockchain. "
+                                                         "(default: 0 = disable pruning blocks, >%u = target size in MiB to use for block files)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
+    strUsage += HelpMessageOpt("-loadtxoutset=<file>", _("Start a new node from a UTXO set snapshot written by dumptxoutset, instead of downloading and validating the blocks below it (needs -prune)"));
+    strUsage += HelpMessageOpt("-assumeutxo=<hash>:<snapshothash>", _("Accept the UTXO set snapshot of block <hash> whose dumptxoutset snapshot_hash is <snapshothash> (can be specified multiple times)"));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild block chain index from current blk000??.dat files") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-resync", _("Delete blockchain folders and resync from scratch") + " " + _("on startup"));
 #if !defined(WIN32)
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), 0));
+    strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain an index of the history and unspent outputs of every address, used by the getaddress* rpc calls (default: %u)"), DEFAULT_ADDRESSINDEX));
+    strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain an index of the input spending every output, used by the getspentinfo rpc call (default: %u)"), DEFAULT_SPENTINDEX));
     strUsage += HelpMessageOpt("-forcestart", _("Attempt to force blockchain corruption recovery") + " " + _("on startup"));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
@@ -382,11 +405,14 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-createwalletbackups=<n>", _("Number of automatic wallet backups (default: 10)"));
     strUsage += HelpMessageOpt("-disablewallet", _("Do not load the wallet and disable wallet RPC calls"));
     strUsage += HelpMessageOpt("-keypool=<n>", strprintf(_("Set key pool size to <n> (default: %u)"), 100));
+    strUsage += HelpMessageOpt("-keypoolfiller", strprintf(_("Refill the key pool in the background as keys are used (default: %u)"), DEFAULT_KEYPOOL_FILLER));
+    strUsage += HelpMessageOpt("-keypoolthreads=<n>", strprintf(_("Set the number of threads deriving new key pool keys (1 to %d, 0 = auto, default: %d)"), MAX_KEYPOOL_THREADS, DEFAULT_KEYPOOL_THREADS));
     if (GetBoolArg("-help-debug", false))
         strUsage += HelpMessageOpt("-mintxfee=<amt>", strprintf(_("Fees (in BSA/Kb) smaller than this are considered zero fee for transaction creation (default: %s)"),
             FormatMoney(CWallet::minTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-paytxfee=<amt>", strprintf(_("Fee (in BSA/kB) to add to transactions you send (default: %s)"), FormatMoney(payTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-rescan", _("Rescan the block chain for missing wallet transactions") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-rescanthreads=<n>", strprintf(_("Set the number of block reader threads used when rescanning the wallet (1 to %d, 0 = auto, default: %d)"), MAX_RESCAN_THREADS, DEFAULT_RESCAN_THREADS));
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet.dat") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-sendfreetransactions", strprintf(_("Send transactions as zero-fee transactions if possible (default: %u)"), 0));
     strUsage += HelpMessageOpt("-spendzeroconfchange", strprintf(_("Spend unconfirmed change when sending transactions (default: %u)"), 1));
@@ -408,15 +434,21 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-zmqpubhashblock=<address>", _("Enable publish hash block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubhashtx=<address>", _("Enable publish hash transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubhashtxlock=<address>", _("Enable publish hash transaction (locked via SwiftTX) in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubhashmasternodewinner=<address>", _("Enable publish hash of masternode payment winner votes in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtxlock=<address>", _("Enable publish raw transaction (locked via SwiftTX) in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubrawbudgetvote=<address>", _("Enable publish raw budget proposal vote in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubqueuesize=<n>", strprintf(_("Maximum size of the queue of messages waiting to be published, in megabytes; messages beyond it are dropped (default: %u)"), DEFAULT_ZMQ_QUEUE_SIZE));
 #endif
 
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
     if (GetBoolArg("-help-debug", false)) {
         strUsage += HelpMessageOpt("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. Also sets -checkmempool (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
+        strUsage += HelpMessageOpt("-checkbackgroundlimit=<n>", strprintf("Stop the background block verification of -checkbackground after <n> blocks, leaving the rest for the next start, regtest only (default: %u)", 0));
+        strUsage += HelpMessageOpt("-checkdisconnectblocks=<n>", strprintf("Disconnect at most <n> blocks in the startup block verification of -checkbackground, leaving the older ones for the background, regtest only (default: %u = as many as the coin cache holds)", 0));
         strUsage += HelpMessageOpt("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
+        strUsage += HelpMessageOpt("-limitancestorcount=<n>", strprintf("Do not accept transactions if number of in-mempool ancestors is <n> or more (default: %u)", DEFAULT_ANCESTOR_LIMIT));
         strUsage += HelpMessageOpt("-checkpoints", strprintf(_("Only accept block chain matching built-in checkpoints (default: %u)"), 1));
         strUsage += HelpMessageOpt("-dblogsize=<n>", strprintf(_("Flush database activity from memory pool to disk log every <n> megabytes (default: %u)"), 100));
         strUsage += HelpMessageOpt("-disablesafemode", strprintf(_("Disable safemode, override a real safe mode event (default: %u)"), 0));
@@ -428,7 +460,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-stopafterblockimport", strprintf(_("Stop running after importing blocks from disk (default: %u)"), 0));
         strUsage += HelpMessageOpt("-sporkkey=<privkey>", _("Enable spork administration functionality with the appropriate private key."));
     }
-    string debugCategories = "addrman, alert, bench, coindb, db, lock, rand, rpc, selectcoins, tor, mempool, net, proxy, basex, (swifttx, masternode, mnpayments, mnbudget)"; // Don't translate these and qt below
+    string debugCategories = "addrman, alert, bench, coindb, db, http, libevent, lock, rand, rpc, selectcoins, tor, mempool, net, proxy, basex, (swifttx, masternode, mnpayments, mnbudget)"; // Don't translate these and qt below
     if (mode == HMM_BITCOIN_QT)
         debugCategories += ", qt";
     strUsage += HelpMessageOpt("-debug=<category>", strprintf(_("Output debugging information (default: %u, supplying <category> is optional)"), 0) + ". " +
@@ -503,15 +535,12 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-rpcpassword=<pw>", _("Password for JSON-RPC connections"));
     strUsage += HelpMessageOpt("-rpcport=<port>", strprintf(_("Listen for JSON-RPC connections on <port> (default: %u or testnet: %u)"), 43211, 43213));
     strUsage += HelpMessageOpt("-rpcallowip=<ip>", _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
-    strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), 4));
+    strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_HTTP_THREADS));
+    strUsage += HelpMessageOpt("-rpcbatchthreads=<n>", strprintf(_("Set the number of threads to run the calls of a JSON-RPC batch request in parallel, 0 to run them one by one (default: %d)"), DEFAULT_RPC_BATCH_THREADS));
+    strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf(_("Set the depth of the work queue to service RPC calls (default: %d)"), DEFAULT_HTTP_WORKQUEUE));
+    strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf(_("Timeout in seconds for reading an HTTP request, and for a request waiting in the work queue (default: %d)"), DEFAULT_HTTP_SERVER_TIMEOUT));
     strUsage += HelpMessageOpt("-rpckeepalive", strprintf(_("RPC support for HTTP persistent connections (default: %d)"), 1));
 
-    strUsage += HelpMessageGroup(_("RPC SSL options: (see the Bitcoin Wiki for SSL setup instructions)"));
-    strUsage += HelpMessageOpt("-rpcssl", _("Use OpenSSL (https) for JSON-RPC connections"));
-    strUsage += HelpMessageOpt("-rpcsslcertificatechainfile=<file.cert>", strprintf(_("Server certificate file (default: %s)"), "server.cert"));
-    strUsage += HelpMessageOpt("-rpcsslprivatekeyfile=<file.pem>", strprintf(_("Server private key (default: %s)"), "server.pem"));
-    strUsage += HelpMessageOpt("-rpcsslciphers=<ciphers>", strprintf(_("Acceptable ciphers (default: %s)"), "TLSv1.2+HIGH:TLSv1+HIGH:!SSLv2:!aNULL:!eNULL:!3DES:@STRENGTH"));
-
     return strUsage;
 }
 
@@ -612,6 +641,14 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
         LogPrintf("Stopping after block import\n");
         StartShutdown();
     }
+
+    // Re-accept the transactions saved at the last shutdown. Only dump again
+    // once this completed, so an interrupted load does not lose the rest.
+    if (GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
+        LoadMempool();
+        fDumpMempoolLater = !ShutdownRequested();
+    }
+    mempool.SetLoaded(!ShutdownRequested());
 }
 
 /** Sanity checks
@@ -762,6 +799,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             LogPrintf("AppInit2 : parameter interaction: -zapwallettxes=<mode> -> setting -rescan=1\n");
     }
 
+    // -prune turns off the transaction index, which needs every block
+    if (GetArg("-prune", 0) > 0) {
+        if (SoftSetBoolArg("-txindex", false))
+            LogPrintf("AppInit2 : parameter interaction: -prune set -> setting -txindex=0\n");
+    }
+
     if (!GetBoolArg("-enableswifttx", fEnableSwiftTX)) {
         if (SoftSetArg("-swifttxdepth", 0))
             LogPrintf("AppInit2 : parameter interaction: -enableswifttx=false -> setting -nSwiftTXDepth=0\n");
@@ -774,15 +817,42 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         }
     }
 
+    // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
+    int64_t nSignedPruneTarget = GetArg("-prune", 0) * 1024 * 1024;
+    if (nSignedPruneTarget < 0)
+        return InitError(_("Prune cannot be configured with a negative value."));
+    nPruneTarget = (uint64_t)nSignedPruneTarget;
+    if (nPruneTarget) {
+        if (nPruneTarget < MIN_DISK_SPACE_FOR_BLOCK_FILES)
+            return InitError(strprintf(_("Prune configured below the minimum of %d MiB.  Please use a higher number."), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
+        LogPrintf("Prune configured to target %uMiB on disk for block and undo files.\n", nPruneTarget / 1024 / 1024);
+        fPruneMode = true;
+    }
+
     // Make sure enough file descriptors are available
     int nBind = std::max((int)mapArgs.count("-bind") + (int)mapArgs.count("-whitebind"), 1);
     nMaxConnections = GetArg("-maxconnections", 125);
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
-    int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
-    if (nFD < MIN_CORE_FILEDESCRIPTORS)
+    // Databases allowed more open files than the default need them on top of the core ones
+    int nDBExtraFD = 0;
+#ifndef WIN32
+    const char* pszLevelDBs[] = {"blocktree", "chainstate", "sporks"};
+    BOOST_FOREACH (const char* pszName, pszLevelDBs)
+        nDBExtraFD += std::max(GetLevelDBProfile(pszName, 0).nMaxOpenFiles - DEFAULT_LEVELDB_MAX_OPEN_FILES, 0);
+#endif
+    int nCoreFD = MIN_CORE_FILEDESCRIPTORS + nDBExtraFD;
+    if (nDBExtraFD > 0 && (int)FD_SETSIZE - nBind - nCoreFD < MIN_CONNECTIONS_AFTER_DB_FILES)
+        return InitError(strprintf(_("-dbmaxopenfiles needs %d file descriptors more than the default, which leaves fewer than %d for connections. Please use a lower value."),
+            nDBExtraFD, MIN_CONNECTIONS_AFTER_DB_FILES));
+    int nMaxConnectionsRequested = nMaxConnections;
+    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - nCoreFD)), 0);
+    int nFD = RaiseFileDescriptorLimit(nMaxConnections + nCoreFD);
+    if (nFD < nCoreFD)
         return InitError(_("Not enough file descriptors available."));
-    if (nFD - MIN_CORE_FILEDESCRIPTORS < nMaxConnections)
-        nMaxConnections = nFD - MIN_CORE_FILEDESCRIPTORS;
+    if (nFD - nCoreFD < nMaxConnections)
+        nMaxConnections = nFD - nCoreFD;
+    if (nDBExtraFD > 0 && nMaxConnections < nMaxConnectionsRequested)
+        InitWarning(strprintf(_("Warning: -dbmaxopenfiles uses %d more file descriptors than the default, so -maxconnections is reduced from %d to %d."),
+            nDBExtraFD, nMaxConnectionsRequested, nMaxConnections));
 
     // ********************************************************* Step 3: parameter-to-internal-flags
 
@@ -813,6 +883,16 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     fCheckBlockIndex = GetBoolArg("-checkblockindex", Params().DefaultConsistencyChecks());
     Checkpoints::fEnabled = GetBoolArg("-checkpoints", true);
 
+    // Test hooks for the background block verification
+    if ((mapArgs.count("-checkbackgroundlimit") || mapArgs.count("-checkdisconnectblocks")) && !Params().MineBlocksOnDemand())
+        return InitError(_("Error: -checkbackgroundlimit and -checkdisconnectblocks are only available in regtest mode."));
+
+    // mempool limits
+    if (GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) < 5)
+        return InitError(strprintf(_("Error: -maxmempool must be at least %d MB"), 5));
+    if (GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) <= 0)
+        return InitError(_("Error: -mempoolexpiry must be positive"));
+
     // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
     nScriptCheckThreads = GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
     if (nScriptCheckThreads <= 0)
@@ -903,6 +983,24 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (GetBoolArg("-peerbloomfilters", DEFAULT_PEERBLOOMFILTERS))
         nLocalServices |= NODE_BLOOM;
 
+    if (fPruneMode) {
+        if (GetBoolArg("-txindex", true))
+            return InitError(_("Prune mode is incompatible with -txindex."));
+#ifdef ENABLE_WALLET
+        if (GetBoolArg("-rescan", false))
+            return InitError(_("Rescans are not possible in pruned mode. You will need to use -reindex which will download the whole blockchain again."));
+#endif
+        // a pruned node cannot serve the full chain to its peers
+        nLocalServices &= ~NODE_NETWORK;
+    }
+
+    if (mapArgs.count("-loadtxoutset")) {
+        if (!fPruneMode)
+            return InitError(_("-loadtxoutset needs -prune, as the blocks below the snapshot are never downloaded."));
+        if (GetBoolArg("-reindex", false))
+            return InitError(_("-loadtxoutset is incompatible with -reindex."));
+    }
+
     // ********************************************************* Step 4: application initialization: dir lock, daemonize, pidfile, debug log
 
     // Sanity check
@@ -1275,7 +1373,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     else if (nTotalCache > (nMaxDbCache << 20))
         nTotalCache = (nMaxDbCache << 20); // total cache cannot be greater than nMaxDbCache
     size_t nBlockTreeDBCache = nTotalCache / 8;
-    if (nBlockTreeDBCache > (1 << 21) && !GetBoolArg("-txindex", true))
+    if (nBlockTreeDBCache > (1 << 21) && !GetBoolArg("-txindex", true) && !GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) && !GetBoolArg("-spentindex", DEFAULT_SPENTINDEX))
         nBlockTreeDBCache = (1 << 21); // block tree db cache shouldn't be larger than 2 MiB
     nTotalCache -= nBlockTreeDBCache;
     size_t nCoinDBCache = nTotalCache / 2; // use half of the remaining cache for coindb cache
@@ -1283,6 +1381,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     nCoinCacheSize = nTotalCache / 300; // coins in memory require around 300 bytes
 
     bool fLoaded = false;
+    bool fVerifyBackground = GetBoolArg("-checkbackground", DEFAULT_VERIFY_BACKGROUND) && !fPruneMode;
+    CVerifyState verifyBackground;
     while (!fLoaded) {
         bool fReset = fReindex;
         std::string strLoadError;
@@ -1310,6 +1410,38 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 if (fReindex)
                     pblocktree->WriteReindexing(true);
 
+                // Fill new databases from a UTXO set snapshot. A load that was
+                // interrupted left them incomplete, so a retry wipes them first.
+                bool fLoadingSnapshot = false;
+                pblocktree->ReadFlag("loadingtxoutset", fLoadingSnapshot);
+                // A chain state the snapshot was already loaded into, checked
+                // against the block index once that is loaded
+                uint256 hashSnapshotLoaded = 0;
+                if (mapArgs.count("-loadtxoutset") && !fLoadingSnapshot && pcoinsdbview->GetBestBlock() != uint256(0)) {
+                    CTxOutSnapshotHeader header;
+                    std::string strSnapshotError;
+                    if (!ReadTxOutSnapshotHeader(GetArg("-loadtxoutset", ""), header, strSnapshotError))
+                        return InitError(strprintf(_("Error loading UTXO set snapshot: %s"), strSnapshotError));
+                    hashSnapshotLoaded = header.hashBlock;
+                } else if (mapArgs.count("-loadtxoutset")) {
+                    if (fLoadingSnapshot) {
+                        delete pcoinsTip;
+                        delete pcoinscatcher;
+                        delete pcoinsdbview;
+                        delete pblocktree;
+                        pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, true);
+                        pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, true);
+                        pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
+                        pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+                    }
+                    uiInterface.InitMessage(_("Loading UTXO set snapshot..."));
+                    std::string strSnapshotError;
+                    if (!LoadTxOutSnapshot(GetArg("-loadtxoutset", ""), strSnapshotError))
+                        return InitError(strprintf(_("Error loading UTXO set snapshot: %s"), strSnapshotError));
+                } else if (fLoadingSnapshot) {
+                    return InitError(_("Loading a UTXO set snapshot was interrupted. Restart with -loadtxoutset to load it again."));
+                }
+
                 // Basex: load previous sessions sporks if we have them.
                 uiInterface.InitMessage(_("Loading sporks..."));
                 LoadSporksFromDB();
@@ -1327,6 +1459,15 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 if (!mapBlockIndex.empty() && mapBlockIndex.count(Params().HashGenesisBlock()) == 0)
                     return InitError(_("Incorrect or no genesis block found. Wrong datadir for network?"));
 
+                // A restart with the same -loadtxoutset continues from the
+                // chain state; any other chain state needs a new data directory
+                if (hashSnapshotLoaded != 0) {
+                    BlockMap::iterator mi = mapBlockIndex.find(hashSnapshotLoaded);
+                    if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second))
+                        return InitError(_("-loadtxoutset needs a new data directory"));
+                    LogPrintf("UTXO set snapshot of block %s is already loaded\n", hashSnapshotLoaded.ToString());
+                }
+
                 // Initialize the block index (no-op if non-empty database was already loaded)
                 if (!InitBlockIndex()) {
                     strLoadError = _("Error initializing block database");
@@ -1339,12 +1480,34 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
 
+                // Check for changed -addressindex and -spentindex state
+                if (fAddressIndex != GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+                    strLoadError = _("You need to rebuild the database using -reindex to change -addressindex");
+                    break;
+                }
+                if (fSpentIndex != GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
+                    strLoadError = _("You need to rebuild the database using -reindex to change -spentindex");
+                    break;
+                }
+
+                // Check for a pruned database that is no longer in prune mode
+                if (fHavePruned && !fPruneMode) {
+                    strLoadError = _("You need to rebuild the database using -reindex to go back to unpruned mode.  This will redownload the entire blockchain");
+                    break;
+                }
+
                 uiInterface.InitMessage(_("Verifying blocks..."));
 
-                if (!CVerifyDB().VerifyDB(pcoinsdbview, GetArg("-checklevel", 4), GetArg("-checkblocks", 100))) {
+                if (!CVerifyDB().VerifyDB(pcoinsdbview, GetArg("-checklevel", 4), GetArg("-checkblocks", 100), fVerifyBackground ? &verifyBackground : NULL)) {
                     strLoadError = _("Corrupted block database detected");
                     break;
                 }
+
+                // Chain states written or moved on by older versions don't have an up to date unspent output set summary
+                if (!pcoinsdbview->InitCommitment()) {
+                    strLoadError = _("Error computing the unspent output set summary");
+                    break;
+                }
             } catch (std::exception& e) {
                 if (fDebug) LogPrintf("%s\n", e.what());
                 strLoadError = _("Error opening block database");
@@ -1480,6 +1643,16 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 pindexRescan = chainActive.Genesis();
         }
         if (chainActive.Tip() && chainActive.Tip() != pindexRescan) {
+            // We can't rescan beyond non-pruned blocks, stop and throw an error
+            if (fPruneMode) {
+                CBlockIndex* block = chainActive.Tip();
+                while (block && block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA) && block->pprev->nTx > 0 && pindexRescan != block)
+                    block = block->pprev;
+
+                if (pindexRescan != block)
+                    return InitError(_("Prune: last wallet synchronisation goes beyond pruned data. You need to -reindex (download the whole blockchain again in case of pruned node)"));
+            }
+
             uiInterface.InitMessage(_("Rescanning..."));
             LogPrintf("Rescanning last %i blocks (from block %i)...\n", chainActive.Height() - pindexRescan->nHeight, pindexRescan->nHeight);
             nStart = GetTimeMillis();
@@ -1512,6 +1685,13 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 #else  // ENABLE_WALLET
     LogPrintf("No wallet compiled in!\n");
 #endif // !ENABLE_WALLET
+
+    // perform the initial blockstore prune after any wallet rescanning has taken place
+    if (fPruneMode && !fReindex) {
+        uiInterface.InitMessage(_("Pruning blockstore..."));
+        PruneAndFlush();
+    }
+
     // ********************************************************* Step 9: import blocks
 
     if (mapArgs.count("-blocknotify"))
@@ -1528,6 +1708,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             vImportFiles.push_back(strFile);
     }
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
+    if (fVerifyBackground)
+        StartBackgroundVerify(threadGroup, verifyBackground);
     if (chainActive.Tip() == NULL) {
         LogPrintf("Waiting for genesis block to be imported...\n");
         while (!fRequestShutdown && chainActive.Tip() == NULL)
@@ -1587,6 +1769,11 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     fMasterNode = GetBoolArg("-masternode", false);
 
+    // Budget collaterals are OP_RETURN outputs, which are never in the UTXO set
+    // and can only be found through the transaction index
+    if ((fMasterNode || masternodeConfig.getCount() > -1) && fPruneMode)
+        return InitError(_("Masternode support is incompatible with -prune, as validating budgets requires the transaction index."));
+
     if ((fMasterNode || masternodeConfig.getCount() > -1) && fTxIndex == false) {
         return InitError("Enabling Masternode support requires turning on transaction indexing."
                          "Please add txindex=1 to your configuration and start with -reindex");
@@ -1698,6 +1885,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
         // Run a thread to flush wallet periodically
         threadGroup.create_thread(boost::bind(&ThreadFlushWalletDB, boost::ref(pwalletMain->strWalletFile)));
+
+        // Run a thread to keep the key pool topped up
+        if (GetBoolArg("-keypoolfiller", DEFAULT_KEYPOOL_FILLER)) {
+            boost::function<void()> keypoolFiller = boost::bind(&CWallet::ThreadKeyPoolFiller, pwalletMain);
+            threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "keypool", keypoolFiller));
+        }
     }
 #endif
 
@@ -0,0 +1,90 @@
+// Copyright (c) 2018 The Basex developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "jsonstream.h"
+
+#include <assert.h>
+
+void CJSONStream::BeginValue()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+    } else if (!vFirst.empty()) {
+        if (!vFirst.back())
+            strBuffer += ',';
+        vFirst.back() = false;
+    }
+}
+
+void CJSONStream::BeginObject()
+{
+    BeginValue();
+    strBuffer += '{';
+    vFirst.push_back(true);
+}
+
+void CJSONStream::EndObject()
+{
+    assert(!vFirst.empty() && !fAfterKey);
+    vFirst.pop_back();
+    strBuffer += '}';
+    if (strBuffer.size() >= JSON_STREAM_FLUSH_SIZE)
+        Flush();
+}
+
+void CJSONStream::BeginArray()
+{
+    BeginValue();
+    strBuffer += '[';
+    vFirst.push_back(true);
+}
+
+void CJSONStream::EndArray()
+{
+    assert(!vFirst.empty() && !fAfterKey);
+    vFirst.pop_back();
+    strBuffer += ']';
+    if (strBuffer.size() >= JSON_STREAM_FLUSH_SIZE)
+        Flush();
+}
+
+void CJSONStream::Key(const std::string& strKey)
+{
+    assert(!vFirst.empty() && !fAfterKey);
+    BeginValue();
+    strBuffer += UniValue(strKey).write();
+    strBuffer += ':';
+    fAfterKey = true;
+}
+
+void CJSONStream::Value(const UniValue& value)
+{
+    BeginValue();
+    strBuffer += value.write();
+    if (strBuffer.size() >= JSON_STREAM_FLUSH_SIZE)
+        Flush();
+}
+
+bool CJSONStream::Flush()
+{
+    if (fFailed) {
+        strBuffer.clear();
+        return false;
+    }
+    if (strBuffer.empty())
+        return true;
+    fStarted = true;
+    if (!WriteChunk(strBuffer))
+        fFailed = true;
+    strBuffer.clear();
+    return !fFailed;
+}
+
+void CJSONStream::Reset()
+{
+    assert(!fStarted);
+    strBuffer.clear();
+    vFirst.clear();
+    fAfterKey = false;
+}
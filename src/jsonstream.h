@@ -0,0 +1,71 @@
+// Copyright (c) 2018 The Basex developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_JSONSTREAM_H
+#define BITCOIN_JSONSTREAM_H
+
+#include <string>
+#include <vector>
+
+#include <univalue.h>
+
+/** Size of the output buffered by a CJSONStream before it is written */
+static const size_t JSON_STREAM_FLUSH_SIZE = 64 * 1024;
+
+/**
+ * Incremental JSON writer for results too large to build as one UniValue.
+ * Objects and arrays are opened and closed explicitly; their members are
+ * written as they are produced, usually one small UniValue at a time. The
+ * output is the same as UniValue::write() of the whole tree. It is handed
+ * to WriteChunk in pieces of about JSON_STREAM_FLUSH_SIZE bytes.
+ */
+class CJSONStream
+{
+private:
+    std::string strBuffer;
+    //! For each open object or array: whether it has no members yet
+    std::vector<bool> vFirst;
+    //! A key was written, its value comes next
+    bool fAfterKey;
+    bool fStarted;
+    bool fFailed;
+
+    void BeginValue();
+
+protected:
+    //! Write a piece of output; returns false if the output is gone
+    virtual bool WriteChunk(const std::string& strChunk) = 0;
+
+public:
+    CJSONStream() : fAfterKey(false), fStarted(false), fFailed(false) {}
+    virtual ~CJSONStream() {}
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+
+    //! Write the key of the next object member
+    void Key(const std::string& strKey);
+    //! Write a complete value: an array element, or the value of the last key
+    void Value(const UniValue& value);
+
+    void Pair(const std::string& strKey, const UniValue& value)
+    {
+        Key(strKey);
+        Value(value);
+    }
+
+    //! Write out the buffered output
+    bool Flush();
+    //! Discard the output; only before any of it was written out
+    void Reset();
+
+    //! Whether output has been written out, after which an error can no longer be reported instead
+    bool Started() const { return fStarted; }
+    //! Whether the output is gone; there is no point producing more
+    bool Failed() const { return fFailed; }
+};
+
+#endif // BITCOIN_JSONSTREAM_H
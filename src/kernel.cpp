@@ -366,8 +366,96 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
     return fSuccess;
 }
 
+/**
+ * Without -txindex the transaction of a stake input is read from its block,
+ * which -prune may have deleted. The stake input is still in the UTXO set,
+ * and its output is all the kernel and the signature check look at. It must
+ * have been created on the chain of pindexPrev.
+ */
+static bool GetStakeInputFromCoins(const COutPoint& prevout, const CBlockIndex* pindexPrev, CTransaction& txPrev, uint256& hashBlock)
+{
+    LOCK(cs_main);
+    const CCoins* coins = pcoinsTip->AccessCoins(prevout.hash);
+    if (!coins || !coins->IsAvailable(prevout.n) || coins->nHeight > chainActive.Height())
+        return false;
+    if (pindexPrev && pindexPrev->GetAncestor(coins->nHeight) != chainActive[coins->nHeight])
+        return false;
+
+    CMutableTransaction tx;
+    tx.nVersion = coins->nVersion;
+    tx.vout.resize(prevout.n + 1);
+    tx.vout[prevout.n] = coins->vout[prevout.n];
+    txPrev = CTransaction(tx);
+    hashBlock = chainActive[coins->nHeight]->GetBlockHash();
+    return true;
+}
+
+/**
+ * A block on a fork may stake an output that the active chain spent after
+ * the fork point, so it is no longer in the UTXO set. Its spend is then in
+ * the undo data of an active block above the fork point, which is within the
+ * maximum reorganization depth and so never pruned. The undo entry records
+ * the height of the transaction only if it spent its last output; otherwise
+ * a later spend or the UTXO set has it.
+ */
+static bool GetStakeInputFromUndo(const COutPoint& prevout, const CBlockIndex* pindexPrev, CTransaction& txPrev, uint256& hashBlock)
+{
+    LOCK(cs_main);
+    const CBlockIndex* pindexFork = chainActive.FindFork(pindexPrev);
+    if (!pindexFork)
+        return false;
+
+    bool fFound = false;
+    CTxOut txout;
+    unsigned int nHeight = 0;
+    for (const CBlockIndex* pindex = chainActive.Next(pindexFork); pindex && nHeight == 0; pindex = chainActive.Next(pindex)) {
+        CBlock block;
+        CBlockUndo blockUndo;
+        CDiskBlockPos pos = pindex->GetUndoPos();
+        if (!ReadBlockFromDisk(block, pindex) || pos.IsNull() || !blockUndo.ReadFromDisk(pos, pindex->pprev->GetBlockHash()))
+            return error("%s : failed to read block %s or its undo data", __func__, pindex->GetBlockHash().ToString());
+        if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
+            return error("%s : undo data of block %s does not match it", __func__, pindex->GetBlockHash().ToString());
+
+        for (size_t i = 1; i < block.vtx.size() && nHeight == 0; i++) {
+            const CTransaction& tx = block.vtx[i];
+            const CTxUndo& txundo = blockUndo.vtxundo[i - 1];
+            if (txundo.vprevout.size() != tx.vin.size())
+                return error("%s : undo data of block %s does not match it", __func__, pindex->GetBlockHash().ToString());
+            for (size_t j = 0; j < tx.vin.size() && nHeight == 0; j++) {
+                if (tx.vin[j].prevout.hash != prevout.hash)
+                    continue;
+                if (tx.vin[j].prevout.n == prevout.n) {
+                    fFound = true;
+                    txout = txundo.vprevout[j].txout;
+                }
+                if (fFound)
+                    nHeight = txundo.vprevout[j].nHeight;
+            }
+        }
+    }
+    if (!fFound)
+        return false;
+    if (nHeight == 0) {
+        const CCoins* coins = pcoinsTip->AccessCoins(prevout.hash);
+        if (!coins)
+            return false;
+        nHeight = coins->nHeight;
+    }
+    // The transaction must exist on the fork too
+    if ((int)nHeight > pindexFork->nHeight)
+        return false;
+
+    CMutableTransaction tx;
+    tx.vout.resize(prevout.n + 1);
+    tx.vout[prevout.n] = txout;
+    txPrev = CTransaction(tx);
+    hashBlock = chainActive[nHeight]->GetBlockHash();
+    return true;
+}
+
 // Check kernel hash target and coinstake signature
-bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake)
+bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake, const CBlockIndex* pindexPrev)
 {
     const CTransaction tx = block.vtx[1];
     if (!tx.IsCoinStake())
@@ -379,7 +467,9 @@ bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake)
     // First try finding the previous transaction in database
     uint256 hashBlock;
     CTransaction txPrev;
-    if (!GetTransaction(txin.prevout.hash, txPrev, hashBlock, true))
+    if (!GetTransaction(txin.prevout.hash, txPrev, hashBlock, true) &&
+        !GetStakeInputFromCoins(txin.prevout, pindexPrev, txPrev, hashBlock) &&
+        !(pindexPrev && GetStakeInputFromUndo(txin.prevout, pindexPrev, txPrev, hashBlock)))
         return error("CheckProofOfStake() : INFO: read txPrev failed");
 
     //verify signature and script
@@ -393,10 +483,9 @@ bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake)
     else
         return error("CheckProofOfStake() : read block failed");
 
-    // Read block header
-    CBlock blockprev;
-    if (!ReadBlockFromDisk(blockprev, pindex->GetBlockPos()))
-        return error("CheckProofOfStake(): INFO: failed to find block");
+    // Read block header; the kernel only needs its hash and time, which the
+    // block index keeps even once the block itself has been pruned
+    CBlock blockprev = pindex->GetBlockHeader();
 
     unsigned int nInterval = 0;
     unsigned int nTime = block.nTime;
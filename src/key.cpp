@@ -2,6 +2,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include "config/basex-config.h"
+#endif
+
 #include "key.h"
 
 #include "crypto/hmac_sha512.h"
@@ -13,9 +17,11 @@
 #include "ecwrapper.h"
 #include <secp256k1.h>
 
+#ifndef USE_SECP256K1
 //! anonymous namespace
 namespace
 {
+/** With verification through libsecp256k1, pubkey.cpp starts the library for both */
 class CSecp256k1Init
 {
 public:
@@ -31,6 +37,7 @@ public:
 static CSecp256k1Init instance_of_csecp256k1;
 
 } // anon namespace
+#endif
 
 bool CKey::Check(const unsigned char* vch)
 {
@@ -238,11 +245,9 @@ void CExtKey::Decode(const unsigned char code[74])
 
 bool ECC_InitSanityCheck()
 {
-#if !defined(USE_SECP256K1)
     if (!CECKey::SanityCheck()) {
         return false;
     }
-#endif
     CKey key;
     key.MakeNewKey(true);
     CPubKey pubkey = key.GetPubKey();
@@ -5,8 +5,17 @@
 #include "leveldbwrapper.h"
 
 #include "util.h"
+#include "utilstrencodings.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <sstream>
+#include <stdio.h>
 
 #include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
@@ -27,14 +36,103 @@ void HandleError(const leveldb::Status& status) throw(leveldb_error)
     throw leveldb_error("Unknown database error");
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+/**
+ * LRU block cache that counts hits and misses, for the database statistics.
+ * The counters are atomic: a lock here would serialize every table read.
+ */
+class CLevelDBCountingCache : public leveldb::Cache
+{
+private:
+    leveldb::Cache* pcache;
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+
+public:
+    CLevelDBCountingCache(size_t nCapacity) : pcache(leveldb::NewLRUCache(nCapacity)), nHits(0), nMisses(0) {}
+    ~CLevelDBCountingCache() { delete pcache; }
+
+    Handle* Insert(const leveldb::Slice& key, void* value, size_t charge, void (*deleter)(const leveldb::Slice& key, void* value))
+    {
+        return pcache->Insert(key, value, charge, deleter);
+    }
+
+    Handle* Lookup(const leveldb::Slice& key)
+    {
+        Handle* handle = pcache->Lookup(key);
+        if (handle)
+            nHits.fetch_add(1, std::memory_order_relaxed);
+        else
+            nMisses.fetch_add(1, std::memory_order_relaxed);
+        return handle;
+    }
+
+    void Release(Handle* handle) { pcache->Release(handle); }
+    void* Value(Handle* handle) { return pcache->Value(handle); }
+    void Erase(const leveldb::Slice& key) { pcache->Erase(key); }
+    uint64_t NewId() { return pcache->NewId(); }
+
+    void GetCounts(uint64_t& nHitsOut, uint64_t& nMissesOut) const
+    {
+        nHitsOut = nHits.load(std::memory_order_relaxed);
+        nMissesOut = nMisses.load(std::memory_order_relaxed);
+    }
+};
+
+/** Databases open in this process, for GetLevelDBStats */
+static boost::mutex csLevelDBs;
+static std::vector<const CLevelDBWrapper*> vLevelDBs;
+
+/**
+ * Value of a -db* option for one database. Entries of the form <name>:<value>
+ * take precedence over plain ones, and later entries over earlier ones.
+ */
+static std::string GetLevelDBArg(const std::string& strArg, const std::string& strName, const std::string& strDefault)
+{
+    std::map<std::string, std::vector<std::string> >::const_iterator it = mapMultiArgs.find(strArg);
+    if (it == mapMultiArgs.end())
+        return strDefault;
+
+    std::string strValue = strDefault;
+    bool fNamed = false;
+    BOOST_FOREACH (const std::string& strEntry, it->second) {
+        size_t nColon = strEntry.find(':');
+        if (nColon == std::string::npos) {
+            if (!fNamed)
+                strValue = strEntry;
+        } else if (strEntry.substr(0, nColon) == strName) {
+            strValue = strEntry.substr(nColon + 1);
+            fNamed = true;
+        }
+    }
+    return strValue;
+}
+
+CLevelDBProfile GetLevelDBProfile(const std::string& strName, size_t nCacheSize)
+{
+    CLevelDBProfile profile;
+    profile.nBlockCacheSize = nCacheSize / 2;
+    profile.nWriteBufferSize = nCacheSize / 4;
+
+    // An explicit write buffer size leaves the rest of the cache to the block cache
+    int64_t nWriteBufferMB = atoi64(GetLevelDBArg("-dbwritebuffer", strName, "0"));
+    if (nWriteBufferMB > 0) {
+        profile.nWriteBufferSize = nWriteBufferMB << 20;
+        profile.nBlockCacheSize = nCacheSize > 2 * profile.nWriteBufferSize ? nCacheSize - 2 * profile.nWriteBufferSize : 0;
+    }
+    profile.nMaxOpenFiles = std::max(atoi(GetLevelDBArg("-dbmaxopenfiles", strName, itostr(DEFAULT_LEVELDB_MAX_OPEN_FILES))), 20);
+    profile.nBloomBits = std::max(atoi(GetLevelDBArg("-dbbloombits", strName, itostr(DEFAULT_LEVELDB_BLOOM_BITS))), 0);
+    return profile;
+}
+
+static leveldb::Options GetOptions(const CLevelDBProfile& profile, leveldb::Cache* pcache)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    options.block_cache = pcache;
+    options.write_buffer_size = profile.nWriteBufferSize;
+    if (profile.nBloomBits > 0)
+        options.filter_policy = leveldb::NewBloomFilterPolicy(profile.nBloomBits);
+    options.compression = leveldb::kNoCompression; // LevelDB is built without Snappy
+    options.max_open_files = profile.nMaxOpenFiles;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
         // on corruption in later versions.
@@ -43,14 +141,16 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe)
+CLevelDBWrapper::CLevelDBWrapper(const std::string& strNameIn, const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe) : strName(strNameIn), strPath(path.string())
 {
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    profile = GetLevelDBProfile(strName, nCacheSize);
+    pcache = new CLevelDBCountingCache(profile.nBlockCacheSize);
+    options = GetOptions(profile, pcache);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -65,21 +165,98 @@ CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCa
     }
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     HandleError(status);
-    LogPrintf("Opened LevelDB successfully\n");
+    LogPrintf("Opened LevelDB %s successfully (block cache %.1fMiB, write buffer %.1fMiB, %d open files, %d bloom bits)\n",
+        strName, profile.nBlockCacheSize * (1.0 / 1024 / 1024), profile.nWriteBufferSize * (1.0 / 1024 / 1024),
+        profile.nMaxOpenFiles, profile.nBloomBits);
+
+    boost::unique_lock<boost::mutex> lock(csLevelDBs);
+    vLevelDBs.push_back(this);
 }
 
 CLevelDBWrapper::~CLevelDBWrapper()
 {
+    {
+        boost::unique_lock<boost::mutex> lock(csLevelDBs);
+        vLevelDBs.erase(std::remove(vLevelDBs.begin(), vLevelDBs.end(), this), vLevelDBs.end());
+    }
     delete pdb;
     pdb = NULL;
     delete options.filter_policy;
     options.filter_policy = NULL;
-    delete options.block_cache;
+    delete pcache;
+    pcache = NULL;
     options.block_cache = NULL;
     delete penv;
     options.env = NULL;
 }
 
+void CLevelDBWrapper::GetStats(CLevelDBStats& stats) const
+{
+    stats.strName = strName;
+    stats.strPath = strPath;
+    stats.profile = profile;
+    pcache->GetCounts(stats.nCacheHits, stats.nCacheMisses);
+
+    // File counts and exact sizes come from the table list ("--- level N ---"
+    // followed by one " number:size[keys]" line per table), the compaction
+    // counters from the stats table, which rounds sizes to whole megabytes.
+    std::map<int, CLevelDBLevelStats> mapLevels;
+    std::string strTables;
+    if (pdb->GetProperty("leveldb.sstables", &strTables)) {
+        std::istringstream ss(strTables);
+        std::string strLine;
+        int nLevel = -1;
+        while (std::getline(ss, strLine)) {
+            unsigned long long nNumber, nSize;
+            if (sscanf(strLine.c_str(), "--- level %d ---", &nLevel) == 1)
+                continue;
+            if (nLevel >= 0 && sscanf(strLine.c_str(), " %llu:%llu", &nNumber, &nSize) == 2) {
+                CLevelDBLevelStats& level = mapLevels[nLevel];
+                level.nFiles++;
+                level.nBytes += nSize;
+            }
+        }
+    }
+    std::string strStats;
+    if (pdb->GetProperty("leveldb.stats", &strStats)) {
+        std::istringstream ss(strStats);
+        std::string strLine;
+        while (std::getline(ss, strLine)) {
+            int nLevel, nFiles;
+            double dSize, dTime, dRead, dWrite;
+            if (sscanf(strLine.c_str(), "%d %d %lf %lf %lf %lf", &nLevel, &nFiles, &dSize, &dTime, &dRead, &dWrite) != 6)
+                continue;
+            CLevelDBLevelStats& level = mapLevels[nLevel];
+            level.dCompactionTime = dTime;
+            level.dCompactionRead = dRead;
+            level.dCompactionWrite = dWrite;
+        }
+    }
+
+    stats.vLevels.clear();
+    for (std::map<int, CLevelDBLevelStats>::iterator it = mapLevels.begin(); it != mapLevels.end(); ++it) {
+        it->second.nLevel = it->first;
+        stats.vLevels.push_back(it->second);
+    }
+}
+
+void CLevelDBWrapper::Compact()
+{
+    int64_t nStart = GetTimeMillis();
+    LogPrintf("Compacting LevelDB %s\n", strName);
+    pdb->CompactRange(NULL, NULL);
+    LogPrintf("Compacted LevelDB %s in %dms\n", strName, GetTimeMillis() - nStart);
+}
+
+std::vector<CLevelDBStats> GetLevelDBStats()
+{
+    boost::unique_lock<boost::mutex> lock(csLevelDBs);
+    std::vector<CLevelDBStats> vStats(vLevelDBs.size());
+    for (unsigned int i = 0; i < vLevelDBs.size(); i++)
+        vLevelDBs[i]->GetStats(vStats[i]);
+    return vStats;
+}
+
 bool CLevelDBWrapper::WriteBatch(CLevelDBBatch& batch, bool fSync) throw(leveldb_error)
 {
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
@@ -11,11 +11,21 @@
 #include "util.h"
 #include "version.h"
 
+#include <string>
+#include <vector>
+
 #include <boost/filesystem/path.hpp>
 
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
+class CLevelDBCountingCache;
+
+//! -dbmaxopenfiles default
+static const int DEFAULT_LEVELDB_MAX_OPEN_FILES = 64;
+//! -dbbloombits default
+static const int DEFAULT_LEVELDB_BLOOM_BITS = 10;
+
 class leveldb_error : public std::runtime_error
 {
 public:
@@ -24,6 +34,45 @@ public:
 
 void HandleError(const leveldb::Status& status) throw(leveldb_error);
 
+/**
+ * Tunables of one LevelDB database. The cache split follows from the cache
+ * size the database is given; the -db* options override the rest, either
+ * for all databases or, as <name>:<value>, for one of them.
+ */
+struct CLevelDBProfile
+{
+    size_t nBlockCacheSize;  //! cache of uncompressed table blocks
+    size_t nWriteBufferSize; //! memtable size; up to two may be held in memory simultaneously
+    int nMaxOpenFiles;       //! table files LevelDB keeps open
+    int nBloomBits;          //! bloom filter bits per key, 0 for no filter
+};
+
+CLevelDBProfile GetLevelDBProfile(const std::string& strName, size_t nCacheSize);
+
+/** Size and compaction counters of one LevelDB level */
+struct CLevelDBLevelStats
+{
+    int nLevel;
+    int nFiles;
+    uint64_t nBytes;
+    double dCompactionTime;  //! seconds spent compacting into this level
+    double dCompactionRead;  //! MB read by those compactions
+    double dCompactionWrite; //! MB written by those compactions
+};
+
+struct CLevelDBStats
+{
+    std::string strName;
+    std::string strPath;
+    CLevelDBProfile profile;
+    uint64_t nCacheHits;
+    uint64_t nCacheMisses;
+    std::vector<CLevelDBLevelStats> vLevels; //! non-empty levels only
+};
+
+/** Statistics of the open databases, in the order they were opened */
+std::vector<CLevelDBStats> GetLevelDBStats();
+
 /** Batch of changes queued to be written to a CLevelDBWrapper */
 class CLevelDBBatch
 {
@@ -64,6 +113,18 @@ public:
 class CLevelDBWrapper
 {
 private:
+    //! name the -db* options and the statistics know this database by
+    std::string strName;
+
+    //! location of the database, for the statistics
+    std::string strPath;
+
+    //! tunables the database was opened with
+    CLevelDBProfile profile;
+
+    //! block cache of the database, counting lookups
+    CLevelDBCountingCache* pcache;
+
     //! custom environment this database is using (may be NULL in case of default environment)
     leveldb::Env* penv;
 
@@ -86,9 +147,14 @@ private:
     leveldb::DB* pdb;
 
 public:
-    CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CLevelDBWrapper(const std::string& strName, const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
     ~CLevelDBWrapper();
 
+    void GetStats(CLevelDBStats& stats) const;
+
+    //! Compact the whole key range; blocks until done. Reads and writes may go on meanwhile.
+    void Compact();
+
     template <typename K, typename V>
     bool Read(const K& key, V& value) const throw(leveldb_error)
     {
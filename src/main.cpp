@@ -8,6 +8,7 @@
 
 #include "main.h"
 
+#include "addressindex.h"
 #include "addrman.h"
 #include "alert.h"
 #include "chainparams.h"
@@ -21,6 +22,7 @@
 #include "merkleblock.h"
 #include "net.h"
 #include "pow.h"
+#include "spentindex.h"
 #include "spork.h"
 #include "sporkdb.h"
 #include "swifttx.h"
@@ -40,6 +42,7 @@
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 
 using namespace boost;
@@ -72,8 +75,13 @@ int nScriptCheckThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = true;
+bool fAddressIndex = DEFAULT_ADDRESSINDEX;
+bool fSpentIndex = DEFAULT_SPENTINDEX;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
+bool fHavePruned = false;
+bool fPruneMode = false;
+uint64_t nPruneTarget = 0;
 unsigned int nCoinCacheSize = 5000;
 bool fAlerts = DEFAULT_ALERTS;
 
@@ -180,74 +188,11 @@ set<CBlockIndex*> setDirtyBlockIndex;
 
 /** Dirty block file entries. */
 set<int> setDirtyFileInfo;
-} // anon namespace
-
-//////////////////////////////////////////////////////////////////////////////
-//
-// dispatching functions
-//
-
-// These functions dispatch to one or all registered wallets
-
-namespace
-{
-struct CMainSignals {
-    /** Notifies listeners of updated transaction data (transaction, and optionally the block it is found in. */
-    boost::signals2::signal<void(const CTransaction&, const CBlock*)> SyncTransaction;
-    /** Notifies listeners of an erased transaction (currently disabled, requires transaction replacement). */
-// XX42    boost::signals2::signal<void(const uint256&)> EraseTransaction;
-    /** Notifies listeners of an updated transaction without new data (for now: a coinbase potentially becoming visible). */
-    boost::signals2::signal<void(const uint256&)> UpdatedTransaction;
-    /** Notifies listeners of a new active block chain. */
-    boost::signals2::signal<void(const CBlockLocator&)> SetBestChain;
-    /** Notifies listeners about an inventory item being seen on the network. */
-    boost::signals2::signal<void(const uint256&)> Inventory;
-    /** Tells listeners to broadcast their data. */
-    boost::signals2::signal<void()> Broadcast;
-    /** Notifies listeners of a block validation result */
-    boost::signals2::signal<void(const CBlock&, const CValidationState&)> BlockChecked;
-} g_signals;
 
+/** Global flag to indicate we should check to see if there are block/undo files that should be deleted. Set on startup or if we allocate more file space when we're in prune mode. */
+bool fCheckForPruning = false;
 } // anon namespace
 
-void RegisterValidationInterface(CValidationInterface* pwalletIn)
-{
-    g_signals.SyncTransaction.connect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
-// XX42 g_signals.EraseTransaction.connect(boost::bind(&CValidationInterface::EraseFromWallet, pwalletIn, _1));
-    g_signals.UpdatedTransaction.connect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
-    g_signals.SetBestChain.connect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
-    g_signals.Inventory.connect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
-    g_signals.Broadcast.connect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn));
-    g_signals.BlockChecked.connect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
-}
-
-void UnregisterValidationInterface(CValidationInterface* pwalletIn)
-{
-    g_signals.BlockChecked.disconnect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
-    g_signals.Broadcast.disconnect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn));
-    g_signals.Inventory.disconnect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
-    g_signals.SetBestChain.disconnect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
-    g_signals.UpdatedTransaction.disconnect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
-// XX42    g_signals.EraseTransaction.disconnect(boost::bind(&CValidationInterface::EraseFromWallet, pwalletIn, _1));
-    g_signals.SyncTransaction.disconnect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
-}
-
-void UnregisterAllValidationInterfaces()
-{
-    g_signals.BlockChecked.disconnect_all_slots();
-    g_signals.Broadcast.disconnect_all_slots();
-    g_signals.Inventory.disconnect_all_slots();
-    g_signals.SetBestChain.disconnect_all_slots();
-    g_signals.UpdatedTransaction.disconnect_all_slots();
-// XX42    g_signals.EraseTransaction.disconnect_all_slots();
-    g_signals.SyncTransaction.disconnect_all_slots();
-}
-
-void SyncWithWallets(const CTransaction& tx, const CBlock* pblock)
-{
-    g_signals.SyncTransaction(tx, pblock);
-}
-
 //////////////////////////////////////////////////////////////////////////////
 //
 // Registration of network node signals.
@@ -592,6 +537,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewCache* pcoinsTip = NULL;
+CCoinsViewDB* pcoinsdbview = NULL;
 CBlockTreeDB* pblocktree = NULL;
 CSporkDB* pSporkDB = NULL;
 
@@ -1091,7 +1037,22 @@ CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowF
 }
 
 
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees)
+void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age)
+{
+    std::list<CTransaction> removed;
+    int expired = pool.Expire(GetTime() - age, &removed);
+    if (expired != 0)
+        LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
+
+    pool.TrimToSize(limit, &removed);
+
+    // Wallet transactions dropped from the mempool no longer spend their
+    // inputs, so let the wallets recompute the outputs they freed up.
+    BOOST_FOREACH (const CTransaction& tx, removed)
+        SyncWithWallets(tx, NULL);
+}
+
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees, int64_t nAcceptTime)
 {
     AssertLockHeld(cs_main);
     if (pfMissingInputs)
@@ -1205,9 +1166,10 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 
         CAmount nValueOut = tx.GetValueOut();
         CAmount nFees = nValueIn - nValueOut;
-        double dPriority = view.GetPriority(tx, chainActive.Height());
+        CAmount inChainInputValue;
+        double dPriority = view.GetPriority(tx, chainActive.Height(), inChainInputValue);
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height());
+        CTxMemPoolEntry entry(tx, nFees, nAcceptTime ? nAcceptTime : GetTime(), dPriority, chainActive.Height(), inChainInputValue);
         unsigned int nSize = entry.GetTxSize();
 
         if (!ignoreFees) {
@@ -1217,8 +1179,15 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
                                         hash.ToString(), nFees, txMinFee),
                     REJECT_INSUFFICIENTFEE, "insufficient fee");
 
+            // A full mempool raises the fee required to get in
+            CAmount mempoolRejectFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+            if (mempoolRejectFee > 0 && nFees < mempoolRejectFee)
+                return state.DoS(0, error("AcceptToMemoryPool : mempool min fee not met %s, %d < %d",
+                                        hash.ToString(), nFees, mempoolRejectFee),
+                    REJECT_INSUFFICIENTFEE, "mempool min fee not met");
+
             // Require that free transactions have sufficient priority to be mined in the next block.
-            if (GetBoolArg("-relaypriority", true) && nFees < ::minRelayTxFee.GetFee(nSize) && !AllowFree(view.GetPriority(tx, chainActive.Height() + 1))) {
+            if (GetBoolArg("-relaypriority", true) && nFees < ::minRelayTxFee.GetFee(nSize) && !AllowFree(entry.GetPriority(chainActive.Height() + 1))) {
                 return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "insufficient priority");
             }
 
@@ -1270,8 +1239,22 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
             return error("AcceptToMemoryPool: : BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s", hash.ToString());
         }
 
+        // Calculate in-mempool ancestors, up to a limit.
+        CTxMemPool::setEntries setAncestors;
+        size_t nLimitAncestors = GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
+        std::string errString;
+        if (!pool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, errString))
+            return state.DoS(0, error("AcceptToMemoryPool : too long mempool chain %s, %s", hash.ToString(), errString),
+                REJECT_NONSTANDARD, "too-long-mempool-chain");
+
         // Store transaction in memory
         pool.addUnchecked(hash, entry);
+
+        // trim mempool and check if tx was trimmed
+        LimitMempoolSize(pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+        if (!pool.exists(hash))
+            return state.DoS(0, error("AcceptToMemoryPool : mempool full, %s evicted", hash.ToString()),
+                REJECT_INSUFFICIENTFEE, "mempool full");
     }
 
     SyncWithWallets(tx, NULL);
@@ -1391,9 +1374,10 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
 
         CAmount nValueOut = tx.GetValueOut();
         CAmount nFees = nValueIn - nValueOut;
-        double dPriority = view.GetPriority(tx, chainActive.Height());
+        CAmount inChainInputValue;
+        double dPriority = view.GetPriority(tx, chainActive.Height(), inChainInputValue);
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height());
+        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height(), inChainInputValue);
         unsigned int nSize = entry.GetTxSize();
 
         // Don't accept it if it can't get into a block
@@ -1404,7 +1388,7 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
                 REJECT_INSUFFICIENTFEE, "insufficient fee");
 
         // Require that free transactions have sufficient priority to be mined in the next block.
-        if (GetBoolArg("-relaypriority", true) && nFees < ::minRelayTxFee.GetFee(nSize) && !AllowFree(view.GetPriority(tx, chainActive.Height() + 1))) {
+        if (GetBoolArg("-relaypriority", true) && nFees < ::minRelayTxFee.GetFee(nSize) && !AllowFree(entry.GetPriority(chainActive.Height() + 1))) {
             return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "insufficient priority");
         }
 
@@ -1466,6 +1450,61 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
     return true;
 }
 
+int GetAddressIndexType(const CScript& scriptPubKey, uint160& hashBytes)
+{
+    if (MatchPayToPubkeyHash(scriptPubKey, hashBytes))
+        return ADDRESS_INDEX_PUBKEYHASH;
+    if (MatchPayToScriptHash(scriptPubKey, hashBytes))
+        return ADDRESS_INDEX_SCRIPTHASH;
+    // Stakes pay to the bare key; index them under its address
+    CPubKey pubkey;
+    if (MatchPayToPubkey(scriptPubKey, pubkey)) {
+        hashBytes = pubkey.GetID();
+        return ADDRESS_INDEX_PUBKEYHASH;
+    }
+    return ADDRESS_INDEX_NONE;
+}
+
+bool GetAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int start, int end)
+{
+    if (!fAddressIndex)
+        return error("%s : address index not enabled", __func__);
+
+    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
+        return error("%s : unable to get txids for address", __func__);
+
+    return true;
+}
+
+bool GetAddressUnspent(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs)
+{
+    if (!fAddressIndex)
+        return error("%s : address index not enabled", __func__);
+
+    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
+        return error("%s : unable to get txids for address", __func__);
+
+    return true;
+}
+
+bool GetSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value)
+{
+    if (!fSpentIndex)
+        return false;
+
+    return pblocktree->ReadSpentIndex(key, value);
+}
+
+bool GetUTXOBlockHash(const COutPoint& outpoint, uint256& hashBlock)
+{
+    LOCK(cs_main);
+    const CCoins* coins = pcoinsTip->AccessCoins(outpoint.hash);
+    if (!coins || !coins->IsAvailable(outpoint.n) || coins->nHeight > chainActive.Height())
+        return false;
+    hashBlock = chainActive[coins->nHeight]->GetBlockHash();
+    return true;
+}
+
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock, bool fAllowSlow)
 {
@@ -1595,6 +1634,40 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
 }
 
 
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CDiskBlockPos& pos, const uint256& hash)
+{
+    // Start at the index header written by WriteBlockToDisk, which has the size
+    CDiskBlockPos hpos = pos;
+    if (hpos.nPos < MESSAGE_START_SIZE + sizeof(unsigned int))
+        return error("%s : invalid block position %d:%u", __func__, pos.nFile, pos.nPos);
+    hpos.nPos -= MESSAGE_START_SIZE + sizeof(unsigned int);
+    CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s : OpenBlockFile failed", __func__);
+
+    try {
+        MessageStartChars pchMessageStart;
+        unsigned int nSize;
+        filein >> FLATDATA(pchMessageStart) >> nSize;
+        if (memcmp(pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE) != 0)
+            return error("%s : no block at %d:%u", __func__, pos.nFile, pos.nPos);
+        if (nSize < 80 || nSize > MAX_BLOCK_SIZE)
+            return error("%s : invalid block size %u at %d:%u", __func__, nSize, pos.nFile, pos.nPos);
+        vchBlock.resize(nSize);
+        filein.read((char*)&vchBlock[0], nSize);
+
+        // Make sure the bytes are the block asked for, as ReadBlockFromDisk does after decoding it
+        CBlockHeader header;
+        CDataStream ssHeader(vchBlock, SER_DISK, CLIENT_VERSION);
+        ssHeader >> header;
+        if (header.GetHash() != hash)
+            return error("%s : block at %d:%u is %s, not %s", __func__, pos.nFile, pos.nPos, header.GetHash().ToString(), hash.ToString());
+    } catch (std::exception& e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+    return true;
+}
+
 double ConvertBitsToDouble(unsigned int nBits)
 {
     int nShift = (nBits >> 24) & 0xff;
@@ -1837,30 +1910,41 @@ void static InvalidBlockFound(CBlockIndex* pindex, const CValidationState& state
 
 void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCache& inputs, CTxUndo& txundo, int nHeight)
 {
+    CCoinsCommitment& commitment = inputs.GetCommitmentDelta();
+
     // mark inputs spent
     if (!tx.IsCoinBase()) {
         txundo.vprevout.reserve(tx.vin.size());
         BOOST_FOREACH (const CTxIn& txin, tx.vin) {
             txundo.vprevout.push_back(CTxInUndo());
-            bool ret = inputs.ModifyCoins(txin.prevout.hash)->Spend(txin.prevout, txundo.vprevout.back());
+            CCoinsModifier coins = inputs.ModifyCoins(txin.prevout.hash);
+            if (coins->IsAvailable(txin.prevout.n))
+                commitment.RemoveOutput(txin.prevout.hash, *coins, txin.prevout.n);
+            bool ret = coins->Spend(txin.prevout, txundo.vprevout.back());
             assert(ret);
+            if (coins->IsPruned())
+                commitment.nTransactions--;
         }
     }
 
     // add outputs
-    inputs.ModifyCoins(tx.GetHash())->FromTx(tx, nHeight);
+    const uint256& hash = tx.GetHash();
+    CCoinsModifier outs = inputs.ModifyCoins(hash);
+    commitment.RemoveCoins(hash, *outs); // only the duplicate transactions BIP30 allowed find unspent outputs here
+    outs->FromTx(tx, nHeight);
+    commitment.AddCoins(hash, *outs);
 }
 
 bool CScriptCheck::operator()()
 {
     const CScript& scriptSig = ptxTo->vin[nIn].scriptSig;
-    if (!VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore), &error)) {
+    if (!VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore, txdata), &error)) {
         return ::error("CScriptCheck(): %s:%d VerifySignature failed: %s", ptxTo->GetHash().ToString(), nIn, ScriptErrorString(error));
     }
     return true;
 }
 
-bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks)
+bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks, const PrecomputedTransactionData* txdata)
 {
     if (!tx.IsCoinBase()) {
         if (pvChecks)
@@ -1921,13 +2005,21 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
         // before the last block chain checkpoint. This is safe because block merkle hashes are
         // still computed and checked, and any change will be caught at the next checkpoint.
         if (fScriptChecks) {
+            // Share the signature hash serialization between the inputs. Deferred
+            // checks need the caller's, which outlives them.
+            boost::scoped_ptr<PrecomputedTransactionData> ptxdataLocal;
+            if (!txdata && !pvChecks && tx.vin.size() > 1) {
+                ptxdataLocal.reset(new PrecomputedTransactionData(tx));
+                txdata = ptxdataLocal.get();
+            }
+
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint& prevout = tx.vin[i].prevout;
                 const CCoins* coins = inputs.AccessCoins(prevout.hash);
                 assert(coins);
 
                 // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore);
+                CScriptCheck check(*coins, tx, i, flags, cacheStore, txdata);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -1940,7 +2032,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
                         CScriptCheck check(*coins, tx, i,
-                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore);
+                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, txdata);
                         if (check())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
                     }
@@ -1960,7 +2052,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
     return true;
 }
 
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean, bool fJustCheck)
 {
     if (pindex->GetBlockHash() != view.GetBestBlock())
         LogPrintf("%s : pindex=%s view=%s\n", __func__, pindex->GetBlockHash().GetHex(), view.GetBestBlock().GetHex());
@@ -1981,11 +2073,27 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
         return error("DisconnectBlock() : block and undo data inconsistent");
 
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction& tx = block.vtx[i];
         uint256 hash = tx.GetHash();
 
+        if (fAddressIndex) {
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                const CTxOut& out = tx.vout[k];
+                uint160 hashBytes;
+                int addressType = GetAddressIndexType(out.scriptPubKey, hashBytes);
+                if (addressType == ADDRESS_INDEX_NONE)
+                    continue;
+                addressIndex.push_back(make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, hash, k, false), out.nValue));
+                addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(addressType, hashBytes, hash, k), CAddressUnspentValue()));
+            }
+        }
+
         // Check that all outputs are available and match the outputs in the block itself
         // exactly. Note that transactions with only provably unspendable outputs won't
         // have outputs available even in the block itself, so we handle that case
@@ -2005,6 +2113,7 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                 fClean = fClean && error("DisconnectBlock() : added transaction mismatch? database corrupted");
 
             // remove outputs
+            view.GetCommitmentDelta().RemoveCoins(hash, *outs);
             outs->Clear();
         }
 
@@ -2017,10 +2126,12 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                 const COutPoint& out = tx.vin[j].prevout;
                 const CTxInUndo& undo = txundo.vprevout[j];
                 CCoinsModifier coins = view.ModifyCoins(out.hash);
+                CCoinsCommitment& commitment = view.GetCommitmentDelta();
                 if (undo.nHeight != 0) {
                     // undo data contains height: this is the last output of the prevout tx being spent
                     if (!coins->IsPruned())
                         fClean = fClean && error("DisconnectBlock() : undo data overwriting existing transaction");
+                    commitment.RemoveCoins(out.hash, *coins);
                     coins->Clear();
                     coins->fCoinBase = undo.fCoinBase;
                     coins->nHeight = undo.nHeight;
@@ -2029,15 +2140,36 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                     if (coins->IsPruned())
                         fClean = fClean && error("DisconnectBlock() : undo data adding output to missing transaction");
                 }
-                if (coins->IsAvailable(out.n))
+                if (coins->IsAvailable(out.n)) {
                     fClean = fClean && error("DisconnectBlock() : undo data overwriting existing output");
+                    commitment.RemoveOutput(out.hash, *coins, out.n);
+                }
+                if (coins->IsPruned())
+                    commitment.nTransactions++;
                 if (coins->vout.size() < out.n + 1)
                     coins->vout.resize(out.n + 1);
                 coins->vout[out.n] = undo.txout;
+                commitment.AddOutput(out.hash, *coins, out.n);
+
+                if (fAddressIndex || fSpentIndex) {
+                    uint160 hashBytes;
+                    int addressType = GetAddressIndexType(undo.txout.scriptPubKey, hashBytes);
+                    if (fAddressIndex && addressType != ADDRESS_INDEX_NONE) {
+                        addressIndex.push_back(make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, hash, j, true), -undo.txout.nValue));
+                        addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(addressType, hashBytes, out.hash, out.n), CAddressUnspentValue(undo.txout.nValue, undo.txout.scriptPubKey, coins->nHeight)));
+                    }
+                    if (fSpentIndex)
+                        spentIndex.push_back(make_pair(CSpentIndexKey(out.hash, out.n), CSpentIndexValue()));
+                }
             }
         }
     }
 
+    if ((fAddressIndex || fSpentIndex) && !fJustCheck) {
+        if (!pblocktree->UpdateAddressIndexes(addressIndex, true, addressUnspentIndex, spentIndex))
+            return state.Abort("Failed to delete address index");
+    }
+
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
@@ -2163,6 +2295,13 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
+    // Signature hash data for the queued script checks; reserved up front so
+    // that the pointers they hold stay valid
+    std::vector<PrecomputedTransactionData> txdata;
+    txdata.reserve(block.vtx.size());
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
     CAmount nValueOut = 0;
     CAmount nValueIn = 0;
     unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS;
@@ -2180,6 +2319,22 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 return state.DoS(100, error("ConnectBlock() : inputs missing/spent"),
                     REJECT_INVALID, "bad-txns-inputs-missingorspent");
 
+            if (fAddressIndex || fSpentIndex) {
+                const uint256& hash = tx.GetHash();
+                for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                    const COutPoint& prevout = tx.vin[j].prevout;
+                    const CTxOut& txout = view.AccessCoins(prevout.hash)->vout[prevout.n];
+                    uint160 hashBytes;
+                    int addressType = GetAddressIndexType(txout.scriptPubKey, hashBytes);
+                    if (fAddressIndex && addressType != ADDRESS_INDEX_NONE) {
+                        addressIndex.push_back(make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, hash, j, true), -txout.nValue));
+                        addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(addressType, hashBytes, prevout.hash, prevout.n), CAddressUnspentValue()));
+                    }
+                    if (fSpentIndex)
+                        spentIndex.push_back(make_pair(CSpentIndexKey(prevout.hash, prevout.n), CSpentIndexValue(hash, j, pindex->nHeight, txout.nValue, addressType, hashBytes)));
+                }
+            }
+
             if (fStrictPayToScriptHash) {
                 // Add in sigops done by pay-to-script-hash inputs;
                 // this is to prevent a "rogue miner" from creating
@@ -2194,8 +2349,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 nFees += view.GetValueIn(tx) - tx.GetValueOut();
             nValueIn += view.GetValueIn(tx);
 
+            const PrecomputedTransactionData* ptxdata = NULL;
+            if (fScriptChecks && tx.vin.size() > 1) {
+                txdata.emplace_back(tx);
+                ptxdata = &txdata.back();
+            }
+
             std::vector<CScriptCheck> vChecks;
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, false, nScriptCheckThreads ? &vChecks : NULL))
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, false, nScriptCheckThreads ? &vChecks : NULL, ptxdata))
                 return false;
             control.Add(vChecks);
         }
@@ -2207,6 +2368,19 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         }
         UpdateCoins(tx, state, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
 
+        if (fAddressIndex) {
+            const uint256& hash = tx.GetHash();
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                const CTxOut& out = tx.vout[k];
+                uint160 hashBytes;
+                int addressType = GetAddressIndexType(out.scriptPubKey, hashBytes);
+                if (addressType == ADDRESS_INDEX_NONE)
+                    continue;
+                addressIndex.push_back(make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, hash, k, false), out.nValue));
+                addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(addressType, hashBytes, hash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
+            }
+        }
+
         vPos.push_back(std::make_pair(tx.GetHash(), pos));
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
@@ -2266,6 +2440,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return state.Abort("Failed to write transaction index");
 
+    if (fAddressIndex || fSpentIndex)
+        if (!pblocktree->UpdateAddressIndexes(addressIndex, false, addressUnspentIndex, spentIndex))
+            return state.Abort("Failed to write address index");
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -2275,7 +2453,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     // Watch for changes to the previous coinbase transaction.
     static uint256 hashPrevBestCoinBase;
-    g_signals.UpdatedTransaction(hashPrevBestCoinBase);
+    GetMainSignals().UpdatedTransaction(hashPrevBestCoinBase);
     hashPrevBestCoinBase = block.vtx[0].GetHash();
 
     int64_t nTime4 = GetTimeMicros();
@@ -2291,17 +2469,137 @@ enum FlushStateMode {
     FLUSH_STATE_ALWAYS
 };
 
+/**
+ * Calculate the block/rev files that should be deleted to remain under target.
+ * Block files are pruned oldest first, and never if they hold blocks within
+ * MIN_BLOCKS_TO_KEEP (or the maximum reorganization depth) of the tip: those
+ * are needed to disconnect blocks and to serve them to peers. The stake
+ * modifiers and headers the kernel checks rely on live in the block index,
+ * which is never pruned.
+ */
+void static FindFilesToPrune(std::set<int>& setFilesToPrune)
+{
+    LOCK2(cs_main, cs_LastBlockFile);
+    if (chainActive.Tip() == NULL || nPruneTarget == 0)
+        return;
+
+    int nBlocksToKeep = std::max<int>(MIN_BLOCKS_TO_KEEP, Params().MaxReorganizationDepth());
+    if (chainActive.Tip()->nHeight <= nBlocksToKeep)
+        return;
+
+    unsigned int nLastBlockWeCanPrune = chainActive.Tip()->nHeight - nBlocksToKeep;
+    uint64_t nCurrentUsage = CalculateCurrentUsage();
+    // We don't check to prune until after we've allocated new space for files,
+    // so we should leave a buffer under our target to account for another allocation
+    // before the next pruning.
+    uint64_t nBuffer = BLOCKFILE_CHUNK_SIZE + UNDOFILE_CHUNK_SIZE;
+    uint64_t nBytesToPrune;
+    int count = 0;
+
+    if (nCurrentUsage + nBuffer >= nPruneTarget) {
+        for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
+            nBytesToPrune = vinfoBlockFile[fileNumber].nSize + vinfoBlockFile[fileNumber].nUndoSize;
+
+            if (vinfoBlockFile[fileNumber].nSize == 0)
+                continue;
+
+            if (nCurrentUsage + nBuffer < nPruneTarget) // are we below our target?
+                break;
+
+            // don't prune files that could have a block within MIN_BLOCKS_TO_KEEP of the main chain's tip
+            if (vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
+                continue;
+
+            PruneOneBlockFile(fileNumber);
+            // Queue up the files for removal
+            setFilesToPrune.insert(fileNumber);
+            nCurrentUsage -= nBytesToPrune;
+            count++;
+        }
+    }
+
+    LogPrint("prune", "Prune: target=%dMiB actual=%dMiB diff=%dMiB max_prune_height=%d removed %d blk/rev pairs\n",
+        nPruneTarget / 1024 / 1024, nCurrentUsage / 1024 / 1024,
+        ((int64_t)nPruneTarget - (int64_t)nCurrentUsage) / 1024 / 1024,
+        nLastBlockWeCanPrune, count);
+}
+
+uint64_t CalculateCurrentUsage()
+{
+    uint64_t retval = 0;
+    BOOST_FOREACH (const CBlockFileInfo& file, vinfoBlockFile) {
+        retval += file.nSize + file.nUndoSize;
+    }
+    return retval;
+}
+
+void PruneOneBlockFile(const int fileNumber)
+{
+    for (BlockMap::iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); ++it) {
+        CBlockIndex* pindex = it->second;
+        if (pindex->nFile == fileNumber) {
+            pindex->nStatus &= ~BLOCK_HAVE_DATA;
+            pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+            pindex->nFile = 0;
+            pindex->nDataPos = 0;
+            pindex->nUndoPos = 0;
+            setDirtyBlockIndex.insert(pindex);
+
+            // Prune from mapBlocksUnlinked -- any block we prune would have
+            // to be downloaded again in order to consider its chain, at which
+            // point it would be considered as a candidate for
+            // mapBlocksUnlinked or setBlockIndexCandidates.
+            std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex->pprev);
+            while (range.first != range.second) {
+                std::multimap<CBlockIndex*, CBlockIndex*>::iterator itUnlinked = range.first;
+                range.first++;
+                if (itUnlinked->second == pindex) {
+                    mapBlocksUnlinked.erase(itUnlinked);
+                }
+            }
+        }
+    }
+
+    vinfoBlockFile[fileNumber].SetNull();
+    setDirtyFileInfo.insert(fileNumber);
+}
+
+void UnlinkPrunedFiles(std::set<int>& setFilesToPrune)
+{
+    for (set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
+        CDiskBlockPos pos(*it, 0);
+        boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
+        boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
+        LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
+    }
+}
+
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed if either they're too large, forceWrite is set, or
  * fast is not set and it's been a while since the last write.
+ * In prune mode, block files found by FindFilesToPrune are also deleted, once
+ * the block index entries no longer pointing at them have been written.
  */
 bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
 {
-    LOCK(cs_main);
+    LOCK2(cs_main, cs_LastBlockFile);
     static int64_t nLastWrite = 0;
+    std::set<int> setFilesToPrune;
+    bool fFlushForPrune = false;
     try {
-        if ((mode == FLUSH_STATE_ALWAYS) ||
+        if (fPruneMode && fCheckForPruning && !fReindex) {
+            FindFilesToPrune(setFilesToPrune);
+            fCheckForPruning = false;
+            if (!setFilesToPrune.empty()) {
+                fFlushForPrune = true;
+                if (!fHavePruned) {
+                    pblocktree->WriteFlag("prunedblockfiles", true);
+                    fHavePruned = true;
+                }
+            }
+        }
+        if ((mode == FLUSH_STATE_ALWAYS) || fFlushForPrune ||
             ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->GetCacheSize() > nCoinCacheSize) ||
             (mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000)) {
             // Typical CCoins structures on disk are around 100 bytes in size.
@@ -2335,9 +2633,12 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
             // Finally flush the chainstate (which may refer to block index entries).
             if (!pcoinsTip->Flush())
                 return state.Abort("Failed to write to coin database");
+            // Nothing refers to the pruned files any more
+            if (fFlushForPrune)
+                UnlinkPrunedFiles(setFilesToPrune);
             // Update best block in wallet (so we can detect restored wallets).
             if (mode != FLUSH_STATE_IF_NEEDED) {
-                g_signals.SetBestChain(chainActive.GetLocator());
+                GetMainSignals().SetBestChain(chainActive.GetLocator());
             }
             nLastWrite = GetTimeMicros();
         }
@@ -2353,6 +2654,13 @@ void FlushStateToDisk()
     FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
 }
 
+void PruneAndFlush()
+{
+    CValidationState state;
+    fCheckForPruning = true;
+    FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED);
+}
+
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex* pindexNew)
 {
@@ -2426,9 +2734,7 @@ bool static DisconnectTip(CValidationState& state)
     UpdateTip(pindexDelete->pprev);
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:
-    BOOST_FOREACH (const CTransaction& tx, block.vtx) {
-        SyncWithWallets(tx, NULL);
-    }
+    SyncBlockWithWallets(list<CTransaction>(), block, false);
     return true;
 }
 
@@ -2467,7 +2773,7 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
     {
         CInv inv(MSG_BLOCK, pindexNew->GetBlockHash());
         bool rv = ConnectBlock(*pblock, state, pindexNew, view, false, fAlreadyChecked);
-        g_signals.BlockChecked(*pblock, state);
+        GetMainSignals().BlockChecked(*pblock, state);
         if (!rv) {
             if (state.IsInvalid())
                 InvalidBlockFound(pindexNew, state);
@@ -2500,14 +2806,9 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
     // Update chainActive & related variables.
     UpdateTip(pindexNew);
     // Tell wallet about transactions that went from mempool
-    // to conflicted:
-    BOOST_FOREACH (const CTransaction& tx, txConflicted) {
-        SyncWithWallets(tx, NULL);
-    }
-    // ... and about transactions that got confirmed:
-    BOOST_FOREACH (const CTransaction& tx, pblock->vtx) {
-        SyncWithWallets(tx, pblock);
-    }
+    // to conflicted, and about transactions that got confirmed:
+    SyncBlockWithWallets(txConflicted, *pblock, true);
+    GetMainSignals().BlockConnected(*pblock, pindexNew);
 
     int64_t nTime6 = GetTimeMicros();
     nTimePostConnect += nTime6 - nTime5;
@@ -3023,6 +3324,8 @@ bool FindBlockPos(CValidationState& state, CDiskBlockPos& pos, unsigned int nAdd
         unsigned int nOldChunks = (pos.nPos + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
         unsigned int nNewChunks = (vinfoBlockFile[nFile].nSize + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
         if (nNewChunks > nOldChunks) {
+            if (fPruneMode)
+                fCheckForPruning = true;
             if (CheckDiskSpace(nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos)) {
                 FILE* file = OpenBlockFile(pos);
                 if (file) {
@@ -3053,6 +3356,8 @@ bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigne
     unsigned int nOldChunks = (pos.nPos + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
     unsigned int nNewChunks = (nNewSize + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
     if (nNewChunks > nOldChunks) {
+        if (fPruneMode)
+            fCheckForPruning = true;
         if (CheckDiskSpace(nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos)) {
             FILE* file = OpenUndoFile(pos);
             if (file) {
@@ -3077,7 +3382,7 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool f
     return true;
 }
 
-bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig)
+bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig, bool fCheckNetworkState)
 {
     // These are checks that are independent of context.
 
@@ -3142,7 +3447,8 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     }
 
     // ----------- swiftTX transaction scanning -----------
-    if (IsSporkActive(SPORK_3_SWIFTTX_BLOCK_FILTERING)) {
+    // the transaction locks only apply to blocks near the tip
+    if (fCheckNetworkState && IsSporkActive(SPORK_3_SWIFTTX_BLOCK_FILTERING)) {
         BOOST_FOREACH (const CTransaction& tx, block.vtx) {
             if (!tx.IsCoinBase()) {
                 //only reject blocks when it's based on complete consensus
@@ -3158,12 +3464,12 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
                 }
             }
         }
-    } else {
+    } else if (fCheckNetworkState) {
         LogPrintf("CheckBlock() : skipping transaction locking checks\n");
     }
 
     // masternode payments / budgets
-    CBlockIndex* pindexPrev = chainActive.Tip();
+    CBlockIndex* pindexPrev = fCheckNetworkState ? chainActive.Tip() : NULL;
     int nHeight = 0;
     if (pindexPrev != NULL) {
         if (pindexPrev->GetBlockHash() == block.hashPrevBlock) {
@@ -3232,7 +3538,7 @@ bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev)
         uint256 hashProofOfStake;
         uint256 hash = block.GetHash();
 
-        if(!CheckProofOfStake(block, hashProofOfStake)) {
+        if(!CheckProofOfStake(block, hashProofOfStake, pindexPrev)) {
             LogPrintf("WARNING: ProcessBlock(): check proof-of-stake failed for block %s\n", hash.ToString().c_str());
             return false;
         }
@@ -3707,7 +4013,9 @@ bool static LoadBlockIndexDB(string& strError)
     BOOST_FOREACH (const PAIRTYPE(int, CBlockIndex*) & item, vSortedByHeight) {
         CBlockIndex* pindex = item.second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
-        if (pindex->nStatus & BLOCK_HAVE_DATA) {
+        // We can link the chain of blocks for which we've received transactions at some point.
+        // Pruned nodes may have deleted the block.
+        if (pindex->nTx > 0) {
             if (pindex->pprev) {
                 if (pindex->pprev->nChainTx) {
                     pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
@@ -3729,6 +4037,11 @@ bool static LoadBlockIndexDB(string& strError)
             pindexBestHeader = pindex;
     }
 
+    // Check whether we have ever pruned block & undo files
+    pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
+    if (fHavePruned)
+        LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
+
     // Load block file info
     pblocktree->ReadLastBlockFile(nLastBlockFile);
     vinfoBlockFile.resize(nLastBlockFile + 1);
@@ -3842,6 +4155,12 @@ bool static LoadBlockIndexDB(string& strError)
     pblocktree->ReadFlag("txindex", fTxIndex);
     LogPrintf("LoadBlockIndexDB(): transaction index %s\n", fTxIndex ? "enabled" : "disabled");
 
+    // Check whether we have an address and spent index
+    pblocktree->ReadFlag("addressindex", fAddressIndex);
+    LogPrintf("LoadBlockIndexDB(): address index %s\n", fAddressIndex ? "enabled" : "disabled");
+    pblocktree->ReadFlag("spentindex", fSpentIndex);
+    LogPrintf("LoadBlockIndexDB(): spent index %s\n", fSpentIndex ? "enabled" : "disabled");
+
     // If this is written true before the next client init, then we know the shutdown process failed
     pblocktree->WriteFlag("shutdown", false);
 
@@ -3861,17 +4180,180 @@ bool static LoadBlockIndexDB(string& strError)
     return true;
 }
 
-CVerifyDB::CVerifyDB()
+int CVerifyState::CountBlocks() const
 {
-    uiInterface.ShowProgress(_("Verifying blocks..."), 0);
+    int nBlocks = 0;
+    for (unsigned int i = 0; i < vRanges.size(); i++)
+        nBlocks += vRanges[i].first - vRanges[i].second + 1;
+    return nBlocks;
 }
 
-CVerifyDB::~CVerifyDB()
+namespace
 {
-    uiInterface.ShowProgress("", 100);
+/** Number of blocks read ahead per block-checking thread */
+const unsigned int VERIFY_READAHEAD_PER_THREAD = 4;
+/** Seconds between saves of the background verification state */
+const int64_t VERIFY_SAVE_INTERVAL = 60;
+
+CCriticalSection cs_verifyProgress;
+CVerifyProgress verifyProgress;
+
+/** A verifychain call while the background verification runs doesn't report its progress, to keep that of the background */
+bool SkipVerifyProgress(bool fBackground)
+{
+    AssertLockHeld(cs_verifyProgress);
+    return !fBackground && verifyProgress.fBackground && verifyProgress.strState == "running";
+}
+
+void StartVerifyProgress(bool fBackground, int nCheckLevel, int nBlocksTotal)
+{
+    LOCK(cs_verifyProgress);
+    if (SkipVerifyProgress(fBackground))
+        return;
+    verifyProgress = CVerifyProgress();
+    verifyProgress.strState = "running";
+    verifyProgress.fBackground = fBackground;
+    verifyProgress.nCheckLevel = nCheckLevel;
+    verifyProgress.nBlocksTotal = nBlocksTotal;
+}
+
+void UpdateVerifyProgress(bool fBackground, int nHeight)
+{
+    LOCK(cs_verifyProgress);
+    if (SkipVerifyProgress(fBackground))
+        return;
+    verifyProgress.nBlocksChecked++;
+    verifyProgress.nHeight = nHeight;
+}
+
+void StopVerifyProgress(bool fBackground, const std::string& strState)
+{
+    LOCK(cs_verifyProgress);
+    if (SkipVerifyProgress(fBackground))
+        return;
+    verifyProgress.strState = strState;
+}
+
+int GetVerifyThreads()
+{
+    int nThreads = GetArg("-checkthreads", DEFAULT_VERIFY_THREADS);
+    if (nThreads <= 0)
+        nThreads += boost::thread::hardware_concurrency();
+    return std::max(1, std::min(MAX_VERIFY_THREADS, nThreads));
 }
 
-bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth)
+/** A block to check at levels 0-2, with what VerifyDB needs to know of it without cs_main */
+struct CVerifyItem {
+    int nHeight;
+    uint256 hash;
+    uint256 hashPrev;
+    CDiskBlockPos pos;
+    CDiskBlockPos posUndo;
+    CBlock block;
+    bool fDone;
+    //! empty if the block passed
+    std::string strError;
+
+    CVerifyItem(const CBlockIndex* pindex) : nHeight(pindex->nHeight), hash(pindex->GetBlockHash()), hashPrev(pindex->pprev->GetBlockHash()),
+                                             pos(pindex->GetBlockPos()), posUndo(pindex->GetUndoPos()), fDone(false) {}
+};
+
+/**
+ * Threads that read and check blocks at levels 0-2 in the order they were
+ * added, without cs_main. Items have to stay alive until Wait() returned for
+ * them or the pool is destroyed.
+ */
+class CVerifyPool
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable condWorker;
+    boost::condition_variable condDone;
+    std::deque<CVerifyItem*> queue;
+    boost::thread_group threads;
+    int nCheckLevel;
+    bool fQuit;
+
+    void Check(CVerifyItem& item) const
+    {
+        // check level 0: read from disk
+        if (!ReadBlockFromDisk(item.block, item.pos) || item.block.GetHash() != item.hash) {
+            item.strError = "ReadBlockFromDisk failed";
+            return;
+        }
+        // check level 1: verify block validity, as far as it doesn't depend on the current network state
+        CValidationState state;
+        if (nCheckLevel >= 1 && !CheckBlock(item.block, state, true, true, true, false)) {
+            item.strError = "found bad block";
+            return;
+        }
+        // check level 2: verify undo validity
+        if (nCheckLevel >= 2 && !item.posUndo.IsNull()) {
+            CBlockUndo undo;
+            if (!undo.ReadFromDisk(item.posUndo, item.hashPrev))
+                item.strError = "found bad undo data";
+        }
+    }
+
+    void Loop()
+    {
+        RenameThread("basex-verify");
+        while (true) {
+            CVerifyItem* pitem;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (queue.empty() && !fQuit)
+                    condWorker.wait(lock);
+                if (fQuit)
+                    return;
+                pitem = queue.front();
+                queue.pop_front();
+            }
+            Check(*pitem);
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                pitem->fDone = true;
+            }
+            condDone.notify_all();
+        }
+    }
+
+public:
+    CVerifyPool(int nThreads, int nCheckLevelIn) : nCheckLevel(nCheckLevelIn), fQuit(false)
+    {
+        for (int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&CVerifyPool::Loop, this));
+    }
+
+    ~CVerifyPool()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fQuit = true;
+        }
+        condWorker.notify_all();
+        threads.join_all();
+    }
+
+    void Add(CVerifyItem* pitem)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            queue.push_back(pitem);
+        }
+        condWorker.notify_one();
+    }
+
+    //! Wait for the checks of pitem, an interruption point
+    void Wait(const CVerifyItem* pitem)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (!pitem->fDone)
+            condDone.wait(lock);
+    }
+};
+
+bool VerifyBlocks(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth, CVerifyState* pBackground)
 {
     LOCK(cs_main);
     if (chainActive.Tip() == NULL || chainActive.Tip()->pprev == NULL)
@@ -3883,45 +4365,69 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
     if (nCheckDepth > chainActive.Height())
         nCheckDepth = chainActive.Height();
     nCheckLevel = std::max(0, std::min(4, nCheckLevel));
-    LogPrintf("Verifying last %i blocks at level %i\n", nCheckDepth, nCheckLevel);
+    // The lowest height to check, so that exactly nCheckDepth blocks are
+    int nHeightStop = chainActive.Height() - nCheckDepth + 1;
+    int nThreads = GetVerifyThreads();
+    LogPrintf("Verifying last %i blocks at level %i with %i threads\n", nCheckDepth, nCheckLevel, nThreads);
+    StartVerifyProgress(false, nCheckLevel, nCheckDepth);
+    // Blocks below this height are not disconnected but left for the background
+    int nHeightDisconnect = 0;
+    if (pBackground && GetArg("-checkdisconnectblocks", 0) > 0)
+        nHeightDisconnect = chainActive.Height() - GetArg("-checkdisconnectblocks", 0) + 1;
     CCoinsViewCache coins(coinsview);
     CBlockIndex* pindexState = chainActive.Tip();
     CBlockIndex* pindexFailure = NULL;
     int nGoodTransactions = 0;
     CValidationState state;
+    // The blocks read ahead; declared before the pool, which has to stop with them alive
+    std::deque<CVerifyItem> vAhead;
+    CVerifyPool pool(nThreads, nCheckLevel);
+    CBlockIndex* pindexAhead = chainActive.Tip();
     for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev) {
         boost::this_thread::interruption_point();
         uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
-        if (pindex->nHeight < chainActive.Height() - nCheckDepth)
+        if (pindex->nHeight < nHeightStop)
+            break;
+        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            // If pruning, only go back as far as we have data.
+            LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
+            break;
+        }
+        bool fDisconnect = nCheckLevel >= 3 && pindex == pindexState && pindex->nHeight >= nHeightDisconnect &&
+                           (coins.GetCacheSize() + pcoinsTip->GetCacheSize()) <= nCoinCacheSize;
+        if (pBackground && !fDisconnect) {
+            pBackground->nCheckLevel = std::min(nCheckLevel, 2);
+            pBackground->nHeightTop = pindex->nHeight;
+            pBackground->vRanges.assign(1, std::make_pair(pindex->nHeight, nHeightStop));
+            pBackground->hashNext = pindex->GetBlockHash();
+            LogPrintf("VerifyDB(): leaving the blocks from height %d down for the background\n", pindex->nHeight);
             break;
-        CBlock block;
-        // check level 0: read from disk
-        if (!ReadBlockFromDisk(block, pindex))
-            return error("VerifyDB() : *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-        // check level 1: verify block validity
-        if (nCheckLevel >= 1 && !CheckBlock(block, state))
-            return error("VerifyDB() : *** found bad block at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
-        // check level 2: verify undo validity
-        if (nCheckLevel >= 2 && pindex) {
-            CBlockUndo undo;
-            CDiskBlockPos pos = pindex->GetUndoPos();
-            if (!pos.IsNull()) {
-                if (!undo.ReadFromDisk(pos, pindex->pprev->GetBlockHash()))
-                    return error("VerifyDB() : *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
-            }
         }
+        while (vAhead.size() < nThreads * VERIFY_READAHEAD_PER_THREAD && pindexAhead->pprev && pindexAhead->nHeight >= nHeightStop &&
+               (!fPruneMode || (pindexAhead->nStatus & BLOCK_HAVE_DATA))) {
+            vAhead.push_back(CVerifyItem(pindexAhead));
+            pool.Add(&vAhead.back());
+            pindexAhead = pindexAhead->pprev;
+        }
+        CVerifyItem& item = vAhead.front();
+        assert(item.hash == pindex->GetBlockHash());
+        pool.Wait(&item);
+        if (!item.strError.empty())
+            return error("VerifyDB() : *** %s at %d, hash=%s", item.strError, pindex->nHeight, pindex->GetBlockHash().ToString());
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.GetCacheSize() + pcoinsTip->GetCacheSize()) <= nCoinCacheSize) {
+        if (fDisconnect) {
             bool fClean = true;
-            if (!DisconnectBlock(block, state, pindex, coins, &fClean))
+            if (!DisconnectBlock(item.block, state, pindex, coins, &fClean, true))
                 return error("VerifyDB() : *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
             pindexState = pindex->pprev;
             if (!fClean) {
                 nGoodTransactions = 0;
                 pindexFailure = pindex;
             } else
-                nGoodTransactions += block.vtx.size();
+                nGoodTransactions += item.block.vtx.size();
         }
+        vAhead.pop_front();
+        UpdateVerifyProgress(false, pindex->nHeight);
         if (ShutdownRequested())
             return true;
     }
@@ -3948,6 +4454,161 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
     return true;
 }
 
+/** Take the next height to check off vRanges */
+bool PopVerifyHeight(std::vector<std::pair<int, int> >& vRanges, int& nHeight)
+{
+    if (vRanges.empty())
+        return false;
+    nHeight = vRanges[0].first;
+    if (vRanges[0].first <= vRanges[0].second)
+        vRanges.erase(vRanges.begin());
+    else
+        vRanges[0].first--;
+    return true;
+}
+
+void WriteVerifyState(CVerifyState& state)
+{
+    LOCK(cs_main);
+    CBlockIndex* pindex = state.IsNull() ? NULL : chainActive[state.vRanges[0].first];
+    if (pindex == NULL) {
+        pblocktree->EraseVerifyState();
+        return;
+    }
+    state.hashNext = pindex->GetBlockHash();
+    if (!pblocktree->WriteVerifyState(state))
+        LogPrintf("%s: failed to write the block verification state\n", __func__);
+}
+
+void ThreadVerifyDB(CVerifyState state)
+{
+    RenameThread("basex-verifydb");
+    int nThreads = GetVerifyThreads();
+    LogPrintf("Verifying %i more blocks at level %i in the background with %i threads\n", state.CountBlocks(), state.nCheckLevel, nThreads);
+
+    std::vector<std::pair<int, int> > vRangesAhead = state.vRanges;
+    std::deque<CVerifyItem> vAhead;
+    CVerifyPool pool(nThreads, state.nCheckLevel);
+    int64_t nLastWrite = GetTime();
+    int nLimit = GetArg("-checkbackgroundlimit", 0);
+    int nChecked = 0;
+    try {
+        while (true) {
+            {
+                LOCK(cs_main);
+                int nHeight;
+                while (vAhead.size() < nThreads * VERIFY_READAHEAD_PER_THREAD && PopVerifyHeight(vRangesAhead, nHeight)) {
+                    // Heights above a tip that went back in a reorganisation are left out
+                    CBlockIndex* pindex = chainActive[nHeight];
+                    if (pindex && pindex->pprev) {
+                        vAhead.push_back(CVerifyItem(pindex));
+                        pool.Add(&vAhead.back());
+                    }
+                }
+            }
+            if (vAhead.empty())
+                break;
+            const CVerifyItem& item = vAhead.front();
+            pool.Wait(&item);
+            if (!item.strError.empty()) {
+                LogPrintf("VerifyDB() : *** %s at %d, hash=%s\n", item.strError, item.nHeight, item.hash.ToString());
+                strMiscWarning = _("Warning: The background block verification found corrupted block data! Restart with -reindex to rebuild the block database.");
+                CAlert::Notify(strMiscWarning, true);
+                LOCK(cs_main);
+                pblocktree->EraseVerifyState();
+                StopVerifyProgress(true, "failed");
+                return;
+            }
+            int nHeight;
+            while (PopVerifyHeight(state.vRanges, nHeight) && nHeight != item.nHeight) {
+            }
+            UpdateVerifyProgress(true, item.nHeight);
+            vAhead.pop_front();
+            if (ShutdownRequested()) {
+                WriteVerifyState(state);
+                StopVerifyProgress(true, "interrupted");
+                return;
+            }
+            if (nLimit > 0 && ++nChecked >= nLimit && !state.IsNull()) {
+                WriteVerifyState(state);
+                StopVerifyProgress(true, "interrupted");
+                LogPrintf("Background block verification stopped by -checkbackgroundlimit, %i blocks left\n", state.CountBlocks());
+                return;
+            }
+            if (GetTime() > nLastWrite + VERIFY_SAVE_INTERVAL) {
+                WriteVerifyState(state);
+                nLastWrite = GetTime();
+            }
+        }
+    } catch (boost::thread_interrupted) {
+        WriteVerifyState(state);
+        StopVerifyProgress(true, "interrupted");
+        LogPrintf("Background block verification interrupted, %i blocks left\n", state.CountBlocks());
+        throw;
+    }
+
+    state.SetNull();
+    WriteVerifyState(state);
+    StopVerifyProgress(true, "done");
+    LogPrintf("Background block verification done\n");
+}
+} // anonymous namespace
+
+CVerifyDB::CVerifyDB()
+{
+    uiInterface.ShowProgress(_("Verifying blocks..."), 0);
+}
+
+CVerifyDB::~CVerifyDB()
+{
+    uiInterface.ShowProgress("", 100);
+}
+
+bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth, CVerifyState* pBackground)
+{
+    bool fResult = VerifyBlocks(coinsview, nCheckLevel, nCheckDepth, pBackground);
+    StopVerifyProgress(false, !fResult ? "failed" : ShutdownRequested() ? "interrupted" : "done");
+    return fResult;
+}
+
+void StartBackgroundVerify(boost::thread_group& threadGroup, CVerifyState state)
+{
+    {
+        LOCK(cs_main);
+        // Pick up the blocks an interrupted verification of the same chain left, as far as they are in this one
+        CVerifyState saved;
+        if (!state.IsNull() && pblocktree->ReadVerifyState(saved) && !saved.IsNull() && saved.nCheckLevel >= state.nCheckLevel &&
+            chainActive[saved.vRanges[0].first] && chainActive[saved.vRanges[0].first]->GetBlockHash() == saved.hashNext) {
+            int nHeightTop = state.vRanges[0].first;
+            int nHeightStop = state.vRanges[0].second;
+            std::vector<std::pair<int, int> > vLeft;
+            vLeft.push_back(std::make_pair(nHeightTop, saved.nHeightTop + 1));
+            vLeft.insert(vLeft.end(), saved.vRanges.begin(), saved.vRanges.end());
+            vLeft.push_back(std::make_pair(saved.vRanges.back().second - 1, nHeightStop));
+            state.vRanges.clear();
+            for (unsigned int i = 0; i < vLeft.size(); i++) {
+                std::pair<int, int> range(std::min(vLeft[i].first, nHeightTop), std::max(vLeft[i].second, nHeightStop));
+                if (range.first >= range.second)
+                    state.vRanges.push_back(range);
+            }
+            state.nHeightTop = std::max(nHeightTop, saved.nHeightTop);
+            LogPrintf("Resuming the background block verification, %i of %i blocks left\n", state.CountBlocks(), nHeightTop - nHeightStop + 1);
+        }
+        if (state.IsNull()) {
+            pblocktree->EraseVerifyState();
+            return;
+        }
+    }
+    StartVerifyProgress(true, state.nCheckLevel, state.CountBlocks());
+    threadGroup.create_thread(boost::bind(&ThreadVerifyDB, state));
+}
+
+CVerifyProgress GetVerifyProgress()
+{
+    LOCK(cs_verifyProgress);
+    return verifyProgress;
+}
+
 void UnloadBlockIndex()
 {
     mapBlockIndex.clear();
@@ -3975,6 +4636,10 @@ bool InitBlockIndex()
     // Use the provided setting for -txindex in the new database
     fTxIndex = GetBoolArg("-txindex", true);
     pblocktree->WriteFlag("txindex", fTxIndex);
+    fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    pblocktree->WriteFlag("addressindex", fAddressIndex);
+    fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    pblocktree->WriteFlag("spentindex", fSpentIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -4105,6 +4770,144 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
     return nLoaded > 0;
 }
 
+static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+
+bool LoadMempool()
+{
+    int64_t nExpiryTimeout = GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
+    FILE* filestr = fopen((GetDataDir() / "mempool.dat").string().c_str(), "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open mempool file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    int64_t count = 0;
+    int64_t skipped = 0;
+    int64_t failed = 0;
+    int64_t nNow = GetTime();
+
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != MEMPOOL_DUMP_VERSION)
+            return false;
+
+        uint64_t num;
+        file >> num;
+        mempool.SetLoadProgress(0, num);
+        for (uint64_t i = 0; i < num; i++) {
+            CTransaction tx;
+            int64_t nTime;
+            double dPriorityDelta;
+            CAmount nFeeDelta;
+            file >> tx;
+            file >> nTime;
+            file >> dPriorityDelta;
+            file >> nFeeDelta;
+
+            if (dPriorityDelta != 0 || nFeeDelta != 0)
+                mempool.PrioritiseTransaction(tx.GetHash(), tx.GetHash().ToString(), dPriorityDelta, nFeeDelta);
+
+            if (nTime + nExpiryTimeout > nNow) {
+                CValidationState state;
+                LOCK(cs_main);
+                if (AcceptToMemoryPool(mempool, state, tx, true, NULL, false, false, nTime))
+                    ++count;
+                else
+                    ++failed;
+            } else {
+                ++skipped;
+            }
+
+            mempool.SetLoadProgress(i + 1, num);
+            if (ShutdownRequested())
+                return false;
+        }
+
+        // Deltas for transactions that were not in the pool when it was dumped
+        std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+        file >> mapDeltas;
+        for (std::map<uint256, std::pair<double, CAmount> >::const_iterator it = mapDeltas.begin(); it != mapDeltas.end(); ++it) {
+            mempool.PrioritiseTransaction(it->first, it->first.ToString(), it->second.first, it->second.second);
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    LogPrintf("Imported mempool transactions from disk: %i successes, %i failed, %i expired\n", count, failed, skipped);
+    return true;
+}
+
+/** Orders mempool entries by their number of in-mempool ancestors */
+struct CompareByAncestorCount {
+    bool operator()(const std::pair<uint64_t, CTxMemPool::txiter>& a, const std::pair<uint64_t, CTxMemPool::txiter>& b) const
+    {
+        return a.first < b.first;
+    }
+};
+
+bool DumpMempool()
+{
+    int64_t start = GetTimeMicros();
+
+    std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    std::vector<CTxMemPoolEntry> vEntries;
+    {
+        LOCK(mempool.cs);
+        mapDeltas = mempool.mapDeltas;
+        // Parents before their children, so that loading finds the inputs of
+        // every transaction: a child has more in-mempool ancestors than any of
+        // its parents.
+        std::vector<std::pair<uint64_t, CTxMemPool::txiter> > vOrder;
+        vOrder.reserve(mempool.mapTx.size());
+        for (CTxMemPool::txiter it = mempool.mapTx.begin(); it != mempool.mapTx.end(); ++it) {
+            CTxMemPool::setEntries setAncestors;
+            std::string dummy;
+            mempool.CalculateMemPoolAncestors(*it, setAncestors, std::numeric_limits<uint64_t>::max(), dummy, false);
+            vOrder.push_back(std::make_pair((uint64_t)setAncestors.size(), it));
+        }
+        std::stable_sort(vOrder.begin(), vOrder.end(), CompareByAncestorCount());
+        vEntries.reserve(vOrder.size());
+        for (unsigned int i = 0; i < vOrder.size(); i++)
+            vEntries.push_back(*vOrder[i].second);
+    }
+
+    int64_t mid = GetTimeMicros();
+
+    try {
+        FILE* filestr = fopen((GetDataDir() / "mempool.dat.new").string().c_str(), "wb");
+        if (!filestr)
+            return false;
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+
+        uint64_t version = MEMPOOL_DUMP_VERSION;
+        file << version;
+
+        file << (uint64_t)vEntries.size();
+        BOOST_FOREACH (const CTxMemPoolEntry& e, vEntries) {
+            file << e.GetTx();
+            file << e.GetTime();
+            file << e.GetPriorityDelta();
+            file << e.GetFeeDelta();
+            mapDeltas.erase(e.GetTx().GetHash());
+        }
+
+        file << mapDeltas;
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(GetDataDir() / "mempool.dat.new", GetDataDir() / "mempool.dat");
+        int64_t last = GetTimeMicros();
+        LogPrintf("Dumped mempool: %gs to copy, %gs to dump\n", (mid - start) * 0.000001, (last - mid) * 0.000001);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
 void static CheckBlockIndex()
 {
     if (!fCheckBlockIndex) {
@@ -4141,6 +4944,7 @@ void static CheckBlockIndex()
     int nHeight = 0;
     CBlockIndex* pindexFirstInvalid = NULL;         // Oldest ancestor of pindex which is invalid.
     CBlockIndex* pindexFirstMissing = NULL;         // Oldest ancestor of pindex which does not have BLOCK_HAVE_DATA.
+    CBlockIndex* pindexFirstNeverProcessed = NULL;  // Oldest ancestor of pindex for which nTx == 0.
     CBlockIndex* pindexFirstNotTreeValid = NULL;    // Oldest ancestor of pindex which does not have BLOCK_VALID_TREE (regardless of being valid or not).
     CBlockIndex* pindexFirstNotChainValid = NULL;   // Oldest ancestor of pindex which does not have BLOCK_VALID_CHAIN (regardless of being valid or not).
     CBlockIndex* pindexFirstNotScriptsValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_SCRIPTS (regardless of being valid or not).
@@ -4148,6 +4952,7 @@ void static CheckBlockIndex()
         nNodes++;
         if (pindexFirstInvalid == NULL && pindex->nStatus & BLOCK_FAILED_VALID) pindexFirstInvalid = pindex;
         if (pindexFirstMissing == NULL && !(pindex->nStatus & BLOCK_HAVE_DATA)) pindexFirstMissing = pindex;
+        if (pindexFirstNeverProcessed == NULL && pindex->nTx == 0) pindexFirstNeverProcessed = pindex;
         if (pindex->pprev != NULL && pindexFirstNotTreeValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TREE) pindexFirstNotTreeValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotChainValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_CHAIN) pindexFirstNotChainValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotScriptsValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_SCRIPTS) pindexFirstNotScriptsValid = pindex;
@@ -4158,12 +4963,21 @@ void static CheckBlockIndex()
             assert(pindex->GetBlockHash() == Params().HashGenesisBlock()); // Genesis block's hash must match.
             assert(pindex == chainActive.Genesis());                       // The current active chain's genesis block must be this block.
         }
-        // HAVE_DATA is equivalent to VALID_TRANSACTIONS and equivalent to nTx > 0 (we stored the number of transactions in the block)
-        assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
-        assert(((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0));
         if (pindex->nChainTx == 0) assert(pindex->nSequenceId == 0); // nSequenceId can't be set for blocks that aren't linked
-        // All parents having data is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
-        assert((pindexFirstMissing != NULL) == (pindex->nChainTx == 0));                                             // nChainTx == 0 is used to signal that all parent block's transaction data is available.
+        // VALID_TRANSACTIONS is equivalent to nTx > 0 for all nodes (whether or not pruning has occurred).
+        // HAVE_DATA is only equivalent to nTx > 0 (or VALID_TRANSACTIONS) if no pruning has occurred.
+        if (!fHavePruned) {
+            // If we've never pruned, then HAVE_DATA should be equivalent to nTx > 0
+            assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
+            assert(pindexFirstMissing == pindexFirstNeverProcessed);
+        } else {
+            // If we have pruned, then we can only say that HAVE_DATA implies nTx > 0
+            if (pindex->nStatus & BLOCK_HAVE_DATA) assert(pindex->nTx > 0);
+        }
+        if (pindex->nStatus & BLOCK_HAVE_UNDO) assert(pindex->nStatus & BLOCK_HAVE_DATA);
+        assert(((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0));
+        // All parents having had data (at some point) is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
+        assert((pindexFirstNeverProcessed != NULL) == (pindex->nChainTx == 0));                                      // nChainTx != 0 is used to signal that all parent blocks have been processed (but may have been pruned).
         assert(pindex->nHeight == nHeight);                                                                          // nHeight must be consistent.
         assert(pindex->pprev == NULL || pindex->nChainWork >= pindex->pprev->nChainWork);                            // For every block except the genesis block, the chainwork must be larger than the parent's.
         assert(nHeight < 2 || (pindex->pskip && (pindex->pskip->nHeight < nHeight)));                                // The pskip pointer must point back for all but the first 2 blocks.
@@ -4175,9 +4989,18 @@ void static CheckBlockIndex()
             // Checks for not-invalid blocks.
             assert((pindex->nStatus & BLOCK_FAILED_MASK) == 0); // The failed mask cannot be set for blocks without invalid parents.
         }
-        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstMissing == NULL) {
-            if (pindexFirstInvalid == NULL) { // If this block sorts at least as good as the current tip and is valid, it must be in setBlockIndexCandidates.
-                assert(setBlockIndexCandidates.count(pindex));
+        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstNeverProcessed == NULL) {
+            if (pindexFirstInvalid == NULL) {
+                // If this block sorts at least as good as the current tip and
+                // is valid and we have all data for its parents, it must be in
+                // setBlockIndexCandidates. chainActive.Tip() must also be there
+                // even if some data has been pruned.
+                if (pindexFirstMissing == NULL || pindex == chainActive.Tip()) {
+                    assert(setBlockIndexCandidates.count(pindex));
+                }
+                // If some parent is missing, then it could be that this block was in
+                // setBlockIndexCandidates but had to be removed because of the missing data.
+                // In this case it must be in mapBlocksUnlinked -- see test below.
             }
         } else { // If this block sorts worse than the current tip, it cannot be in setBlockIndexCandidates.
             assert(setBlockIndexCandidates.count(pindex) == 0);
@@ -4193,12 +5016,25 @@ void static CheckBlockIndex()
             }
             rangeUnlinked.first++;
         }
-        if (pindex->pprev && pindex->nStatus & BLOCK_HAVE_DATA && pindexFirstMissing != NULL) {
-            if (pindexFirstInvalid == NULL) { // If this block has block data available, some parent doesn't, and has no invalid parents, it must be in mapBlocksUnlinked.
-                assert(foundInUnlinked);
+        if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindexFirstNeverProcessed != NULL && pindexFirstInvalid == NULL) {
+            // If this block has block data available, some parent was never received, and has no invalid parents, it must be in mapBlocksUnlinked.
+            assert(foundInUnlinked);
+        }
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA)) assert(!foundInUnlinked); // Can't be in mapBlocksUnlinked if we don't HAVE_DATA
+        if (pindexFirstMissing == NULL) assert(!foundInUnlinked);          // We aren't missing data for any parent -- cannot be in mapBlocksUnlinked.
+        if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindexFirstNeverProcessed == NULL && pindexFirstMissing != NULL) {
+            // We HAVE_DATA for this block, have received data for all parents at some point, but we're currently missing data for some parent.
+            assert(fHavePruned); // We must have pruned.
+            // This block may have entered mapBlocksUnlinked if:
+            //  - it has a descendant that at some point had more work than the tip, and
+            //  - we tried switching to that descendant but were missing data for some intermediate block between chainActive and the tip.
+            // So if this block is itself better than chainActive.Tip() and it wasn't in
+            // setBlockIndexCandidates, then it must be in mapBlocksUnlinked.
+            if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && setBlockIndexCandidates.count(pindex) == 0) {
+                if (pindexFirstInvalid == NULL) {
+                    assert(foundInUnlinked);
+                }
             }
-        } else { // If this block does not have block data available, or all parents do, it cannot be in mapBlocksUnlinked.
-            assert(!foundInUnlinked);
         }
         // assert(pindex->GetBlockHash() == pindex->GetBlockHeader().GetHash()); // Perhaps too slow
         // End: actual consistency checks.
@@ -4218,6 +5054,7 @@ void static CheckBlockIndex()
             // If pindex was the first with a certain property, unset the corresponding variable.
             if (pindex == pindexFirstInvalid) pindexFirstInvalid = NULL;
             if (pindex == pindexFirstMissing) pindexFirstMissing = NULL;
+            if (pindex == pindexFirstNeverProcessed) pindexFirstNeverProcessed = NULL;
             if (pindex == pindexFirstNotTreeValid) pindexFirstNotTreeValid = NULL;
             if (pindex == pindexFirstNotChainValid) pindexFirstNotChainValid = NULL;
             if (pindex == pindexFirstNotScriptsValid) pindexFirstNotScriptsValid = NULL;
@@ -4567,7 +5404,7 @@ void static ProcessGetData(CNode* pfrom)
             }
 
             // Track requests for our stuff.
-            g_signals.Inventory(inv.hash);
+            GetMainSignals().Inventory(inv.hash);
 
             if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
                 break;
@@ -4830,7 +5667,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             }
 
             // Track requests for our stuff
-            g_signals.Inventory(inv.hash);
+            GetMainSignals().Inventory(inv.hash);
 
             if (pfrom->nSendSize > (SendBufferSize() * 2)) {
                 Misbehaving(pfrom->GetId(), 50);
@@ -4882,6 +5719,13 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 LogPrint("net", "  getblocks stopping at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
                 break;
             }
+            // If pruning, don't inv blocks unless we have on disk and are likely to still have
+            // for some reasonable time window (1 hour) that block relay might require.
+            const int nPrunedBlocksLikelyToHave = MIN_BLOCKS_TO_KEEP - 3600 / Params().TargetSpacing();
+            if (fPruneMode && (!(pindex->nStatus & BLOCK_HAVE_DATA) || pindex->nHeight <= chainActive.Tip()->nHeight - nPrunedBlocksLikelyToHave)) {
+                LogPrint("net", " getblocks stopping, pruned or too old block at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+                break;
+            }
             pfrom->PushInventory(CInv(MSG_BLOCK, pindex->GetBlockHash()));
             if (--nLimit <= 0) {
                 // When this block is requested, we'll send an inv that'll make them
@@ -5613,7 +6457,7 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         // Except during reindex, importing and IBD, when old wallet
         // transactions become unconfirmed and spams other nodes.
         if (!fReindex /*&& !fImporting && !IsInitialBlockDownload()*/) {
-            g_signals.Broadcast();
+            GetMainSignals().Broadcast();
         }
 
         //
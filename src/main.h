@@ -44,8 +44,14 @@
 
 #include <boost/unordered_map.hpp>
 
+namespace boost
+{
+class thread_group;
+} // namespace boost
+
 class CBlockIndex;
 class CBlockTreeDB;
+class CCoinsViewDB;
 class CSporkDB;
 class CBloomFilter;
 class CInv;
@@ -53,8 +59,13 @@ class CScriptCheck;
 class CValidationInterface;
 class CValidationState;
 
+struct CAddressIndexKey;
+struct CAddressUnspentKey;
+struct CAddressUnspentValue;
 struct CBlockTemplate;
 struct CNodeStateStats;
+struct CSpentIndexKey;
+struct CSpentIndexValue;
 
 /** Default for -blockmaxsize and -blockminsize, which control the range of sizes the mining code will create **/
 static const unsigned int DEFAULT_BLOCK_MAX_SIZE = 750000;
@@ -73,6 +84,18 @@ static const unsigned int MAX_P2SH_SIGOPS = 15;
 static const unsigned int MAX_TX_SIGOPS = MAX_BLOCK_SIGOPS / 5;
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/** Default for -maxmempool, maximum megabytes of mempool memory usage */
+static const unsigned int DEFAULT_MAX_MEMPOOL_SIZE = 300;
+/** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
+static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 72;
+/** Default for -limitancestorcount, max number of in-mempool ancestors */
+static const unsigned int DEFAULT_ANCESTOR_LIMIT = 25;
+/** Default for -persistmempool, save the mempool on shutdown and load it on restart */
+static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -addressindex, index the history and unspent outputs of every address */
+static const bool DEFAULT_ADDRESSINDEX = false;
+/** Default for -spentindex, index the input spending every output */
+static const bool DEFAULT_SPENTINDEX = false;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
@@ -87,6 +110,12 @@ static const unsigned int LOCKTIME_THRESHOLD = 500000000; // Tue Nov  5 00:53:20
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Maximum number of block-checking threads of the startup block verification */
+static const int MAX_VERIFY_THREADS = 16;
+/** -checkthreads default (number of block-checking threads, 0 = auto) */
+static const int DEFAULT_VERIFY_THREADS = 0;
+/** Default for -checkbackground, continue the startup block verification after init */
+static const bool DEFAULT_VERIFY_BACKGROUND = false;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -101,6 +130,14 @@ static const unsigned int MAX_HEADERS_RESULTS = 2000;
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
 /** Time to wait (in seconds) between writing blockchain state to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 3600;
+/** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned
+ *  (nor within the maximum reorganization depth, should that ever be larger). */
+static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
+/** Require that user allocate at least 550MB for block & undo files (blk???.dat and rev???.dat).
+ *  Since we prune in full block file chunks, the high water mark which triggers the prune is
+ *  one 128MB block file plus its undo data above what the kept blocks need, which for blocks
+ *  of the sizes seen in practice leaves a target above 550MB likely to be respected. */
+static const uint64_t MIN_DISK_SPACE_FOR_BLOCK_FILES = 550 * 1024 * 1024;
 /** Maximum length of reject messages. */
 static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 
@@ -136,8 +173,17 @@ extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+extern bool fAddressIndex;
+extern bool fSpentIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
+/** Pruning-related variables and constants */
+/** True if any block files have ever been pruned. */
+extern bool fHavePruned;
+/** True if we're running in -prune mode. */
+extern bool fPruneMode;
+/** Number of bytes of block and undo files that we're trying to stay below. */
+extern uint64_t nPruneTarget;
 extern unsigned int nCoinCacheSize;
 extern CFeeRate minRelayTxFee;
 extern bool fAlerts;
@@ -160,15 +206,6 @@ extern CBlockIndex* pindexBestHeader;
 /** Minimum disk space required - used in CheckDiskSpace() */
 static const uint64_t nMinDiskSpace = 52428800;
 
-/** Register a wallet to receive updates from core */
-void RegisterValidationInterface(CValidationInterface* pwalletIn);
-/** Unregister a wallet from core */
-void UnregisterValidationInterface(CValidationInterface* pwalletIn);
-/** Unregister all wallets from core */
-void UnregisterAllValidationInterfaces();
-/** Push an updated transaction to all registered wallets */
-void SyncWithWallets(const CTransaction& tx, const CBlock* pblock = NULL);
-
 /** Register with a network node to receive its signals */
 void RegisterNodeSignals(CNodeSignals& nodeSignals);
 /** Unregister a network node */
@@ -226,6 +263,16 @@ bool IsInitialBlockDownload();
 std::string GetWarnings(std::string strFor);
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256& hash, CTransaction& tx, uint256& hashBlock, bool fAllowSlow = false);
+/** Map a scriptPubKey to its address index type and hash, ADDRESS_INDEX_NONE if it has no address */
+int GetAddressIndexType(const CScript& scriptPubKey, uint160& hashBytes);
+/** Look up the history of an address (-addressindex), optionally limited to a range of heights */
+bool GetAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int start = 0, int end = 0);
+/** Look up the unspent outputs of an address (-addressindex) */
+bool GetAddressUnspent(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs);
+/** Look up the input spending an output (-spentindex) */
+bool GetSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value);
+/** Find the block of an unspent output's transaction through the UTXO set, which works without -txindex and after pruning */
+bool GetUTXOBlockHash(const COutPoint& outpoint, uint256& hashBlock);
 /** Find the best known block, and make it the tip of the block chain */
 
 bool DisconnectBlocksAndReprocess(int blocks);
@@ -248,10 +295,26 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats);
 void Misbehaving(NodeId nodeid, int howmuch);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/** Prune block files and flush state to disk. */
+void PruneAndFlush();
+/** Calculate the amount of disk space the block & undo files currently use */
+uint64_t CalculateCurrentUsage();
+/** Mark one block file as pruned: its blocks lose their data and undo positions */
+void PruneOneBlockFile(const int fileNumber);
+/** Actually unlink the specified files */
+void UnlinkPrunedFiles(std::set<int>& setFilesToPrune);
 
 
 /** (try to) add transaction to memory pool **/
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee = false, bool ignoreFees = false);
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee = false, bool ignoreFees = false, int64_t nAcceptTime = 0);
+
+/** Expire transactions older than -mempoolexpiry and trim the mempool to -maxmempool, telling the wallets what was dropped */
+void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age);
+
+/** Re-accept the transactions saved in mempool.dat, with their original entry time and fee deltas */
+bool LoadMempool();
+/** Write the mempool and all prioritisetransaction deltas to mempool.dat */
+bool DumpMempool();
 
 bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee = false);
 
@@ -340,7 +403,7 @@ unsigned int GetP2SHSigOpCount(const CTransaction& tx, const CCoinsViewCache& ma
  * This does not modify the UTXO set. If pvChecks is not NULL, script checks are pushed onto it
  * instead of being performed inline.
  */
-bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks = NULL);
+bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks = NULL, const PrecomputedTransactionData* txdata = NULL);
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCache& inputs, CTxUndo& txundo, int nHeight);
@@ -396,11 +459,12 @@ private:
     unsigned int nFlags;
     bool cacheStore;
     ScriptError error;
+    const PrecomputedTransactionData* txdata;
 
 public:
-    CScriptCheck() : ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
-    CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn) : scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey),
-                                                                                                                                ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
+    CScriptCheck() : ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(NULL) {}
+    CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, const PrecomputedTransactionData* txdataIn = NULL) : scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey),
+                                                                                                                                ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) {}
 
     bool operator()();
 
@@ -412,6 +476,7 @@ public:
         std::swap(nFlags, check.nFlags);
         std::swap(cacheStore, check.cacheStore);
         std::swap(error, check.error);
+        std::swap(txdata, check.txdata);
     }
 
     ScriptError GetScriptError() const { return error; }
@@ -422,6 +487,8 @@ public:
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+/** Read the serialized bytes of a block, as stored, decoding only the header to check it is the block with this hash */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CDiskBlockPos& pos, const uint256& hash);
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -429,8 +496,9 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  In case pfClean is provided, operation will try to be tolerant about errors, and *pfClean
  *  will be true if no problems were found. Otherwise, the return value will be false in case
- *  of problems. Note that in any case, coins may be modified. */
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL);
+ *  of problems. Note that in any case, coins may be modified. With fJustCheck the address
+ *  and spent indexes are left untouched. */
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL, bool fJustCheck = false);
 
 /** Reprocess a number of blocks to try and get on the correct chain again **/
 bool DisconnectBlocksAndReprocess(int blocks);
@@ -440,7 +508,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
 /** Context-independent validity checks */
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW = true);
-bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSig = true);
+/** fCheckNetworkState: also check the block against the swiftTX locks and masternode payees we know of now, which needs cs_main */
+bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSig = true, bool fCheckNetworkState = true);
 bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev);
 
 /** Context-dependent validity checks */
@@ -586,15 +655,81 @@ public:
     std::string GetRejectReason() const { return strRejectReason; }
 };
 
+/** Blocks a background block verification has yet to check, kept in the block tree across restarts */
+class CVerifyState
+{
+public:
+    int nCheckLevel;
+    //! the highest height of the verification, everything below it down to the last range is checked
+    int nHeightTop;
+    //! heights left to check, each range from first down to second
+    std::vector<std::pair<int, int> > vRanges;
+    //! the block at vRanges[0].first when saved, to notice a reorganisation
+    uint256 hashNext;
+
+    CVerifyState()
+    {
+        SetNull();
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nCheckLevel);
+        READWRITE(nHeightTop);
+        READWRITE(vRanges);
+        READWRITE(hashNext);
+    }
+
+    void SetNull()
+    {
+        nCheckLevel = 0;
+        nHeightTop = 0;
+        vRanges.clear();
+        hashNext = 0;
+    }
+
+    bool IsNull() const { return vRanges.empty(); }
+    int CountBlocks() const;
+};
+
+/** Progress of the last block verification, as shown by getblockchaininfo */
+struct CVerifyProgress {
+    //! "running", "done", "failed" or "interrupted", empty if there was none
+    std::string strState;
+    bool fBackground;
+    int nCheckLevel;
+    int nBlocksTotal;
+    int nBlocksChecked;
+    //! the last height checked
+    int nHeight;
+
+    CVerifyProgress() : fBackground(false), nCheckLevel(0), nBlocksTotal(0), nBlocksChecked(0), nHeight(0) {}
+};
+
 /** RAII wrapper for VerifyDB: Verify consistency of the block and coin databases */
 class CVerifyDB
 {
 public:
     CVerifyDB();
     ~CVerifyDB();
-    bool VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth);
+    /**
+     * Check the last nCheckDepth blocks of the active chain. Reading blocks,
+     * CheckBlock and reading undo data (levels 0-2) run ahead on -checkthreads
+     * threads, disconnecting (level 3) and reconnecting (level 4) on this one.
+     * With pBackground, stop where level 3 does and leave the rest of the
+     * blocks in it for StartBackgroundVerify.
+     */
+    bool VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth, CVerifyState* pBackground = NULL);
 };
 
+/** Check the blocks of state at levels 0-2 on a thread of threadGroup, together with those an interrupted background verification left */
+void StartBackgroundVerify(boost::thread_group& threadGroup, CVerifyState state);
+/** Progress of the last block verification */
+CVerifyProgress GetVerifyProgress();
+
 /** Find the last common block between the parameter chain and a locator. */
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator);
 
@@ -610,6 +745,9 @@ extern CChain chainActive;
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache* pcoinsTip;
 
+/** Global variable that points to the coin database under pcoinsTip (protected by cs_main) */
+extern CCoinsViewDB* pcoinsdbview;
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB* pblocktree;
 
@@ -1353,7 +1353,11 @@ bool CBudgetManager::UpdateProposal(CBudgetVote& vote, CNode* pfrom, std::string
     }
 
 
-    return mapProposals[vote.nProposalHash].AddOrUpdateVote(vote, strError);
+    if (!mapProposals[vote.nProposalHash].AddOrUpdateVote(vote, strError))
+        return false;
+
+    GetMainSignals().NotifyBudgetVote(vote);
+    return true;
 }
 
 bool CBudgetManager::UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pfrom, std::string& strError)
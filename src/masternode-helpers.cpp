@@ -13,9 +13,55 @@
 #include "amount.h"
 #include "swifttx.h"
 
+#include <boost/thread/locks.hpp>
+#include <boost/thread/shared_mutex.hpp>
+
 // A helper object for signing messages from Masternodes
 CMasternodeSigner masternodeSigner;
 
+namespace
+{
+/**
+ * Masternode, spork, budget and swifttx messages are relayed and checked
+ * over and over with the same signature. Keep the public key recovered for
+ * each (message hash, signature) pair so each is recovered only once.
+ */
+class CMasternodeKeyCache
+{
+private:
+    //! keyed by Hash(message hash, signature)
+    std::map<uint256, CPubKey> mapKeys;
+    boost::shared_mutex cs_keycache;
+
+public:
+    bool Get(const uint256& entry, CPubKey& pubkey)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_keycache);
+        std::map<uint256, CPubKey>::const_iterator it = mapKeys.find(entry);
+        if (it == mapKeys.end())
+            return false;
+        pubkey = it->second;
+        return true;
+    }
+
+    void Set(const uint256& entry, const CPubKey& pubkey)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_keycache);
+
+        // Evict a random entry once full, like the script signature cache
+        while (mapKeys.size() >= MASTERNODE_KEY_CACHE_SIZE) {
+            std::map<uint256, CPubKey>::iterator it = mapKeys.lower_bound(GetRandHash());
+            if (it == mapKeys.end())
+                it = mapKeys.begin();
+            mapKeys.erase(it);
+        }
+        mapKeys.insert(std::make_pair(entry, pubkey));
+    }
+};
+
+CMasternodeKeyCache masternodeKeyCache;
+} // anon namespace
+
 void ThreadMasternodePool()
 {
     if (fLiteMode) return; //disable all Masternode related functionality
@@ -57,7 +103,7 @@ bool CMasternodeSigner::IsVinAssociatedWithPubkey(CTxIn& vin, CPubKey& pubkey)
 
     CTransaction txVin;
     uint256 hash;
-    if (GetTransaction(vin.prevout.hash, txVin, hash, true)) {
+    if (GetTransaction(vin.prevout.hash, txVin, hash, true) || GetUTXOBlockHash(vin.prevout, hash)) {
         BlockMap::iterator iter = mapBlockIndex.find(hash);
         if (iter != mapBlockIndex.end()) {
             int txnheight = iter->second->nHeight;
@@ -157,10 +203,16 @@ bool CMasternodeSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vch
     ss << strMessageMagic;
     ss << strMessage;
 
+    uint256 hash = ss.GetHash();
+    uint256 entry = Hash(hash.begin(), hash.end(), vchSig.begin(), vchSig.end());
+
     CPubKey pubkey2;
-    if (!pubkey2.RecoverCompact(ss.GetHash(), vchSig)) {
-        errorMessage = _("Error recovering public key.");
-        return false;
+    if (!masternodeKeyCache.Get(entry, pubkey2)) {
+        if (!pubkey2.RecoverCompact(hash, vchSig)) {
+            errorMessage = _("Error recovering public key.");
+            return false;
+        }
+        masternodeKeyCache.Set(entry, pubkey2);
     }
 
     if (fDebug && pubkey2.GetID() != pubkey.GetID())
@@ -12,6 +12,9 @@
 #include "base58.h"
 #include "amount.h"
 
+/** Number of recovered masternode message keys kept by CMasternodeSigner::VerifyMessage */
+static const unsigned int MASTERNODE_KEY_CACHE_SIZE = 20000;
+
 /** Helper object for signing and checking signatures
  */
 class CMasternodeSigner
@@ -15,6 +15,7 @@
 #include "sync.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "validationinterface.h"
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
 
@@ -507,6 +508,7 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
     }
 
     mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1);
+    GetMainSignals().NotifyMasternodeWinner(winnerIn);
 
     return true;
 }
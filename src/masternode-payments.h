@@ -184,7 +184,7 @@ public:
         payee = CScript();
     }
 
-    uint256 GetHash()
+    uint256 GetHash() const
     {
         CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
         ss << payee;
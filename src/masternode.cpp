@@ -221,7 +221,7 @@ void CMasternode::Check(bool forceCheck)
         CAmount collateral = 3500 * COIN;
         CTransaction wtx2;
         uint256 hashBlock2;
-        if(GetTransaction(vin.prevout.hash, wtx2, hashBlock2, true)) {
+        if (GetTransaction(vin.prevout.hash, wtx2, hashBlock2, true) || GetUTXOBlockHash(vin.prevout, hashBlock2)) {
             BlockMap::iterator iter = mapBlockIndex.find(hashBlock2);
             if (iter != mapBlockIndex.end()) {
                 int txnheight = iter->second->nHeight;
@@ -627,7 +627,7 @@ bool CMasternodeBroadcast::CheckInputsAndAdd(int& nDoS)
     CAmount collateral = 3500 * COIN;
     CTransaction wtx2;
     uint256 hashBlock2;
-    if(GetTransaction(vin.prevout.hash, wtx2, hashBlock2, true)) {
+    if (GetTransaction(vin.prevout.hash, wtx2, hashBlock2, true) || GetUTXOBlockHash(vin.prevout, hashBlock2)) {
         BlockMap::iterator iter = mapBlockIndex.find(hashBlock2);
         if (iter != mapBlockIndex.end()) {
             int txnheight = iter->second->nHeight;
@@ -703,7 +703,8 @@ bool CMasternodeBroadcast::CheckInputsAndAdd(int& nDoS)
     // should be at least not earlier than block when 1000 BSA tx got MASTERNODE_MIN_CONFIRMATIONS
     uint256 hashBlock = 0;
     CTransaction tx2;
-    GetTransaction(vin.prevout.hash, tx2, hashBlock, true);
+    if (!GetTransaction(vin.prevout.hash, tx2, hashBlock, true))
+        GetUTXOBlockHash(vin.prevout, hashBlock);
     BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
     if (mi != mapBlockIndex.end() && (*mi).second) {
         CBlockIndex* pMNIndex = (*mi).second;                                                        // block for 1000 PIVX tx -> 1 confirmation
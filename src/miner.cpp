@@ -40,28 +40,17 @@ using namespace std;
 // transactions in the memory pool. When we select transactions from the
 // pool, we select by highest priority or fee rate, so we might consider
 // transactions that depend on transactions that aren't yet in the block.
-// The COrphan class keeps track of these 'temporary orphans' while
-// CreateBlock is figuring out which transactions to include.
+// The mempool keeps track of every entry's in-pool parents and keeps all
+// entries sorted by fee rate, so CreateNewBlock walks that index directly
+// and only parks a transaction until its parents have been added.
 //
-class COrphan
-{
-public:
-    const CTransaction* ptx;
-    set<uint256> setDependsOn;
-    CFeeRate feeRate;
-    double dPriority;
-
-    COrphan(const CTransaction* ptxIn) : ptx(ptxIn), feeRate(0), dPriority(0)
-    {
-    }
-};
 
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 int64_t nLastCoinStakeSearchInterval = 0;
 
 // We want to sort transactions by priority and fee rate, so:
-typedef boost::tuple<double, CFeeRate, const CTransaction*> TxPriority;
+typedef boost::tuple<double, CFeeRate, const CTxMemPoolEntry*> TxPriority;
 class TxPriorityCompare
 {
     bool byFee;
@@ -69,7 +58,7 @@ class TxPriorityCompare
 public:
     TxPriorityCompare(bool _byFee) : byFee(_byFee) {}
 
-    bool operator()(const TxPriority& a, const TxPriority& b)
+    bool operator()(const TxPriority& a, const TxPriority& b) const
     {
         if (byFee) {
             if (a.get<1>() == b.get<1>())
@@ -175,100 +164,83 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
         const int nHeight = pindexPrev->nHeight + 1;
         CCoinsViewCache view(pcoinsTip);
 
-        // Priority order to process transactions
-        list<COrphan> vOrphan; // list memory doesn't move
-        map<uint256, vector<COrphan*> > mapDependers;
+        // Transactions waiting for an in-pool parent to be added to the block
+        map<uint256, set<const CTxMemPoolEntry*> > mapDependers;
+        set<uint256> setInBlock;
         bool fPrintPriority = GetBoolArg("-printpriority", false);
 
-        // This vector will be sorted into a priority queue:
-        vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool.mapTx.size());
-        for (map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin();
-             mi != mempool.mapTx.end(); ++mi) {
-            const CTransaction& tx = mi->second.GetTx();
-            if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight))
-                continue;
-
-            COrphan* porphan = NULL;
-            double dPriority = 0;
-            CAmount nTotalIn = 0;
-            bool fMissingInputs = false;
-            for (const CTxIn& txin : tx.vin) {
-                // Read prev transaction
-                if (!view.HaveCoins(txin.prevout.hash)) {
-                    // This should never happen; all transactions in the memory
-                    // pool should connect to either transactions in the chain
-                    // or other transactions in the memory pool.
-                    if (!mempool.mapTx.count(txin.prevout.hash)) {
-                        LogPrintf("ERROR: mempool transaction missing input\n");
-                        if (fDebug) assert("mempool transaction missing input" == 0);
-                        fMissingInputs = true;
-                        if (porphan)
-                            vOrphan.pop_back();
-                        break;
-                    }
-
-                    // Has to wait for dependencies
-                    if (!porphan) {
-                        // Use list for automatic deletion
-                        vOrphan.push_back(COrphan(&tx));
-                        porphan = &vOrphan.back();
-                    }
-                    mapDependers[txin.prevout.hash].push_back(porphan);
-                    porphan->setDependsOn.insert(txin.prevout.hash);
-                    nTotalIn += mempool.mapTx[txin.prevout.hash].GetTx().vout[txin.prevout.n].nValue;
-                    continue;
-                }
-                const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-                assert(coins);
-
-                CAmount nValueIn = coins->vout[txin.prevout.n].nValue;
-                nTotalIn += nValueIn;
-
-                int nConf = nHeight - coins->nHeight;
-
-                dPriority += (double)nValueIn * nConf;
-            }
-            if (fMissingInputs) continue;
-
-            // Priority is sum(valuein * age) / modified_txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            dPriority = tx.ComputePriority(dPriority, nTxSize);
-
-            uint256 hash = tx.GetHash();
-            mempool.ApplyDeltas(hash, dPriority, nTotalIn);
-
-            CFeeRate feeRate(nTotalIn - tx.GetValueOut(), nTxSize);
-
-            if (porphan) {
-                porphan->dPriority = dPriority;
-                porphan->feeRate = feeRate;
-            } else
-                vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->second.GetTx()));
-        }
-
         // Collect transactions into block
         uint64_t nBlockSize = 1000;
         uint64_t nBlockTx = 0;
         int nBlockSigOps = 100;
         bool fSortedByFee = (nBlockPrioritySize <= 0);
 
+        // While filling the high-priority area, candidates come from a heap of
+        // priorities computed from the values cached in each entry. Once sorted
+        // by fee, the heap only holds dependents released by their parents and
+        // is merged with a walk of the mempool's fee rate index.
+        vector<TxPriority> vecPriority;
         TxPriorityCompare comparer(fSortedByFee);
-        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+        if (!fSortedByFee) {
+            vecPriority.reserve(mempool.mapTx.size());
+            for (CTxMemPool::indexed_transaction_set::const_iterator mi = mempool.mapTx.begin();
+                 mi != mempool.mapTx.end(); ++mi) {
+                const CTxMemPoolEntry& entry = *mi;
+                vecPriority.push_back(TxPriority(entry.GetModifiedPriority(nHeight), entry.GetModifiedFeeRate(), &entry));
+            }
+            std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+        }
+        typedef CTxMemPool::indexed_transaction_set::index<mining_score>::type::const_iterator feerate_iter;
+        const CTxMemPool::indexed_transaction_set::index<mining_score>::type& mapTxByFeeRate = mempool.mapTx.get<mining_score>();
+        feerate_iter itFeeRate = mapTxByFeeRate.begin();
 
         vector<CBigNum> vBlockSerials;
         vector<CBigNum> vTxSerials;
-        while (!vecPriority.empty()) {
-            // Take highest priority transaction off the priority queue:
-            double dPriority = vecPriority.front().get<0>();
-            CFeeRate feeRate = vecPriority.front().get<1>();
-            const CTransaction& tx = *(vecPriority.front().get<2>());
+        while (true) {
+            // Take highest priority transaction off the priority queue, or the
+            // better of the released dependents and the fee rate index:
+            const CTxMemPoolEntry* pentry = NULL;
+            bool fFromHeap = !fSortedByFee;
+            if (fSortedByFee && !vecPriority.empty()) {
+                fFromHeap = (itFeeRate == mapTxByFeeRate.end() ||
+                             comparer(TxPriority(0, itFeeRate->GetModifiedFeeRate(), &(*itFeeRate)), vecPriority.front()));
+            }
+            if (fFromHeap) {
+                if (vecPriority.empty())
+                    break;
+                pentry = vecPriority.front().get<2>();
+                std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
+                vecPriority.pop_back();
+            } else {
+                if (itFeeRate == mapTxByFeeRate.end())
+                    break;
+                pentry = &(*itFeeRate++);
+            }
 
-            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            vecPriority.pop_back();
+            const CTransaction& tx = pentry->GetTx();
+            const uint256& hash = tx.GetHash();
+            if (setInBlock.count(hash))
+                continue;
+            if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight))
+                continue;
+
+            // Has to wait for dependencies
+            bool fWaiting = false;
+            BOOST_FOREACH (const uint256& hashParent, pentry->GetMemPoolParents()) {
+                if (!setInBlock.count(hashParent)) {
+                    mapDependers[hashParent].insert(pentry);
+                    fWaiting = true;
+                    break;
+                }
+            }
+            if (fWaiting)
+                continue;
+
+            double dPriority = pentry->GetModifiedPriority(nHeight);
+            CFeeRate feeRate = pentry->GetModifiedFeeRate();
 
             // Size limits
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+            unsigned int nTxSize = pentry->GetTxSize();
             if (nBlockSize + nTxSize >= nBlockMaxSize)
                 continue;
 
@@ -279,20 +251,17 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
                 continue;
 
             // Skip free transactions if we're past the minimum block size:
-            const uint256& hash = tx.GetHash();
-            double dPriorityDelta = 0;
-            CAmount nFeeDelta = 0;
-            mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
-            if (fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
+            if (fSortedByFee && (pentry->GetPriorityDelta() <= 0) && (pentry->GetFeeDelta() <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
                 continue;
 
             // Prioritise by fee once past the priority size or we run out of high-priority
-            // transactions:
+            // transactions. Everything left in the priority heap is also in the
+            // fee rate index, which is walked from here on.
             if (!fSortedByFee &&
                 ((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority))) {
                 fSortedByFee = true;
                 comparer = TxPriorityCompare(fSortedByFee);
-                std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+                vecPriority.clear();
             }
 
             if (!view.HaveInputs(tx))
@@ -316,6 +285,7 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
 
             // Added
             pblock->vtx.push_back(tx);
+            setInBlock.insert(hash);
             pblocktemplate->vTxFees.push_back(nTxFees);
             pblocktemplate->vTxSigOps.push_back(nTxSigOps);
             nBlockSize += nTxSize;
@@ -331,17 +301,15 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
                     dPriority, feeRate.ToString(), tx.GetHash().ToString());
             }
 
-            // Add transactions that depend on this one to the priority queue
-            if (mapDependers.count(hash)) {
-                BOOST_FOREACH (COrphan* porphan, mapDependers[hash]) {
-                    if (!porphan->setDependsOn.empty()) {
-                        porphan->setDependsOn.erase(hash);
-                        if (porphan->setDependsOn.empty()) {
-                            vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-                        }
-                    }
+            // Add transactions that depend on this one to the priority queue;
+            // any that still wait on another parent are parked again there
+            map<uint256, set<const CTxMemPoolEntry*> >::iterator itDep = mapDependers.find(hash);
+            if (itDep != mapDependers.end()) {
+                BOOST_FOREACH (const CTxMemPoolEntry* pdep, itDep->second) {
+                    vecPriority.push_back(TxPriority(pdep->GetModifiedPriority(nHeight), pdep->GetModifiedFeeRate(), pdep));
+                    std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
                 }
+                mapDependers.erase(itDep);
             }
         }
 
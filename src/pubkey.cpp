@@ -2,6 +2,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include "config/basex-config.h"
+#endif
+
 #include "pubkey.h"
 
 #include "eccryptoverify.h"
@@ -12,12 +16,163 @@
 #include "ecwrapper.h"
 #endif
 
+#ifdef USE_SECP256K1
+//! anonymous namespace
+namespace
+{
+/**
+ * Verification uses the precomputed multiples of G held by libsecp256k1.
+ * Build them once at startup and keep them for the lifetime of the process,
+ * so that no verification pays for them. This is the only owner of the
+ * library: the signing tables key.cpp needs are built here too.
+ */
+class CSecp256k1Init
+{
+public:
+    CSecp256k1Init()
+    {
+        secp256k1_start(SECP256K1_START_VERIFY | SECP256K1_START_SIGN);
+    }
+    ~CSecp256k1Init()
+    {
+        secp256k1_stop();
+    }
+};
+static CSecp256k1Init instance_of_csecp256k1;
+
+/**
+ * Parse a DER signature the way OpenSSL's d2i_ECDSA_SIG did for us before:
+ * long-form lengths, excess padding and trailing garbage are tolerated.
+ * On success the R and S values are written as 32 byte big endian numbers
+ * to rs[0..31] and rs[32..63]. Values wider than 32 bytes are not
+ * representable and make the signature invalid (as they would for OpenSSL).
+ */
+bool ParseDERSignatureLax(const unsigned char* input, size_t inputlen, unsigned char rs[64])
+{
+    size_t rpos, rlen, spos, slen;
+    size_t pos = 0;
+    size_t lenbyte;
+
+    memset(rs, 0, 64);
+
+    /* Sequence tag byte */
+    if (pos == inputlen || input[pos] != 0x30)
+        return false;
+    pos++;
+
+    /* Sequence length bytes */
+    if (pos == inputlen)
+        return false;
+    lenbyte = input[pos++];
+    if (lenbyte & 0x80) {
+        lenbyte -= 0x80;
+        if (lenbyte > inputlen - pos)
+            return false;
+        pos += lenbyte;
+    }
+
+    /* Integer tag byte for R */
+    if (pos == inputlen || input[pos] != 0x02)
+        return false;
+    pos++;
+
+    /* Integer length for R */
+    if (pos == inputlen)
+        return false;
+    lenbyte = input[pos++];
+    if (lenbyte & 0x80) {
+        lenbyte -= 0x80;
+        if (lenbyte > inputlen - pos)
+            return false;
+        while (lenbyte > 0 && input[pos] == 0) {
+            pos++;
+            lenbyte--;
+        }
+        if (lenbyte >= sizeof(size_t))
+            return false;
+        rlen = 0;
+        while (lenbyte > 0) {
+            rlen = (rlen << 8) + input[pos];
+            pos++;
+            lenbyte--;
+        }
+    } else {
+        rlen = lenbyte;
+    }
+    if (rlen > inputlen - pos)
+        return false;
+    rpos = pos;
+    pos += rlen;
+
+    /* Integer tag byte for S */
+    if (pos == inputlen || input[pos] != 0x02)
+        return false;
+    pos++;
+
+    /* Integer length for S */
+    if (pos == inputlen)
+        return false;
+    lenbyte = input[pos++];
+    if (lenbyte & 0x80) {
+        lenbyte -= 0x80;
+        if (lenbyte > inputlen - pos)
+            return false;
+        while (lenbyte > 0 && input[pos] == 0) {
+            pos++;
+            lenbyte--;
+        }
+        if (lenbyte >= sizeof(size_t))
+            return false;
+        slen = 0;
+        while (lenbyte > 0) {
+            slen = (slen << 8) + input[pos];
+            pos++;
+            lenbyte--;
+        }
+    } else {
+        slen = lenbyte;
+    }
+    if (slen > inputlen - pos)
+        return false;
+    spos = pos;
+
+    /* Ignore leading zeroes in R and S */
+    while (rlen > 0 && input[rpos] == 0) {
+        rlen--;
+        rpos++;
+    }
+    while (slen > 0 && input[spos] == 0) {
+        slen--;
+        spos++;
+    }
+    if (rlen > 32 || slen > 32)
+        return false;
+    memcpy(rs + 32 - rlen, input + rpos, rlen);
+    memcpy(rs + 64 - slen, input + spos, slen);
+    return true;
+}
+
+} // anon namespace
+#endif
+
 bool CPubKey::Verify(const uint256& hash, const std::vector<unsigned char>& vchSig) const
 {
     if (!IsValid())
         return false;
 #ifdef USE_SECP256K1
-    if (secp256k1_ecdsa_verify((const unsigned char*)&hash, 32, &vchSig[0], vchSig.size(), begin(), size()) != 1)
+    if (vchSig.empty())
+        return false;
+    // Re-encode as strict DER with fixed 33 byte integers, which the bundled
+    // parser accepts for every R and S that fit in 32 bytes.
+    unsigned char rs[64];
+    if (!ParseDERSignatureLax(&vchSig[0], vchSig.size(), rs))
+        return false;
+    unsigned char der[72] = {0x30, 0x46, 0x02, 0x21};
+    memcpy(der + 5, rs, 32);
+    der[37] = 0x02;
+    der[38] = 0x21;
+    memcpy(der + 40, rs + 32, 32);
+    if (secp256k1_ecdsa_verify((const unsigned char*)&hash, 32, der, sizeof(der), begin(), size()) != 1)
         return false;
 #else
     CECKey key;
@@ -56,7 +211,7 @@ bool CPubKey::IsFullyValid() const
     if (!IsValid())
         return false;
 #ifdef USE_SECP256K1
-    if (!secp256k1_ecdsa_pubkey_verify(begin(), size()))
+    if (!secp256k1_ec_pubkey_verify(begin(), size()))
         return false;
 #else
     CECKey key;
@@ -72,7 +227,7 @@ bool CPubKey::Decompress()
         return false;
 #ifdef USE_SECP256K1
     int clen = size();
-    int ret = secp256k1_ecdsa_pubkey_decompress((unsigned char*)begin(), &clen);
+    int ret = secp256k1_ec_pubkey_decompress((unsigned char*)begin(), &clen);
     assert(ret);
     assert(clen == (int)size());
 #else
@@ -96,7 +251,7 @@ bool CPubKey::Derive(CPubKey& pubkeyChild, unsigned char ccChild[32], unsigned i
     memcpy(ccChild, out + 32, 32);
 #ifdef USE_SECP256K1
     pubkeyChild = *this;
-    bool ret = secp256k1_ecdsa_pubkey_tweak_add((unsigned char*)pubkeyChild.begin(), pubkeyChild.size(), out);
+    bool ret = secp256k1_ec_pubkey_tweak_add((unsigned char*)pubkeyChild.begin(), pubkeyChild.size(), out);
 #else
     CECKey key;
     bool ret = key.SetPubKey(begin(), size());
@@ -8,16 +8,21 @@
 #include "base58.h"
 #include "checkpoints.h"
 #include "clientversion.h"
+#include "jsonstream.h"
+#include "leveldbwrapper.h"
 #include "main.h"
 #include "rpcserver.h"
 #include "sync.h"
 #include "txdb.h"
+#include "txoutsnapshot.h"
 #include "util.h"
 #include "utilmoneystr.h"
 
 #include <stdint.h>
 #include <univalue.h>
 
+#include <boost/filesystem.hpp>
+
 using namespace std;
 
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
@@ -90,7 +95,62 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
 }
 
 
-UniValue blockHeaderToJSON(const CBlock& block, const CBlockIndex* blockindex)
+/**
+ * Write the same object as blockToJSON, one transaction at a time. Takes
+ * cs_main to read the chain position of the block; it is not held while the
+ * transactions are written.
+ */
+void blockToJSONStream(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, CJSONStream& out)
+{
+    int confirmations = -1;
+    UniValue prevhash, nexthash;
+    {
+        LOCK(cs_main);
+        // Only report confirmations if the block is on the main chain
+        if (chainActive.Contains(blockindex))
+            confirmations = chainActive.Height() - blockindex->nHeight + 1;
+        if (blockindex->pprev)
+            prevhash = blockindex->pprev->GetBlockHash().GetHex();
+        CBlockIndex* pnext = chainActive.Next(blockindex);
+        if (pnext)
+            nexthash = pnext->GetBlockHash().GetHex();
+    }
+
+    out.BeginObject();
+    out.Pair("hash", block.GetHash().GetHex());
+    out.Pair("confirmations", confirmations);
+    out.Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
+    out.Pair("height", blockindex->nHeight);
+    out.Pair("version", block.nVersion);
+    out.Pair("merkleroot", block.hashMerkleRoot.GetHex());
+    out.Key("tx");
+    out.BeginArray();
+    BOOST_FOREACH (const CTransaction& tx, block.vtx) {
+        if (out.Failed())
+            return;
+        if (txDetails) {
+            UniValue objTx(UniValue::VOBJ);
+            TxToJSON(tx, uint256(0), objTx);
+            out.Value(objTx);
+        } else
+            out.Value(tx.GetHash().GetHex());
+    }
+    out.EndArray();
+    out.Pair("time", block.GetBlockTime());
+    out.Pair("nonce", (uint64_t)block.nNonce);
+    out.Pair("bits", strprintf("%08x", block.nBits));
+    out.Pair("difficulty", GetDifficulty(blockindex));
+    out.Pair("chainwork", blockindex->nChainWork.GetHex());
+
+    if (!prevhash.isNull())
+        out.Pair("previousblockhash", prevhash);
+    if (!nexthash.isNull())
+        out.Pair("nextblockhash", nexthash);
+    out.EndObject();
+}
+
+
+UniValue blockHeaderToJSON(const CBlockHeader& block, const CBlockIndex* blockindex)
 {
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("version", block.nVersion));
@@ -147,6 +207,35 @@ UniValue getdifficulty(const UniValue& params, bool fHelp)
 }
 
 
+/** Verbose getrawmempool entry. Requires mempool.cs. */
+static UniValue MempoolEntryToJSON(const CTxMemPoolEntry& e, int nChainHeight)
+{
+    UniValue info(UniValue::VOBJ);
+    info.push_back(Pair("size", (int)e.GetTxSize()));
+    info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
+    info.push_back(Pair("time", e.GetTime()));
+    info.push_back(Pair("height", (int)e.GetHeight()));
+    info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
+    info.push_back(Pair("currentpriority", e.GetPriority(nChainHeight)));
+    info.push_back(Pair("descendantcount", e.GetCountWithDescendants()));
+    info.push_back(Pair("descendantsize", e.GetSizeWithDescendants()));
+    info.push_back(Pair("descendantfees", ValueFromAmount(e.GetModFeesWithDescendants())));
+    const CTransaction& tx = e.GetTx();
+    set<string> setDepends;
+    BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+        if (mempool.exists(txin.prevout.hash))
+            setDepends.insert(txin.prevout.hash.ToString());
+    }
+
+    UniValue depends(UniValue::VARR);
+    BOOST_FOREACH(const string& dep, setDepends) {
+        depends.push_back(dep);
+    }
+
+    info.push_back(Pair("depends", depends));
+    return info;
+}
+
 UniValue getrawmempool(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() > 1)
@@ -169,6 +258,9 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
             "    \"height\" : n,           (numeric) block height when transaction entered pool\n"
             "    \"startingpriority\" : n, (numeric) priority when transaction entered pool\n"
             "    \"currentpriority\" : n,  (numeric) transaction priority now\n"
+            "    \"descendantcount\" : n,  (numeric) number of in-mempool descendant transactions (including this one)\n"
+            "    \"descendantsize\" : n,   (numeric) size of in-mempool descendants (including this one)\n"
+            "    \"descendantfees\" : n,   (numeric) modified fees (see above) of in-mempool descendants (including this one)\n"
             "    \"depends\" : [           (array) unconfirmed transactions used as inputs for this transaction\n"
             "        \"transactionid\",    (string) parent transaction id\n"
             "       ... ]\n"
@@ -184,30 +276,9 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
     if (fVerbose) {
         LOCK(mempool.cs);
         UniValue o(UniValue::VOBJ);
-        BOOST_FOREACH (const PAIRTYPE(uint256, CTxMemPoolEntry) & entry, mempool.mapTx) {
-            const uint256& hash = entry.first;
-            const CTxMemPoolEntry& e = entry.second;
-            UniValue info(UniValue::VOBJ);
-            info.push_back(Pair("size", (int)e.GetTxSize()));
-            info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
-            info.push_back(Pair("time", e.GetTime()));
-            info.push_back(Pair("height", (int)e.GetHeight()));
-            info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
-            info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
-            const CTransaction& tx = e.GetTx();
-            set<string> setDepends;
-            BOOST_FOREACH (const CTxIn& txin, tx.vin) {
-                if (mempool.exists(txin.prevout.hash))
-                    setDepends.insert(txin.prevout.hash.ToString());
-            }
-
-            UniValue depends(UniValue::VARR);
-            BOOST_FOREACH(const string& dep, setDepends) {
-                depends.push_back(dep);
-            }
-
-            info.push_back(Pair("depends", depends));
-            o.push_back(Pair(hash.ToString(), info));
+        BOOST_FOREACH (const CTxMemPoolEntry& e, mempool.mapTx) {
+            const uint256& hash = e.GetTx().GetHash();
+            o.push_back(Pair(hash.ToString(), MempoolEntryToJSON(e, chainActive.Height())));
         }
         return o;
     } else {
@@ -222,6 +293,51 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
     }
 }
 
+/** Transactions of a verbose getrawmempool described per acquisition of mempool.cs */
+static const unsigned int MEMPOOL_STREAM_BATCH = 1000;
+
+/**
+ * Write the object of a verbose getrawmempool. Transactions that leave the
+ * pool while it is written are left out.
+ */
+void mempoolToJSONStream(CJSONStream& out)
+{
+    int nChainHeight;
+    {
+        LOCK(cs_main);
+        nChainHeight = chainActive.Height();
+    }
+    vector<uint256> vtxid;
+    mempool.queryHashes(vtxid);
+
+    out.BeginObject();
+    for (unsigned int nStart = 0; nStart < vtxid.size() && !out.Failed(); nStart += MEMPOOL_STREAM_BATCH) {
+        unsigned int nEnd = std::min(nStart + MEMPOOL_STREAM_BATCH, (unsigned int)vtxid.size());
+        vector<pair<string, UniValue> > vEntries;
+        vEntries.reserve(nEnd - nStart);
+        {
+            LOCK(mempool.cs);
+            for (unsigned int i = nStart; i < nEnd; i++) {
+                CTxMemPool::txiter it = mempool.mapTx.find(vtxid[i]);
+                if (it != mempool.mapTx.end())
+                    vEntries.push_back(make_pair(vtxid[i].ToString(), MempoolEntryToJSON(*it, nChainHeight)));
+            }
+        }
+        for (unsigned int i = 0; i < vEntries.size(); i++)
+            out.Pair(vEntries[i].first, vEntries[i].second);
+    }
+    out.EndObject();
+}
+
+bool getrawmempool_stream(const UniValue& params, CJSONStream& out)
+{
+    if (params.size() != 1 || !params[0].get_bool())
+        return false;
+
+    mempoolToJSONStream(out);
+    return true;
+}
+
 UniValue getblockhash(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -235,6 +351,8 @@ UniValue getblockhash(const UniValue& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("getblockhash", "1000") + HelpExampleRpc("getblockhash", "1000"));
 
+    LOCK(cs_main);
+
     int nHeight = params[0].get_int();
     if (nHeight < 0 || nHeight > chainActive.Height())
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
@@ -243,6 +361,31 @@ UniValue getblockhash(const UniValue& params, bool fHelp)
     return pblockindex->GetBlockHash().GetHex();
 }
 
+/** Look up and read a block for getblock */
+static CBlockIndex* ReadBlockForRPC(const uint256& hash, CBlock& block)
+{
+    CBlockIndex* pblockindex;
+    CDiskBlockPos pos;
+    {
+        LOCK(cs_main);
+        if (mapBlockIndex.count(hash) == 0)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+        pblockindex = mapBlockIndex[hash];
+
+        if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+        pos = pblockindex->GetBlockPos();
+    }
+
+    // Read the block without holding cs_main, so that calls in a batch don't
+    // wait on each other's disk reads. Should the file have been pruned in the
+    // meantime, the read or the hash check fails.
+    if (!ReadBlockFromDisk(block, pos) || block.GetHash() != hash)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    return pblockindex;
+}
+
 UniValue getblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -285,14 +428,8 @@ UniValue getblock(const UniValue& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
-    if (!ReadBlockFromDisk(block, pblockindex))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    CBlockIndex* pblockindex = ReadBlockForRPC(hash, block);
 
     if (!fVerbose) {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
@@ -301,9 +438,21 @@ UniValue getblock(const UniValue& params, bool fHelp)
         return strHex;
     }
 
+    LOCK(cs_main);
     return blockToJSON(block, pblockindex);
 }
 
+bool getblock_stream(const UniValue& params, CJSONStream& out)
+{
+    if (params.size() < 1 || params.size() > 2 || (params.size() > 1 && !params[1].get_bool()))
+        return false;
+
+    CBlock block;
+    CBlockIndex* pblockindex = ReadBlockForRPC(uint256(params[0].get_str()), block);
+    blockToJSONStream(block, pblockindex, false, out);
+    return true;
+}
+
 UniValue getblockheader(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -338,55 +487,124 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
     if (mapBlockIndex.count(hash) == 0)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-    CBlock block;
     CBlockIndex* pblockindex = mapBlockIndex[hash];
-
-    if (!ReadBlockFromDisk(block, pblockindex))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    CBlockHeader header = pblockindex->GetBlockHeader();
 
     if (!fVerbose) {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-        ssBlock << block.GetBlockHeader();
+        ssBlock << header;
         std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
         return strHex;
     }
 
-    return blockHeaderToJSON(block, pblockindex);
+    return blockHeaderToJSON(header, pblockindex);
 }
 
 UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 1)
         throw runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( summary )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time, unless summary is given: the statistics then come\n"
+            "from a summary kept up to date as blocks are connected and disconnected.\n"
+            "\nArguments:\n"
+            "1. summary      (boolean, optional, default=false) Only return the statistics kept in the summary, without scanning the chain state\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
-            "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"bytes_serialized\": n,  (numeric) The serialized size, not with summary\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash, not with summary\n"
+            "  \"bytes_txouts\": n,      (numeric) The serialized size of the unspent outputs\n"
+            "  \"hash_txouts\": \"hash\",  (string) Order independent hash of the unspent outputs\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n" +
-            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleRpc("gettxoutsetinfo", ""));
+            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleCli("gettxoutsetinfo", "true") + HelpExampleRpc("gettxoutsetinfo", ""));
+
+    bool fSummary = false;
+    if (params.size() > 0)
+        fSummary = params[0].get_bool();
 
     UniValue ret(UniValue::VOBJ);
 
-    CCoinsStats stats;
-    FlushStateToDisk();
-    if (pcoinsTip->GetStats(stats)) {
-        ret.push_back(Pair("height", (int64_t)stats.nHeight));
-        ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
-        ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
-        ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
-        ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
-        ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
-        ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+    if (!fSummary) {
+        CCoinsStats stats;
+        FlushStateToDisk();
+        if (pcoinsTip->GetStats(stats)) {
+            ret.push_back(Pair("height", (int64_t)stats.nHeight));
+            ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
+            ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
+            ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
+            ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
+            ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+            ret.push_back(Pair("bytes_txouts", stats.commitment.nSerializedSize));
+            ret.push_back(Pair("hash_txouts", stats.commitment.hashOutputs.GetHex()));
+            ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+        }
+        return ret;
     }
+
+    LOCK(cs_main);
+    CCoinsCommitment commitment;
+    if (!pcoinsTip->GetCommitment(commitment))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unspent output set summary not available");
+    uint256 hashBlock = pcoinsTip->GetBestBlock();
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+    ret.push_back(Pair("height", mi == mapBlockIndex.end() ? 0 : (int64_t)mi->second->nHeight));
+    ret.push_back(Pair("bestblock", hashBlock.GetHex()));
+    ret.push_back(Pair("transactions", commitment.nTransactions));
+    ret.push_back(Pair("txouts", commitment.nTransactionOutputs));
+    ret.push_back(Pair("bytes_txouts", commitment.nSerializedSize));
+    ret.push_back(Pair("hash_txouts", commitment.hashOutputs.GetHex()));
+    ret.push_back(Pair("total_amount", ValueFromAmount(commitment.nTotalAmount)));
+    return ret;
+}
+
+UniValue dumptxoutset(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrite the unspent transaction output set and the block index at the current tip to a file.\n"
+            "A new node can start from it with -loadtxoutset, once it accepts the snapshot_hash\n"
+            "through -assumeutxo=<bestblock>:<snapshot_hash>.\n"
+            "The node keeps connecting blocks while the file is written.\n"
+            "\nArguments:\n"
+            "1. \"path\"    (string, required) The file to write, relative to the data directory if not absolute\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"path\": \"path\",            (string) the file written\n"
+            "  \"height\": n,               (numeric) the height of the snapshot block\n"
+            "  \"bestblock\": \"hash\",       (string) the hash of the snapshot block\n"
+            "  \"transactions\": n,         (numeric) the number of transactions with unspent outputs\n"
+            "  \"txouts\": n,               (numeric) the number of unspent outputs\n"
+            "  \"snapshot_hash\": \"hash\"    (string) the hash -assumeutxo accepts the snapshot by\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("dumptxoutset", "\"utxo.dat\"") + HelpExampleRpc("dumptxoutset", "\"utxo.dat\""));
+
+    boost::filesystem::path path(params[0].get_str());
+    if (!path.is_complete())
+        path = GetDataDir() / path;
+    if (boost::filesystem::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+
+    CTxOutSnapshotHeader header;
+    std::string strError;
+    if (!DumpTxOutSnapshot(path.string(), header, strError))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, strError);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("path", path.string()));
+    ret.push_back(Pair("height", header.nHeight));
+    ret.push_back(Pair("bestblock", header.hashBlock.GetHex()));
+    ret.push_back(Pair("transactions", header.commitment.nTransactions));
+    ret.push_back(Pair("txouts", header.commitment.nTransactionOutputs));
+    ret.push_back(Pair("snapshot_hash", header.GetSnapshotHash().GetHex()));
     return ret;
 }
 
@@ -434,6 +652,8 @@ UniValue gettxout(const UniValue& params, bool fHelp)
     if (params.size() > 2)
         fMempool = params[2].get_bool();
 
+    LOCK(cs_main);
+
     CCoins coins;
     if (fMempool) {
         LOCK(mempool.cs);
@@ -489,6 +709,149 @@ UniValue verifychain(const UniValue& params, bool fHelp)
     return CVerifyDB().VerifyDB(pcoinsTip, nCheckLevel, nCheckDepth);
 }
 
+static UniValue LevelDBStatsToJSON(const CLevelDBStats& stats)
+{
+    UniValue profile(UniValue::VOBJ);
+    profile.push_back(Pair("blockcache", (uint64_t)stats.profile.nBlockCacheSize));
+    profile.push_back(Pair("writebuffer", (uint64_t)stats.profile.nWriteBufferSize));
+    profile.push_back(Pair("maxopenfiles", stats.profile.nMaxOpenFiles));
+    profile.push_back(Pair("bloombits", stats.profile.nBloomBits));
+
+    UniValue cache(UniValue::VOBJ);
+    cache.push_back(Pair("hits", stats.nCacheHits));
+    cache.push_back(Pair("misses", stats.nCacheMisses));
+    uint64_t nLookups = stats.nCacheHits + stats.nCacheMisses;
+    cache.push_back(Pair("hitrate", nLookups ? (double)stats.nCacheHits / nLookups : 0.0));
+
+    UniValue levels(UniValue::VARR);
+    int nFiles = 0;
+    uint64_t nBytes = 0;
+    BOOST_FOREACH (const CLevelDBLevelStats& level, stats.vLevels) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("level", level.nLevel));
+        entry.push_back(Pair("files", level.nFiles));
+        entry.push_back(Pair("bytes", level.nBytes));
+        entry.push_back(Pair("compaction_seconds", level.dCompactionTime));
+        entry.push_back(Pair("compaction_read_mb", level.dCompactionRead));
+        entry.push_back(Pair("compaction_write_mb", level.dCompactionWrite));
+        levels.push_back(entry);
+        nFiles += level.nFiles;
+        nBytes += level.nBytes;
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("name", stats.strName));
+    ret.push_back(Pair("path", stats.strPath));
+    ret.push_back(Pair("files", nFiles));
+    ret.push_back(Pair("bytes", nBytes));
+    ret.push_back(Pair("profile", profile));
+    ret.push_back(Pair("cache", cache));
+    ret.push_back(Pair("levels", levels));
+    return ret;
+}
+
+UniValue getleveldbstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getleveldbstats ( \"name\" )\n"
+            "\nReturns the settings, block cache counters and level sizes of the LevelDB databases.\n"
+            "\nArguments:\n"
+            "1. \"name\"    (string, optional) Only the database with this name: blocktree, chainstate or sporks\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"name\": \"name\",           (string) the name the -db* options know the database by\n"
+            "    \"path\": \"path\",           (string) the database directory\n"
+            "    \"files\": n,               (numeric) the number of table files\n"
+            "    \"bytes\": n,               (numeric) the size of the table files\n"
+            "    \"profile\": {              (json object) the settings the database was opened with\n"
+            "      \"blockcache\": n,        (numeric) block cache size in bytes\n"
+            "      \"writebuffer\": n,       (numeric) write buffer size in bytes\n"
+            "      \"maxopenfiles\": n,      (numeric) table files kept open\n"
+            "      \"bloombits\": n,         (numeric) bloom filter bits per key\n"
+            "    },\n"
+            "    \"cache\": {                (json object) block cache lookups since startup\n"
+            "      \"hits\": n,\n"
+            "      \"misses\": n,\n"
+            "      \"hitrate\": x.xxx        (numeric) hits divided by lookups\n"
+            "    },\n"
+            "    \"levels\": [               (array) the levels holding tables or compacted into\n"
+            "      {\n"
+            "        \"level\": n,\n"
+            "        \"files\": n,\n"
+            "        \"bytes\": n,\n"
+            "        \"compaction_seconds\": x.xxx,   (numeric) time spent compacting into the level\n"
+            "        \"compaction_read_mb\": x.xxx,   (numeric) megabytes read by those compactions\n"
+            "        \"compaction_write_mb\": x.xxx   (numeric) megabytes written by those compactions\n"
+            "      }, ...\n"
+            "    ]\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getleveldbstats", "") + HelpExampleCli("getleveldbstats", "\"chainstate\"") + HelpExampleRpc("getleveldbstats", ""));
+
+    std::string strName;
+    if (params.size() > 0)
+        strName = params[0].get_str();
+
+    UniValue ret(UniValue::VARR);
+    std::vector<CLevelDBStats> vStats = GetLevelDBStats();
+    BOOST_FOREACH (const CLevelDBStats& stats, vStats) {
+        if (strName.empty() || stats.strName == strName)
+            ret.push_back(LevelDBStatsToJSON(stats));
+    }
+    if (!strName.empty() && ret.empty())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown database " + strName);
+    return ret;
+}
+
+static uint64_t LevelDBBytes(const std::string& strName)
+{
+    uint64_t nBytes = 0;
+    std::vector<CLevelDBStats> vStats = GetLevelDBStats();
+    BOOST_FOREACH (const CLevelDBStats& stats, vStats) {
+        if (stats.strName == strName) {
+            BOOST_FOREACH (const CLevelDBLevelStats& level, stats.vLevels)
+                nBytes += level.nBytes;
+        }
+    }
+    return nBytes;
+}
+
+static CCriticalSection cs_compactchainstate;
+
+UniValue compactchainstate(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "compactchainstate\n"
+            "\nFlushes the coins cache and compacts the chain state database.\n"
+            "Blocks keep being connected while it runs; this may take a while.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"bytes_before\": n,   (numeric) size of the table files before\n"
+            "  \"bytes_after\": n,    (numeric) size of the table files after\n"
+            "  \"seconds\": x.xxx     (numeric) time taken by the compaction\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("compactchainstate", "") + HelpExampleRpc("compactchainstate", ""));
+
+    TRY_LOCK(cs_compactchainstate, lockCompact);
+    if (!lockCompact)
+        throw JSONRPCError(RPC_MISC_ERROR, "The chain state is already being compacted");
+
+    FlushStateToDisk();
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("bytes_before", LevelDBBytes("chainstate")));
+    int64_t nStart = GetTimeMillis();
+    pcoinsdbview->Compact();
+    ret.push_back(Pair("bytes_after", LevelDBBytes("chainstate")));
+    ret.push_back(Pair("seconds", (GetTimeMillis() - nStart) * 0.001));
+    return ret;
+}
+
 UniValue getblockchaininfo(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -504,6 +867,17 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             "  \"difficulty\": xxxxxx,     (numeric) the current difficulty\n"
             "  \"verificationprogress\": xxxx, (numeric) estimate of verification progress [0..1]\n"
             "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
+            "  \"pruned\": xx,             (boolean) if the blocks are subject to pruning\n"
+            "  \"pruneheight\": xxxxxx,    (numeric) lowest-height complete block stored, only present if pruning is enabled\n"
+            "  \"blockverification\": {   (json object) the last check of stored blocks, by -checkblocks or verifychain (not while the background check runs), only present after one\n"
+            "    \"state\": \"xxxx\",       (string) running, done, failed or interrupted\n"
+            "    \"background\": xx,       (boolean) if this is the part continued after startup with -checkbackground\n"
+            "    \"level\": n,             (numeric) the check level\n"
+            "    \"checked\": n,           (numeric) the blocks checked so far\n"
+            "    \"total\": n,             (numeric) the blocks to check\n"
+            "    \"height\": n,            (numeric) the height of the last block checked\n"
+            "    \"progress\": x.xxx       (numeric) the part of the blocks checked [0..1]\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getblockchaininfo", "") + HelpExampleRpc("getblockchaininfo", ""));
@@ -516,6 +890,26 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("difficulty", (double)GetDifficulty()));
     obj.push_back(Pair("verificationprogress", Checkpoints::GuessVerificationProgress(chainActive.Tip())));
     obj.push_back(Pair("chainwork", chainActive.Tip()->nChainWork.GetHex()));
+    obj.push_back(Pair("pruned", fPruneMode));
+    if (fPruneMode) {
+        CBlockIndex* block = chainActive.Tip();
+        while (block && block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA))
+            block = block->pprev;
+
+        obj.push_back(Pair("pruneheight", block->nHeight));
+    }
+    CVerifyProgress progress = GetVerifyProgress();
+    if (!progress.strState.empty()) {
+        UniValue verification(UniValue::VOBJ);
+        verification.push_back(Pair("state", progress.strState));
+        verification.push_back(Pair("background", progress.fBackground));
+        verification.push_back(Pair("level", progress.nCheckLevel));
+        verification.push_back(Pair("checked", progress.nBlocksChecked));
+        verification.push_back(Pair("total", progress.nBlocksTotal));
+        verification.push_back(Pair("height", progress.nHeight));
+        verification.push_back(Pair("progress", progress.nBlocksTotal ? (double)progress.nBlocksChecked / progress.nBlocksTotal : 1.0));
+        obj.push_back(Pair("blockverification", verification));
+    }
     return obj;
 }
 
@@ -649,6 +1043,9 @@ UniValue getfeeinfo(const UniValue& params, bool fHelp)
     for (int i = nStartHeight; i <= nBestHeight; i++) {
         CBlockIndex* pindex = chainActive[i];
         CBlock block;
+        if (fHavePruned && !(pindex->nStatus & BLOCK_HAVE_DATA) && pindex->nTx > 0)
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+
         if (!ReadBlockFromDisk(block, pindex))
             throw JSONRPCError(RPC_DATABASE_ERROR, "failed to read block from disk");
 
@@ -692,6 +1089,23 @@ UniValue getfeeinfo(const UniValue& params, bool fHelp)
     return ret;
 }
 
+UniValue mempoolInfoToJSON()
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("size", (int64_t)mempool.size()));
+    ret.push_back(Pair("bytes", (int64_t)mempool.GetTotalTxSize()));
+    ret.push_back(Pair("usage", (int64_t)mempool.DynamicMemoryUsage()));
+    size_t maxmempool = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+    ret.push_back(Pair("maxmempool", (int64_t)maxmempool));
+    ret.push_back(Pair("mempoolminfee", ValueFromAmount(mempool.GetMinFee(maxmempool).GetFeePerK())));
+    uint64_t nLoadProcessed, nLoadTotal;
+    mempool.GetLoadProgress(nLoadProcessed, nLoadTotal);
+    ret.push_back(Pair("loaded", mempool.IsLoaded()));
+    ret.push_back(Pair("loadprogress", nLoadTotal ? (double)nLoadProcessed / nLoadTotal : 1.0));
+
+    return ret;
+}
+
 UniValue getmempoolinfo(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -702,15 +1116,16 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
             "{\n"
             "  \"size\": xxxxx                (numeric) Current tx count\n"
             "  \"bytes\": xxxxx               (numeric) Sum of all tx sizes\n"
+            "  \"usage\": xxxxx               (numeric) Total memory usage for the mempool\n"
+            "  \"maxmempool\": xxxxx          (numeric) Maximum memory usage for the mempool\n"
+            "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee for tx to be accepted\n"
+            "  \"loaded\": true|false         (boolean) True if the mempool saved at the last shutdown is fully loaded\n"
+            "  \"loadprogress\": xxxxx        (numeric) Fraction of the saved mempool processed so far (0 to 1)\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getmempoolinfo", "") + HelpExampleRpc("getmempoolinfo", ""));
 
-    UniValue ret(UniValue::VOBJ);
-    ret.push_back(Pair("size", (int64_t)mempool.size()));
-    ret.push_back(Pair("bytes", (int64_t)mempool.GetTotalTxSize()));
-
-    return ret;
+    return mempoolInfoToJSON();
 }
 
 UniValue invalidateblock(const UniValue& params, bool fHelp)
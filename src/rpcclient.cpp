@@ -74,6 +74,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"listunspent", 2},
         {"getblock", 1},
         {"getblockheader", 1},
+        {"gettxoutsetinfo", 0},
         {"gettransaction", 1},
         {"getrawtransaction", 1},
         {"createrawtransaction", 0},
@@ -119,7 +120,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"setstakesplitthreshold", 0},
         {"autocombinerewards", 0},
         {"autocombinerewards", 1},
-        {"getfeeinfo", 0}
+        {"getfeeinfo", 0},
+        {"getspentinfo", 0}
     };
 
 class CRPCConvertTable
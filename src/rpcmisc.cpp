@@ -5,6 +5,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "addressindex.h"
 #include "base58.h"
 #include "clientversion.h"
 #include "init.h"
@@ -13,6 +14,7 @@
 #include "net.h"
 #include "netbase.h"
 #include "rpcserver.h"
+#include "spentindex.h"
 #include "spork.h"
 #include "timedata.h"
 #include "util.h"
@@ -485,6 +487,247 @@ UniValue setmocktime(const UniValue& params, bool fHelp)
     return NullUniValue;
 }
 
+static void AddIndexAddress(const std::string& strAddress, std::vector<std::pair<uint160, int> >& addresses)
+{
+    CBitcoinAddress address(strAddress);
+    if (!address.IsValid())
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+
+    CTxDestination dest = address.Get();
+    if (const CKeyID* keyID = boost::get<CKeyID>(&dest))
+        addresses.push_back(make_pair(*keyID, (int)ADDRESS_INDEX_PUBKEYHASH));
+    else if (const CScriptID* scriptID = boost::get<CScriptID>(&dest))
+        addresses.push_back(make_pair(*scriptID, (int)ADDRESS_INDEX_SCRIPTHASH));
+    else
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+}
+
+/** The address parameter, parsed if basex-cli passed the object form as a string */
+static UniValue IndexAddressParam(const UniValue& param)
+{
+    if (param.isStr() && !param.get_str().empty() && param.get_str()[0] == '{') {
+        UniValue value;
+        if (!value.read(param.get_str()) || !value.isObject())
+            throw JSONRPCError(RPC_PARSE_ERROR, "Error parsing JSON:" + param.get_str());
+        return value;
+    }
+    return param;
+}
+
+/** Accepts a single address or an object {"addresses": [...]} */
+static std::vector<std::pair<uint160, int> > ParseIndexAddresses(const UniValue& param)
+{
+    std::vector<std::pair<uint160, int> > addresses;
+    if (param.isStr()) {
+        AddIndexAddress(param.get_str(), addresses);
+    } else if (param.isObject()) {
+        const UniValue& values = find_value(param.get_obj(), "addresses");
+        if (!values.isArray())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, addresses is expected to be an array");
+        for (unsigned int i = 0; i < values.size(); i++)
+            AddIndexAddress(values[i].get_str(), addresses);
+    } else {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, expected an address or an object with addresses");
+    }
+    return addresses;
+}
+
+static std::string IndexAddressToString(const uint160& hashBytes, int type)
+{
+    if (type == ADDRESS_INDEX_SCRIPTHASH)
+        return CBitcoinAddress(CScriptID(hashBytes)).ToString();
+    return CBitcoinAddress(CKeyID(hashBytes)).ToString();
+}
+
+static bool HeightSort(const std::pair<CAddressUnspentKey, CAddressUnspentValue>& a, const std::pair<CAddressUnspentKey, CAddressUnspentValue>& b)
+{
+    return a.second.blockHeight < b.second.blockHeight;
+}
+
+UniValue getaddressbalance(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance \"address\"|{\"addresses\": [\"address\",...]}\n"
+            "\nReturns the balance of one or more addresses (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"address\"              (string) The bsa address, or\n"
+            "   {\n"
+            "     \"addresses\": [\"address\",...]  (array) The bsa addresses\n"
+            "   }\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\": x.xxx,    (numeric) The current balance in BSA\n"
+            "  \"received\": x.xxx    (numeric) The total amount received in BSA, including change\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressbalance", "\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"") + HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}'") + HelpExampleRpc("getaddressbalance", "{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}"));
+
+    UniValue param = IndexAddressParam(params[0]);
+    std::vector<std::pair<uint160, int> > addresses = ParseIndexAddresses(param);
+
+    CAmount balance = 0;
+    CAmount received = 0;
+    for (std::vector<std::pair<uint160, int> >::const_iterator it = addresses.begin(); it != addresses.end(); it++) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!GetAddressIndex(it->first, it->second, addressIndex))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator entry = addressIndex.begin(); entry != addressIndex.end(); entry++) {
+            if (entry->second > 0)
+                received += entry->second;
+            balance += entry->second;
+        }
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("balance", ValueFromAmount(balance)));
+    result.push_back(Pair("received", ValueFromAmount(received)));
+    return result;
+}
+
+UniValue getaddressutxos(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressutxos \"address\"|{\"addresses\": [\"address\",...]}\n"
+            "\nReturns the unspent outputs of one or more addresses, oldest first (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"address\"              (string) The bsa address, or\n"
+            "   {\n"
+            "     \"addresses\": [\"address\",...]  (array) The bsa addresses\n"
+            "   }\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\": \"address\",  (string) The address\n"
+            "    \"txid\": \"hash\",        (string) The output txid\n"
+            "    \"outputIndex\": n,      (numeric) The output index\n"
+            "    \"script\": \"hex\",       (string) The script hex encoded\n"
+            "    \"amount\": x.xxx,       (numeric) The output amount in BSA\n"
+            "    \"height\": n            (numeric) The block height\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressutxos", "\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"") + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}'") + HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}"));
+
+    UniValue param = IndexAddressParam(params[0]);
+    std::vector<std::pair<uint160, int> > addresses = ParseIndexAddresses(param);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    for (std::vector<std::pair<uint160, int> >::const_iterator it = addresses.begin(); it != addresses.end(); it++) {
+        if (!GetAddressUnspent(it->first, it->second, unspentOutputs))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    }
+    std::stable_sort(unspentOutputs.begin(), unspentOutputs.end(), HeightSort);
+
+    UniValue result(UniValue::VARR);
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = unspentOutputs.begin(); it != unspentOutputs.end(); it++) {
+        UniValue output(UniValue::VOBJ);
+        output.push_back(Pair("address", IndexAddressToString(it->first.hashBytes, it->first.type)));
+        output.push_back(Pair("txid", it->first.txhash.GetHex()));
+        output.push_back(Pair("outputIndex", (int)it->first.index));
+        output.push_back(Pair("script", HexStr(it->second.script.begin(), it->second.script.end())));
+        output.push_back(Pair("amount", ValueFromAmount(it->second.satoshis)));
+        output.push_back(Pair("height", it->second.blockHeight));
+        result.push_back(output);
+    }
+    return result;
+}
+
+UniValue getaddresstxids(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddresstxids \"address\"|{\"addresses\": [\"address\",...], \"start\": n, \"end\": n}\n"
+            "\nReturns the txids touching one or more addresses, in chain order (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"address\"              (string) The bsa address, or\n"
+            "   {\n"
+            "     \"addresses\": [\"address\",...]  (array) The bsa addresses\n"
+            "     \"start\": n           (numeric, optional) The first block height to include\n"
+            "     \"end\": n             (numeric, optional) The last block height to include\n"
+            "   }\n"
+            "\nResult:\n"
+            "[\n"
+            "  \"transactionid\"  (string) The transaction id\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"], \"start\": 1000}'") + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"], \"start\": 1000}"));
+
+    UniValue param = IndexAddressParam(params[0]);
+    std::vector<std::pair<uint160, int> > addresses = ParseIndexAddresses(param);
+
+    int start = 0;
+    int end = 0;
+    if (param.isObject()) {
+        const UniValue& startValue = find_value(param.get_obj(), "start");
+        const UniValue& endValue = find_value(param.get_obj(), "end");
+        if (!startValue.isNull())
+            start = startValue.get_int();
+        if (!endValue.isNull())
+            end = endValue.get_int();
+        if (start < 0 || end < 0 || (end > 0 && end < start))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, start and end are expected to be a range of heights");
+    }
+
+    // Ordered by height, then by position in the block
+    std::set<std::pair<std::pair<int, unsigned int>, uint256> > txids;
+    for (std::vector<std::pair<uint160, int> >::const_iterator it = addresses.begin(); it != addresses.end(); it++) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!GetAddressIndex(it->first, it->second, addressIndex, start, end))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator entry = addressIndex.begin(); entry != addressIndex.end(); entry++)
+            txids.insert(make_pair(make_pair(entry->first.blockHeight, entry->first.txindex), entry->first.txhash));
+    }
+
+    UniValue result(UniValue::VARR);
+    for (std::set<std::pair<std::pair<int, unsigned int>, uint256> >::const_iterator it = txids.begin(); it != txids.end(); it++)
+        result.push_back(it->second.GetHex());
+    return result;
+}
+
+UniValue getspentinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1 || !params[0].isObject())
+        throw runtime_error(
+            "getspentinfo {\"txid\": \"hash\", \"index\": n}\n"
+            "\nReturns the input spending an output (requires -spentindex).\n"
+            "\nArguments:\n"
+            "1. {\n"
+            "     \"txid\": \"hash\",  (string) The hex string of the txid\n"
+            "     \"index\": n       (numeric) The output index\n"
+            "   }\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\": \"hash\",     (string) The id of the spending transaction\n"
+            "  \"index\": n,         (numeric) The index of the spending input\n"
+            "  \"height\": n         (numeric) The height of the block containing it\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getspentinfo", "'{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}'") + HelpExampleRpc("getspentinfo", "{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}"));
+
+    const UniValue& txidValue = find_value(params[0].get_obj(), "txid");
+    const UniValue& indexValue = find_value(params[0].get_obj(), "index");
+    if (!txidValue.isStr() || !indexValue.isNum())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, expected txid and index");
+    int nOutput = indexValue.get_int();
+    if (nOutput < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, index must be positive");
+
+    CSpentIndexKey key(ParseHashV(txidValue, "txid"), nOutput);
+    CSpentIndexValue value;
+    if (!GetSpentIndex(key, value))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("txid", value.txid.GetHex()));
+    result.push_back(Pair("index", (int)value.inputIndex));
+    result.push_back(Pair("height", value.blockHeight));
+    return result;
+}
+
 #ifdef ENABLE_WALLET
 UniValue getstakingstatus(const UniValue& params, bool fHelp)
 {
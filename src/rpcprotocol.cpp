@@ -62,116 +62,6 @@ string HTTPPost(const string& strMsg, const map<string, string>& mapRequestHeade
     return s.str();
 }
 
-static string rfc1123Time()
-{
-    return DateTimeStrFormat("%a, %d %b %Y %H:%M:%S +0000", GetTime());
-}
-
-static const char* httpStatusDescription(int nStatus)
-{
-    switch (nStatus) {
-    case HTTP_OK:
-        return "OK";
-    case HTTP_BAD_REQUEST:
-        return "Bad Request";
-    case HTTP_FORBIDDEN:
-        return "Forbidden";
-    case HTTP_NOT_FOUND:
-        return "Not Found";
-    case HTTP_INTERNAL_SERVER_ERROR:
-        return "Internal Server Error";
-    default:
-        return "";
-    }
-}
-
-string HTTPError(int nStatus, bool keepalive, bool headersOnly)
-{
-    if (nStatus == HTTP_UNAUTHORIZED)
-        return strprintf("HTTP/1.0 401 Authorization Required\r\n"
-                         "Date: %s\r\n"
-                         "Server: basex-json-rpc/%s\r\n"
-                         "WWW-Authenticate: Basic realm=\"jsonrpc\"\r\n"
-                         "Content-Type: text/html\r\n"
-                         "Content-Length: 296\r\n"
-                         "\r\n"
-                         "<!DOCTYPE HTML PUBLIC \"-//W3C//DTD HTML 4.01 Transitional//EN\"\r\n"
-                         "\"http://www.w3.org/TR/1999/REC-html401-19991224/loose.dtd\">\r\n"
-                         "<HTML>\r\n"
-                         "<HEAD>\r\n"
-                         "<TITLE>Error</TITLE>\r\n"
-                         "<META HTTP-EQUIV='Content-Type' CONTENT='text/html; charset=ISO-8859-1'>\r\n"
-                         "</HEAD>\r\n"
-                         "<BODY><H1>401 Unauthorized.</H1></BODY>\r\n"
-                         "</HTML>\r\n",
-            rfc1123Time(), FormatFullVersion());
-
-    return HTTPReply(nStatus, httpStatusDescription(nStatus), keepalive,
-        headersOnly, "text/plain");
-}
-
-string HTTPReplyHeader(int nStatus, bool keepalive, size_t contentLength, const char* contentType)
-{
-    return strprintf(
-        "HTTP/1.1 %d %s\r\n"
-        "Date: %s\r\n"
-        "Connection: %s\r\n"
-        "Content-Length: %u\r\n"
-        "Content-Type: %s\r\n"
-        "Server: basex-json-rpc/%s\r\n"
-        "\r\n",
-        nStatus,
-        httpStatusDescription(nStatus),
-        rfc1123Time(),
-        keepalive ? "keep-alive" : "close",
-        contentLength,
-        contentType,
-        FormatFullVersion());
-}
-
-string HTTPReply(int nStatus, const string& strMsg, bool keepalive, bool headersOnly, const char* contentType)
-{
-    if (headersOnly) {
-        return HTTPReplyHeader(nStatus, keepalive, 0, contentType);
-    } else {
-        return HTTPReplyHeader(nStatus, keepalive, strMsg.size(), contentType) + strMsg;
-    }
-}
-
-bool ReadHTTPRequestLine(std::basic_istream<char>& stream, int& proto, string& http_method, string& http_uri)
-{
-    string str;
-    getline(stream, str);
-
-    // HTTP request line is space-delimited
-    vector<string> vWords;
-    boost::split(vWords, str, boost::is_any_of(" "));
-    if (vWords.size() < 2)
-        return false;
-
-    // HTTP methods permitted: GET, POST
-    http_method = vWords[0];
-    if (http_method != "GET" && http_method != "POST")
-        return false;
-
-    // HTTP URI must be an absolute path, relative to current host
-    http_uri = vWords[1];
-    if (http_uri.size() == 0 || http_uri[0] != '/')
-        return false;
-
-    // parse proto, if present
-    string strProto = "";
-    if (vWords.size() > 2)
-        strProto = vWords[2];
-
-    proto = 0;
-    const char* ver = strstr(strProto.c_str(), "HTTP/1.");
-    if (ver != NULL)
-        proto = atoi(ver + 7);
-
-    return true;
-}
-
 int ReadHTTPStatus(std::basic_istream<char>& stream, int& proto)
 {
     string str;
@@ -8,6 +8,7 @@
 #include "base58.h"
 #include "core_io.h"
 #include "init.h"
+#include "jsonstream.h"
 #include "keystore.h"
 #include "main.h"
 #include "net.h"
@@ -186,6 +187,7 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
     if (!fVerbose)
         return strHex;
 
+    LOCK(cs_main);
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("hex", strHex));
     TxToJSON(tx, hashBlock, result);
@@ -193,6 +195,78 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
 }
 
 #ifdef ENABLE_WALLET
+static void ParseListUnspentParams(const UniValue& params, int& nMinDepth, int& nMaxDepth, set<CBitcoinAddress>& setAddress)
+{
+    RPCTypeCheck(params, boost::assign::list_of(UniValue::VNUM)(UniValue::VNUM)(UniValue::VARR));
+
+    nMinDepth = 1;
+    if (params.size() > 0)
+        nMinDepth = params[0].get_int();
+
+    nMaxDepth = 9999999;
+    if (params.size() > 1)
+        nMaxDepth = params[1].get_int();
+
+    if (params.size() > 2) {
+        UniValue inputs = params[2].get_array();
+        for (unsigned int inx = 0; inx < inputs.size(); inx++) {
+            const UniValue& input = inputs[inx];
+            CBitcoinAddress address(input.get_str());
+            if (!address.IsValid())
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, string("Invalid BSA address: ") + input.get_str());
+            if (setAddress.count(address))
+                throw JSONRPCError(RPC_INVALID_PARAMETER, string("Invalid parameter, duplicated address: ") + input.get_str());
+            setAddress.insert(address);
+        }
+    }
+}
+
+static bool UnspentMatches(const COutput& out, int nMinDepth, int nMaxDepth, const set<CBitcoinAddress>& setAddress)
+{
+    if (out.nDepth < nMinDepth || out.nDepth > nMaxDepth)
+        return false;
+
+    if (setAddress.size()) {
+        CTxDestination address;
+        if (!ExtractDestination(out.tx->vout[out.i].scriptPubKey, address))
+            return false;
+
+        if (!setAddress.count(address))
+            return false;
+    }
+    return true;
+}
+
+/** listunspent entry for output i of wtx. Requires pwalletMain->cs_wallet. */
+static UniValue UnspentToJSON(const CWalletTx& wtx, int i, int nDepth, bool fSpendable)
+{
+    CAmount nValue = wtx.vout[i].nValue;
+    const CScript& pk = wtx.vout[i].scriptPubKey;
+    UniValue entry(UniValue::VOBJ);
+    entry.push_back(Pair("txid", wtx.GetHash().GetHex()));
+    entry.push_back(Pair("vout", i));
+    CTxDestination address;
+    if (ExtractDestination(wtx.vout[i].scriptPubKey, address)) {
+        entry.push_back(Pair("address", CBitcoinAddress(address).ToString()));
+        if (pwalletMain->mapAddressBook.count(address))
+            entry.push_back(Pair("account", pwalletMain->mapAddressBook[address].name));
+    }
+    entry.push_back(Pair("scriptPubKey", HexStr(pk.begin(), pk.end())));
+    if (pk.IsPayToScriptHash()) {
+        CTxDestination address;
+        if (ExtractDestination(pk, address)) {
+            const CScriptID& hash = boost::get<CScriptID>(address);
+            CScript redeemScript;
+            if (pwalletMain->GetCScript(hash, redeemScript))
+                entry.push_back(Pair("redeemScript", HexStr(redeemScript.begin(), redeemScript.end())));
+        }
+    }
+    entry.push_back(Pair("amount", ValueFromAmount(nValue)));
+    entry.push_back(Pair("confirmations", nDepth));
+    entry.push_back(Pair("spendable", fSpendable));
+    return entry;
+}
+
 UniValue listunspent(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() > 3)
@@ -228,75 +302,70 @@ UniValue listunspent(const UniValue& params, bool fHelp)
             "\nExamples\n" +
             HelpExampleCli("listunspent", "") + HelpExampleCli("listunspent", "6 9999999 \"[\\\"1PGFqEzfmQch1gKD3ra4k18PNj3tTUUSqg\\\",\\\"1LtvqCaApEdUGFkpKMM4MstjcaL4dKg8SP\\\"]\"") + HelpExampleRpc("listunspent", "6, 9999999 \"[\\\"1PGFqEzfmQch1gKD3ra4k18PNj3tTUUSqg\\\",\\\"1LtvqCaApEdUGFkpKMM4MstjcaL4dKg8SP\\\"]\""));
 
-    RPCTypeCheck(params, boost::assign::list_of(UniValue::VNUM)(UniValue::VNUM)(UniValue::VARR));
-
-    int nMinDepth = 1;
-    if (params.size() > 0)
-        nMinDepth = params[0].get_int();
-
-    int nMaxDepth = 9999999;
-    if (params.size() > 1)
-        nMaxDepth = params[1].get_int();
-
+    int nMinDepth;
+    int nMaxDepth;
     set<CBitcoinAddress> setAddress;
-    if (params.size() > 2) {
-        UniValue inputs = params[2].get_array();
-        for (unsigned int inx = 0; inx < inputs.size(); inx++) {
-            const UniValue& input = inputs[inx];
-            CBitcoinAddress address(input.get_str());
-            if (!address.IsValid())
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, string("Invalid BSA address: ") + input.get_str());
-            if (setAddress.count(address))
-                throw JSONRPCError(RPC_INVALID_PARAMETER, string("Invalid parameter, duplicated address: ") + input.get_str());
-            setAddress.insert(address);
-        }
-    }
+    ParseListUnspentParams(params, nMinDepth, nMaxDepth, setAddress);
 
     UniValue results(UniValue::VARR);
     vector<COutput> vecOutputs;
     assert(pwalletMain != NULL);
     pwalletMain->AvailableCoins(vecOutputs, false);
     BOOST_FOREACH (const COutput& out, vecOutputs) {
-        if (out.nDepth < nMinDepth || out.nDepth > nMaxDepth)
-            continue;
+        if (UnspentMatches(out, nMinDepth, nMaxDepth, setAddress))
+            results.push_back(UnspentToJSON(*out.tx, out.i, out.nDepth, out.fSpendable));
+    }
 
-        if (setAddress.size()) {
-            CTxDestination address;
-            if (!ExtractDestination(out.tx->vout[out.i].scriptPubKey, address))
-                continue;
+    return results;
+}
 
-            if (!setAddress.count(address))
-                continue;
-        }
+/** Unspent outputs described per acquisition of the wallet lock by listunspent_stream */
+static const unsigned int UNSPENT_STREAM_BATCH = 1000;
 
-        CAmount nValue = out.tx->vout[out.i].nValue;
-        const CScript& pk = out.tx->vout[out.i].scriptPubKey;
-        UniValue entry(UniValue::VOBJ);
-        entry.push_back(Pair("txid", out.tx->GetHash().GetHex()));
-        entry.push_back(Pair("vout", out.i));
-        CTxDestination address;
-        if (ExtractDestination(out.tx->vout[out.i].scriptPubKey, address)) {
-            entry.push_back(Pair("address", CBitcoinAddress(address).ToString()));
-            if (pwalletMain->mapAddressBook.count(address))
-                entry.push_back(Pair("account", pwalletMain->mapAddressBook[address].name));
-        }
-        entry.push_back(Pair("scriptPubKey", HexStr(pk.begin(), pk.end())));
-        if (pk.IsPayToScriptHash()) {
-            CTxDestination address;
-            if (ExtractDestination(pk, address)) {
-                const CScriptID& hash = boost::get<CScriptID>(address);
-                CScript redeemScript;
-                if (pwalletMain->GetCScript(hash, redeemScript))
-                    entry.push_back(Pair("redeemScript", HexStr(redeemScript.begin(), redeemScript.end())));
+bool listunspent_stream(const UniValue& params, CJSONStream& out)
+{
+    if (params.size() > 3)
+        return false;
+
+    int nMinDepth;
+    int nMaxDepth;
+    set<CBitcoinAddress> setAddress;
+    ParseListUnspentParams(params, nMinDepth, nMaxDepth, setAddress);
+
+    // The wallet transactions are looked up again for each batch, as they
+    // may be erased while the lock is released
+    vector<COutput> vOutputs;
+    vector<uint256> vTxid;
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+        vector<COutput> vecOutputs;
+        pwalletMain->AvailableCoins(vecOutputs, false);
+        BOOST_FOREACH (const COutput& output, vecOutputs) {
+            if (UnspentMatches(output, nMinDepth, nMaxDepth, setAddress)) {
+                vOutputs.push_back(output);
+                vTxid.push_back(output.tx->GetHash());
             }
         }
-        entry.push_back(Pair("amount", ValueFromAmount(nValue)));
-        entry.push_back(Pair("confirmations", out.nDepth));
-        entry.push_back(Pair("spendable", out.fSpendable));
-        results.push_back(entry);
     }
 
-    return results;
+    out.BeginArray();
+    for (unsigned int nStart = 0; nStart < vOutputs.size() && !out.Failed(); nStart += UNSPENT_STREAM_BATCH) {
+        unsigned int nEnd = std::min(nStart + UNSPENT_STREAM_BATCH, (unsigned int)vOutputs.size());
+        vector<UniValue> vEntries;
+        vEntries.reserve(nEnd - nStart);
+        {
+            LOCK2(cs_main, pwalletMain->cs_wallet);
+            for (unsigned int i = nStart; i < nEnd; i++) {
+                map<uint256, CWalletTx>::const_iterator mi = pwalletMain->mapWallet.find(vTxid[i]);
+                if (mi != pwalletMain->mapWallet.end())
+                    vEntries.push_back(UnspentToJSON(mi->second, vOutputs[i].i, vOutputs[i].nDepth, vOutputs[i].fSpendable));
+            }
+        }
+        BOOST_FOREACH (const UniValue& entry, vEntries)
+            out.Value(entry);
+    }
+    out.EndArray();
+    return true;
 }
 #endif
 
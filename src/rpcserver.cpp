@@ -8,6 +8,8 @@
 #include "rpcserver.h"
 
 #include "base58.h"
+#include "checkqueue.h"
+#include "httpserver.h"
 #include "init.h"
 #include "main.h"
 #include "ui_interface.h"
@@ -18,12 +20,8 @@
 
 #include <boost/algorithm/string.hpp>
 #include <boost/asio.hpp>
-#include <boost/asio/ssl.hpp>
 #include <boost/bind.hpp>
-#include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
-#include <boost/iostreams/concepts.hpp>
-#include <boost/iostreams/stream.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 
@@ -43,11 +41,9 @@ static CCriticalSection cs_rpcWarmup;
 //! These are created by StartRPCThreads, destroyed in StopRPCThreads
 static asio::io_service* rpc_io_service = NULL;
 static map<string, boost::shared_ptr<deadline_timer> > deadlineTimers;
-static ssl::context* rpc_ssl_context = NULL;
 static boost::thread_group* rpc_worker_group = NULL;
 static boost::asio::io_service::work* rpc_dummy_work = NULL;
-static std::vector<CSubNet> rpc_allow_subnets; //!< List of subnets to allow RPC connections from
-static std::vector<boost::shared_ptr<ip::tcp::acceptor> > rpc_acceptors;
+static boost::thread_group* rpc_batch_group = NULL;
 
 void RPCTypeCheck(const UniValue& params,
                   const list<UniValue::VType>& typesExpected,
@@ -248,6 +244,49 @@ UniValue stop(const UniValue& params, bool fHelp)
     return "Basex server stopping";
 }
 
+UniValue getrpcinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getrpcinfo\n"
+            "\nReturns the state of the HTTP server work queue.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"threads\": n,              (numeric) the number of worker threads (-rpcthreads)\n"
+            "  \"depth\": n,                (numeric) the number of requests waiting in the work queue\n"
+            "  \"maxdepth\": n,             (numeric) the size of the work queue (-rpcworkqueue)\n"
+            "  \"peakdepth\": n,            (numeric) the largest number of requests that waited at once\n"
+            "  \"requests\": n,             (numeric) the number of requests run by the workers\n"
+            "  \"rejected\": n,             (numeric) the number of requests refused because the work queue was full\n"
+            "  \"timedout\": n,             (numeric) the number of requests dropped after waiting longer than -rpcservertimeout\n"
+            "  \"queuetime_avg\": x.xxx,    (numeric) the average time a request waited for a worker, in milliseconds\n"
+            "  \"queuetime_max\": x.xxx,    (numeric) the longest time a request waited for a worker, in milliseconds\n"
+            "  \"exectime_avg\": x.xxx,     (numeric) the average time a worker spent on a request, in milliseconds\n"
+            "  \"exectime_max\": x.xxx      (numeric) the longest time a worker spent on a request, in milliseconds\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getrpcinfo", "") + HelpExampleRpc("getrpcinfo", ""));
+
+    HTTPServerStats stats;
+    if (!GetHTTPServerStats(stats))
+        throw JSONRPCError(RPC_MISC_ERROR, "HTTP server is not running");
+
+    uint64_t nQueued = stats.nRequests + stats.nTimedOut;
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("threads", stats.nThreads));
+    obj.push_back(Pair("depth", (uint64_t)stats.nQueueDepth));
+    obj.push_back(Pair("maxdepth", (uint64_t)stats.nQueueDepthLimit));
+    obj.push_back(Pair("peakdepth", (uint64_t)stats.nQueueDepthPeak));
+    obj.push_back(Pair("requests", stats.nRequests));
+    obj.push_back(Pair("rejected", stats.nRejected));
+    obj.push_back(Pair("timedout", stats.nTimedOut));
+    obj.push_back(Pair("queuetime_avg", nQueued ? 0.001 * stats.nQueueTimeTotal / nQueued : 0.0));
+    obj.push_back(Pair("queuetime_max", 0.001 * stats.nQueueTimeMax));
+    obj.push_back(Pair("exectime_avg", stats.nRequests ? 0.001 * stats.nExecTimeTotal / stats.nRequests : 0.0));
+    obj.push_back(Pair("exectime_max", 0.001 * stats.nExecTimeMax));
+    return obj;
+}
+
 
 /**
  * Call Table
@@ -258,6 +297,7 @@ static const CRPCCommand vRPCCommands[] =
         //  --------------------- ------------------------  -----------------------  ---------- ---------- ---------
         /* Overall control/query calls */
         {"control", "getinfo", &getinfo, true, false, false}, /* uses wallet if enabled */
+        {"control", "getrpcinfo", &getrpcinfo, true, true, false},
         {"control", "help", &help, true, true, false},
         {"control", "stop", &stop, true, true, false},
 
@@ -278,16 +318,19 @@ static const CRPCCommand vRPCCommands[] =
         {"blockchain", "getblockchaininfo", &getblockchaininfo, true, false, false},
         {"blockchain", "getbestblockhash", &getbestblockhash, true, false, false},
         {"blockchain", "getblockcount", &getblockcount, true, false, false},
-        {"blockchain", "getblock", &getblock, true, false, false},
-        {"blockchain", "getblockhash", &getblockhash, true, false, false},
+        {"blockchain", "getblock", &getblock, true, true, false, &getblock_stream},
+        {"blockchain", "getblockhash", &getblockhash, true, true, false},
         {"blockchain", "getblockheader", &getblockheader, false, false, false},
         {"blockchain", "getchaintips", &getchaintips, true, false, false},
         {"blockchain", "getdifficulty", &getdifficulty, true, false, false},
         {"blockchain", "getfeeinfo", &getfeeinfo, true, false, false},
         {"blockchain", "getmempoolinfo", &getmempoolinfo, true, true, false},
-        {"blockchain", "getrawmempool", &getrawmempool, true, false, false},
-        {"blockchain", "gettxout", &gettxout, true, false, false},
+        {"blockchain", "getrawmempool", &getrawmempool, true, false, false, &getrawmempool_stream},
+        {"blockchain", "gettxout", &gettxout, true, true, false},
         {"blockchain", "gettxoutsetinfo", &gettxoutsetinfo, true, false, false},
+        {"blockchain", "dumptxoutset", &dumptxoutset, true, true, false},
+        {"blockchain", "getleveldbstats", &getleveldbstats, true, true, false},
+        {"blockchain", "compactchainstate", &compactchainstate, true, true, false},
         {"blockchain", "invalidateblock", &invalidateblock, true, true, false},
         {"blockchain", "reconsiderblock", &reconsiderblock, true, true, false},
         {"blockchain", "verifychain", &verifychain, true, false, false},
@@ -311,7 +354,7 @@ static const CRPCCommand vRPCCommands[] =
         {"rawtransactions", "createrawtransaction", &createrawtransaction, true, false, false},
         {"rawtransactions", "decoderawtransaction", &decoderawtransaction, true, false, false},
         {"rawtransactions", "decodescript", &decodescript, true, false, false},
-        {"rawtransactions", "getrawtransaction", &getrawtransaction, true, false, false},
+        {"rawtransactions", "getrawtransaction", &getrawtransaction, true, true, false},
         {"rawtransactions", "sendrawtransaction", &sendrawtransaction, false, false, false},
         {"rawtransactions", "signrawtransaction", &signrawtransaction, false, false, false}, /* uses wallet if enabled */
 
@@ -322,6 +365,12 @@ static const CRPCCommand vRPCCommands[] =
         {"util", "estimatefee", &estimatefee, true, true, false},
         {"util", "estimatepriority", &estimatepriority, true, true, false},
 
+        /* Address index */
+        {"addressindex", "getaddressbalance", &getaddressbalance, true, true, false},
+        {"addressindex", "getaddressutxos", &getaddressutxos, true, true, false},
+        {"addressindex", "getaddresstxids", &getaddresstxids, true, true, false},
+        {"addressindex", "getspentinfo", &getspentinfo, true, true, false},
+
         /* Not shown in help */
         {"hidden", "invalidateblock", &invalidateblock, true, true, false},
         {"hidden", "reconsiderblock", &reconsiderblock, true, true, false},
@@ -378,9 +427,9 @@ static const CRPCCommand vRPCCommands[] =
         {"wallet", "gettransaction", &gettransaction, false, false, true},
         {"wallet", "getunconfirmedbalance", &getunconfirmedbalance, false, false, true},
         {"wallet", "getwalletinfo", &getwalletinfo, false, false, true},
-        {"wallet", "importprivkey", &importprivkey, true, false, true},
-        {"wallet", "importwallet", &importwallet, true, false, true},
-        {"wallet", "importaddress", &importaddress, true, false, true},
+        {"wallet", "importprivkey", &importprivkey, true, true, true},
+        {"wallet", "importwallet", &importwallet, true, true, true},
+        {"wallet", "importaddress", &importaddress, true, true, true},
         {"wallet", "keypoolrefill", &keypoolrefill, true, false, true},
         {"wallet", "listaccounts", &listaccounts, false, false, true},
         {"wallet", "listaddressgroupings", &listaddressgroupings, false, false, true},
@@ -388,8 +437,8 @@ static const CRPCCommand vRPCCommands[] =
         {"wallet", "listreceivedbyaccount", &listreceivedbyaccount, false, false, true},
         {"wallet", "listreceivedbyaddress", &listreceivedbyaddress, false, false, true},
         {"wallet", "listsinceblock", &listsinceblock, false, false, true},
-        {"wallet", "listtransactions", &listtransactions, false, false, true},
-        {"wallet", "listunspent", &listunspent, false, false, true},
+        {"wallet", "listtransactions", &listtransactions, false, false, true, &listtransactions_stream},
+        {"wallet", "listunspent", &listunspent, false, false, true, &listunspent_stream},
         {"wallet", "lockunspent", &lockunspent, true, false, true},
         {"wallet", "move", &movecmd, false, false, true},
         {"wallet", "multisend", &multisend, false, false, true},
@@ -427,9 +476,8 @@ const CRPCCommand* CRPCTable::operator[](string name) const
 }
 
 
-bool HTTPAuthorized(map<string, string>& mapHeaders)
+static bool RPCAuthorized(const std::string& strAuth)
 {
-    string strAuth = mapHeaders["authorization"];
     if (strAuth.substr(0, 6) != "Basic ")
         return false;
     string strUserPass64 = strAuth.substr(6);
@@ -438,7 +486,7 @@ bool HTTPAuthorized(map<string, string>& mapHeaders)
     return TimingResistantEqual(strUserPass, strRPCUserColonPass);
 }
 
-void ErrorReply(std::ostream& stream, const UniValue& objError, const UniValue& id)
+static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const UniValue& id)
 {
     // Send error reply from json-rpc error object
     int nStatus = HTTP_INTERNAL_SERVER_ERROR;
@@ -448,170 +496,26 @@ void ErrorReply(std::ostream& stream, const UniValue& objError, const UniValue&
     else if (code == RPC_METHOD_NOT_FOUND)
         nStatus = HTTP_NOT_FOUND;
     string strReply = JSONRPCReply(NullUniValue, objError, id);
-    stream << HTTPReply(nStatus, strReply, false) << std::flush;
-}
-
-CNetAddr BoostAsioToCNetAddr(boost::asio::ip::address address)
-{
-    CNetAddr netaddr;
-    // Make sure that IPv4-compatible and IPv4-mapped IPv6 addresses are treated as IPv4 addresses
-    if (address.is_v6() && (address.to_v6().is_v4_compatible() || address.to_v6().is_v4_mapped()))
-        address = address.to_v6().to_v4();
-
-    if (address.is_v4()) {
-        boost::asio::ip::address_v4::bytes_type bytes = address.to_v4().to_bytes();
-        netaddr.SetRaw(NET_IPV4, &bytes[0]);
-    } else {
-        boost::asio::ip::address_v6::bytes_type bytes = address.to_v6().to_bytes();
-        netaddr.SetRaw(NET_IPV6, &bytes[0]);
-    }
-    return netaddr;
-}
-
-bool ClientAllowed(const boost::asio::ip::address& address)
-{
-    CNetAddr netaddr = BoostAsioToCNetAddr(address);
-    BOOST_FOREACH (const CSubNet& subnet, rpc_allow_subnets)
-        if (subnet.Match(netaddr))
-            return true;
-    return false;
-}
-
-template <typename Protocol>
-class AcceptedConnectionImpl : public AcceptedConnection
-{
-public:
-    AcceptedConnectionImpl(
-        asio::io_service& io_service,
-        ssl::context& context,
-        bool fUseSSL) : sslStream(io_service, context),
-                        _d(sslStream, fUseSSL),
-                        _stream(_d)
-    {
-    }
-
-    virtual std::iostream& stream()
-    {
-        return _stream;
-    }
-
-    virtual std::string peer_address_to_string() const
-    {
-        return peer.address().to_string();
-    }
-
-    virtual void close()
-    {
-        _stream.close();
-    }
-
-    typename Protocol::endpoint peer;
-    asio::ssl::stream<typename Protocol::socket> sslStream;
-
-private:
-    SSLIOStreamDevice<Protocol> _d;
-    iostreams::stream<SSLIOStreamDevice<Protocol> > _stream;
-};
-
-void ServiceConnection(AcceptedConnection* conn);
-
-//! Forward declaration required for RPCListen
-template <typename Protocol, typename SocketAcceptorService>
-static void RPCAcceptHandler(boost::shared_ptr<basic_socket_acceptor<Protocol, SocketAcceptorService> > acceptor,
-    ssl::context& context,
-    bool fUseSSL,
-    boost::shared_ptr<AcceptedConnection> conn,
-    const boost::system::error_code& error);
-
-/**
- * Sets up I/O resources to accept and handle a new connection.
- */
-template <typename Protocol, typename SocketAcceptorService>
-static void RPCListen(boost::shared_ptr<basic_socket_acceptor<Protocol, SocketAcceptorService> > acceptor,
-    ssl::context& context,
-    const bool fUseSSL)
-{
-    // Accept connection
-    boost::shared_ptr<AcceptedConnectionImpl<Protocol> > conn(new AcceptedConnectionImpl<Protocol>(acceptor->get_io_service(), context, fUseSSL));
-
-    acceptor->async_accept(
-        conn->sslStream.lowest_layer(),
-        conn->peer,
-        boost::bind(&RPCAcceptHandler<Protocol, SocketAcceptorService>,
-            acceptor,
-            boost::ref(context),
-            fUseSSL,
-            conn,
-            _1));
+    req->WriteHeader("Content-Type", "application/json");
+    req->WriteReply(nStatus, strReply);
 }
 
+static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string&);
+static void ThreadRPCBatch();
 
-/**
- * Accept and handle incoming connection.
- */
-template <typename Protocol, typename SocketAcceptorService>
-static void RPCAcceptHandler(boost::shared_ptr<basic_socket_acceptor<Protocol, SocketAcceptorService> > acceptor,
-    ssl::context& context,
-    const bool fUseSSL,
-    boost::shared_ptr<AcceptedConnection> conn,
-    const boost::system::error_code& error)
-{
-    // Immediately start accepting new connections, except when we're cancelled or our socket is closed.
-    if (error != asio::error::operation_aborted && acceptor->is_open())
-        RPCListen(acceptor, context, fUseSSL);
-
-    AcceptedConnectionImpl<ip::tcp>* tcp_conn = dynamic_cast<AcceptedConnectionImpl<ip::tcp>*>(conn.get());
-
-    if (error) {
-        // TODO: Actually handle errors
-        LogPrintf("%s: Error: %s\n", __func__, error.message());
-    }
-    // Restrict callers by IP.  It is important to
-    // do this before starting client thread, to filter out
-    // certain DoS and misbehaving clients.
-    else if (tcp_conn && !ClientAllowed(tcp_conn->peer.address())) {
-        // Only send a 403 if we're not using SSL to prevent a DoS during the SSL handshake.
-        if (!fUseSSL)
-            conn->stream() << HTTPError(HTTP_FORBIDDEN, false) << std::flush;
-        conn->close();
-    } else {
-        ServiceConnection(conn.get());
-        conn->close();
-    }
-}
-
-static ip::tcp::endpoint ParseEndpoint(const std::string& strEndpoint, int defaultPort)
+/** Thread running the RPCRunLater timers; requests are served by the HTTP server threads */
+static void StartRPCTimerThread()
 {
-    std::string addr;
-    int port = defaultPort;
-    SplitHostPort(strEndpoint, port, addr);
-    return ip::tcp::endpoint(asio::ip::address::from_string(addr), port);
+    rpc_io_service = new asio::io_service();
+    /* Create dummy "work" to keep the thread from exiting when no timeouts active,
+     * see http://www.boost.org/doc/libs/1_51_0/doc/html/boost_asio/reference/io_service.html#boost_asio.reference.io_service.stopping_the_io_service_from_running_out_of_work */
+    rpc_dummy_work = new asio::io_service::work(*rpc_io_service);
+    rpc_worker_group = new boost::thread_group();
+    rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
 }
 
 void StartRPCThreads()
 {
-    rpc_allow_subnets.clear();
-    rpc_allow_subnets.push_back(CSubNet("127.0.0.0/8")); // always allow IPv4 local subnet
-    rpc_allow_subnets.push_back(CSubNet("::1"));         // always allow IPv6 localhost
-    if (mapMultiArgs.count("-rpcallowip")) {
-        const vector<string>& vAllow = mapMultiArgs["-rpcallowip"];
-        BOOST_FOREACH (string strAllow, vAllow) {
-            CSubNet subnet(strAllow);
-            if (!subnet.IsValid()) {
-                uiInterface.ThreadSafeMessageBox(
-                    strprintf("Invalid -rpcallowip subnet specification: %s. Valid are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24).", strAllow),
-                    "", CClientUIInterface::MSG_ERROR);
-                StartShutdown();
-                return;
-            }
-            rpc_allow_subnets.push_back(subnet);
-        }
-    }
-    std::string strAllowed;
-    BOOST_FOREACH (const CSubNet& subnet, rpc_allow_subnets)
-        strAllowed += subnet.ToString() + " ";
-    LogPrint("rpc", "Allowing RPC connections from: %s\n", strAllowed);
-
     if (mapArgs["-rpcpassword"] == "") {
         LogPrintf("No rpcpassword set - using random cookie authentication\n");
         if (!GenerateAuthCookie(&strRPCUserColonPass)) {
@@ -626,120 +530,31 @@ void StartRPCThreads()
     }
 
     assert(rpc_io_service == NULL);
-    rpc_io_service = new asio::io_service();
-    rpc_ssl_context = new ssl::context(*rpc_io_service, ssl::context::sslv23);
-
-    const bool fUseSSL = GetBoolArg("-rpcssl", false);
-
-    if (fUseSSL) {
-        rpc_ssl_context->set_options(ssl::context::no_sslv2 | ssl::context::no_sslv3);
-
-        filesystem::path pathCertFile(GetArg("-rpcsslcertificatechainfile", "server.cert"));
-        if (!pathCertFile.is_complete()) pathCertFile = filesystem::path(GetDataDir()) / pathCertFile;
-        if (filesystem::exists(pathCertFile))
-            rpc_ssl_context->use_certificate_chain_file(pathCertFile.string());
-        else
-            LogPrintf("ThreadRPCServer ERROR: missing server certificate file %s\n", pathCertFile.string());
-
-        filesystem::path pathPKFile(GetArg("-rpcsslprivatekeyfile", "server.pem"));
-        if (!pathPKFile.is_complete()) pathPKFile = filesystem::path(GetDataDir()) / pathPKFile;
-        if (filesystem::exists(pathPKFile))
-            rpc_ssl_context->use_private_key_file(pathPKFile.string(), ssl::context::pem);
-        else
-            LogPrintf("ThreadRPCServer ERROR: missing server private key file %s\n", pathPKFile.string());
-
-        string strCiphers = GetArg("-rpcsslciphers", "TLSv1.2+HIGH:TLSv1+HIGH:!SSLv2:!aNULL:!eNULL:!3DES:@STRENGTH");
-        SSL_CTX_set_cipher_list(rpc_ssl_context->impl(), strCiphers.c_str());
+    if (!InitHTTPServer()) {
+        StartShutdown();
+        return;
     }
 
-    std::vector<ip::tcp::endpoint> vEndpoints;
-    bool bBindAny = false;
-    int defaultPort = GetArg("-rpcport", BaseParams().RPCPort());
-    if (!mapArgs.count("-rpcallowip")) // Default to loopback if not allowing external IPs
-    {
-        vEndpoints.push_back(ip::tcp::endpoint(asio::ip::address_v6::loopback(), defaultPort));
-        vEndpoints.push_back(ip::tcp::endpoint(asio::ip::address_v4::loopback(), defaultPort));
-        if (mapArgs.count("-rpcbind")) {
-            LogPrintf("WARNING: option -rpcbind was ignored because -rpcallowip was not specified, refusing to allow everyone to connect\n");
-        }
-    } else if (mapArgs.count("-rpcbind")) // Specific bind address
-    {
-        BOOST_FOREACH (const std::string& addr, mapMultiArgs["-rpcbind"]) {
-            try {
-                vEndpoints.push_back(ParseEndpoint(addr, defaultPort));
-            } catch (const boost::system::system_error&) {
-                uiInterface.ThreadSafeMessageBox(
-                    strprintf(_("Could not parse -rpcbind value %s as network address"), addr),
-                    "", CClientUIInterface::MSG_ERROR);
-                StartShutdown();
-                return;
-            }
-        }
-    } else { // No specific bind address specified, bind to any
-        vEndpoints.push_back(ip::tcp::endpoint(asio::ip::address_v6::any(), defaultPort));
-        vEndpoints.push_back(ip::tcp::endpoint(asio::ip::address_v4::any(), defaultPort));
-        // Prefer making the socket dual IPv6/IPv4 instead of binding
-        // to both addresses seperately.
-        bBindAny = true;
+    int nBatchThreads = GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS);
+    if (nBatchThreads > 0) {
+        rpc_batch_group = new boost::thread_group();
+        for (int i = 0; i < nBatchThreads; i++)
+            rpc_batch_group->create_thread(&ThreadRPCBatch);
     }
 
-    bool fListening = false;
-    std::string strerr;
-    std::string straddress;
-    BOOST_FOREACH (const ip::tcp::endpoint& endpoint, vEndpoints) {
-        try {
-            asio::ip::address bindAddress = endpoint.address();
-            straddress = bindAddress.to_string();
-            LogPrintf("Binding RPC on address %s port %i (IPv4+IPv6 bind any: %i)\n", straddress, endpoint.port(), bBindAny);
-            boost::system::error_code v6_only_error;
-            boost::shared_ptr<ip::tcp::acceptor> acceptor(new ip::tcp::acceptor(*rpc_io_service));
-
-            acceptor->open(endpoint.protocol());
-            acceptor->set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
-
-            // Try making the socket dual IPv6/IPv4 when listening on the IPv6 "any" address
-            acceptor->set_option(boost::asio::ip::v6_only(
-                                     !bBindAny || bindAddress != asio::ip::address_v6::any()),
-                v6_only_error);
-
-            acceptor->bind(endpoint);
-            acceptor->listen(socket_base::max_connections);
-
-            RPCListen(acceptor, *rpc_ssl_context, fUseSSL);
-
-            rpc_acceptors.push_back(acceptor);
-            fListening = true;
-            rpc_acceptors.push_back(acceptor);
-            // If dual IPv6/IPv4 bind successful, skip binding to IPv4 separately
-            if (bBindAny && bindAddress == asio::ip::address_v6::any() && !v6_only_error)
-                break;
-        } catch (boost::system::system_error& e) {
-            LogPrintf("ERROR: Binding RPC on address %s port %i failed: %s\n", straddress, endpoint.port(), e.what());
-            strerr = strprintf(_("An error occurred while setting up the RPC address %s port %u for listening: %s"), straddress, endpoint.port(), e.what());
-        }
-    }
-
-    if (!fListening) {
-        uiInterface.ThreadSafeMessageBox(strerr, "", CClientUIInterface::MSG_ERROR);
-        StartShutdown();
-        return;
-    }
+    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC);
+    if (GetBoolArg("-rest", false))
+        StartREST();
+    StartHTTPServer();
 
-    rpc_worker_group = new boost::thread_group();
-    for (int i = 0; i < GetArg("-rpcthreads", 4); i++)
-        rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
+    StartRPCTimerThread();
     fRPCRunning = true;
 }
 
 void StartDummyRPCThread()
 {
     if (rpc_io_service == NULL) {
-        rpc_io_service = new asio::io_service();
-        /* Create dummy "work" to keep the thread from exiting when no timeouts active,
-         * see http://www.boost.org/doc/libs/1_51_0/doc/html/boost_asio/reference/io_service.html#boost_asio.reference.io_service.stopping_the_io_service_from_running_out_of_work */
-        rpc_dummy_work = new asio::io_service::work(*rpc_io_service);
-        rpc_worker_group = new boost::thread_group();
-        rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
+        StartRPCTimerThread();
         fRPCRunning = true;
     }
 }
@@ -749,17 +564,24 @@ void StopRPCThreads()
     if (rpc_io_service == NULL) return;
     // Set this to false first, so that longpolling loops will exit when woken up
     fRPCRunning = false;
+    cvBlockChange.notify_all();
 
-    // First, cancel all timers and acceptors
+    // Stop taking new requests and let the workers finish the calls they are running
+    InterruptHTTPServer();
+    StopREST();
+    UnregisterHTTPHandler("/", true);
+    StopHTTPServer();
+    if (rpc_batch_group != NULL) {
+        rpc_batch_group->interrupt_all();
+        rpc_batch_group->join_all();
+        delete rpc_batch_group;
+        rpc_batch_group = NULL;
+    }
+
+    // Cancel all timers
     // This is not done automatically by ->stop(), and in some cases the destructor of
     // asio::io_service can hang if this is skipped.
     boost::system::error_code ec;
-    BOOST_FOREACH (const boost::shared_ptr<ip::tcp::acceptor>& acceptor, rpc_acceptors) {
-        acceptor->cancel(ec);
-        if (ec)
-            LogPrintf("%s: Warning: %s when cancelling acceptor", __func__, ec.message());
-    }
-    rpc_acceptors.clear();
     BOOST_FOREACH (const PAIRTYPE(std::string, boost::shared_ptr<deadline_timer>) & timer, deadlineTimers) {
         timer.second->cancel(ec);
         if (ec)
@@ -770,15 +592,12 @@ void StopRPCThreads()
     DeleteAuthCookie();
 
     rpc_io_service->stop();
-    cvBlockChange.notify_all();
     if (rpc_worker_group != NULL)
         rpc_worker_group->join_all();
     delete rpc_dummy_work;
     rpc_dummy_work = NULL;
     delete rpc_worker_group;
     rpc_worker_group = NULL;
-    delete rpc_ssl_context;
-    rpc_ssl_context = NULL;
     delete rpc_io_service;
     rpc_io_service = NULL;
 }
@@ -889,42 +708,155 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
+/**
+ * One call of a JSON-RPC batch, run by the batch threads. Its reply goes to
+ * its own slot, so the batch is answered in the order it was sent.
+ */
+class CRPCBatchCheck
+{
+private:
+    const UniValue* req;
+    UniValue* reply;
+
+public:
+    CRPCBatchCheck() : req(NULL), reply(NULL) {}
+    CRPCBatchCheck(const UniValue& reqIn, UniValue& replyIn) : req(&reqIn), reply(&replyIn) {}
+
+    bool operator()()
+    {
+        *reply = JSONRPCExecOne(*req);
+        return true;
+    }
+
+    void swap(CRPCBatchCheck& check)
+    {
+        std::swap(req, check.req);
+        std::swap(reply, check.reply);
+    }
+};
+
+static CCheckQueue<CRPCBatchCheck> rpcbatchqueue(4);
+//! CCheckQueue serves one master at a time; other batches run on their own HTTP worker
+static boost::mutex cs_rpcbatchqueue;
+
+static void ThreadRPCBatch()
+{
+    RenameThread("basex-rpcbatch");
+    rpcbatchqueue.Thread();
+}
+
+/**
+ * Calls that only read state and take their own locks. Only these run in
+ * parallel within a batch: threadSafe alone also covers calls with side
+ * effects, such as stop, setgenerate or importprivkey.
+ */
+static const char* const pszBatchReadOnly[] = {
+    "estimatefee",
+    "estimatepriority",
+    "getaddressbalance",
+    "getaddresstxids",
+    "getaddressutxos",
+    "getblock",
+    "getblockhash",
+    "getmempoolinfo",
+    "getnettotals",
+    "getrawtransaction",
+    "getspentinfo",
+    "gettxout",
+    "help",
+};
+
+static bool IsBatchReadOnly(const UniValue& req)
+{
+    if (!req.isObject())
+        return false;
+    const UniValue& valMethod = find_value(req.get_obj(), "method");
+    if (!valMethod.isStr())
+        return false;
+    const CRPCCommand* pcmd = tableRPC[valMethod.get_str()];
+    if (!pcmd || !pcmd->threadSafe)
+        return false;
+    for (unsigned int i = 0; i < ARRAYLEN(pszBatchReadOnly); i++)
+        if (valMethod.get_str() == pszBatchReadOnly[i])
+            return true;
+    return false;
+}
+
+/** Run consecutive read-only calls, over the batch threads if they are free */
+static void JSONRPCExecParallel(std::vector<CRPCBatchCheck>& vChecks)
+{
+    if (vChecks.empty())
+        return;
+    boost::unique_lock<boost::mutex> lock(cs_rpcbatchqueue, boost::try_to_lock);
+    bool fParallel = rpc_batch_group != NULL && lock.owns_lock() && vChecks.size() > 1;
+    CCheckQueueControl<CRPCBatchCheck> control(fParallel ? &rpcbatchqueue : NULL);
+    if (fParallel)
+        control.Add(vChecks);
+    else
+        BOOST_FOREACH (CRPCBatchCheck& check, vChecks)
+            check();
+    control.Wait();
+    vChecks.clear();
+}
+
 static string JSONRPCExecBatch(const UniValue& vReq)
 {
+    // Consecutive read-only calls fan out over the batch threads. Any other
+    // call waits for them and runs on its own, so every call still sees the
+    // effects of the calls before it. CRPCTable::execute takes the locks.
+    std::vector<UniValue> vReplies(vReq.size());
+    std::vector<CRPCBatchCheck> vChecks;
+    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++) {
+        if (IsBatchReadOnly(vReq[reqIdx])) {
+            vChecks.push_back(CRPCBatchCheck(vReq[reqIdx], vReplies[reqIdx]));
+            continue;
+        }
+        JSONRPCExecParallel(vChecks);
+        vReplies[reqIdx] = JSONRPCExecOne(vReq[reqIdx]);
+    }
+    JSONRPCExecParallel(vChecks);
+
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    for (unsigned int reqIdx = 0; reqIdx < vReplies.size(); reqIdx++)
+        ret.push_back(vReplies[reqIdx]);
 
     return ret.write() + "\n";
 }
 
-static bool HTTPReq_JSONRPC(AcceptedConnection* conn,
-    string& strRequest,
-    map<string, string>& mapHeaders,
-    bool fRun)
+static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string&)
 {
+    // JSONRPC handles only POST
+    if (req->GetRequestMethod() != HTTPRequest::POST) {
+        req->WriteReply(HTTP_BAD_METHOD, "JSONRPC server handles only POST requests");
+        return false;
+    }
+
     // Check authorization
-    if (mapHeaders.count("authorization") == 0) {
-        conn->stream() << HTTPError(HTTP_UNAUTHORIZED, false) << std::flush;
+    std::pair<bool, std::string> authHeader = req->GetHeader("authorization");
+    if (!authHeader.first) {
+        req->WriteHeader("WWW-Authenticate", "Basic realm=\"jsonrpc\"");
+        req->WriteReply(HTTP_UNAUTHORIZED);
         return false;
     }
 
-    if (!HTTPAuthorized(mapHeaders)) {
-        LogPrintf("ThreadRPCServer incorrect password attempt from %s\n", conn->peer_address_to_string());
+    if (!RPCAuthorized(authHeader.second)) {
+        LogPrintf("ThreadRPCServer incorrect password attempt from %s\n", req->GetPeer().ToString());
         /* Deter brute-forcing
            If this results in a DoS the user really
            shouldn't have their RPC port exposed. */
         MilliSleep(250);
 
-        conn->stream() << HTTPError(HTTP_UNAUTHORIZED, false) << std::flush;
+        req->WriteHeader("WWW-Authenticate", "Basic realm=\"jsonrpc\"");
+        req->WriteReply(HTTP_UNAUTHORIZED);
         return false;
     }
 
     JSONRequest jreq;
+    HTTPJSONStream stream(req);
     try {
         // Parse request
         UniValue valRequest;
-        if (!valRequest.read(strRequest))
+        if (!valRequest.read(req->ReadBody()))
             throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
 
         // Return immediately if in warmup
@@ -940,6 +872,17 @@ static bool HTTPReq_JSONRPC(AcceptedConnection* conn,
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
+            // Large results are sent as they are produced
+            stream.BeginObject();
+            stream.Key("result");
+            if (tableRPC.executeStream(jreq.strMethod, jreq.params, stream)) {
+                stream.Pair("error", NullUniValue);
+                stream.Pair("id", jreq.id);
+                stream.EndObject();
+                return stream.End();
+            }
+            stream.Reset();
+
             UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
 
             // Send reply
@@ -951,59 +894,30 @@ static bool HTTPReq_JSONRPC(AcceptedConnection* conn,
         else
             throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
 
-        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, strReply.size()) << strReply << std::flush;
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strReply);
     } catch (const UniValue& objError) {
-        ErrorReply(conn->stream(), objError, jreq.id);
+        if (stream.Started()) {
+            // Too late for an error reply: the client gets a truncated result
+            LogPrintf("%s: %s failed after part of its result was sent: %s\n", __func__, SanitizeString(jreq.strMethod), find_value(objError, "message").getValStr());
+            return false;
+        }
+        JSONErrorReply(req, objError, jreq.id);
         return false;
     } catch (std::exception& e) {
-        ErrorReply(conn->stream(), JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
+        if (stream.Started()) {
+            LogPrintf("%s: %s failed after part of its result was sent: %s\n", __func__, SanitizeString(jreq.strMethod), e.what());
+            return false;
+        }
+        JSONErrorReply(req, JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
         return false;
     }
     return true;
 }
 
-void ServiceConnection(AcceptedConnection* conn)
+/** Throw if the command is disabled or not allowed in safe mode */
+static void CheckRPCCommandAllowed(const CRPCCommand* pcmd)
 {
-    bool fRun = true;
-    while (fRun && !ShutdownRequested()) {
-        int nProto = 0;
-        map<string, string> mapHeaders;
-        string strRequest, strMethod, strURI;
-
-        // Read HTTP request line
-        if (!ReadHTTPRequestLine(conn->stream(), nProto, strMethod, strURI))
-            break;
-
-        // Read HTTP message headers and body
-        ReadHTTPMessage(conn->stream(), mapHeaders, strRequest, nProto, MAX_SIZE);
-
-        // HTTP Keep-Alive is false; close connection immediately
-        if ((mapHeaders["connection"] == "close") || (!GetBoolArg("-rpckeepalive", true)))
-            fRun = false;
-
-        // Process via JSON-RPC API
-        if (strURI == "/") {
-            if (!HTTPReq_JSONRPC(conn, strRequest, mapHeaders, fRun))
-                break;
-
-            // Process via HTTP REST API
-        } else if (strURI.substr(0, 6) == "/rest/" && GetBoolArg("-rest", false)) {
-            if (!HTTPReq_REST(conn, strURI, mapHeaders, fRun))
-                break;
-
-        } else {
-            conn->stream() << HTTPError(HTTP_NOT_FOUND, false) << std::flush;
-            break;
-        }
-    }
-}
-
-UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
-{
-    // Find method
-    const CRPCCommand* pcmd = tableRPC[strMethod];
-    if (!pcmd)
-        throw JSONRPCError(RPC_METHOD_NOT_FOUND, "Method not found");
 #ifdef ENABLE_WALLET
     if (pcmd->reqWallet && !pwalletMain)
         throw JSONRPCError(RPC_METHOD_NOT_FOUND, "Method not found (disabled)");
@@ -1014,6 +928,15 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
     if (strWarning != "" && !GetBoolArg("-disablesafemode", false) &&
         !pcmd->okSafeMode)
         throw JSONRPCError(RPC_FORBIDDEN_BY_SAFE_MODE, string("Safe mode: ") + strWarning);
+}
+
+UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
+{
+    // Find method
+    const CRPCCommand* pcmd = tableRPC[strMethod];
+    if (!pcmd)
+        throw JSONRPCError(RPC_METHOD_NOT_FOUND, "Method not found");
+    CheckRPCCommandAllowed(pcmd);
 
     try {
         // Execute
@@ -1057,6 +980,22 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
     }
 }
 
+bool CRPCTable::executeStream(const std::string &strMethod, const UniValue &params, CJSONStream &out) const
+{
+    // Anything else goes through execute, which reports the errors
+    const CRPCCommand* pcmd = tableRPC[strMethod];
+    if (!pcmd || !pcmd->streamActor)
+        return false;
+    CheckRPCCommandAllowed(pcmd);
+
+    try {
+        // Stream actors take their own locks
+        return pcmd->streamActor(params, out);
+    } catch (std::exception& e) {
+        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+}
+
 std::vector<std::string> CRPCTable::listCommands() const
 {
     std::vector<std::string> commandList;
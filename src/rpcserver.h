@@ -22,19 +22,12 @@
 
 
 class CBlockIndex;
-class CNetAddr;
+class CJSONStream;
 
-class AcceptedConnection
-{
-public:
-    virtual ~AcceptedConnection() {}
-
-    virtual std::iostream& stream() = 0;
-    virtual std::string peer_address_to_string() const = 0;
-    virtual void close() = 0;
-};
+//! Threads running the read-only calls of a JSON-RPC batch in parallel (-rpcbatchthreads)
+static const int DEFAULT_RPC_BATCH_THREADS = 4;
 
-/** Start RPC threads */
+/** Start the HTTP server for JSON-RPC (and REST with -rest) and the RPC timer thread */
 void StartRPCThreads();
 /**
  * Alternative to StartRPCThreads for the GUI, when no server is
@@ -42,7 +35,7 @@ void StartRPCThreads();
  * If real RPC threads have already been started this is a no-op.
  */
 void StartDummyRPCThread();
-/** Stop RPC threads */
+/** Stop the HTTP server and the RPC timer thread */
 void StopRPCThreads();
 /** Query whether RPC is running */
 bool IsRPCRunning();
@@ -79,11 +72,16 @@ void RPCTypeCheckObj(const UniValue& o,
  */
 void RPCRunLater(const std::string& name, boost::function<void(void)> func, int64_t nSeconds);
 
-//! Convert boost::asio address to CNetAddr
-extern CNetAddr BoostAsioToCNetAddr(boost::asio::ip::address address);
-
 typedef UniValue(*rpcfn_type)(const UniValue& params, bool fHelp);
 
+/**
+ * Writes the result of a call to out as it is produced, instead of returning
+ * it. Takes its own locks, and does not hold them while writing. Returns
+ * false, before writing anything, when it does not handle these params; the
+ * call then goes to the regular actor.
+ */
+typedef bool (*rpcstreamfn_type)(const UniValue& params, CJSONStream& out);
+
 class CRPCCommand
 {
 public:
@@ -93,6 +91,7 @@ public:
     bool okSafeMode;
     bool threadSafe;
     bool reqWallet;
+    rpcstreamfn_type streamActor; //! optional, for results too large to build in memory
 };
 
 /**
@@ -117,6 +116,14 @@ public:
      */
     UniValue execute(const std::string &method, const UniValue &params) const;
 
+    /**
+     * Execute a method that can stream its result.
+     * @returns false if the method has no stream actor or it does not stream
+     *          these params; nothing was written then.
+     * @throws an exception (UniValue) when an error happens.
+     */
+    bool executeStream(const std::string &method, const UniValue &params, CJSONStream &out) const;
+
     /**
     * Returns a list of registered commands
     * @returns List of registered commands.
@@ -200,6 +207,7 @@ extern UniValue addmultisigaddress(const UniValue& params, bool fHelp);
 extern UniValue listreceivedbyaddress(const UniValue& params, bool fHelp);
 extern UniValue listreceivedbyaccount(const UniValue& params, bool fHelp);
 extern UniValue listtransactions(const UniValue& params, bool fHelp);
+extern bool listtransactions_stream(const UniValue& params, CJSONStream& out);
 extern UniValue listaddressgroupings(const UniValue& params, bool fHelp);
 extern UniValue listaccounts(const UniValue& params, bool fHelp);
 extern UniValue listsinceblock(const UniValue& params, bool fHelp);
@@ -221,6 +229,7 @@ extern UniValue autocombinerewards(const UniValue& params, bool fHelp);
 
 extern UniValue getrawtransaction(const UniValue& params, bool fHelp); // in rcprawtransaction.cpp
 extern UniValue listunspent(const UniValue& params, bool fHelp);
+extern bool listunspent_stream(const UniValue& params, CJSONStream& out);
 extern UniValue lockunspent(const UniValue& params, bool fHelp);
 extern UniValue listlockunspent(const UniValue& params, bool fHelp);
 extern UniValue createrawtransaction(const UniValue& params, bool fHelp);
@@ -235,11 +244,16 @@ extern UniValue getdifficulty(const UniValue& params, bool fHelp);
 extern UniValue settxfee(const UniValue& params, bool fHelp);
 extern UniValue getmempoolinfo(const UniValue& params, bool fHelp);
 extern UniValue getrawmempool(const UniValue& params, bool fHelp);
+extern bool getrawmempool_stream(const UniValue& params, CJSONStream& out);
 extern UniValue getblockhash(const UniValue& params, bool fHelp);
 extern UniValue getblock(const UniValue& params, bool fHelp);
+extern bool getblock_stream(const UniValue& params, CJSONStream& out);
 extern UniValue getblockheader(const UniValue& params, bool fHelp);
 extern UniValue getfeeinfo(const UniValue& params, bool fHelp);
 extern UniValue gettxoutsetinfo(const UniValue& params, bool fHelp);
+extern UniValue dumptxoutset(const UniValue& params, bool fHelp);
+extern UniValue getleveldbstats(const UniValue& params, bool fHelp);
+extern UniValue compactchainstate(const UniValue& params, bool fHelp);
 extern UniValue gettxout(const UniValue& params, bool fHelp);
 extern UniValue verifychain(const UniValue& params, bool fHelp);
 extern UniValue getchaintips(const UniValue& params, bool fHelp);
@@ -279,12 +293,16 @@ extern UniValue validateaddress(const UniValue& params, bool fHelp);
 extern UniValue createmultisig(const UniValue& params, bool fHelp);
 extern UniValue verifymessage(const UniValue& params, bool fHelp);
 extern UniValue setmocktime(const UniValue& params, bool fHelp);
+extern UniValue getaddressbalance(const UniValue& params, bool fHelp);
+extern UniValue getaddressutxos(const UniValue& params, bool fHelp);
+extern UniValue getaddresstxids(const UniValue& params, bool fHelp);
+extern UniValue getspentinfo(const UniValue& params, bool fHelp);
 extern UniValue getstakingstatus(const UniValue& params, bool fHelp);
 
 // in rest.cpp
-extern bool HTTPReq_REST(AcceptedConnection* conn,
-    std::string& strURI,
-    std::map<std::string, std::string>& mapHeaders,
-    bool fRun);
+/** Register the REST handlers with the HTTP server */
+extern void StartREST();
+/** Unregister the REST handlers */
+extern void StopREST();
 
 #endif // BITCOIN_RPCSERVER_H
@@ -9,6 +9,7 @@
 #include "base58.h"
 #include "core_io.h"
 #include "init.h"
+#include "jsonstream.h"
 #include "net.h"
 #include "netbase.h"
 #include "rpcserver.h"
@@ -97,7 +98,7 @@ UniValue getnewaddress(const UniValue& params, bool fHelp)
         strAccount = AccountFromValue(params[0]);
 
     if (!pwalletMain->IsLocked())
-        pwalletMain->TopUpKeyPool();
+        pwalletMain->RequestKeyPoolTopUp();
 
     // Generate a new key that is added to wallet
     CPubKey newKey;
@@ -182,7 +183,7 @@ UniValue getrawchangeaddress(const UniValue& params, bool fHelp)
             HelpExampleCli("getrawchangeaddress", "") + HelpExampleRpc("getrawchangeaddress", ""));
 
     if (!pwalletMain->IsLocked())
-        pwalletMain->TopUpKeyPool();
+        pwalletMain->RequestKeyPoolTopUp();
 
     CReserveKey reservekey(pwalletMain);
     CPubKey vchPubKey;
@@ -1207,6 +1208,55 @@ void AcentryToJSON(const CAccountingEntry& acentry, const string& strAccount, Un
     }
 }
 
+/**
+ * Entries of a listtransactions call, newest first, enough for the page. The
+ * page is [nFrom, nFrom + nCount), clamped to the entries found.
+ */
+static void ListTransactionsNewestFirst(const UniValue& params, UniValue& ret, int& nFrom, int& nCount)
+{
+    string strAccount = "*";
+    if (params.size() > 0)
+        strAccount = params[0].get_str();
+    nCount = 10;
+    if (params.size() > 1)
+        nCount = params[1].get_int();
+    nFrom = 0;
+    if (params.size() > 2)
+        nFrom = params[2].get_int();
+    isminefilter filter = ISMINE_SPENDABLE;
+    if (params.size() > 3)
+        if (params[3].get_bool())
+            filter = filter | ISMINE_WATCH_ONLY;
+
+    if (nCount < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
+    if (nFrom < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative from");
+
+    ret.setArray();
+
+    std::list<CAccountingEntry> acentries;
+    CWallet::TxItems txOrdered = pwalletMain->OrderedTxItems(acentries, strAccount);
+
+    // iterate backwards until we have nCount items to return:
+    for (CWallet::TxItems::reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it) {
+        CWalletTx* const pwtx = (*it).second.first;
+        if (pwtx != 0)
+            ListTransactions(*pwtx, strAccount, 0, true, ret, filter);
+        CAccountingEntry* const pacentry = (*it).second.second;
+        if (pacentry != 0)
+            AcentryToJSON(*pacentry, strAccount, ret);
+
+        if ((int)ret.size() >= (nCount + nFrom)) break;
+    }
+    // ret is newest to oldest
+
+    if (nFrom > (int)ret.size())
+        nFrom = ret.size();
+    if ((nFrom + nCount) > (int)ret.size())
+        nCount = ret.size() - nFrom;
+}
+
 UniValue listtransactions(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() > 4)
@@ -1262,47 +1312,10 @@ UniValue listtransactions(const UniValue& params, bool fHelp)
             "\nList transactions 100 to 120 from the tabby account\n" + HelpExampleCli("listtransactions", "\"tabby\" 20 100") +
             "\nAs a json rpc call\n" + HelpExampleRpc("listtransactions", "\"tabby\", 20, 100"));
 
-    string strAccount = "*";
-    if (params.size() > 0)
-        strAccount = params[0].get_str();
-    int nCount = 10;
-    if (params.size() > 1)
-        nCount = params[1].get_int();
-    int nFrom = 0;
-    if (params.size() > 2)
-        nFrom = params[2].get_int();
-    isminefilter filter = ISMINE_SPENDABLE;
-    if (params.size() > 3)
-        if (params[3].get_bool())
-            filter = filter | ISMINE_WATCH_ONLY;
-
-    if (nCount < 0)
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
-    if (nFrom < 0)
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative from");
-
-    UniValue ret(UniValue::VARR);
-
-    std::list<CAccountingEntry> acentries;
-    CWallet::TxItems txOrdered = pwalletMain->OrderedTxItems(acentries, strAccount);
-
-    // iterate backwards until we have nCount items to return:
-    for (CWallet::TxItems::reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it) {
-        CWalletTx* const pwtx = (*it).second.first;
-        if (pwtx != 0)
-            ListTransactions(*pwtx, strAccount, 0, true, ret, filter);
-        CAccountingEntry* const pacentry = (*it).second.second;
-        if (pacentry != 0)
-            AcentryToJSON(*pacentry, strAccount, ret);
-
-        if ((int)ret.size() >= (nCount + nFrom)) break;
-    }
-    // ret is newest to oldest
-
-    if (nFrom > (int)ret.size())
-        nFrom = ret.size();
-    if ((nFrom + nCount) > (int)ret.size())
-        nCount = ret.size() - nFrom;
+    int nFrom;
+    int nCount;
+    UniValue ret;
+    ListTransactionsNewestFirst(params, ret, nFrom, nCount);
 
     vector<UniValue> arrTmp = ret.getValues();
 
@@ -1323,6 +1336,27 @@ UniValue listtransactions(const UniValue& params, bool fHelp)
     return ret;
 }
 
+bool listtransactions_stream(const UniValue& params, CJSONStream& out)
+{
+    if (params.size() > 4)
+        return false;
+
+    int nFrom;
+    int nCount;
+    UniValue ret;
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+        ListTransactionsNewestFirst(params, ret, nFrom, nCount);
+    }
+
+    // Return oldest to newest
+    out.BeginArray();
+    for (int i = nFrom + nCount - 1; i >= nFrom && !out.Failed(); i--)
+        out.Value(ret[i]);
+    out.EndArray();
+    return true;
+}
+
 UniValue listaccounts(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() > 2)
@@ -1638,7 +1672,7 @@ UniValue walletpassphrase(const UniValue& params, bool fHelp)
     if (!pwalletMain->Unlock(strWalletPass))
         throw JSONRPCError(RPC_WALLET_PASSPHRASE_INCORRECT, "Error: The wallet passphrase entered was incorrect.");
 
-    pwalletMain->TopUpKeyPool();
+    pwalletMain->RequestKeyPoolTopUp();
 
     int64_t nSleepTime = params[1].get_int64();
     LOCK(cs_nWalletUnlockTime);
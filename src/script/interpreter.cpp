@@ -14,6 +14,9 @@
 #include "script/script.h"
 #include "uint256.h"
 
+#include <algorithm>
+#include <stdexcept>
+
 using namespace std;
 
 typedef vector<unsigned char> valtype;
@@ -57,13 +60,66 @@ bool CastToBool(const valtype& vch)
  */
 #define stacktop(i)  (stack.at(stack.size()+(i)))
 #define altstacktop(i)  (altstack.at(altstack.size()+(i)))
-static inline void popstack(vector<valtype>& stack)
+static inline void popstack(CScriptStack& stack)
 {
     if (stack.empty())
         throw runtime_error("popstack() : stack empty");
     stack.pop_back();
 }
 
+CScriptStack& CScriptStack::operator=(const CScriptStack& other)
+{
+    if (this == &other)
+        return *this;
+    nSize = 0;
+    for (const_iterator it = other.begin(); it != other.end(); ++it)
+        push_back(*it);
+    return *this;
+}
+
+CScriptStack::value_type& CScriptStack::at(size_t n)
+{
+    if (n >= nSize)
+        throw out_of_range("CScriptStack::at() : out of range");
+    return vSlots[n];
+}
+
+void CScriptStack::push_back(const value_type& vch)
+{
+    if (nSize == vSlots.size())
+        vSlots.push_back(vch);
+    else
+        vSlots[nSize] = vch;
+    nSize++;
+}
+
+void CScriptStack::pop_back()
+{
+    assert(nSize > 0);
+    nSize--;
+}
+
+void CScriptStack::insert(iterator pos, const value_type& vch)
+{
+    size_t nPos = pos - begin();
+    push_back(vch);
+    std::rotate(begin() + nPos, end() - 1, end());
+}
+
+void CScriptStack::erase(iterator first, iterator last)
+{
+    // Move the erased elements' buffers above the top for reuse
+    size_t nErased = last - first;
+    std::rotate(first, last, end());
+    nSize -= nErased;
+}
+
+void CScriptStack::Trim(size_t nMaxSlots)
+{
+    if (vSlots.size() > std::max(nSize, nMaxSlots))
+        vSlots.resize(std::max(nSize, nMaxSlots));
+}
+
 bool static IsCompressedOrUncompressedPubKey(const valtype &vchPubKey) {
     if (vchPubKey.size() < 33) {
         //  Non-canonical public key: too short
@@ -236,6 +292,14 @@ bool static CheckMinimalPush(const valtype& data, opcodetype opcode) {
 }
 
 bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+{
+    CScriptStack scriptStack(stack);
+    bool fResult = EvalScript(scriptStack, script, flags, checker, serror);
+    stack.assign(scriptStack.begin(), scriptStack.end());
+    return fResult;
+}
+
+bool EvalScript(CScriptStack& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
 {
     static const CScriptNum bnZero(0);
     static const CScriptNum bnOne(1);
@@ -251,7 +315,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
     opcodetype opcode;
     valtype vchPushValue;
     vector<bool> vfExec;
-    vector<valtype> altstack;
+    CScriptStack altstack;
     set_error(serror, SCRIPT_ERR_UNKNOWN_ERROR);
     if (script.size() > 10000)
         return set_error(serror, SCRIPT_ERR_SCRIPT_SIZE);
@@ -498,9 +562,8 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x - 0 | x x)
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-1);
-                    if (CastToBool(vch))
-                        stack.push_back(vch);
+                    if (CastToBool(stacktop(-1)))
+                        stack.push_back(stacktop(-1));
                 }
                 break;
 
@@ -526,8 +589,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x -- x x)
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-1);
-                    stack.push_back(vch);
+                    stack.push_back(stacktop(-1));
                 }
                 break;
 
@@ -759,19 +821,20 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     valtype& vch = stacktop(-1);
-                    valtype vchHash((opcode == OP_RIPEMD160 || opcode == OP_SHA1 || opcode == OP_HASH160) ? 20 : 32);
+                    unsigned char vchHash[32];
+                    size_t nHashSize = (opcode == OP_RIPEMD160 || opcode == OP_SHA1 || opcode == OP_HASH160) ? 20 : 32;
                     if (opcode == OP_RIPEMD160)
-                        CRIPEMD160().Write(begin_ptr(vch), vch.size()).Finalize(begin_ptr(vchHash));
+                        CRIPEMD160().Write(begin_ptr(vch), vch.size()).Finalize(vchHash);
                     else if (opcode == OP_SHA1)
-                        CSHA1().Write(begin_ptr(vch), vch.size()).Finalize(begin_ptr(vchHash));
+                        CSHA1().Write(begin_ptr(vch), vch.size()).Finalize(vchHash);
                     else if (opcode == OP_SHA256)
-                        CSHA256().Write(begin_ptr(vch), vch.size()).Finalize(begin_ptr(vchHash));
+                        CSHA256().Write(begin_ptr(vch), vch.size()).Finalize(vchHash);
                     else if (opcode == OP_HASH160)
-                        CHash160().Write(begin_ptr(vch), vch.size()).Finalize(begin_ptr(vchHash));
+                        CHash160().Write(begin_ptr(vch), vch.size()).Finalize(vchHash);
                     else if (opcode == OP_HASH256)
-                        CHash256().Write(begin_ptr(vch), vch.size()).Finalize(begin_ptr(vchHash));
-                    popstack(stack);
-                    stack.push_back(vchHash);
+                        CHash256().Write(begin_ptr(vch), vch.size()).Finalize(vchHash);
+                    // Replace the input in place rather than pop and push
+                    vch.assign(vchHash, vchHash + nHashSize);
                 }
                 break;                                   
 
@@ -1031,9 +1094,53 @@ public:
     }
 };
 
+/** Serialization sink appending to a byte vector */
+class CVectorWriter {
+private:
+    std::vector<unsigned char> &vch;
+
+public:
+    int nType;
+    int nVersion;
+
+    CVectorWriter(std::vector<unsigned char> &vchIn, int nTypeIn, int nVersionIn) : vch(vchIn), nType(nTypeIn), nVersion(nVersionIn) {}
+
+    CVectorWriter& write(const char *pch, size_t size) {
+        vch.insert(vch.end(), (const unsigned char*)pch, (const unsigned char*)pch + size);
+        return *this;
+    }
+
+    template<typename T>
+    CVectorWriter& operator<<(const T& obj) {
+        ::Serialize(*this, obj, nType, nVersion);
+        return *this;
+    }
+};
+
 } // anon namespace
 
-uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType)
+PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << txTo.nVersion;
+    ::WriteCompactSize(ss, txTo.vin.size());
+
+    // Serialize the inputs the way CTransactionSignatureSerializer does for
+    // the inputs other than the one being signed
+    CVectorWriter tail(vchTail, SER_GETHASH, 0);
+    vPrefix.reserve(txTo.vin.size());
+    vInputOffset.reserve(txTo.vin.size() + 1);
+    for (unsigned int i = 0; i < txTo.vin.size(); i++) {
+        vPrefix.push_back(ss);
+        vInputOffset.push_back(vchTail.size());
+        tail << txTo.vin[i].prevout << CScript() << txTo.vin[i].nSequence;
+        ss.write((const char*)&vchTail[vInputOffset.back()], vchTail.size() - vInputOffset.back());
+    }
+    vInputOffset.push_back(vchTail.size());
+    tail << txTo.vout << txTo.nLockTime;
+}
+
+uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const PrecomputedTransactionData* txdata)
 {
     if (nIn >= txTo.vin.size()) {
         //  nIn out of range
@@ -1051,6 +1158,18 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
 
+    // SIGHASH_ALL serializes every other input blanked and every output, so
+    // only the input being signed differs from the precomputed serialization
+    if (txdata && !(nHashType & SIGHASH_ANYONECANPAY) && (nHashType & 0x1f) != SIGHASH_SINGLE && (nHashType & 0x1f) != SIGHASH_NONE) {
+        assert(txdata->vPrefix.size() == txTo.vin.size());
+        CHashWriter ss(txdata->vPrefix[nIn]);
+        txTmp.SerializeInput(ss, nIn, SER_GETHASH, 0);
+        size_t nOffset = txdata->vInputOffset[nIn + 1];
+        ss.write((const char*)&txdata->vchTail[nOffset], txdata->vchTail.size() - nOffset);
+        ss << nHashType;
+        return ss.GetHash();
+    }
+
     // Serialize and hash
     CHashWriter ss(SER_GETHASH, 0);
     ss << txTmp << nHashType;
@@ -1075,7 +1194,7 @@ bool TransactionSignatureChecker::CheckSig(const vector<unsigned char>& vchSigIn
     int nHashType = vchSig.back();
     vchSig.pop_back();
 
-    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType);
+    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType, txdata);
 
     if (!VerifySignature(vchSig, pubkey, sighash))
         return false;
@@ -1083,6 +1202,49 @@ bool TransactionSignatureChecker::CheckSig(const vector<unsigned char>& vchSigIn
     return true;
 }
 
+namespace {
+
+/** Number of stack slots whose buffers VerifyScript keeps between calls */
+const size_t SCRIPT_STACK_ARENA_SLOTS = 32;
+
+/** Stacks VerifyScript reuses on each thread */
+struct CScriptStackArena {
+    CScriptStack stack;
+    CScriptStack stackCopy;
+    bool fInUse;
+
+    CScriptStackArena() : fInUse(false) {}
+
+    /** Claims an arena for one VerifyScript call */
+    class Lease {
+    public:
+        CScriptStackArena& arena;
+
+        explicit Lease(CScriptStackArena& arenaIn) : arena(arenaIn)
+        {
+            arena.fInUse = true;
+            arena.stack.clear();
+            arena.stackCopy.clear();
+        }
+
+        ~Lease()
+        {
+            // Don't hold on to the buffers of an unusually deep script
+            arena.stack.clear();
+            arena.stackCopy.clear();
+            arena.stack.Trim(SCRIPT_STACK_ARENA_SLOTS);
+            arena.stackCopy.Trim(SCRIPT_STACK_ARENA_SLOTS);
+            arena.fInUse = false;
+        }
+
+    private:
+        Lease(const Lease&);
+        Lease& operator=(const Lease&);
+    };
+};
+
+} // anon namespace
+
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
 {
     set_error(serror, SCRIPT_ERR_UNKNOWN_ERROR);
@@ -1091,7 +1253,14 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigne
         return set_error(serror, SCRIPT_ERR_SIG_PUSHONLY);
     }
 
-    vector<vector<unsigned char> > stack, stackCopy;
+    // Evaluate on this thread's reusable stacks, unless a checker is
+    // verifying another script from inside this call
+    static thread_local CScriptStackArena arena;
+    CScriptStackArena local;
+    CScriptStackArena::Lease lease(arena.fInUse ? local : arena);
+    CScriptStack& stack = lease.arena.stack;
+    CScriptStack& stackCopy = lease.arena.stackCopy;
+
     if (!EvalScript(stack, scriptSig, flags, checker, serror))
         // serror is set
         return false;
@@ -6,6 +6,7 @@
 #ifndef BITCOIN_SCRIPT_INTERPRETER_H
 #define BITCOIN_SCRIPT_INTERPRETER_H
 
+#include "hash.h"
 #include "script_error.h"
 #include "primitives/transaction.h"
 
@@ -72,7 +73,29 @@ enum
 
 };
 
-uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
+/**
+ * The parts of a transaction's signature hash serialization that don't depend
+ * on the input being signed, computed once per transaction. The signature
+ * hash commits to the whole transaction for every input, so checking all
+ * inputs stays quadratic, but with this SIGHASH_ALL resumes from the hash
+ * state after the inputs before the one being signed, and hashes the rest
+ * from a single serialization instead of re-serializing the transaction.
+ * The resulting hashes are identical.
+ */
+class PrecomputedTransactionData
+{
+public:
+    //! Hash state after nVersion and the blanked inputs before each input
+    std::vector<CHashWriter> vPrefix;
+    //! Blanked inputs, outputs and nLockTime, serialized as signed by SIGHASH_ALL
+    std::vector<unsigned char> vchTail;
+    //! Offset of each blanked input in vchTail, plus one past the last input
+    std::vector<size_t> vInputOffset;
+
+    explicit PrecomputedTransactionData(const CTransaction& txTo);
+};
+
+uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const PrecomputedTransactionData* txdata = NULL);
 
 class BaseSignatureChecker
 {
@@ -90,12 +113,13 @@ class TransactionSignatureChecker : public BaseSignatureChecker
 private:
     const CTransaction* txTo;
     unsigned int nIn;
+    const PrecomputedTransactionData* txdata;
 
 protected:
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 
 public:
-    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn) : txTo(txToIn), nIn(nInIn) {}
+    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const PrecomputedTransactionData* txdataIn = NULL) : txTo(txToIn), nIn(nInIn), txdata(txdataIn) {}
     bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const;
 };
 
@@ -108,6 +132,50 @@ public:
     MutableTransactionSignatureChecker(const CMutableTransaction* txToIn, unsigned int nInIn) : TransactionSignatureChecker(&txTo, nInIn), txTo(*txToIn) {}
 };
 
+/**
+ * Script interpreter stack. Popped elements keep their buffers in the slots
+ * above size(), and pushes assign into those, so a stack that is reused
+ * across evaluations stops allocating once its buffers have grown to the
+ * sizes it sees. Pushing an element of the stack itself is allowed.
+ */
+class CScriptStack
+{
+public:
+    typedef std::vector<unsigned char> value_type;
+    typedef std::vector<value_type>::iterator iterator;
+    typedef std::vector<value_type>::const_iterator const_iterator;
+
+    CScriptStack() : nSize(0) {}
+    explicit CScriptStack(const std::vector<value_type>& vch) : vSlots(vch), nSize(vch.size()) {}
+    CScriptStack(const CScriptStack& other) : vSlots(other.begin(), other.end()), nSize(other.nSize) {}
+    CScriptStack& operator=(const CScriptStack& other);
+
+    size_t size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+    iterator begin() { return vSlots.begin(); }
+    iterator end() { return vSlots.begin() + nSize; }
+    const_iterator begin() const { return vSlots.begin(); }
+    const_iterator end() const { return vSlots.begin() + nSize; }
+    value_type& back() { return vSlots[nSize - 1]; }
+    const value_type& back() const { return vSlots[nSize - 1]; }
+    value_type& at(size_t n);
+
+    void push_back(const value_type& vch);
+    void pop_back();
+    void insert(iterator pos, const value_type& vch);
+    void erase(iterator pos) { erase(pos, pos + 1); }
+    void erase(iterator first, iterator last);
+    void clear() { nSize = 0; }
+
+    //! Free the buffers kept beyond the first nMaxSlots slots
+    void Trim(size_t nMaxSlots);
+
+private:
+    std::vector<value_type> vSlots;
+    size_t nSize;
+};
+
+bool EvalScript(CScriptStack& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* error = NULL);
 bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* error = NULL);
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* error = NULL);
 
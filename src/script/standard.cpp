@@ -34,8 +34,90 @@ const char* GetTxnOutputType(txnouttype t)
     return NULL;
 }
 
+/** OP_DUP OP_HASH160 20 [20 byte hash] OP_EQUALVERIFY OP_CHECKSIG */
+static bool IsPayToPubkeyHash(const CScript& script)
+{
+    return (script.size() == 25 &&
+            script[0] == OP_DUP &&
+            script[1] == OP_HASH160 &&
+            script[2] == 20 &&
+            script[23] == OP_EQUALVERIFY &&
+            script[24] == OP_CHECKSIG);
+}
+
+bool MatchPayToPubkeyHash(const CScript& script, uint160& hashRet)
+{
+    if (!IsPayToPubkeyHash(script))
+        return false;
+    memcpy(hashRet.begin(), &script[3], 20);
+    return true;
+}
+
+bool MatchPayToScriptHash(const CScript& script, uint160& hashRet)
+{
+    if (!script.IsPayToScriptHash())
+        return false;
+    memcpy(hashRet.begin(), &script[2], 20);
+    return true;
+}
+
+/** Length of the public key pushed by a pay-to-pubkey script, or 0 if it isn't one */
+static unsigned int MatchPayToPubkeyLength(const CScript& script)
+{
+    // [33 to 65 byte direct push] OP_CHECKSIG
+    if (script.size() < 35 || script.size() > 67 || script[0] != script.size() - 2 || script.back() != OP_CHECKSIG)
+        return 0;
+    return script[0];
+}
+
+bool MatchPayToPubkey(const CScript& script, CPubKey& pubkeyRet)
+{
+    unsigned int nLen = MatchPayToPubkeyLength(script);
+    if (nLen == 0)
+        return false;
+    pubkeyRet.Set(&script[1], &script[1] + nLen);
+    return true;
+}
+
+/**
+ * Match OP_m [pubkeys] OP_n OP_CHECKMULTISIG with 1 <= m <= n <= 16 and n keys
+ * of 33 to 65 bytes in direct pushes, and return Solver's solutions for it.
+ */
+static bool MatchMultisig(const CScript& script, vector<valtype>& vSolutionsRet)
+{
+    if (script.size() < 37 || script.back() != OP_CHECKMULTISIG)
+        return false;
+    opcodetype opM = (opcodetype)script[0];
+    opcodetype opN = (opcodetype)script[script.size() - 2];
+    if (opM < OP_1 || opM > OP_16 || opN < opM || opN > OP_16)
+        return false;
+
+    size_t nEnd = script.size() - 2;
+    size_t nPos = 1;
+    int nKeys = 0;
+    while (nPos < nEnd) {
+        unsigned int nLen = script[nPos];
+        if (nLen < 33 || nLen > 65 || nPos + 1 + nLen > nEnd)
+            return false;
+        nPos += 1 + nLen;
+        nKeys++;
+    }
+    if (nKeys != CScript::DecodeOP_N(opN))
+        return false;
+
+    vSolutionsRet.clear();
+    vSolutionsRet.reserve(nKeys + 2);
+    vSolutionsRet.push_back(valtype(1, (unsigned char)CScript::DecodeOP_N(opM)));
+    for (nPos = 1; nPos < nEnd; nPos += 1 + script[nPos])
+        vSolutionsRet.push_back(valtype(script.begin() + nPos + 1, script.begin() + nPos + 1 + script[nPos]));
+    vSolutionsRet.push_back(valtype(1, (unsigned char)nKeys));
+    return true;
+}
+
 /**
  * Return public keys or hashes from scriptPubKey, for 'standard' transaction types.
+ * The common templates are recognized by their bytes; only scripts that don't
+ * match those exactly go through the generic template matcher.
  */
 bool Solver(const CScript& scriptPubKey, txnouttype& typeRet, vector<vector<unsigned char> >& vSolutionsRet)
 {
@@ -63,6 +145,24 @@ bool Solver(const CScript& scriptPubKey, txnouttype& typeRet, vector<vector<unsi
         return true;
     }
 
+    if (IsPayToPubkeyHash(scriptPubKey)) {
+        typeRet = TX_PUBKEYHASH;
+        vSolutionsRet.assign(1, valtype(scriptPubKey.begin() + 3, scriptPubKey.begin() + 23));
+        return true;
+    }
+
+    unsigned int nPubKeyLen = MatchPayToPubkeyLength(scriptPubKey);
+    if (nPubKeyLen > 0) {
+        typeRet = TX_PUBKEY;
+        vSolutionsRet.assign(1, valtype(scriptPubKey.begin() + 1, scriptPubKey.begin() + 1 + nPubKeyLen));
+        return true;
+    }
+
+    if (MatchMultisig(scriptPubKey, vSolutionsRet)) {
+        typeRet = TX_MULTISIG;
+        return true;
+    }
+
     // Provably prunable, data-carrying output
     //
     // So long as script passes the IsUnspendable() test and all but the first
@@ -203,6 +303,16 @@ bool IsStandard(const CScript& scriptPubKey, txnouttype& whichType)
 
 bool ExtractDestination(const CScript& scriptPubKey, CTxDestination& addressRet)
 {
+    uint160 hash;
+    if (MatchPayToPubkeyHash(scriptPubKey, hash)) {
+        addressRet = CKeyID(hash);
+        return true;
+    }
+    if (MatchPayToScriptHash(scriptPubKey, hash)) {
+        addressRet = CScriptID(hash);
+        return true;
+    }
+
     vector<valtype> vSolutions;
     txnouttype whichType;
     if (!Solver(scriptPubKey, whichType, vSolutions))
@@ -14,6 +14,7 @@
 #include <stdint.h>
 
 class CKeyID;
+class CPubKey;
 class CScript;
 
 /** A reference to a CScript: the Hash160 of its serialization (see script.h) */
@@ -82,6 +83,15 @@ typedef boost::variant<CNoDestination, CKeyID, CScriptID> CTxDestination;
 
 const char* GetTxnOutputType(txnouttype t);
 
+/**
+ * Constant time matchers for the common script templates, which don't
+ * allocate. They only recognize the canonical encodings, for which Solver
+ * gives the same result, and return false for everything else.
+ */
+bool MatchPayToPubkeyHash(const CScript& script, uint160& hashRet);
+bool MatchPayToScriptHash(const CScript& script, uint160& hashRet);
+bool MatchPayToPubkey(const CScript& script, CPubKey& pubkeyRet);
+
 bool Solver(const CScript& scriptPubKey, txnouttype& typeRet, std::vector<std::vector<unsigned char> >& vSolutionsRet);
 int ScriptSigArgsExpected(txnouttype t, const std::vector<std::vector<unsigned char> >& vSolutions);
 bool IsStandard(const CScript& scriptPubKey, txnouttype& whichType);
@@ -0,0 +1,97 @@
+// Copyright (c) 2018 The Basex developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SPENTINDEX_H
+#define BITCOIN_SPENTINDEX_H
+
+#include "amount.h"
+#include "serialize.h"
+#include "uint256.h"
+
+/** Key of the 'p' records: the output that was spent */
+struct CSpentIndexKey {
+    uint256 txid;
+    unsigned int outputIndex;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(txid);
+        READWRITE(outputIndex);
+    }
+
+    CSpentIndexKey(const uint256& t, unsigned int i)
+    {
+        txid = t;
+        outputIndex = i;
+    }
+
+    CSpentIndexKey()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        txid = 0;
+        outputIndex = 0;
+    }
+};
+
+/** Value of the 'p' records: the input spending it. A null value in an index update erases the record. */
+struct CSpentIndexValue {
+    uint256 txid;
+    unsigned int inputIndex;
+    int blockHeight;
+    CAmount satoshis;
+    int addressType;
+    uint160 addressHash;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(txid);
+        READWRITE(inputIndex);
+        READWRITE(blockHeight);
+        READWRITE(satoshis);
+        READWRITE(addressType);
+        READWRITE(addressHash);
+    }
+
+    CSpentIndexValue(const uint256& t, unsigned int i, int h, CAmount s, int type, const uint160& a)
+    {
+        txid = t;
+        inputIndex = i;
+        blockHeight = h;
+        satoshis = s;
+        addressType = type;
+        addressHash = a;
+    }
+
+    CSpentIndexValue()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        txid = 0;
+        inputIndex = 0;
+        blockHeight = 0;
+        satoshis = 0;
+        addressType = 0;
+        addressHash = 0;
+    }
+
+    bool IsNull() const
+    {
+        return txid == 0;
+    }
+};
+
+#endif // BITCOIN_SPENTINDEX_H
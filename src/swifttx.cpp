@@ -15,6 +15,7 @@
 #include "spork.h"
 #include "sync.h"
 #include "util.h"
+#include "validationinterface.h"
 #include <boost/lexical_cast.hpp>
 
 using namespace std;
@@ -348,8 +349,8 @@ bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
         if ((*i).second.CountSignatures() >= SWIFTTX_SIGNATURES_REQUIRED) {
             LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Transaction Lock Is Complete %s !\n", (*i).second.GetHash().ToString().c_str());
 
-            CTransaction& tx = mapTxLockReq[ctx.txHash];
-            if (!CheckForConflictingLocks(tx)) {
+            std::map<uint256, CTransaction>::iterator itReq = mapTxLockReq.find(ctx.txHash);
+            if (itReq == mapTxLockReq.end() || !CheckForConflictingLocks(itReq->second)) {
 #ifdef ENABLE_WALLET
                 if (pwalletMain) {
                     if (pwalletMain->UpdatedTransaction((*i).second.txHash)) {
@@ -358,12 +359,16 @@ bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
                 }
 #endif
 
-                if (mapTxLockReq.count(ctx.txHash)) {
+                if (itReq != mapTxLockReq.end()) {
+                    const CTransaction& tx = itReq->second;
                     BOOST_FOREACH (const CTxIn& in, tx.vin) {
                         if (!mapLockedInputs.count(in.prevout)) {
                             mapLockedInputs.insert(make_pair(in.prevout, ctx.txHash));
                         }
                     }
+                    // only the vote that completes the lock is announced
+                    if ((*i).second.CountSignatures() == SWIFTTX_SIGNATURES_REQUIRED)
+                        GetMainSignals().NotifyTransactionLock(tx);
                 }
 
                 // resolve conflicts
@@ -430,13 +435,12 @@ void CleanTransactionLocksList()
         if (GetTime() > it->second.nExpiration) { //keep them for an hour
             LogPrintf("Removing old transaction lock %s\n", it->second.txHash.ToString().c_str());
 
-            if (mapTxLockReq.count(it->second.txHash)) {
-                CTransaction& tx = mapTxLockReq[it->second.txHash];
-
-                BOOST_FOREACH (const CTxIn& in, tx.vin)
+            std::map<uint256, CTransaction>::iterator itReq = mapTxLockReq.find(it->second.txHash);
+            if (itReq != mapTxLockReq.end()) {
+                BOOST_FOREACH (const CTxIn& in, itReq->second.vin)
                     mapLockedInputs.erase(in.prevout);
 
-                mapTxLockReq.erase(it->second.txHash);
+                mapTxLockReq.erase(itReq);
                 mapTxLockReqRejected.erase(it->second.txHash);
 
                 BOOST_FOREACH (CConsensusVote& v, it->second.vecConsensusVotes)
@@ -0,0 +1,76 @@
+// Copyright (c) 2018 The Basex developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+#include "spentindex.h"
+#include "txdb.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(addressindex_tests)
+
+BOOST_AUTO_TEST_CASE(addressindex_order)
+{
+    CBlockTreeDB db(1 << 20, true);
+    uint160 hashA = 1, hashB = 2;
+    uint256 txid = 3;
+
+    // Heights that sort differently little endian
+    vector<pair<CAddressIndexKey, CAmount> > addressIndex;
+    addressIndex.push_back(make_pair(CAddressIndexKey(ADDRESS_INDEX_PUBKEYHASH, hashA, 65536, 0, txid, 0, false), 3));
+    addressIndex.push_back(make_pair(CAddressIndexKey(ADDRESS_INDEX_PUBKEYHASH, hashA, 256, 1, txid, 0, false), 2));
+    addressIndex.push_back(make_pair(CAddressIndexKey(ADDRESS_INDEX_PUBKEYHASH, hashA, 1, 0, txid, 0, false), 1));
+    addressIndex.push_back(make_pair(CAddressIndexKey(ADDRESS_INDEX_PUBKEYHASH, hashB, 2, 0, txid, 0, false), 4));
+    addressIndex.push_back(make_pair(CAddressIndexKey(ADDRESS_INDEX_SCRIPTHASH, hashA, 2, 0, txid, 0, false), 5));
+    BOOST_CHECK(db.UpdateAddressIndexes(addressIndex, false, vector<pair<CAddressUnspentKey, CAddressUnspentValue> >(), vector<pair<CSpentIndexKey, CSpentIndexValue> >()));
+
+    vector<pair<CAddressIndexKey, CAmount> > result;
+    BOOST_CHECK(db.ReadAddressIndex(hashA, ADDRESS_INDEX_PUBKEYHASH, result));
+    BOOST_CHECK_EQUAL(result.size(), 3U);
+    for (unsigned int i = 0; i < result.size(); i++)
+        BOOST_CHECK_EQUAL(result[i].second, (CAmount)(i + 1));
+
+    result.clear();
+    BOOST_CHECK(db.ReadAddressIndex(hashA, ADDRESS_INDEX_PUBKEYHASH, result, 2, 256));
+    BOOST_CHECK_EQUAL(result.size(), 1U);
+    BOOST_CHECK_EQUAL(result[0].first.blockHeight, 256);
+
+    // Disconnecting erases the records again
+    BOOST_CHECK(db.UpdateAddressIndexes(addressIndex, true, vector<pair<CAddressUnspentKey, CAddressUnspentValue> >(), vector<pair<CSpentIndexKey, CSpentIndexValue> >()));
+    result.clear();
+    BOOST_CHECK(db.ReadAddressIndex(hashA, ADDRESS_INDEX_PUBKEYHASH, result));
+    BOOST_CHECK(result.empty());
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_unspent)
+{
+    CBlockTreeDB db(1 << 20, true);
+    uint160 hash = 1;
+    uint256 txid1 = 1, txid2 = 2;
+
+    // An output created and spent in the same block is gone afterwards
+    vector<pair<CAddressUnspentKey, CAddressUnspentValue> > unspent;
+    unspent.push_back(make_pair(CAddressUnspentKey(ADDRESS_INDEX_PUBKEYHASH, hash, txid1, 0), CAddressUnspentValue(10, CScript(), 5)));
+    unspent.push_back(make_pair(CAddressUnspentKey(ADDRESS_INDEX_PUBKEYHASH, hash, txid2, 1), CAddressUnspentValue(20, CScript(), 5)));
+    unspent.push_back(make_pair(CAddressUnspentKey(ADDRESS_INDEX_PUBKEYHASH, hash, txid1, 0), CAddressUnspentValue()));
+
+    vector<pair<CSpentIndexKey, CSpentIndexValue> > spent;
+    spent.push_back(make_pair(CSpentIndexKey(txid1, 0), CSpentIndexValue(txid2, 0, 5, 10, ADDRESS_INDEX_PUBKEYHASH, hash)));
+    BOOST_CHECK(db.UpdateAddressIndexes(vector<pair<CAddressIndexKey, CAmount> >(), false, unspent, spent));
+
+    vector<pair<CAddressUnspentKey, CAddressUnspentValue> > result;
+    BOOST_CHECK(db.ReadAddressUnspentIndex(hash, ADDRESS_INDEX_PUBKEYHASH, result));
+    BOOST_CHECK_EQUAL(result.size(), 1U);
+    BOOST_CHECK(result[0].first.txhash == txid2);
+    BOOST_CHECK_EQUAL(result[0].second.satoshis, 20);
+
+    CSpentIndexValue value;
+    BOOST_CHECK(db.ReadSpentIndex(CSpentIndexKey(txid1, 0), value));
+    BOOST_CHECK(value.txid == txid2);
+    BOOST_CHECK(!db.ReadSpentIndex(CSpentIndexKey(txid2, 1), value));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,7 +3,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "coins.h"
+#include "main.h"
 #include "random.h"
+#include "txdb.h"
 #include "uint256.h"
 
 #include <vector>
@@ -17,6 +19,7 @@ class CCoinsViewTest : public CCoinsView
 {
     uint256 hashBestBlock_;
     std::map<uint256, CCoins> map_;
+    CCoinsCommitment commitment_;
 
 public:
     bool GetCoins(const uint256& txid, CCoins& coins) const
@@ -41,7 +44,7 @@ public:
 
     uint256 GetBestBlock() const { return hashBestBlock_; }
 
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsCommitment& commitmentDelta)
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
             map_[it->first] = it->second.coins;
@@ -53,10 +56,26 @@ public:
         }
         mapCoins.clear();
         hashBestBlock_ = hashBlock;
+        commitment_ += commitmentDelta;
         return true;
     }
 
     bool GetStats(CCoinsStats& stats) const { return false; }
+
+    bool GetCommitment(CCoinsCommitment& commitment) const
+    {
+        commitment = commitment_;
+        return true;
+    }
+};
+
+class CCoinsViewDBTest : public CCoinsViewDB
+{
+public:
+    CCoinsViewDBTest(bool fWipe) : CCoinsViewDB(1 << 20, false, fWipe) {}
+
+    //! Move the best block on without the summary, as an older version does
+    bool WriteBestBlockOnly(const uint256& hash) { return db.Write('B', hash); }
 };
 }
 
@@ -175,4 +194,113 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(missed_an_entry);
 }
 
+static CCoins RandomCoins(unsigned int nOutputs)
+{
+    CCoins coins;
+    coins.nVersion = 1;
+    coins.nHeight = insecure_rand() % 1000000;
+    coins.fCoinBase = insecure_rand() % 2;
+    coins.vout.resize(nOutputs);
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        coins.vout[i].nValue = insecure_rand();
+        coins.vout[i].scriptPubKey = CScript() << OP_TRUE;
+    }
+    return coins;
+}
+
+BOOST_AUTO_TEST_CASE(coins_commitment_test)
+{
+    std::vector<uint256> txids;
+    std::vector<CCoins> coins;
+    for (unsigned int i = 0; i < 20; i++) {
+        txids.push_back(GetRandHash());
+        coins.push_back(RandomCoins(1 + i % 3));
+    }
+
+    // The summary does not depend on the order outputs are added in
+    CCoinsCommitment forward, backward;
+    for (unsigned int i = 0; i < txids.size(); i++) {
+        forward.AddCoins(txids[i], coins[i]);
+        backward.AddCoins(txids[txids.size() - 1 - i], coins[txids.size() - 1 - i]);
+    }
+    BOOST_CHECK(forward == backward);
+    BOOST_CHECK_EQUAL(forward.nTransactions, 20);
+    BOOST_CHECK_EQUAL(forward.nTransactionOutputs, 7 * 1 + 7 * 2 + 6 * 3);
+
+    // Spending every output one by one goes back to the empty summary
+    for (unsigned int i = 0; i < txids.size(); i++) {
+        for (unsigned int n = 0; n < coins[i].vout.size(); n++)
+            forward.RemoveOutput(txids[i], coins[i], n);
+        forward.nTransactions--;
+    }
+    BOOST_CHECK(forward == CCoinsCommitment());
+
+    // A different height gives a different summary
+    CCoinsCommitment moved;
+    CCoins coinsMoved = coins[0];
+    coinsMoved.nHeight++;
+    moved.AddCoins(txids[0], coinsMoved);
+    forward.AddCoins(txids[0], coins[0]);
+    BOOST_CHECK(moved.hashOutputs != forward.hashOutputs);
+
+    // Changes recorded in a stack of caches reach the base on Flush
+    CCoinsViewTest base;
+    CCoinsViewCache middle(&base);
+    CCoinsViewCache* top = new CCoinsViewCache(&middle);
+    for (unsigned int i = 0; i < 10; i++)
+        middle.GetCommitmentDelta().AddCoins(txids[i], coins[i]);
+    for (unsigned int i = 10; i < txids.size(); i++)
+        top->GetCommitmentDelta().AddCoins(txids[i], coins[i]);
+    top->GetCommitmentDelta().RemoveCoins(txids[0], coins[0]);
+
+    CCoinsCommitment expected, result;
+    for (unsigned int i = 1; i < txids.size(); i++)
+        expected.AddCoins(txids[i], coins[i]);
+    BOOST_CHECK(top->GetCommitment(result));
+    BOOST_CHECK(result == expected);
+
+    BOOST_CHECK(top->Flush());
+    delete top;
+    BOOST_CHECK(middle.Flush());
+    BOOST_CHECK(base.GetCommitment(result));
+    BOOST_CHECK(result == expected);
+    BOOST_CHECK(middle.GetCommitmentDelta() == CCoinsCommitment());
+}
+
+BOOST_AUTO_TEST_CASE(coins_commitment_best_block)
+{
+    uint256 txid = GetRandHash();
+    CCoins coins = RandomCoins(2);
+    CCoinsCommitment expected, result;
+    expected.AddCoins(txid, coins);
+    {
+        CCoinsViewDBTest db(true);
+        CCoinsMap mapCoins;
+        mapCoins[txid].coins = coins;
+        mapCoins[txid].flags = CCoinsCacheEntry::DIRTY;
+        BOOST_CHECK(db.BatchWrite(mapCoins, GetRandHash(), expected));
+    }
+    {
+        // Reopened at the same best block, the stored summary is used
+        CCoinsViewDBTest db(false);
+        BOOST_CHECK(db.GetCommitment(result));
+        BOOST_CHECK(result == expected);
+        // GetStats looks up the height of the best block, so move to one that is known
+        BOOST_CHECK(db.WriteBestBlockOnly(chainActive.Genesis()->GetBlockHash()));
+    }
+    {
+        // The best block moved on without it, so it is computed again
+        CCoinsViewDBTest db(false);
+        BOOST_CHECK(!db.GetCommitment(result));
+        BOOST_CHECK(db.InitCommitment());
+        BOOST_CHECK(db.GetCommitment(result));
+        BOOST_CHECK(result == expected);
+    }
+    {
+        CCoinsViewDBTest db(false);
+        BOOST_CHECK(db.GetCommitment(result));
+        BOOST_CHECK(result == expected);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,158 @@
+// Copyright (c) 2018 The Basex developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "jsonstream.h"
+#include "main.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <univalue.h>
+
+using namespace std;
+
+extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern void blockToJSONStream(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, CJSONStream& out);
+
+/** Collects the chunks written by a CJSONStream */
+class CJSONStringStream : public CJSONStream
+{
+protected:
+    bool WriteChunk(const std::string& strChunk)
+    {
+        vChunks.push_back(strChunk);
+        return !fClosed;
+    }
+
+public:
+    vector<string> vChunks;
+    bool fClosed;
+
+    CJSONStringStream() : fClosed(false) {}
+
+    string str()
+    {
+        Flush();
+        string strAll;
+        BOOST_FOREACH (const string& strChunk, vChunks)
+            strAll += strChunk;
+        return strAll;
+    }
+};
+
+BOOST_AUTO_TEST_SUITE(jsonstream_tests)
+
+BOOST_AUTO_TEST_CASE(jsonstream_matches_univalue)
+{
+    UniValue inner(UniValue::VARR);
+    inner.push_back(1);
+    inner.push_back("two \"quoted\"\n");
+    inner.push_back(NullUniValue);
+    UniValue empty(UniValue::VOBJ);
+
+    UniValue expected(UniValue::VOBJ);
+    expected.push_back(Pair("a", inner));
+    expected.push_back(Pair("b", empty));
+    expected.push_back(Pair("c", UniValue(UniValue::VARR)));
+    expected.push_back(Pair("key \"with\" quotes", true));
+    expected.push_back(Pair("e", 1.5));
+
+    CJSONStringStream out;
+    out.BeginObject();
+    out.Key("a");
+    out.BeginArray();
+    out.Value(1);
+    out.Value("two \"quoted\"\n");
+    out.Value(NullUniValue);
+    out.EndArray();
+    out.Key("b");
+    out.BeginObject();
+    out.EndObject();
+    out.Key("c");
+    out.BeginArray();
+    out.EndArray();
+    out.Pair("key \"with\" quotes", true);
+    out.Pair("e", 1.5);
+    out.EndObject();
+
+    BOOST_CHECK(!out.Started());
+    BOOST_CHECK_EQUAL(out.str(), expected.write());
+    BOOST_CHECK_EQUAL(out.vChunks.size(), 1U);
+    BOOST_CHECK(out.Started());
+
+    // Nested containers as array elements
+    CJSONStringStream outArray;
+    outArray.BeginArray();
+    outArray.BeginObject();
+    outArray.Pair("x", 1);
+    outArray.EndObject();
+    outArray.BeginArray();
+    outArray.EndArray();
+    outArray.Value(expected);
+    outArray.EndArray();
+    UniValue expectedArray(UniValue::VARR);
+    UniValue x(UniValue::VOBJ);
+    x.push_back(Pair("x", 1));
+    expectedArray.push_back(x);
+    expectedArray.push_back(UniValue(UniValue::VARR));
+    expectedArray.push_back(expected);
+    BOOST_CHECK_EQUAL(outArray.str(), expectedArray.write());
+}
+
+BOOST_AUTO_TEST_CASE(jsonstream_chunks)
+{
+    UniValue expected(UniValue::VARR);
+    CJSONStringStream out;
+    out.BeginArray();
+    for (int i = 0; i < 20000; i++) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("n", i));
+        entry.push_back(Pair("s", string(10, 'a' + i % 26)));
+        expected.push_back(entry);
+        out.Value(entry);
+    }
+    out.EndArray();
+
+    // Written out in pieces of about the flush size as it went
+    BOOST_CHECK(out.vChunks.size() > 1);
+    for (unsigned int i = 0; i < out.vChunks.size(); i++) {
+        BOOST_CHECK(out.vChunks[i].size() >= JSON_STREAM_FLUSH_SIZE);
+        BOOST_CHECK(out.vChunks[i].size() < JSON_STREAM_FLUSH_SIZE + 64);
+    }
+    BOOST_CHECK_EQUAL(out.str(), expected.write());
+
+    // Nothing can be taken back once written out
+    CJSONStringStream outClosed;
+    outClosed.fClosed = true;
+    outClosed.BeginArray();
+    for (int i = 0; i < 20000 && !outClosed.Failed(); i++)
+        outClosed.Value(string(10, 'a'));
+    BOOST_CHECK(outClosed.Failed());
+    BOOST_CHECK_EQUAL(outClosed.vChunks.size(), 1U);
+
+    // Unless nothing was
+    CJSONStringStream outReset;
+    outReset.BeginObject();
+    outReset.Key("result");
+    outReset.Reset();
+    outReset.BeginArray();
+    outReset.EndArray();
+    BOOST_CHECK_EQUAL(outReset.str(), "[]");
+}
+
+BOOST_AUTO_TEST_CASE(jsonstream_block)
+{
+    LOCK(cs_main);
+    CBlockIndex* pindex = chainActive.Genesis();
+    BOOST_REQUIRE(pindex);
+    const CBlock& block = Params().GenesisBlock();
+
+    for (int txDetails = 0; txDetails < 2; txDetails++) {
+        CJSONStringStream out;
+        blockToJSONStream(block, pindex, txDetails, out);
+        BOOST_CHECK_EQUAL(out.str(), blockToJSON(block, pindex, txDetails).write());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,7 @@
 #include "key.h"
 
 #include "base58.h"
+#include "ecwrapper.h"
 #include "script/script.h"
 #include "uint256.h"
 #include "util.h"
@@ -185,6 +186,36 @@ BOOST_AUTO_TEST_CASE(key_test1)
     BOOST_CHECK(key2C.SignCompact(hashMsg, detsigc));
     BOOST_CHECK(detsig == ParseHex("1c469e065172b99b782ac742d54a568867eb13274864665e605272a8f11c696cdf5892001019e2813b39887c3f5e67048751b16ebb5fd2f9f3a38639538234e4f1"));
     BOOST_CHECK(detsigc == ParseHex("20469e065172b99b782ac742d54a568867eb13274864665e605272a8f11c696cdf5892001019e2813b39887c3f5e67048751b16ebb5fd2f9f3a38639538234e4f1"));
+
+    // Encodings that were valid before BIP66 must verify the same way through
+    // CPubKey::Verify as through OpenSSL, which reads R and S as unsigned and
+    // re-encodes them, whichever verifier the build uses.
+    struct {
+        CPubKey pubkey;
+        const char* sig;
+        bool fValid;
+    } vLaxSigs[] = {
+        // strict DER
+        {pubkey2, "30440220469e065172b99b782ac742d54a568867eb13274864665e605272a8f11c696cdf02205892001019e2813b39887c3f5e67048751b16ebb5fd2f9f3a38639538234e4f1", true},
+        // excess zero padding in R or S
+        {pubkey2, "3045022100469e065172b99b782ac742d54a568867eb13274864665e605272a8f11c696cdf02205892001019e2813b39887c3f5e67048751b16ebb5fd2f9f3a38639538234e4f1", true},
+        {pubkey2, "30450220469e065172b99b782ac742d54a568867eb13274864665e605272a8f11c696cdf0221005892001019e2813b39887c3f5e67048751b16ebb5fd2f9f3a38639538234e4f1", true},
+        // R with its high bit set but no sign byte
+        {pubkey1, "304402208e7fe2176fc31d4c8ade9f7f07361409eff432d62e98dce653a95850a7793f910220487bcbf390003988a0cc46f3ed2bf013b78ca3a40406bde7991004487ba58695", true},
+        // long form sequence length and trailing garbage
+        {pubkey2, "3081440220469e065172b99b782ac742d54a568867eb13274864665e605272a8f11c696cdf02205892001019e2813b39887c3f5e67048751b16ebb5fd2f9f3a38639538234e4f1", true},
+        {pubkey2, "30440220469e065172b99b782ac742d54a568867eb13274864665e605272a8f11c696cdf02205892001019e2813b39887c3f5e67048751b16ebb5fd2f9f3a38639538234e4f101", true},
+        // R wider than 32 bytes, truncated S
+        {pubkey2, "3045022101469e065172b99b782ac742d54a568867eb13274864665e605272a8f11c696cdf02205892001019e2813b39887c3f5e67048751b16ebb5fd2f9f3a38639538234e4f1", false},
+        {pubkey2, "30440220469e065172b99b782ac742d54a568867eb13274864665e605272a8f11c696cdf02205892001019e2813b39887c3f5e67048751b16ebb5fd2f9f3a38639538234e4", false},
+    };
+    for (unsigned int i = 0; i < sizeof(vLaxSigs) / sizeof(vLaxSigs[0]); i++) {
+        std::vector<unsigned char> vchSig = ParseHex(vLaxSigs[i].sig);
+        CECKey ecKey;
+        BOOST_CHECK(ecKey.SetPubKey(vLaxSigs[i].pubkey.begin(), vLaxSigs[i].pubkey.size()));
+        BOOST_CHECK_MESSAGE(ecKey.Verify(hashMsg, vchSig) == vLaxSigs[i].fValid, vLaxSigs[i].sig);
+        BOOST_CHECK_MESSAGE(vLaxSigs[i].pubkey.Verify(hashMsg, vchSig) == vLaxSigs[i].fValid, vLaxSigs[i].sig);
+    }
 }
 
 BOOST_AUTO_TEST_SUITE_END()
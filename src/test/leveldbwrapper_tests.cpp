@@ -0,0 +1,80 @@
+// Copyright (c) 2018 The Basex developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "leveldbwrapper.h"
+#include "uint256.h"
+#include "util.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(leveldbwrapper_tests)
+
+BOOST_AUTO_TEST_CASE(leveldbwrapper_profile)
+{
+    map<string, vector<string> > mapMultiArgsSaved = mapMultiArgs;
+    mapMultiArgs.clear();
+
+    CLevelDBProfile profile = GetLevelDBProfile("chainstate", 8 << 20);
+    BOOST_CHECK_EQUAL(profile.nBlockCacheSize, 4U << 20);
+    BOOST_CHECK_EQUAL(profile.nWriteBufferSize, 2U << 20);
+    BOOST_CHECK_EQUAL(profile.nMaxOpenFiles, DEFAULT_LEVELDB_MAX_OPEN_FILES);
+    BOOST_CHECK_EQUAL(profile.nBloomBits, DEFAULT_LEVELDB_BLOOM_BITS);
+
+    // A named entry beats plain ones wherever it appears
+    mapMultiArgs["-dbmaxopenfiles"].push_back("chainstate:1000");
+    mapMultiArgs["-dbmaxopenfiles"].push_back("200");
+    mapMultiArgs["-dbwritebuffer"].push_back("chainstate:1");
+    mapMultiArgs["-dbbloombits"].push_back("0");
+
+    profile = GetLevelDBProfile("chainstate", 8 << 20);
+    BOOST_CHECK_EQUAL(profile.nMaxOpenFiles, 1000);
+    BOOST_CHECK_EQUAL(profile.nWriteBufferSize, 1U << 20);
+    BOOST_CHECK_EQUAL(profile.nBlockCacheSize, 6U << 20);
+    BOOST_CHECK_EQUAL(profile.nBloomBits, 0);
+
+    profile = GetLevelDBProfile("blocktree", 8 << 20);
+    BOOST_CHECK_EQUAL(profile.nMaxOpenFiles, 200);
+    BOOST_CHECK_EQUAL(profile.nWriteBufferSize, 2U << 20);
+
+    mapMultiArgs = mapMultiArgsSaved;
+}
+
+BOOST_AUTO_TEST_CASE(leveldbwrapper_stats)
+{
+    CLevelDBWrapper db("leveldbwrapper_tests", GetTempPath() / "leveldbwrapper_tests", 1 << 20, true);
+
+    for (int i = 0; i < 20000; i++)
+        BOOST_CHECK(db.Write(make_pair('k', i), uint256(i)));
+    db.Compact();
+
+    uint256 value;
+    for (int i = 0; i < 20000; i += 100) {
+        BOOST_CHECK(db.Read(make_pair('k', i), value));
+        BOOST_CHECK(value == uint256(i));
+    }
+
+    vector<CLevelDBStats> vStats = GetLevelDBStats();
+    const CLevelDBStats* pstats = NULL;
+    for (unsigned int i = 0; i < vStats.size(); i++) {
+        if (vStats[i].strName == "leveldbwrapper_tests")
+            pstats = &vStats[i];
+    }
+    BOOST_REQUIRE(pstats);
+
+    // Everything was compacted out of the write buffer into tables
+    int nFiles = 0;
+    uint64_t nBytes = 0;
+    for (unsigned int i = 0; i < pstats->vLevels.size(); i++) {
+        nFiles += pstats->vLevels[i].nFiles;
+        nBytes += pstats->vLevels[i].nBytes;
+    }
+    BOOST_CHECK(nFiles > 0);
+    BOOST_CHECK(nBytes > 20000 * 32);
+    BOOST_CHECK(pstats->nCacheHits + pstats->nCacheMisses >= 200);
+    BOOST_CHECK(pstats->nCacheHits > 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -58,17 +58,17 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     BOOST_CHECK_EQUAL(removed.size(), 0);
 
     // Just the parent:
-    testPool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 0, 0, 0.0, 1));
+    testPool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 0, 0, 0.0, 1, 0));
     testPool.remove(txParent, removed, true);
     BOOST_CHECK_EQUAL(removed.size(), 1);
     removed.clear();
     
     // Parent, children, grandchildren:
-    testPool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 0, 0, 0.0, 1));
+    testPool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 0, 0, 0.0, 1, 0));
     for (int i = 0; i < 3; i++)
     {
-        testPool.addUnchecked(txChild[i].GetHash(), CTxMemPoolEntry(txChild[i], 0, 0, 0.0, 1));
-        testPool.addUnchecked(txGrandChild[i].GetHash(), CTxMemPoolEntry(txGrandChild[i], 0, 0, 0.0, 1));
+        testPool.addUnchecked(txChild[i].GetHash(), CTxMemPoolEntry(txChild[i], 0, 0, 0.0, 1, 0));
+        testPool.addUnchecked(txGrandChild[i].GetHash(), CTxMemPoolEntry(txGrandChild[i], 0, 0, 0.0, 1, 0));
     }
     // Remove Child[0], GrandChild[0] should be removed:
     testPool.remove(txChild[0], removed, true);
@@ -88,8 +88,8 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     // Add children and grandchildren, but NOT the parent (simulate the parent being in a block)
     for (int i = 0; i < 3; i++)
     {
-        testPool.addUnchecked(txChild[i].GetHash(), CTxMemPoolEntry(txChild[i], 0, 0, 0.0, 1));
-        testPool.addUnchecked(txGrandChild[i].GetHash(), CTxMemPoolEntry(txGrandChild[i], 0, 0, 0.0, 1));
+        testPool.addUnchecked(txChild[i].GetHash(), CTxMemPoolEntry(txChild[i], 0, 0, 0.0, 1, 0));
+        testPool.addUnchecked(txGrandChild[i].GetHash(), CTxMemPoolEntry(txGrandChild[i], 0, 0, 0.0, 1, 0));
     }
     // Now remove the parent, as might happen if a block-re-org occurs but the parent cannot be
     // put into the mempool (maybe because it is non-standard):
@@ -99,4 +99,135 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     removed.clear();
 }
 
+BOOST_AUTO_TEST_CASE(MempoolIndexesTest)
+{
+    // Test the fee rate index and in-pool parent tracking used by CreateNewBlock
+    CTxMemPool pool(CFeeRate(0));
+
+    CMutableTransaction tx1;
+    tx1.vin.resize(1);
+    tx1.vin[0].scriptSig = CScript() << OP_11;
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx1.GetHash(), CTxMemPoolEntry(tx1, 10000LL, 0, 10.0, 1, 10 * COIN));
+
+    CMutableTransaction tx2;
+    tx2.vin.resize(1);
+    tx2.vin[0].scriptSig = CScript() << OP_12;
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx2.vout[0].nValue = 2 * COIN;
+    pool.addUnchecked(tx2.GetHash(), CTxMemPoolEntry(tx2, 20000LL, 0, 9.0, 1, 2 * COIN));
+
+    // Child of tx1 paying the lowest fee
+    CMutableTransaction tx3;
+    tx3.vin.resize(1);
+    tx3.vin[0].prevout = COutPoint(tx1.GetHash(), 0);
+    tx3.vin[0].scriptSig = CScript() << OP_11;
+    tx3.vout.resize(1);
+    tx3.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx3.vout[0].nValue = 5 * COIN;
+    pool.addUnchecked(tx3.GetHash(), CTxMemPoolEntry(tx3, 0LL, 0, 0.0, 1, 0));
+
+    BOOST_CHECK_EQUAL(pool.size(), 3);
+    CTxMemPool::indexed_transaction_set::index<mining_score>::type::iterator it = pool.mapTx.get<mining_score>().begin();
+    BOOST_CHECK((it++)->GetTx().GetHash() == tx2.GetHash());
+    BOOST_CHECK((it++)->GetTx().GetHash() == tx1.GetHash());
+    BOOST_CHECK((it++)->GetTx().GetHash() == tx3.GetHash());
+
+    // tx1 carries its low fee child
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx1.GetHash())->GetCountWithDescendants(), 2);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx1.GetHash())->GetModFeesWithDescendants(), 10000LL);
+
+    BOOST_CHECK(pool.mapTx.find(tx1.GetHash())->GetMemPoolParents().empty());
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx3.GetHash())->GetMemPoolParents().size(), 1);
+    BOOST_CHECK(pool.mapTx.find(tx3.GetHash())->GetMemPoolParents().count(tx1.GetHash()));
+
+    // Prioritising re-sorts the entry
+    pool.PrioritiseTransaction(tx3.GetHash(), tx3.GetHash().ToString(), 0.0, 50000LL);
+    BOOST_CHECK(pool.mapTx.get<mining_score>().begin()->GetTx().GetHash() == tx3.GetHash());
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx3.GetHash())->GetModifiedFee(), 50000LL);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx1.GetHash())->GetModFeesWithDescendants(), 60000LL);
+
+    // Mining the parent releases the child
+    std::vector<CTransaction> vtx;
+    vtx.push_back(tx1);
+    std::list<CTransaction> conflicts;
+    pool.removeForBlock(vtx, 2, conflicts);
+    BOOST_CHECK_EQUAL(pool.size(), 2);
+    BOOST_CHECK(pool.mapTx.find(tx3.GetHash())->GetMemPoolParents().empty());
+
+    // Re-adding it (as in a re-org) links the child again
+    pool.addUnchecked(tx1.GetHash(), CTxMemPoolEntry(tx1, 10000LL, 0, 10.0, 1, 10 * COIN));
+    BOOST_CHECK(pool.mapTx.find(tx3.GetHash())->GetMemPoolParents().count(tx1.GetHash()));
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx1.GetHash())->GetCountWithDescendants(), 2);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx1.GetHash())->GetModFeesWithDescendants(), 60000LL);
+
+    pool.clear();
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+    BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
+{
+    CTxMemPool pool(CFeeRate(1000));
+
+    // Three unrelated transactions entered at increasing times and fee rates
+    CMutableTransaction tx[3];
+    for (int i = 0; i < 3; i++) {
+        tx[i].vin.resize(1);
+        tx[i].vin[0].scriptSig = CScript() << OP_1 << i;
+        tx[i].vout.resize(1);
+        tx[i].vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx[i].vout[0].nValue = 10 * COIN;
+        pool.addUnchecked(tx[i].GetHash(), CTxMemPoolEntry(tx[i], 1000LL * (i + 1), 100 * (i + 1), 0.0, 1, 10 * COIN));
+    }
+    BOOST_CHECK(pool.DynamicMemoryUsage() > 0);
+
+    // Trimming just below the current usage evicts the lowest fee rate first
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK_EQUAL(pool.size(), 2);
+    BOOST_CHECK(!pool.exists(tx[0].GetHash()));
+    BOOST_CHECK(pool.GetMinFee(1).GetFeePerK() > 1000);
+
+    // Expiry removes everything that entered before the given time
+    BOOST_CHECK_EQUAL(pool.Expire(250), 1);
+    BOOST_CHECK(!pool.exists(tx[1].GetHash()));
+    BOOST_CHECK(pool.exists(tx[2].GetHash()));
+
+    pool.TrimToSize(0);
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolDescendantScoreTieTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+
+    // Two unrelated transactions of the same size, fee and entry time
+    CMutableTransaction tx[2];
+    for (int i = 0; i < 2; i++) {
+        tx[i].vin.resize(1);
+        tx[i].vin[0].scriptSig = CScript() << OP_1 << i;
+        tx[i].vout.resize(1);
+        tx[i].vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx[i].vout[0].nValue = 10 * COIN;
+        pool.addUnchecked(tx[i].GetHash(), CTxMemPoolEntry(tx[i], 1000LL, 100, 0.0, 1, 10 * COIN));
+    }
+    BOOST_CHECK_EQUAL(pool.size(), 2);
+
+    const CTxMemPoolEntry& a = *pool.mapTx.find(tx[0].GetHash());
+    const CTxMemPoolEntry& b = *pool.mapTx.find(tx[1].GetHash());
+    CompareTxMemPoolEntryByDescendantScore cmp;
+    BOOST_CHECK(!cmp(a, a));
+    BOOST_CHECK(cmp(a, b) != cmp(b, a));
+
+    // The tie is broken by hash, so eviction picks the lower hash first
+    uint256 hashFirst = tx[0].GetHash() < tx[1].GetHash() ? tx[0].GetHash() : tx[1].GetHash();
+    BOOST_CHECK(pool.mapTx.get<descendant_score>().begin()->GetTx().GetHash() == hashFirst);
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK_EQUAL(pool.size(), 1);
+    BOOST_CHECK(!pool.exists(hashFirst));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -277,6 +277,60 @@ BOOST_AUTO_TEST_CASE(multisig_Solver1)
     }
 }
 
+BOOST_AUTO_TEST_CASE(multisig_Solver_templates)
+{
+    // The byte pattern matchers only accept the canonical encodings; any
+    // other push of the right size must still be solved by the generic
+    // template matcher with the same result.
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    CKeyID keyid = pubkey.GetID();
+
+    CScript p2pkh;
+    p2pkh << OP_DUP << OP_HASH160 << ToByteVector(keyid) << OP_EQUALVERIFY << OP_CHECKSIG;
+    uint160 hash;
+    BOOST_CHECK(MatchPayToPubkeyHash(p2pkh, hash));
+    BOOST_CHECK(CKeyID(hash) == keyid);
+    BOOST_CHECK(!MatchPayToScriptHash(p2pkh, hash));
+
+    CScript p2pk;
+    p2pk << ToByteVector(pubkey) << OP_CHECKSIG;
+    CPubKey pubkeyRet;
+    BOOST_CHECK(MatchPayToPubkey(p2pk, pubkeyRet));
+    BOOST_CHECK(pubkeyRet == pubkey);
+    BOOST_CHECK(!MatchPayToPubkeyHash(p2pk, hash));
+
+    // Same hash, pushed with OP_PUSHDATA1
+    CScript p2pkhPushData;
+    p2pkhPushData << OP_DUP << OP_HASH160 << OP_PUSHDATA1;
+    p2pkhPushData.push_back(20);
+    p2pkhPushData.insert(p2pkhPushData.end(), keyid.begin(), keyid.end());
+    p2pkhPushData << OP_EQUALVERIFY << OP_CHECKSIG;
+    BOOST_CHECK(!MatchPayToPubkeyHash(p2pkhPushData, hash));
+
+    vector<valtype> solutions, solutionsPushData;
+    txnouttype whichType, whichTypePushData;
+    BOOST_CHECK(Solver(p2pkh, whichType, solutions));
+    BOOST_CHECK(Solver(p2pkhPushData, whichTypePushData, solutionsPushData));
+    BOOST_CHECK_EQUAL(whichType, TX_PUBKEYHASH);
+    BOOST_CHECK_EQUAL(whichTypePushData, TX_PUBKEYHASH);
+    BOOST_CHECK(solutions == solutionsPushData);
+
+    // Multisig with keys out of the 33-65 byte range is not standard
+    CScript badMultisig;
+    badMultisig << OP_1 << valtype(32, 0x02) << OP_1 << OP_CHECKMULTISIG;
+    BOOST_CHECK(!Solver(badMultisig, whichType, solutions));
+    BOOST_CHECK_EQUAL(whichType, TX_NONSTANDARD);
+
+    CScript multisig;
+    multisig << OP_1 << ToByteVector(pubkey) << OP_1 << OP_CHECKMULTISIG;
+    BOOST_CHECK(Solver(multisig, whichType, solutions));
+    BOOST_CHECK_EQUAL(whichType, TX_MULTISIG);
+    BOOST_CHECK_EQUAL(solutions.size(), 3U);
+    BOOST_CHECK(solutions[1] == ToByteVector(pubkey));
+}
+
 BOOST_AUTO_TEST_CASE(multisig_Sign)
 {
     // Test SignSignature() (and therefore the version of Solver() that signs transactions)
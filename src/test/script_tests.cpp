@@ -667,6 +667,40 @@ BOOST_AUTO_TEST_CASE(script_invalid)
     }
 }
 
+BOOST_AUTO_TEST_CASE(script_stack)
+{
+    valtype a(1, 'a'), b(2, 'b'), c(3, 'c');
+    CScriptStack stack;
+    stack.push_back(a);
+    stack.push_back(b);
+    stack.push_back(c);
+
+    // Pushing an element of the stack itself
+    stack.push_back(stack.at(0));
+    BOOST_CHECK_EQUAL(stack.size(), 4U);
+    BOOST_CHECK(stack.back() == a);
+
+    // Erased and popped slots are reused without disturbing live elements
+    stack.erase(stack.begin() + 1);
+    BOOST_CHECK_EQUAL(stack.size(), 3U);
+    BOOST_CHECK(stack.at(0) == a && stack.at(1) == c && stack.at(2) == a);
+    stack.insert(stack.end() - 2, b);
+    BOOST_CHECK(stack.at(0) == a && stack.at(1) == b && stack.at(2) == c && stack.at(3) == a);
+    stack.pop_back();
+    stack.pop_back();
+    stack.push_back(a);
+    BOOST_CHECK_EQUAL(stack.size(), 3U);
+    BOOST_CHECK(stack.at(2) == a);
+    BOOST_CHECK_THROW(stack.at(3), std::out_of_range);
+
+    CScriptStack stackCopy;
+    stackCopy = stack;
+    stack.clear();
+    BOOST_CHECK(stack.empty());
+    BOOST_CHECK_EQUAL(stackCopy.size(), 3U);
+    BOOST_CHECK(stackCopy.at(1) == b);
+}
+
 BOOST_AUTO_TEST_CASE(script_PushData)
 {
     // Check that PUSHDATA1, PUSHDATA2, and PUSHDATA4 create the same value on
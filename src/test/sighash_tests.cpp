@@ -135,9 +135,11 @@ BOOST_AUTO_TEST_CASE(sighash_test)
         RandomScript(scriptCode);
         int nIn = insecure_rand() % txTo.vin.size();
 
-        uint256 sh, sho;
+        uint256 sh, sho, shp;
         sho = SignatureHashOld(scriptCode, txTo, nIn, nHashType);
         sh = SignatureHash(scriptCode, txTo, nIn, nHashType);
+        PrecomputedTransactionData txdata(txTo);
+        shp = SignatureHash(scriptCode, txTo, nIn, nHashType, &txdata);
         #if defined(PRINT_SIGHASH_JSON)
         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
         ss << txTo;
@@ -154,6 +156,7 @@ BOOST_AUTO_TEST_CASE(sighash_test)
         std::cout << "\n";
         #endif
         BOOST_CHECK(sh == sho);
+        BOOST_CHECK(shp == sho);
     }
     #if defined(PRINT_SIGHASH_JSON)
     std::cout << "]\n";
@@ -206,6 +209,10 @@ BOOST_AUTO_TEST_CASE(sighash_from_data)
 
         sh = SignatureHash(scriptCode, tx, nIn, nHashType);
         BOOST_CHECK_MESSAGE(sh.GetHex() == sigHashHex, strTest);
+
+        PrecomputedTransactionData txdata(tx);
+        sh = SignatureHash(scriptCode, tx, nIn, nHashType, &txdata);
+        BOOST_CHECK_MESSAGE(sh.GetHex() == sigHashHex, strTest);
     }
 }
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,153 @@
+// Copyright (c) 2018 The Basex developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "main.h"
+#include "random.h"
+#include "streams.h"
+#include "txdb.h"
+#include "txoutsnapshot.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(txoutsnapshot_tests)
+
+/** Swaps in-memory databases for the global ones for the length of a test */
+struct SnapshotDatabases {
+    CBlockTreeDB* pblocktreeSaved;
+    CCoinsViewDB* pcoinsdbviewSaved;
+    CCoinsViewCache* pcoinsTipSaved;
+
+    SnapshotDatabases()
+    {
+        pblocktreeSaved = pblocktree;
+        pcoinsdbviewSaved = pcoinsdbview;
+        pcoinsTipSaved = pcoinsTip;
+        pblocktree = new CBlockTreeDB(1 << 20, true);
+        pcoinsdbview = new CCoinsViewDB(1 << 20, true);
+        pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+    }
+
+    ~SnapshotDatabases()
+    {
+        delete pcoinsTip;
+        delete pcoinsdbview;
+        delete pblocktree;
+        pblocktree = pblocktreeSaved;
+        pcoinsdbview = pcoinsdbviewSaved;
+        pcoinsTip = pcoinsTipSaved;
+    }
+};
+
+BOOST_AUTO_TEST_CASE(txoutsnapshot_roundtrip)
+{
+    boost::filesystem::path path = GetTempPath() / strprintf("test_txoutsnapshot_%i", (int)GetRand(100000));
+    CTxOutSnapshotHeader header;
+    CCoinsCommitment commitment;
+    vector<uint256> txids;
+    {
+        SnapshotDatabases dbs;
+
+        // A chain state at the genesis block, the tip of the test chain
+        for (unsigned int i = 0; i < 100; i++) {
+            CMutableTransaction tx;
+            tx.vout.resize(1 + i % 3);
+            for (unsigned int n = 0; n < tx.vout.size(); n++) {
+                tx.vout[n].nValue = 1000 * (i + 1) + n;
+                tx.vout[n].scriptPubKey = CScript() << OP_TRUE;
+            }
+            txids.push_back(GetRandHash());
+            CCoinsModifier coins = pcoinsTip->ModifyCoins(txids.back());
+            coins->FromTx(tx, 1);
+            pcoinsTip->GetCommitmentDelta().AddCoins(txids.back(), *coins);
+        }
+        pcoinsTip->SetBestBlock(chainActive.Tip()->GetBlockHash());
+        BOOST_CHECK(pcoinsTip->GetCommitment(commitment));
+
+        string strError;
+        BOOST_CHECK(DumpTxOutSnapshot(path.string(), header, strError));
+        BOOST_CHECK_EQUAL(header.nHeight, 0);
+        BOOST_CHECK(header.hashBlock == Params().HashGenesisBlock());
+        BOOST_CHECK(header.commitment == commitment);
+        BOOST_CHECK_EQUAL(header.commitment.nTransactions, 100);
+        BOOST_CHECK(header.hashCoins != 0);
+        BOOST_CHECK(!boost::filesystem::exists(path.string() + ".incomplete"));
+    }
+
+    // Snapshots have to be accepted first
+    {
+        SnapshotDatabases dbs;
+        string strError;
+        BOOST_CHECK(!LoadTxOutSnapshot(path.string(), strError));
+        BOOST_CHECK(strError.find("not accepted") != string::npos);
+        BOOST_CHECK(pcoinsdbview->GetBestBlock() == uint256(0));
+    }
+
+    mapMultiArgs["-assumeutxo"].push_back(header.hashBlock.GetHex() + ":" + header.GetSnapshotHash().GetHex());
+    {
+        SnapshotDatabases dbs;
+        string strError;
+        BOOST_CHECK(LoadTxOutSnapshot(path.string(), strError));
+        BOOST_CHECK(pcoinsdbview->GetBestBlock() == header.hashBlock);
+
+        CCoinsCommitment commitmentLoaded;
+        BOOST_CHECK(pcoinsdbview->GetCommitment(commitmentLoaded));
+        BOOST_CHECK(commitmentLoaded == commitment);
+        BOOST_FOREACH (const uint256& txid, txids)
+            BOOST_CHECK(pcoinsdbview->HaveCoins(txid));
+
+        bool fFlag = false;
+        BOOST_CHECK(pblocktree->ReadFlag("prunedblockfiles", fFlag) && fFlag);
+        BOOST_CHECK(pblocktree->ReadFlag("loadingtxoutset", fFlag) && !fFlag);
+    }
+
+    // The coins are checked against their sequential hash, not just the summary
+    {
+        CTxOutSnapshotHeader headerForged = header;
+        headerForged.hashCoins = GetRandHash();
+        {
+            CAutoFile file(fopen(path.string().c_str(), "r+b"), SER_DISK, CLIENT_VERSION);
+            BOOST_REQUIRE(!file.IsNull());
+            file << headerForged;
+        }
+        mapMultiArgs["-assumeutxo"].push_back(headerForged.hashBlock.GetHex() + ":" + headerForged.GetSnapshotHash().GetHex());
+
+        SnapshotDatabases dbs;
+        string strError;
+        BOOST_CHECK(!LoadTxOutSnapshot(path.string(), strError));
+        BOOST_CHECK(strError.find("coins do not match") != string::npos);
+        BOOST_CHECK(pcoinsdbview->GetBestBlock() == uint256(0));
+
+        mapMultiArgs["-assumeutxo"].pop_back();
+        CAutoFile file(fopen(path.string().c_str(), "r+b"), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(!file.IsNull());
+        file << header;
+    }
+
+    // Flip a byte in the last coins chunk: its checksum no longer matches
+    {
+        FILE* file = fopen(path.string().c_str(), "r+b");
+        BOOST_REQUIRE(file);
+        fseek(file, -60, SEEK_END);
+        int ch = fgetc(file);
+        fseek(file, -60, SEEK_END);
+        fputc(ch ^ 1, file);
+        fclose(file);
+
+        SnapshotDatabases dbs;
+        string strError;
+        BOOST_CHECK(!LoadTxOutSnapshot(path.string(), strError));
+        BOOST_CHECK(strError.find("checksum") != string::npos);
+        BOOST_CHECK(pcoinsdbview->GetBestBlock() == uint256(0));
+    }
+
+    mapMultiArgs.erase("-assumeutxo");
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,11 @@
 
 #include "wallet.h"
 
+#include "main.h"
+#include "random.h"
+#include "script/standard.h"
+#include "txmempool.h"
+
 #include <set>
 #include <stdint.h>
 #include <utility>
@@ -305,4 +310,203 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+typedef vector<pair<CAmount, pair<const CWalletTx*, unsigned int> > > CoinValues;
+
+static void add_value(CoinValues& vValue, const CAmount& nValue)
+{
+    vValue.push_back(make_pair(nValue, make_pair((const CWalletTx*)NULL, (unsigned int)vValue.size())));
+}
+
+BOOST_AUTO_TEST_CASE(coin_selection_bnb_tests)
+{
+    CoinValues vValue;
+    vector<char> vfBest;
+    CAmount nBest;
+
+    // an exact match among 5, 4, 3, 2 and 1 cents, with no room for an excess
+    for (int n = 5; n > 0; n--)
+        add_value(vValue, n * CENT);
+    BOOST_CHECK(SelectCoinsBnB(vValue, 6 * CENT, 1, vfBest, nBest));
+    BOOST_CHECK_EQUAL(nBest, 6 * CENT);
+    CAmount nTotal = 0;
+    for (unsigned int i = 0; i < vValue.size(); i++)
+        if (vfBest[i])
+            nTotal += vValue[i].first;
+    BOOST_CHECK_EQUAL(nTotal, 6 * CENT);
+
+    // it is only found after 5+4, 5+3 and 5+2 cents were tried
+    BOOST_CHECK(!SelectCoinsBnB(vValue, 6 * CENT, 1, vfBest, nBest, 2));
+
+    // no odd total can be made of even values; the search gives up after MAX_BNB_TRIES
+    // nodes instead of walking all the subsets
+    vValue.clear();
+    for (int i = 0; i < 100; i++)
+        add_value(vValue, 2);
+    BOOST_CHECK(!SelectCoinsBnB(vValue, 101, 1, vfBest, nBest));
+
+    // without a subset that needs no change, SelectCoinsMinConf falls back to the knapsack
+    CAmount nNoChange = 3 * ::minRelayTxFee.GetFee(34 + 148);
+    vValue.clear();
+    for (int i = 0; i < 3; i++)
+        add_value(vValue, 6 * CENT);
+    BOOST_CHECK(!SelectCoinsBnB(vValue, 10 * CENT, nNoChange, vfBest, nBest));
+
+    CoinSet setCoinsRet;
+    CAmount nValueRet;
+    LOCK(wallet.cs_wallet);
+    empty_wallet();
+    for (int i = 0; i < 3; i++)
+        add_coin(6 * CENT);
+    BOOST_CHECK(wallet.SelectCoinsMinConf(10 * CENT, 1, 6, vCoins, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 12 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+    empty_wallet();
+}
+
+/**
+ * Give the wallet a key and build txReceive, which pays 5 coins to it and 7
+ * to someone else, and txSpend, which spends the 5 coins to someone else.
+ */
+static void make_receive_and_spend(CWallet& wallet, CMutableTransaction& txReceive, CMutableTransaction& txSpend)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    BOOST_CHECK(wallet.AddKey(key));
+    CKey keyOther;
+    keyOther.MakeNewKey(true);
+
+    txReceive.vin.resize(1);
+    txReceive.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txReceive.vout.resize(2);
+    txReceive.vout[0].nValue = 5 * COIN;
+    txReceive.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    txReceive.vout[1].nValue = 7 * COIN;
+    txReceive.vout[1].scriptPubKey = GetScriptForDestination(keyOther.GetPubKey().GetID());
+
+    txSpend.vin.resize(1);
+    txSpend.vin[0].prevout = COutPoint(txReceive.GetHash(), 0);
+    txSpend.vout.resize(1);
+    txSpend.vout[0].nValue = 4 * COIN;
+    txSpend.vout[0].scriptPubKey = GetScriptForDestination(keyOther.GetPubKey().GetID());
+}
+
+/** Add tx to the wallet, either confirmed in the tip block or in the mempool since nTime */
+static void add_wallet_tx(CWallet& wallet, const CMutableTransaction& tx, bool fConfirmed = false, int64_t nTime = GetTime())
+{
+    CWalletTx wtx(&wallet, tx);
+    if (fConfirmed) {
+        wtx.hashBlock = chainActive.Tip()->GetBlockHash();
+        wtx.nIndex = 0;
+        wtx.fMerkleVerified = true;
+    } else {
+        mempool.addUnchecked(wtx.GetHash(), CTxMemPoolEntry(tx, 0, nTime, 0.0, 1, 0));
+    }
+    BOOST_CHECK(wallet.AddToWallet(wtx, true));
+}
+
+BOOST_AUTO_TEST_CASE(cached_balance_tests)
+{
+    CWallet wallet;
+    CMutableTransaction txReceive, txSpend;
+    make_receive_and_spend(wallet, txReceive, txSpend);
+
+    LOCK2(cs_main, wallet.cs_wallet);
+    add_wallet_tx(wallet, txReceive);
+    BOOST_CHECK_EQUAL(wallet.GetUnconfirmedBalance(), 5 * COIN);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), 0);
+    BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), 0);
+
+    // An unconfirmed transaction is re-evaluated on every query, so leaving
+    // and re-entering the mempool shows up without the wallet being told.
+    std::list<CTransaction> removed;
+    mempool.remove(txReceive, removed);
+    BOOST_CHECK_EQUAL(wallet.GetUnconfirmedBalance(), 0);
+    mempool.addUnchecked(txReceive.GetHash(), CTxMemPoolEntry(txReceive, 0, GetTime(), 0.0, 1, 0));
+    BOOST_CHECK_EQUAL(wallet.GetUnconfirmedBalance(), 5 * COIN);
+
+    // Marking the wallet dirty rebuilds the cache from scratch
+    wallet.MarkDirty();
+    BOOST_CHECK_EQUAL(wallet.GetUnconfirmedBalance(), 5 * COIN);
+    BOOST_CHECK_EQUAL(wallet.GetWatchOnlyBalance(), 0);
+
+    mempool.remove(txReceive, removed);
+}
+
+BOOST_AUTO_TEST_CASE(cached_balance_evicted_spend_tests)
+{
+    CWallet wallet;
+    CMutableTransaction txReceive, txSpend;
+    make_receive_and_spend(wallet, txReceive, txSpend);
+
+    LOCK2(cs_main, wallet.cs_wallet);
+    RegisterValidationInterface(&wallet);
+
+    // A confirmed receive is not re-evaluated on every balance query
+    add_wallet_tx(wallet, txReceive, true);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), 5 * COIN);
+    add_wallet_tx(wallet, txSpend, false, 1);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), 0);
+
+    // Expiring the spend from the mempool gives the output back
+    LimitMempoolSize(mempool, 1000000000, 60 * 60);
+    BOOST_CHECK(!mempool.exists(txSpend.GetHash()));
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), 5 * COIN);
+
+    UnregisterValidationInterface(&wallet);
+}
+
+BOOST_AUTO_TEST_CASE(wallet_coins_tests)
+{
+    CWallet wallet;
+    CMutableTransaction txReceive, txSpend;
+    make_receive_and_spend(wallet, txReceive, txSpend);
+
+    LOCK2(cs_main, wallet.cs_wallet);
+    vector<COutput> vAvailable;
+    add_wallet_tx(wallet, txReceive);
+    wallet.AvailableCoins(vAvailable, false, NULL, false, ALL_COINS, false);
+    BOOST_CHECK_EQUAL(vAvailable.size(), 1U);
+    BOOST_CHECK_EQUAL(vAvailable[0].tx->vout[vAvailable[0].i].nValue, 5 * COIN);
+
+    // Spent by an unconfirmed wallet transaction
+    add_wallet_tx(wallet, txSpend);
+    wallet.AvailableCoins(vAvailable, false, NULL, false, ALL_COINS, false);
+    BOOST_CHECK(vAvailable.empty());
+
+    // The spend dropping out of the mempool makes the output available again
+    std::list<CTransaction> removed;
+    mempool.remove(txSpend, removed);
+    wallet.AvailableCoins(vAvailable, false, NULL, false, ALL_COINS, false);
+    BOOST_CHECK_EQUAL(vAvailable.size(), 1U);
+
+    mempool.remove(txReceive, removed);
+}
+
+BOOST_AUTO_TEST_CASE(keypool_topup_tests)
+{
+    map<string, string> mapArgsSaved = mapArgs;
+    bool fFirstRun;
+    CWallet wallet("wallet_keypool.dat");
+    wallet.LoadWallet(fFirstRun);
+
+    // Keys derived on several threads must all end up in the keystore and the pool
+    mapArgs["-keypool"] = "210";
+    mapArgs["-keypoolthreads"] = "4";
+    BOOST_CHECK(wallet.TopUpKeyPool());
+    BOOST_CHECK_EQUAL(wallet.GetKeyPoolSize(), 211U);
+
+    set<CKeyID> setAddress;
+    wallet.GetAllReserveKeys(setAddress);
+    BOOST_CHECK_EQUAL(setAddress.size(), 211U);
+
+    // Without a background filler, taking a key tops the pool up in place
+    CPubKey pubkey;
+    BOOST_CHECK(wallet.GetKeyFromPool(pubkey));
+    BOOST_CHECK(wallet.HaveKey(pubkey.GetID()));
+    BOOST_CHECK_EQUAL(setAddress.count(pubkey.GetID()), 1U);
+    BOOST_CHECK_EQUAL(wallet.GetKeyPoolSize(), 211U);
+
+    mapArgs = mapArgsSaved;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
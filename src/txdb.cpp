@@ -29,8 +29,25 @@ void static BatchWriteHashBestChain(CLevelDBBatch& batch, const uint256& hash)
     batch.Write('B', hash);
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
+void static BatchWriteCommitment(CLevelDBBatch& batch, const uint256& hashBlock, const CCoinsCommitment& commitment)
 {
+    batch.Write('S', make_pair(hashBlock, commitment));
+}
+
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db("chainstate", GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
+{
+    // The summary is stored with the best block it was computed for. An
+    // empty database starts with an empty summary. One written by an older
+    // version, or whose best block an older version has moved on since, has
+    // none until InitCommitment scans it.
+    uint256 hashBestBlock = GetBestBlock();
+    std::pair<uint256, CCoinsCommitment> summary;
+    if (db.Read('S', summary) && summary.first == hashBestBlock) {
+        commitment = summary.second;
+        fHaveCommitment = true;
+    } else {
+        fHaveCommitment = hashBestBlock == uint256(0);
+    }
 }
 
 bool CCoinsViewDB::GetCoins(const uint256& txid, CCoins& coins) const
@@ -51,7 +68,7 @@ uint256 CCoinsViewDB::GetBestBlock() const
     return hashBestChain;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsCommitment& commitmentDelta)
 {
     CLevelDBBatch batch;
     size_t count = 0;
@@ -67,12 +84,102 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
     }
     if (hashBlock != uint256(0))
         BatchWriteHashBestChain(batch, hashBlock);
+    // The in-memory commitment only advances once the batch is on disk
+    CCoinsCommitment commitmentNew = commitment;
+    if (fHaveCommitment) {
+        commitmentNew += commitmentDelta;
+        BatchWriteCommitment(batch, hashBlock != uint256(0) ? hashBlock : GetBestBlock(), commitmentNew);
+    }
 
     LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
-    return db.WriteBatch(batch);
+    if (!db.WriteBatch(batch))
+        return false;
+    commitment = commitmentNew;
+    return true;
+}
+
+bool CCoinsViewDB::GetCommitment(CCoinsCommitment& commitmentOut) const
+{
+    if (!fHaveCommitment)
+        return false;
+    commitmentOut = commitment;
+    return true;
+}
+
+CCoinsViewDBCursor* CCoinsViewDB::Cursor() const
+{
+    /* No const iterators in LevelDB either; see GetStats. */
+    CCoinsViewDBCursor* pcursor = new CCoinsViewDBCursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
+    pcursor->pcursor->Seek(std::string(1, 'c'));
+    return pcursor;
+}
+
+CCoinsViewDBCursor::CCoinsViewDBCursor(leveldb::Iterator* pcursorIn) : pcursor(pcursorIn)
+{
+}
+
+CCoinsViewDBCursor::~CCoinsViewDBCursor()
+{
+    delete pcursor;
+}
+
+bool CCoinsViewDBCursor::Valid() const
+{
+    if (!pcursor->Valid())
+        return false;
+    leveldb::Slice slKey = pcursor->key();
+    return slKey.size() > 0 && slKey.data()[0] == 'c';
+}
+
+bool CCoinsViewDBCursor::GetKey(uint256& txid) const
+{
+    try {
+        leveldb::Slice slKey = pcursor->key();
+        CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+        char chType;
+        ssKey >> chType >> txid;
+    } catch (const std::exception& e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+    return true;
+}
+
+bool CCoinsViewDBCursor::GetValue(CCoins& coins) const
+{
+    try {
+        leveldb::Slice slValue = pcursor->value();
+        CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+        ssValue >> coins;
+    } catch (const std::exception& e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+    return true;
+}
+
+void CCoinsViewDBCursor::Next()
+{
+    pcursor->Next();
+}
+
+bool CCoinsViewDB::InitCommitment()
+{
+    if (fHaveCommitment)
+        return true;
+
+    LogPrintf("Computing the unspent output set summary...\n");
+    CCoinsStats stats;
+    if (!GetStats(stats))
+        return false;
+    CLevelDBBatch batch;
+    BatchWriteCommitment(batch, stats.hashBlock, stats.commitment);
+    if (!db.WriteBatch(batch, true))
+        return false;
+    commitment = stats.commitment;
+    fHaveCommitment = true;
+    return true;
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe)
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper("blocktree", GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe)
 {
 }
 
@@ -146,6 +253,7 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
                 ss << (coins.fCoinBase ? 'c' : 'n');
                 ss << VARINT(coins.nHeight);
                 stats.nTransactions++;
+                stats.commitment.AddCoins(txhash, coins);
                 for (unsigned int i = 0; i < coins.vout.size(); i++) {
                     const CTxOut& out = coins.vout[i];
                     if (!out.IsNull()) {
@@ -182,6 +290,114 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::UpdateAddressIndexes(const std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, bool fErase,
+    const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& addressUnspentIndex,
+    const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >& spentIndex)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = addressIndex.begin(); it != addressIndex.end(); it++) {
+        if (fErase)
+            batch.Erase(make_pair('a', it->first));
+        else
+            batch.Write(make_pair('a', it->first), it->second);
+    }
+    // Order matters here: an output created and spent in the same block is
+    // written and then erased
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = addressUnspentIndex.begin(); it != addressUnspentIndex.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair('u', it->first));
+        else
+            batch.Write(make_pair('u', it->first), it->second);
+    }
+    for (std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >::const_iterator it = spentIndex.begin(); it != spentIndex.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair('p', it->first));
+        else
+            batch.Write(make_pair('p', it->first), it->second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int start, int end)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    if (start > 0)
+        ssKeySet << make_pair('a', CAddressIndexIteratorKey(type, addressHash, start));
+    else
+        ssKeySet << make_pair('a', CAddressIndexIteratorKey(type, addressHash));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != 'a')
+                break;
+            CAddressIndexKey indexKey;
+            ssKey >> indexKey;
+            if (indexKey.type != (unsigned int)type || indexKey.hashBytes != addressHash)
+                break;
+            if (end > 0 && indexKey.blockHeight > end)
+                break;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAmount nValue;
+            ssValue >> nValue;
+            addressIndex.push_back(make_pair(indexKey, nValue));
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('u', CAddressIndexIteratorKey(type, addressHash));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != 'u')
+                break;
+            CAddressUnspentKey indexKey;
+            ssKey >> indexKey;
+            if (indexKey.type != (unsigned int)type || indexKey.hashBytes != addressHash)
+                break;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAddressUnspentValue value;
+            ssValue >> value;
+            unspentOutputs.push_back(make_pair(indexKey, value));
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::ReadSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value)
+{
+    return Read(make_pair('p', key), value);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string& name, bool fValue)
 {
     return Write(std::make_pair('F', name), fValue ? '1' : '0');
@@ -206,6 +422,21 @@ bool CBlockTreeDB::ReadInt(const std::string& name, int& nValue)
     return Read(std::make_pair('I', name), nValue);
 }
 
+bool CBlockTreeDB::WriteVerifyState(const CVerifyState& state)
+{
+    return Write('V', state);
+}
+
+bool CBlockTreeDB::ReadVerifyState(CVerifyState& state)
+{
+    return Read('V', state);
+}
+
+bool CBlockTreeDB::EraseVerifyState()
+{
+    return Erase('V');
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts()
 {
     boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
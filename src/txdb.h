@@ -7,8 +7,10 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "addressindex.h"
 #include "leveldbwrapper.h"
 #include "main.h"
+#include "spentindex.h"
 
 #include <map>
 #include <string>
@@ -25,20 +27,57 @@ static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 4096 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
 
+class CCoinsViewDBCursor;
+
 /** CCoinsView backed by the LevelDB coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CLevelDBWrapper db;
 
+    //! The unspent output summary as of the best block, written along with it and its hash
+    CCoinsCommitment commitment;
+    bool fHaveCommitment;
+
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
     bool GetCoins(const uint256& txid, CCoins& coins) const;
     bool HaveCoins(const uint256& txid) const;
     uint256 GetBestBlock() const;
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsCommitment& commitmentDelta);
     bool GetStats(CCoinsStats& stats) const;
+    bool GetCommitment(CCoinsCommitment& commitmentOut) const;
+
+    //! Compute the unspent output summary with a full scan, for a database written or moved on without it
+    bool InitCommitment();
+
+    //! Iterate over the coins as of now; later writes are not seen by the cursor. The caller owns it.
+    CCoinsViewDBCursor* Cursor() const;
+
+    //! Compact the database, for reads after a large number of writes and deletions
+    void Compact() { db.Compact(); }
+};
+
+/** Walks the coin records of a CCoinsViewDB in txid order */
+class CCoinsViewDBCursor
+{
+public:
+    ~CCoinsViewDBCursor();
+
+    bool Valid() const;
+    bool GetKey(uint256& txid) const;
+    bool GetValue(CCoins& coins) const;
+    void Next();
+
+private:
+    CCoinsViewDBCursor(leveldb::Iterator* pcursorIn);
+    CCoinsViewDBCursor(const CCoinsViewDBCursor&);
+    void operator=(const CCoinsViewDBCursor&);
+
+    leveldb::Iterator* pcursor;
+
+    friend class CCoinsViewDB;
 };
 
 /** Access to the block database (blocks/index/) */
@@ -61,10 +100,24 @@ public:
     bool ReadReindexing(bool& fReindex);
     bool ReadTxIndex(const uint256& txid, CDiskTxPos& pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >& list);
+    /**
+     * Apply the address and spent index changes of one block in a single
+     * batch. Null values erase unspent outputs and spent records; fErase
+     * erases the address history records instead of writing them.
+     */
+    bool UpdateAddressIndexes(const std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, bool fErase,
+        const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& addressUnspentIndex,
+        const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >& spentIndex);
+    bool ReadAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int start = 0, int end = 0);
+    bool ReadAddressUnspentIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs);
+    bool ReadSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value);
     bool WriteFlag(const std::string& name, bool fValue);
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
     bool ReadInt(const std::string& name, int& nValue);
+    bool WriteVerifyState(const CVerifyState& state);
+    bool ReadVerifyState(CVerifyState& state);
+    bool EraseVerifyState();
     bool LoadBlockIndexGuts();
 };
 
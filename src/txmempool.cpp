@@ -7,6 +7,7 @@
 #include "txmempool.h"
 
 #include "clientversion.h"
+#include "core_memusage.h"
 #include "main.h"
 #include "streams.h"
 #include "util.h"
@@ -15,18 +16,26 @@
 
 #include <boost/circular_buffer.hpp>
 
+#include <math.h>
+
 using namespace std;
 
-CTxMemPoolEntry::CTxMemPoolEntry() : nFee(0), nTxSize(0), nModSize(0), nTime(0), dPriority(0.0)
+CTxMemPoolEntry::CTxMemPoolEntry() : nFee(0), nTxSize(0), nModSize(0), nUsageSize(0), nTime(0), dPriority(0.0), inChainInputValue(0),
+                                     dPriorityDelta(0.0), nFeeDelta(0), nCountWithDescendants(1), nSizeWithDescendants(0), nModFeesWithDescendants(0)
 {
     nHeight = MEMPOOL_HEIGHT;
 }
 
-CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight) : tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight)
+CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight, CAmount _inChainInputValue) : tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight),
+                                                                                                                                                                     inChainInputValue(_inChainInputValue), dPriorityDelta(0.0), nFeeDelta(0)
 {
     nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-
     nModSize = tx.CalculateModifiedSize(nTxSize);
+    nUsageSize = RecursiveDynamicUsage(tx);
+
+    nCountWithDescendants = 1;
+    nSizeWithDescendants = nTxSize;
+    nModFeesWithDescendants = nFee;
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
@@ -37,12 +46,44 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
 double
 CTxMemPoolEntry::GetPriority(unsigned int currentHeight) const
 {
-    CAmount nValueIn = tx.GetValueOut() + nFee;
-    double deltaPriority = ((double)(currentHeight - nHeight) * nValueIn) / nModSize;
+    // Only inputs that were already confirmed when the transaction entered
+    // the pool age; in-mempool inputs start aging once they are mined.
+    double deltaPriority = ((double)(currentHeight - nHeight) * inChainInputValue) / nModSize;
     double dResult = dPriority + deltaPriority;
     return dResult;
 }
 
+void CTxMemPoolEntry::UpdateDescendantState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount)
+{
+    nSizeWithDescendants += modifySize;
+    assert(int64_t(nSizeWithDescendants) > 0);
+    nModFeesWithDescendants += modifyFee;
+    nCountWithDescendants += modifyCount;
+    assert(int64_t(nCountWithDescendants) > 0);
+}
+
+void CTxMemPoolEntry::SetDescendantState(uint64_t nCount, uint64_t nSize, CAmount nModFees)
+{
+    nCountWithDescendants = nCount;
+    nSizeWithDescendants = nSize;
+    nModFeesWithDescendants = nModFees;
+}
+
+void CTxMemPoolEntry::UpdateDeltas(double newPriorityDelta, CAmount newFeeDelta)
+{
+    nModFeesWithDescendants += newFeeDelta - nFeeDelta;
+    nFeeDelta = newFeeDelta;
+    dPriorityDelta = newPriorityDelta;
+}
+
+void CTxMemPoolEntry::UpdateParent(const uint256& hashParent, bool fAdd)
+{
+    if (fAdd)
+        setMemPoolParents.insert(hashParent);
+    else
+        setMemPoolParents.erase(hashParent);
+}
+
 /**
  * Keep track of fee/priority for transactions confirmed within N blocks
  */
@@ -356,8 +397,13 @@ public:
 
 
 CTxMemPool::CTxMemPool(const CFeeRate& _minRelayFee) : nTransactionsUpdated(0),
-                                                       minRelayFee(_minRelayFee)
+                                                       minRelayFee(_minRelayFee),
+                                                       fLoaded(false),
+                                                       nLoadProcessed(0),
+                                                       nLoadTotal(0)
 {
+    clear();
+
     // Sanity checks off by default for performance, because otherwise
     // accepting transactions becomes O(N^2) where N is the number
     // of transactions in the pool
@@ -402,6 +448,31 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
 }
 
 
+void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, const setEntries& setAncestors)
+{
+    int64_t updateCount = (add ? 1 : -1);
+    int64_t updateSize = updateCount * it->GetTxSize();
+    CAmount updateFee = updateCount * it->GetModifiedFee();
+    BOOST_FOREACH (txiter ancestorIt, setAncestors) {
+        mapTx.modify(ancestorIt, update_descendant_state(updateSize, updateFee, updateCount));
+    }
+}
+
+void CTxMemPool::UpdateDescendantStateFromScratch(txiter it)
+{
+    setEntries setDescendants;
+    CalculateDescendants(it, setDescendants);
+    uint64_t nCount = 0;
+    uint64_t nSize = 0;
+    CAmount nModFees = 0;
+    BOOST_FOREACH (txiter descendantIt, setDescendants) {
+        nCount++;
+        nSize += descendantIt->GetTxSize();
+        nModFees += descendantIt->GetModifiedFee();
+    }
+    mapTx.modify(it, set_descendant_state(nCount, nSize, nModFees));
+}
+
 bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry)
 {
     // Add to memory pool without checking anything.
@@ -409,25 +480,187 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry)
     // all the appropriate checks.
     LOCK(cs);
     {
-        mapTx[hash] = entry;
-        const CTransaction& tx = mapTx[hash].GetTx();
-        for (unsigned int i = 0; i < tx.vin.size(); i++)
+        std::pair<txiter, bool> ret = mapTx.insert(entry);
+        if (!ret.second)
+            return false;
+        txiter newit = ret.first;
+        cachedInnerUsage += newit->DynamicMemoryUsage();
+
+        // Update transaction for any feeDelta created by PrioritiseTransaction
+        std::map<uint256, std::pair<double, CAmount> >::const_iterator pos = mapDeltas.find(hash);
+        if (pos != mapDeltas.end())
+            mapTx.modify(newit, update_deltas(pos->second.first, pos->second.second));
+
+        const CTransaction& tx = newit->GetTx();
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
             mapNextTx[tx.vin[i].prevout] = CInPoint(&tx, i);
+            if (mapTx.count(tx.vin[i].prevout.hash) && !newit->GetMemPoolParents().count(tx.vin[i].prevout.hash)) {
+                mapTx.modify(newit, update_parent(tx.vin[i].prevout.hash, true));
+                cachedInnerUsage += memusage::IncrementalDynamicUsage(newit->GetMemPoolParents());
+            }
+        }
+
+        // Every in-mempool ancestor now has one more descendant
+        setEntries setAncestors;
+        std::string dummy;
+        CalculateMemPoolAncestors(*newit, setAncestors, std::numeric_limits<uint64_t>::max(), dummy, false);
+        UpdateAncestorsOf(true, newit, setAncestors);
+
+        // Transactions re-added during a re-org may already have children in
+        // the pool; link them and recompute the affected descendant state.
+        bool fHasChildren = false;
+        std::map<COutPoint, CInPoint>::iterator itNext = mapNextTx.lower_bound(COutPoint(hash, 0));
+        while (itNext != mapNextTx.end() && itNext->first.hash == hash) {
+            txiter childit = mapTx.find(itNext->second.ptx->GetHash());
+            if (childit != mapTx.end() && !childit->GetMemPoolParents().count(hash)) {
+                mapTx.modify(childit, update_parent(hash, true));
+                cachedInnerUsage += memusage::IncrementalDynamicUsage(childit->GetMemPoolParents());
+                fHasChildren = true;
+            }
+            itNext++;
+        }
+        if (fHasChildren) {
+            UpdateDescendantStateFromScratch(newit);
+            BOOST_FOREACH (txiter ancestorIt, setAncestors)
+                UpdateDescendantStateFromScratch(ancestorIt);
+        }
+
         nTransactionsUpdated++;
         totalTxSize += entry.GetTxSize();
     }
     return true;
 }
 
+void CTxMemPool::UpdateChildrenForRemoval(txiter it)
+{
+    AssertLockHeld(cs);
+    const uint256& hash = it->GetTx().GetHash();
+    std::map<COutPoint, CInPoint>::iterator itNext = mapNextTx.lower_bound(COutPoint(hash, 0));
+    while (itNext != mapNextTx.end() && itNext->first.hash == hash) {
+        txiter childit = mapTx.find(itNext->second.ptx->GetHash());
+        if (childit != mapTx.end() && childit->GetMemPoolParents().count(hash)) {
+            cachedInnerUsage -= memusage::IncrementalDynamicUsage(childit->GetMemPoolParents());
+            mapTx.modify(childit, update_parent(hash, false));
+        }
+        itNext++;
+    }
+}
+
+void CTxMemPool::UpdateForRemoveFromMempool(const setEntries& entriesToRemove)
+{
+    // For each entry, walk back all ancestors and decrement size associated
+    // with this transaction. This must happen while all the links are still
+    // intact.
+    BOOST_FOREACH (txiter removeIt, entriesToRemove) {
+        setEntries setAncestors;
+        std::string dummy;
+        CalculateMemPoolAncestors(*removeIt, setAncestors, std::numeric_limits<uint64_t>::max(), dummy, false);
+        UpdateAncestorsOf(false, removeIt, setAncestors);
+    }
+}
+
+void CTxMemPool::removeUnchecked(txiter it)
+{
+    const CTransaction& tx = it->GetTx();
+    UpdateChildrenForRemoval(it);
+    BOOST_FOREACH (const CTxIn& txin, tx.vin)
+        mapNextTx.erase(txin.prevout);
+
+    totalTxSize -= it->GetTxSize();
+    cachedInnerUsage -= it->DynamicMemoryUsage();
+    cachedInnerUsage -= memusage::IncrementalDynamicUsage(it->GetMemPoolParents()) * it->GetMemPoolParents().size();
+    mapTx.erase(it);
+    nTransactionsUpdated++;
+}
+
+void CTxMemPool::RemoveStaged(setEntries& stage)
+{
+    AssertLockHeld(cs);
+    UpdateForRemoveFromMempool(stage);
+    BOOST_FOREACH (const txiter& it, stage) {
+        removeUnchecked(it);
+    }
+}
+
+bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry& entry, setEntries& setAncestors, uint64_t limitAncestorCount, std::string& errString, bool fSearchForParents) const
+{
+    LOCK(cs);
+    setEntries parentHashes;
+    const CTransaction& tx = entry.GetTx();
+
+    if (fSearchForParents) {
+        // Get parents of this transaction that are in the mempool
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
+            txiter piter = mapTx.find(tx.vin[i].prevout.hash);
+            if (piter != mapTx.end())
+                parentHashes.insert(piter);
+        }
+    } else {
+        // If we're not searching for parents, we require this to be an
+        // entry in the mempool already.
+        BOOST_FOREACH (const uint256& hashParent, entry.GetMemPoolParents()) {
+            txiter piter = mapTx.find(hashParent);
+            assert(piter != mapTx.end());
+            parentHashes.insert(piter);
+        }
+    }
+
+    while (!parentHashes.empty()) {
+        txiter stageit = *parentHashes.begin();
+        setAncestors.insert(stageit);
+        parentHashes.erase(stageit);
+
+        if (setAncestors.size() + 1 > limitAncestorCount) {
+            errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
+            return false;
+        }
+
+        BOOST_FOREACH (const uint256& hashParent, stageit->GetMemPoolParents()) {
+            txiter phash = mapTx.find(hashParent);
+            assert(phash != mapTx.end());
+            if (setAncestors.count(phash) == 0)
+                parentHashes.insert(phash);
+        }
+    }
+
+    return true;
+}
+
+void CTxMemPool::CalculateDescendants(txiter entryit, setEntries& setDescendants) const
+{
+    setEntries stage;
+    if (setDescendants.count(entryit) == 0)
+        stage.insert(entryit);
+    // Traverse down the children of entry, only adding children that are not
+    // accounted for in setDescendants already (because those children have either
+    // already been walked, or will be walked in this iteration).
+    while (!stage.empty()) {
+        txiter it = *stage.begin();
+        setDescendants.insert(it);
+        stage.erase(it);
+
+        const uint256& hash = it->GetTx().GetHash();
+        std::map<COutPoint, CInPoint>::const_iterator itNext = mapNextTx.lower_bound(COutPoint(hash, 0));
+        while (itNext != mapNextTx.end() && itNext->first.hash == hash) {
+            txiter childit = mapTx.find(itNext->second.ptx->GetHash());
+            assert(childit != mapTx.end());
+            if (setDescendants.count(childit) == 0)
+                stage.insert(childit);
+            itNext++;
+        }
+    }
+}
 
 void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& removed, bool fRecursive)
 {
     // Remove transaction from memory pool
     {
         LOCK(cs);
-        std::deque<uint256> txToRemove;
-        txToRemove.push_back(origTx.GetHash());
-        if (fRecursive && !mapTx.count(origTx.GetHash())) {
+        setEntries txToRemove;
+        txiter origit = mapTx.find(origTx.GetHash());
+        if (origit != mapTx.end()) {
+            txToRemove.insert(origit);
+        } else if (fRecursive) {
             // If recursively removing but origTx isn't in the mempool
             // be sure to remove any children that are in the pool. This can
             // happen during chain re-orgs if origTx isn't re-accepted into
@@ -436,31 +669,23 @@ void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& rem
                 std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(origTx.GetHash(), i));
                 if (it == mapNextTx.end())
                     continue;
-                txToRemove.push_back(it->second.ptx->GetHash());
+                txiter nextit = mapTx.find(it->second.ptx->GetHash());
+                assert(nextit != mapTx.end());
+                txToRemove.insert(nextit);
             }
         }
-        while (!txToRemove.empty()) {
-            uint256 hash = txToRemove.front();
-            txToRemove.pop_front();
-            if (!mapTx.count(hash))
-                continue;
-            const CTransaction& tx = mapTx[hash].GetTx();
-            if (fRecursive) {
-                for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                    std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(hash, i));
-                    if (it == mapNextTx.end())
-                        continue;
-                    txToRemove.push_back(it->second.ptx->GetHash());
-                }
+        setEntries setAllRemoves;
+        if (fRecursive) {
+            BOOST_FOREACH (txiter it, txToRemove) {
+                CalculateDescendants(it, setAllRemoves);
             }
-            BOOST_FOREACH (const CTxIn& txin, tx.vin)
-                mapNextTx.erase(txin.prevout);
-
-            removed.push_back(tx);
-            totalTxSize -= mapTx[hash].GetTxSize();
-            mapTx.erase(hash);
-            nTransactionsUpdated++;
+        } else {
+            setAllRemoves.swap(txToRemove);
         }
+        BOOST_FOREACH (txiter it, setAllRemoves) {
+            removed.push_back(it->GetTx());
+        }
+        RemoveStaged(setAllRemoves);
     }
 }
 
@@ -469,10 +694,10 @@ void CTxMemPool::removeCoinbaseSpends(const CCoinsViewCache* pcoins, unsigned in
     // Remove transactions spending a coinbase which are now immature
     LOCK(cs);
     list<CTransaction> transactionsToRemove;
-    for (std::map<uint256, CTxMemPoolEntry>::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
-        const CTransaction& tx = it->second.GetTx();
+    for (indexed_transaction_set::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
+        const CTransaction& tx = it->GetTx();
         BOOST_FOREACH (const CTxIn& txin, tx.vin) {
-            std::map<uint256, CTxMemPoolEntry>::const_iterator it2 = mapTx.find(txin.prevout.hash);
+            indexed_transaction_set::const_iterator it2 = mapTx.find(txin.prevout.hash);
             if (it2 != mapTx.end())
                 continue;
             const CCoins* coins = pcoins->AccessCoins(txin.prevout.hash);
@@ -514,8 +739,9 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
     std::vector<CTxMemPoolEntry> entries;
     BOOST_FOREACH (const CTransaction& tx, vtx) {
         uint256 hash = tx.GetHash();
-        if (mapTx.count(hash))
-            entries.push_back(mapTx[hash]);
+        indexed_transaction_set::iterator i = mapTx.find(hash);
+        if (i != mapTx.end())
+            entries.push_back(*i);
     }
     minerPolicyEstimator->seenBlock(entries, nBlockHeight, minRelayFee);
     BOOST_FOREACH (const CTransaction& tx, vtx) {
@@ -524,6 +750,8 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
         removeConflicts(tx, conflicts);
         ClearPrioritisation(tx.GetHash());
     }
+    lastRollingFeeUpdate = GetTime();
+    blockSinceLastRollingFeeBump = true;
 }
 
 
@@ -533,6 +761,10 @@ void CTxMemPool::clear()
     mapTx.clear();
     mapNextTx.clear();
     totalTxSize = 0;
+    cachedInnerUsage = 0;
+    lastRollingFeeUpdate = GetTime();
+    blockSinceLastRollingFeeBump = false;
+    rollingMinimumFeeRate = 0;
     ++nTransactionsUpdated;
 }
 
@@ -544,23 +776,28 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
     LogPrint("mempool", "Checking mempool with %u transactions and %u inputs\n", (unsigned int)mapTx.size(), (unsigned int)mapNextTx.size());
 
     uint64_t checkTotal = 0;
+    uint64_t innerUsage = 0;
 
     CCoinsViewCache mempoolDuplicate(const_cast<CCoinsViewCache*>(pcoins));
 
     LOCK(cs);
     list<const CTxMemPoolEntry*> waitingOnDependants;
-    for (std::map<uint256, CTxMemPoolEntry>::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
+    for (indexed_transaction_set::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
         unsigned int i = 0;
-        checkTotal += it->second.GetTxSize();
-        const CTransaction& tx = it->second.GetTx();
+        checkTotal += it->GetTxSize();
+        innerUsage += it->DynamicMemoryUsage();
+        innerUsage += memusage::IncrementalDynamicUsage(it->GetMemPoolParents()) * it->GetMemPoolParents().size();
+        const CTransaction& tx = it->GetTx();
         bool fDependsWait = false;
+        std::set<uint256> setParentCheck;
         BOOST_FOREACH (const CTxIn& txin, tx.vin) {
             // Check that every mempool transaction's inputs refer to available coins, or other mempool tx's.
-            std::map<uint256, CTxMemPoolEntry>::const_iterator it2 = mapTx.find(txin.prevout.hash);
+            indexed_transaction_set::const_iterator it2 = mapTx.find(txin.prevout.hash);
             if (it2 != mapTx.end()) {
-                const CTransaction& tx2 = it2->second.GetTx();
+                const CTransaction& tx2 = it2->GetTx();
                 assert(tx2.vout.size() > txin.prevout.n && !tx2.vout[txin.prevout.n].IsNull());
                 fDependsWait = true;
+                setParentCheck.insert(txin.prevout.hash);
             } else {
                 const CCoins* coins = pcoins->AccessCoins(txin.prevout.hash);
                 assert(coins && coins->IsAvailable(txin.prevout.n));
@@ -572,8 +809,23 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
             assert(it3->second.n == i);
             i++;
         }
+        assert(setParentCheck == it->GetMemPoolParents());
+
+        // Check the cached descendant state against a fresh walk
+        setEntries setDescendants;
+        CalculateDescendants(mapTx.find(tx.GetHash()), setDescendants);
+        uint64_t nSizeCheck = 0;
+        CAmount nFeesCheck = 0;
+        BOOST_FOREACH (txiter descendantIt, setDescendants) {
+            nSizeCheck += descendantIt->GetTxSize();
+            nFeesCheck += descendantIt->GetModifiedFee();
+        }
+        assert(it->GetCountWithDescendants() == setDescendants.size());
+        assert(it->GetSizeWithDescendants() == nSizeCheck);
+        assert(it->GetModFeesWithDescendants() == nFeesCheck);
+
         if (fDependsWait)
-            waitingOnDependants.push_back(&it->second);
+            waitingOnDependants.push_back(&(*it));
         else {
             CValidationState state;
             CTxUndo undo;
@@ -599,15 +851,16 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
     }
     for (std::map<COutPoint, CInPoint>::const_iterator it = mapNextTx.begin(); it != mapNextTx.end(); it++) {
         uint256 hash = it->second.ptx->GetHash();
-        map<uint256, CTxMemPoolEntry>::const_iterator it2 = mapTx.find(hash);
-        const CTransaction& tx = it2->second.GetTx();
+        indexed_transaction_set::const_iterator it2 = mapTx.find(hash);
         assert(it2 != mapTx.end());
+        const CTransaction& tx = it2->GetTx();
         assert(&tx == it->second.ptx);
         assert(tx.vin.size() > it->second.n);
         assert(it->first == it->second.ptx->vin[it->second.n].prevout);
     }
 
     assert(totalTxSize == checkTotal);
+    assert(innerUsage == cachedInnerUsage);
 }
 
 void CTxMemPool::queryHashes(vector<uint256>& vtxid)
@@ -616,16 +869,16 @@ void CTxMemPool::queryHashes(vector<uint256>& vtxid)
 
     LOCK(cs);
     vtxid.reserve(mapTx.size());
-    for (map<uint256, CTxMemPoolEntry>::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi)
-        vtxid.push_back((*mi).first);
+    for (indexed_transaction_set::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi)
+        vtxid.push_back(mi->GetTx().GetHash());
 }
 
 bool CTxMemPool::lookup(uint256 hash, CTransaction& result) const
 {
     LOCK(cs);
-    map<uint256, CTxMemPoolEntry>::const_iterator i = mapTx.find(hash);
+    indexed_transaction_set::const_iterator i = mapTx.find(hash);
     if (i == mapTx.end()) return false;
-    result = i->second.GetTx();
+    result = i->GetTx();
     return true;
 }
 
@@ -640,6 +893,32 @@ double CTxMemPool::estimatePriority(int nBlocks) const
     return minerPolicyEstimator->estimatePriority(nBlocks);
 }
 
+void CTxMemPool::SetLoadProgress(uint64_t nProcessed, uint64_t nTotal)
+{
+    LOCK(cs);
+    nLoadProcessed = nProcessed;
+    nLoadTotal = nTotal;
+}
+
+void CTxMemPool::GetLoadProgress(uint64_t& nProcessed, uint64_t& nTotal) const
+{
+    LOCK(cs);
+    nProcessed = nLoadProcessed;
+    nTotal = nLoadTotal;
+}
+
+void CTxMemPool::SetLoaded(bool fLoadedIn)
+{
+    LOCK(cs);
+    fLoaded = fLoadedIn;
+}
+
+bool CTxMemPool::IsLoaded() const
+{
+    LOCK(cs);
+    return fLoaded;
+}
+
 bool CTxMemPool::WriteFeeEstimates(CAutoFile& fileout) const
 {
     try {
@@ -678,6 +957,18 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash, const string strHash,
         std::pair<double, CAmount>& deltas = mapDeltas[hash];
         deltas.first += dPriorityDelta;
         deltas.second += nFeeDelta;
+
+        // Re-sort the entry and its ancestors if it is already in the pool
+        txiter it = mapTx.find(hash);
+        if (it != mapTx.end()) {
+            mapTx.modify(it, update_deltas(deltas.first, deltas.second));
+            setEntries setAncestors;
+            std::string dummy;
+            CalculateMemPoolAncestors(*it, setAncestors, std::numeric_limits<uint64_t>::max(), dummy, false);
+            BOOST_FOREACH (txiter ancestorIt, setAncestors) {
+                mapTx.modify(ancestorIt, update_descendant_state(0, nFeeDelta, 0));
+            }
+        }
     }
     LogPrintf("PrioritiseTransaction: %s priority += %f, fee += %d\n", strHash, dPriorityDelta, FormatMoney(nFeeDelta));
 }
@@ -699,6 +990,100 @@ void CTxMemPool::ClearPrioritisation(const uint256 hash)
     mapDeltas.erase(hash);
 }
 
+size_t CTxMemPool::DynamicMemoryUsage() const
+{
+    LOCK(cs);
+    // Estimate the overhead of mapTx to be 12 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented:
+    // each of its 4 ordered indices adds a red-black tree node of 3 pointers to the entry.
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + cachedInnerUsage;
+}
+
+CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const
+{
+    LOCK(cs);
+    if (!blockSinceLastRollingFeeBump || rollingMinimumFeeRate == 0)
+        return CFeeRate(rollingMinimumFeeRate);
+
+    int64_t time = GetTime();
+    if (time > lastRollingFeeUpdate + 10) {
+        double halflife = ROLLING_FEE_HALFLIFE;
+        if (DynamicMemoryUsage() < sizelimit / 4)
+            halflife /= 4;
+        else if (DynamicMemoryUsage() < sizelimit / 2)
+            halflife /= 2;
+
+        rollingMinimumFeeRate = rollingMinimumFeeRate / pow(2.0, (time - lastRollingFeeUpdate) / halflife);
+        lastRollingFeeUpdate = time;
+
+        if (rollingMinimumFeeRate < minRelayFee.GetFeePerK() / 2) {
+            rollingMinimumFeeRate = 0;
+            return CFeeRate(0);
+        }
+    }
+    return std::max(CFeeRate(rollingMinimumFeeRate), minRelayFee);
+}
+
+void CTxMemPool::trackPackageRemoved(const CFeeRate& rate)
+{
+    AssertLockHeld(cs);
+    if (rate.GetFeePerK() > rollingMinimumFeeRate) {
+        rollingMinimumFeeRate = rate.GetFeePerK();
+        blockSinceLastRollingFeeBump = false;
+    }
+}
+
+void CTxMemPool::TrimToSize(size_t sizelimit, std::list<CTransaction>* pRemoved)
+{
+    LOCK(cs);
+
+    unsigned nTxnRemoved = 0;
+    CFeeRate maxFeeRateRemoved(0);
+    while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
+        indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
+
+        // We set the new mempool min fee to the feerate of the removed set, plus the
+        // minimum relay fee. This way, we don't allow txn to enter mempool with feerate
+        // equal to txn which were removed with no block in between.
+        CFeeRate removed(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
+        removed = CFeeRate(removed.GetFeePerK() + minRelayFee.GetFeePerK());
+        trackPackageRemoved(removed);
+        maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
+
+        setEntries stage;
+        CalculateDescendants(mapTx.project<0>(it), stage);
+        nTxnRemoved += stage.size();
+        if (pRemoved) {
+            BOOST_FOREACH (txiter removeit, stage)
+                pRemoved->push_back(removeit->GetTx());
+        }
+        RemoveStaged(stage);
+    }
+
+    if (maxFeeRateRemoved > CFeeRate(0))
+        LogPrint("mempool", "Removed %u txn, rolling minimum fee bumped to %s\n", nTxnRemoved, maxFeeRateRemoved.ToString());
+}
+
+int CTxMemPool::Expire(int64_t time, std::list<CTransaction>* pRemoved)
+{
+    LOCK(cs);
+    indexed_transaction_set::index<entry_time>::type::iterator it = mapTx.get<entry_time>().begin();
+    setEntries toremove;
+    while (it != mapTx.get<entry_time>().end() && it->GetTime() < time) {
+        toremove.insert(mapTx.project<0>(it));
+        it++;
+    }
+    setEntries stage;
+    BOOST_FOREACH (txiter removeit, toremove) {
+        CalculateDescendants(removeit, stage);
+    }
+    if (pRemoved) {
+        BOOST_FOREACH (txiter removeit, stage)
+            pRemoved->push_back(removeit->GetTx());
+    }
+    RemoveStaged(stage);
+    return stage.size();
+}
+
 
 CCoinsViewMemPool::CCoinsViewMemPool(CCoinsView* baseIn, CTxMemPool& mempoolIn) : CCoinsViewBacked(baseIn), mempool(mempoolIn) {}
 
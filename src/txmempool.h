@@ -8,12 +8,16 @@
 #define BITCOIN_TXMEMPOOL_H
 
 #include <list>
+#include <set>
 
 #include "amount.h"
 #include "coins.h"
 #include "primitives/transaction.h"
 #include "sync.h"
 
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index_container.hpp>
+
 class CAutoFile;
 
 inline double AllowFreeThreshold()
@@ -34,31 +38,201 @@ static const unsigned int MEMPOOL_HEIGHT = 0x7FFFFFFF;
 
 /**
  * CTxMemPool stores these:
+ *
+ * Besides the transaction itself, each entry caches the state of all of its
+ * in-mempool descendants (count, size and modified fees including itself),
+ * which CTxMemPool keeps up to date as transactions enter and leave the pool.
+ * These drive eviction when the pool grows past -maxmempool.
  */
 class CTxMemPoolEntry
 {
 private:
     CTransaction tx;
-    CAmount nFee;         //! Cached to avoid expensive parent-transaction lookups
-    size_t nTxSize;       //! ... and avoid recomputing tx size
-    size_t nModSize;      //! ... and modified size for priority
-    int64_t nTime;        //! Local time when entering the mempool
-    double dPriority;     //! Priority when entering the mempool
-    unsigned int nHeight; //! Chain height when entering the mempool
+    CAmount nFee;                 //! Cached to avoid expensive parent-transaction lookups
+    size_t nTxSize;               //! ... and avoid recomputing tx size
+    size_t nModSize;              //! ... and modified size for priority
+    size_t nUsageSize;            //! ... and total memory usage
+    int64_t nTime;                //! Local time when entering the mempool
+    double dPriority;             //! Priority when entering the mempool
+    unsigned int nHeight;         //! Chain height when entering the mempool
+    CAmount inChainInputValue;    //! Sum of all txin values that are already in blockchain
+    double dPriorityDelta;        //! Priority delta from PrioritiseTransaction
+    CAmount nFeeDelta;            //! Fee delta from PrioritiseTransaction
+    std::set<uint256> setMemPoolParents; //! In-mempool transactions this one spends from (maintained by CTxMemPool)
+
+    // Information about descendants of this transaction that are in the
+    // mempool; if we remove this transaction we must remove all of these
+    // descendants as well.
+    uint64_t nCountWithDescendants;  //! number of descendant transactions, including this one
+    uint64_t nSizeWithDescendants;   //! ... and size
+    CAmount nModFeesWithDescendants; //! ... and total fees (all including us)
 
 public:
-    CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight);
+    CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight, CAmount _inChainInputValue);
     CTxMemPoolEntry();
     CTxMemPoolEntry(const CTxMemPoolEntry& other);
 
     const CTransaction& GetTx() const { return this->tx; }
+    /**
+     * Fast calculation of priority at the given height, using only values
+     * cached when the transaction entered the pool (no coin lookups).
+     */
     double GetPriority(unsigned int currentHeight) const;
     CAmount GetFee() const { return nFee; }
     size_t GetTxSize() const { return nTxSize; }
     int64_t GetTime() const { return nTime; }
     unsigned int GetHeight() const { return nHeight; }
+    CAmount GetInChainInputValue() const { return inChainInputValue; }
+    size_t DynamicMemoryUsage() const { return nUsageSize; }
+
+    /** Fee and priority including any PrioritiseTransaction deltas */
+    CAmount GetModifiedFee() const { return nFee + nFeeDelta; }
+    double GetModifiedPriority(unsigned int currentHeight) const { return GetPriority(currentHeight) + dPriorityDelta; }
+    CFeeRate GetModifiedFeeRate() const { return CFeeRate(GetModifiedFee(), nTxSize); }
+    double GetPriorityDelta() const { return dPriorityDelta; }
+    CAmount GetFeeDelta() const { return nFeeDelta; }
+
+    const std::set<uint256>& GetMemPoolParents() const { return setMemPoolParents; }
+
+    uint64_t GetCountWithDescendants() const { return nCountWithDescendants; }
+    uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
+    CAmount GetModFeesWithDescendants() const { return nModFeesWithDescendants; }
+
+    // Adjusts the descendant state to account for a descendant entering or leaving the pool
+    void UpdateDescendantState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount);
+    // Replaces the descendant state with a freshly computed one
+    void SetDescendantState(uint64_t nCount, uint64_t nSize, CAmount nModFees);
+    // Updates the PrioritiseTransaction deltas (and the descendant fees accordingly)
+    void UpdateDeltas(double newPriorityDelta, CAmount newFeeDelta);
+    // Adds or removes an in-mempool parent
+    void UpdateParent(const uint256& hashParent, bool fAdd);
+};
+
+// Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
+struct update_descendant_state {
+    update_descendant_state(int64_t _modifySize, CAmount _modifyFee, int64_t _modifyCount) : modifySize(_modifySize), modifyFee(_modifyFee), modifyCount(_modifyCount)
+    {
+    }
+
+    void operator()(CTxMemPoolEntry& e) { e.UpdateDescendantState(modifySize, modifyFee, modifyCount); }
+
+private:
+    int64_t modifySize;
+    CAmount modifyFee;
+    int64_t modifyCount;
+};
+
+struct set_descendant_state {
+    set_descendant_state(uint64_t _nCount, uint64_t _nSize, CAmount _nModFees) : nCount(_nCount), nSize(_nSize), nModFees(_nModFees) {}
+
+    void operator()(CTxMemPoolEntry& e) { e.SetDescendantState(nCount, nSize, nModFees); }
+
+private:
+    uint64_t nCount;
+    uint64_t nSize;
+    CAmount nModFees;
+};
+
+struct update_deltas {
+    update_deltas(double _dPriorityDelta, CAmount _nFeeDelta) : dPriorityDelta(_dPriorityDelta), nFeeDelta(_nFeeDelta) {}
+
+    void operator()(CTxMemPoolEntry& e) { e.UpdateDeltas(dPriorityDelta, nFeeDelta); }
+
+private:
+    double dPriorityDelta;
+    CAmount nFeeDelta;
+};
+
+struct update_parent {
+    update_parent(const uint256& _hashParent, bool _fAdd) : hashParent(_hashParent), fAdd(_fAdd) {}
+
+    void operator()(CTxMemPoolEntry& e) { e.UpdateParent(hashParent, fAdd); }
+
+private:
+    uint256 hashParent;
+    bool fAdd;
+};
+
+// extracts a TxMemPoolEntry's transaction hash
+struct mempoolentry_txid {
+    typedef uint256 result_type;
+    result_type operator()(const CTxMemPoolEntry& entry) const
+    {
+        return entry.GetTx().GetHash();
+    }
+};
+
+/**
+ * Sort mempool entries by modified fee rate, highest first, breaking ties
+ * by hash so that the ordering is total.
+ */
+class CompareTxMemPoolEntryByFeeRate
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        // Compare fee/size cross-multiplied as doubles to avoid overflow
+        double f1 = (double)a.GetModifiedFee() * b.GetTxSize();
+        double f2 = (double)b.GetModifiedFee() * a.GetTxSize();
+        if (f1 == f2)
+            return a.GetTx().GetHash() < b.GetTx().GetHash();
+        return f1 > f2;
+    }
+};
+
+/**
+ * Sort an entry by max(fee rate of entry's tx, fee rate with all descendants),
+ * lowest first: the front of this index is the next package to evict.
+ */
+class CompareTxMemPoolEntryByDescendantScore
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        bool fUseADescendants = UseDescendantScore(a);
+        bool fUseBDescendants = UseDescendantScore(b);
+
+        double aModFee = fUseADescendants ? a.GetModFeesWithDescendants() : a.GetModifiedFee();
+        double aSize = fUseADescendants ? a.GetSizeWithDescendants() : a.GetTxSize();
+
+        double bModFee = fUseBDescendants ? b.GetModFeesWithDescendants() : b.GetModifiedFee();
+        double bSize = fUseBDescendants ? b.GetSizeWithDescendants() : b.GetTxSize();
+
+        // Avoid division by rewriting (a/b > c/d) as (a*d > c*b).
+        double f1 = aModFee * bSize;
+        double f2 = aSize * bModFee;
+
+        if (f1 == f2) {
+            if (a.GetTime() != b.GetTime())
+                return a.GetTime() > b.GetTime();
+            return a.GetTx().GetHash() < b.GetTx().GetHash();
+        }
+        return f1 < f2;
+    }
+
+    // Calculate which score to use for an entry (avoiding division).
+    bool UseDescendantScore(const CTxMemPoolEntry& a) const
+    {
+        double f1 = (double)a.GetModifiedFee() * a.GetSizeWithDescendants();
+        double f2 = (double)a.GetModFeesWithDescendants() * a.GetTxSize();
+        return f2 > f1;
+    }
+};
+
+class CompareTxMemPoolEntryByEntryTime
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        return a.GetTime() < b.GetTime();
+    }
 };
 
+// Multi_index tag names
+struct descendant_score {};
+struct entry_time {};
+struct mining_score {};
+
 class CMinerPolicyEstimator;
 
 /** An inpoint - a combination of a transaction and an index n into its vin */
@@ -101,13 +275,74 @@ private:
 
     CFeeRate minRelayFee; //! Passed to constructor to avoid dependency on main
     uint64_t totalTxSize; //! sum of all mempool tx' byte sizes
+    uint64_t cachedInnerUsage; //! sum of dynamic memory usage of all the map elements (NOT the maps themselves)
+
+    mutable int64_t lastRollingFeeUpdate;
+    mutable bool blockSinceLastRollingFeeBump;
+    mutable double rollingMinimumFeeRate; //! minimum fee to get into the pool, decreases exponentially
+
+    bool fLoaded;            //! false while mempool.dat is being re-accepted
+    uint64_t nLoadProcessed; //! mempool.dat entries processed so far
+    uint64_t nLoadTotal;     //! mempool.dat entries to process
+
+    void trackPackageRemoved(const CFeeRate& rate);
 
 public:
+    static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12; // public only for testing
+
+    typedef boost::multi_index_container<
+        CTxMemPoolEntry,
+        boost::multi_index::indexed_by<
+            // sorted by txid
+            boost::multi_index::ordered_unique<mempoolentry_txid>,
+            // sorted by fee rate including descendants, lowest first
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<descendant_score>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByDescendantScore>,
+            // sorted by entry time
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<entry_time>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByEntryTime>,
+            // sorted by modified fee rate, highest first
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<mining_score>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByFeeRate> > >
+        indexed_transaction_set;
+
     mutable CCriticalSection cs;
-    std::map<uint256, CTxMemPoolEntry> mapTx;
+    indexed_transaction_set mapTx;
+    typedef indexed_transaction_set::nth_index<0>::type::iterator txiter;
+
+    struct CompareIteratorByHash {
+        bool operator()(const txiter& a, const txiter& b) const
+        {
+            return a->GetTx().GetHash() < b->GetTx().GetHash();
+        }
+    };
+    typedef std::set<txiter, CompareIteratorByHash> setEntries;
+
     std::map<COutPoint, CInPoint> mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
 
+private:
+    /** Set ancestor state for an entry and its in-mempool ancestors */
+    void UpdateAncestorsOf(bool add, txiter it, const setEntries& setAncestors);
+    /** Recompute the descendant state of an entry from its descendants */
+    void UpdateDescendantStateFromScratch(txiter it);
+    /** Sever the links from in-mempool children to a transaction about to be removed */
+    void UpdateChildrenForRemoval(txiter it);
+    /**
+     * Before calling removeUnchecked for a given transaction,
+     * UpdateForRemoveFromMempool must be called on the entire (dependent) set
+     * of transactions being removed at the same time. Use RemoveStaged.
+     */
+    void UpdateForRemoveFromMempool(const setEntries& entriesToRemove);
+    void removeUnchecked(txiter entry);
+
+public:
     CTxMemPool(const CFeeRate& _minRelayFee);
     ~CTxMemPool();
 
@@ -121,6 +356,11 @@ public:
     void setSanityCheck(bool _fSanityCheck) { fSanityCheck = _fSanityCheck; }
 
     bool addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry);
+    /**
+     * Remove a set of transactions from the mempool. If a transaction is in
+     * this set, then all in-mempool descendants must also be in the set.
+     */
+    void RemoveStaged(setEntries& stage);
     void remove(const CTransaction& tx, std::list<CTransaction>& removed, bool fRecursive = false);
     void removeCoinbaseSpends(const CCoinsViewCache* pcoins, unsigned int nMemPoolHeight);
     void removeConflicts(const CTransaction& tx, std::list<CTransaction>& removed);
@@ -136,6 +376,40 @@ public:
     void ApplyDeltas(const uint256 hash, double& dPriorityDelta, CAmount& nFeeDelta);
     void ClearPrioritisation(const uint256 hash);
 
+    /**
+     * Try to calculate all in-mempool ancestors of entry (not including the
+     * entry itself). limitAncestorCount is the max number of ancestors a
+     * transaction may have, including itself. If fSearchForParents is false,
+     * the entry's cached parent set is used instead of looking its inputs up,
+     * which is only valid for entries already in the pool.
+     */
+    bool CalculateMemPoolAncestors(const CTxMemPoolEntry& entry, setEntries& setAncestors, uint64_t limitAncestorCount, std::string& errString, bool fSearchForParents = true) const;
+
+    /**
+     * Populate setDescendants with all in-mempool descendants of the given
+     * entry, including the entry itself. Assumes entryit is already a tx in
+     * the mempool and setDescendants only holds entries whose descendants are
+     * already in it.
+     */
+    void CalculateDescendants(txiter entryit, setEntries& setDescendants) const;
+
+    /**
+     * The minimum fee to get into the mempool, which may itself not be enough
+     * for larger-sized transactions. It starts at zero and rises to the fee
+     * rate of the last evicted package, then decays with ROLLING_FEE_HALFLIFE.
+     */
+    CFeeRate GetMinFee(size_t sizelimit) const;
+
+    /**
+     * Remove transactions from the mempool until its dynamic size is <=
+     * sizelimit, evicting the package with the lowest descendant fee rate
+     * first. The evicted transactions are appended to pRemoved if given.
+     */
+    void TrimToSize(size_t sizelimit, std::list<CTransaction>* pRemoved = NULL);
+
+    /** Expire all transaction (and their dependencies) in the mempool older than time. Return the number of removed transactions. */
+    int Expire(int64_t time, std::list<CTransaction>* pRemoved = NULL);
+
     unsigned long size()
     {
         LOCK(cs);
@@ -155,6 +429,15 @@ public:
 
     bool lookup(uint256 hash, CTransaction& result) const;
 
+    /** Estimated memory usage of the pool, including the containers */
+    size_t DynamicMemoryUsage() const;
+
+    /** Progress of reloading mempool.dat after a restart */
+    void SetLoadProgress(uint64_t nProcessed, uint64_t nTotal);
+    void GetLoadProgress(uint64_t& nProcessed, uint64_t& nTotal) const;
+    void SetLoaded(bool fLoadedIn);
+    bool IsLoaded() const;
+
     /** Estimate fee rate needed to get into the next nBlocks */
     CFeeRate estimateFee(int nBlocks) const;
 
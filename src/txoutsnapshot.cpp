@@ -0,0 +1,388 @@
+// Copyright (c) 2018 The Basex developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txoutsnapshot.h"
+
+#include "chainparams.h"
+#include "clientversion.h"
+#include "hash.h"
+#include "main.h"
+#include "pow.h"
+#include "streams.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+/** Records per chunk, and the size at which a chunk is written out early */
+static const unsigned int SNAPSHOT_CHUNK_RECORDS = 4096;
+static const unsigned int SNAPSHOT_CHUNK_SIZE = 1 << 20;
+
+void CTxOutSnapshotHeader::SetNull()
+{
+    memset(pchMessageStart, 0, sizeof(pchMessageStart));
+    nVersion = 0;
+    hashBlock = 0;
+    nHeight = -1;
+    hashBlockIndex = 0;
+    hashCoins = 0;
+    commitment.SetNull();
+}
+
+uint256 CTxOutSnapshotHeader::GetSnapshotHash() const
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << hashBlock << hashBlockIndex << hashCoins << commitment;
+    return ss.GetHash();
+}
+
+/** The block index entry as every node has it: without the positions in the local block files */
+static CDiskBlockIndex GetSnapshotBlockIndex(CBlockIndex* pindex)
+{
+    CDiskBlockIndex diskindex(pindex);
+    diskindex.nStatus = BLOCK_VALID_SCRIPTS;
+    diskindex.nFile = 0;
+    diskindex.nDataPos = 0;
+    diskindex.nUndoPos = 0;
+    return diskindex;
+}
+
+static void WriteChunk(CAutoFile& file, char chType, unsigned int nCount, CDataStream& ssChunk)
+{
+    std::vector<char> vch(ssChunk.begin(), ssChunk.end());
+    file << chType << nCount << vch << Hash(vch.begin(), vch.end());
+    ssChunk.clear();
+}
+
+static bool ReadChunk(CAutoFile& file, char& chType, unsigned int& nCount, CDataStream& ssChunk)
+{
+    std::vector<char> vch;
+    uint256 hashChunk;
+    file >> chType >> nCount >> vch >> hashChunk;
+    if (Hash(vch.begin(), vch.end()) != hashChunk)
+        return false;
+    ssChunk.clear();
+    ssChunk.write(vch.data(), vch.size());
+    return true;
+}
+
+/**
+ * Write the snapshot to an open file. The header goes first and is written
+ * again at the end, once the hash of the coins is known.
+ */
+static bool WriteTxOutSnapshot(CAutoFile& file, const std::string& strPath, CTxOutSnapshotHeader& header,
+    std::vector<CDiskBlockIndex>& vIndex, CCoinsViewDBCursor* pcursor, std::string& strError)
+{
+    // Summing up the coins as they are written checks the summary kept in the database
+    CCoinsCommitment commitment;
+    CHashWriter ssCoins(SER_GETHASH, 0);
+    try {
+        file << header;
+
+        CDataStream ssChunk(SER_DISK, CLIENT_VERSION);
+        unsigned int nCount = 0;
+        BOOST_FOREACH (const CDiskBlockIndex& diskindex, vIndex) {
+            ssChunk << diskindex;
+            if (++nCount == SNAPSHOT_CHUNK_RECORDS || ssChunk.size() > SNAPSHOT_CHUNK_SIZE) {
+                WriteChunk(file, 'b', nCount, ssChunk);
+                nCount = 0;
+            }
+        }
+        if (nCount > 0)
+            WriteChunk(file, 'b', nCount, ssChunk);
+        vIndex.clear();
+
+        nCount = 0;
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            uint256 txid;
+            CCoins coins;
+            if (!pcursor->GetKey(txid) || !pcursor->GetValue(coins)) {
+                strError = "Cannot read the chain state";
+                return false;
+            }
+            commitment.AddCoins(txid, coins);
+            ssCoins << txid << coins;
+            ssChunk << txid << coins;
+            if (++nCount == SNAPSHOT_CHUNK_RECORDS || ssChunk.size() > SNAPSHOT_CHUNK_SIZE) {
+                WriteChunk(file, 'c', nCount, ssChunk);
+                nCount = 0;
+            }
+            pcursor->Next();
+        }
+        if (nCount > 0)
+            WriteChunk(file, 'c', nCount, ssChunk);
+        WriteChunk(file, 'e', 0, ssChunk);
+
+        if (commitment != header.commitment) {
+            strError = "Chain state does not match its unspent output set summary";
+            return false;
+        }
+        header.hashCoins = ssCoins.GetHash();
+        if (fseek(file.Get(), 0, SEEK_SET) != 0) {
+            strError = strprintf("Cannot write %s", strPath);
+            return false;
+        }
+        file << header;
+
+        FileCommit(file.Get());
+    } catch (const std::exception& e) {
+        strError = strprintf("Cannot write %s: %s", strPath, e.what());
+        return false;
+    }
+    return true;
+}
+
+bool DumpTxOutSnapshot(const std::string& strPath, CTxOutSnapshotHeader& header, std::string& strError)
+{
+    std::vector<CDiskBlockIndex> vIndex;
+    boost::scoped_ptr<CCoinsViewDBCursor> pcursor;
+    {
+        LOCK(cs_main);
+        // The cursor reads the database, so everything has to be there first
+        FlushStateToDisk();
+        CBlockIndex* pindexTip = chainActive.Tip();
+        if (pcoinsdbview->GetBestBlock() != pindexTip->GetBlockHash()) {
+            strError = "Chain state was not flushed";
+            return false;
+        }
+        if (!pcoinsdbview->GetCommitment(header.commitment)) {
+            strError = "Unspent output set summary not available";
+            return false;
+        }
+        memcpy(header.pchMessageStart, Params().MessageStart(), sizeof(header.pchMessageStart));
+        header.nVersion = TXOUTSNAPSHOT_VERSION;
+        header.hashBlock = pindexTip->GetBlockHash();
+        header.nHeight = pindexTip->nHeight;
+
+        vIndex.reserve(pindexTip->nHeight + 1);
+        for (int nHeight = 0; nHeight <= pindexTip->nHeight; nHeight++)
+            vIndex.push_back(GetSnapshotBlockIndex(chainActive[nHeight]));
+        pcursor.reset(pcoinsdbview->Cursor());
+    }
+
+    CHashWriter ssIndex(SER_GETHASH, 0);
+    BOOST_FOREACH (const CDiskBlockIndex& diskindex, vIndex)
+        ssIndex << diskindex;
+    header.hashBlockIndex = ssIndex.GetHash();
+
+    boost::filesystem::path pathSnapshot(strPath);
+    boost::filesystem::path pathTmp(strPath + ".incomplete");
+    CAutoFile file(fopen(pathTmp.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        strError = strprintf("Cannot open %s for writing", pathTmp.string());
+        return false;
+    }
+
+    bool fOk = WriteTxOutSnapshot(file, pathTmp.string(), header, vIndex, pcursor.get(), strError);
+    file.fclose();
+    if (fOk && !RenameOver(pathTmp, pathSnapshot)) {
+        strError = strprintf("Cannot rename %s", pathTmp.string());
+        fOk = false;
+    }
+    if (!fOk)
+        boost::filesystem::remove(pathTmp);
+    return fOk;
+}
+
+/** Whether the chain parameters or -assumeutxo=<block hash>:<snapshot hash> accept the snapshot */
+static bool IsSnapshotAccepted(const CTxOutSnapshotHeader& header)
+{
+    const uint256 hashSnapshot = header.GetSnapshotHash();
+    MapAssumeUTXO::const_iterator it = Params().AssumeUTXO().find(header.hashBlock);
+    if (it != Params().AssumeUTXO().end())
+        return it->second == hashSnapshot;
+
+    BOOST_FOREACH (const std::string& strAssume, mapMultiArgs["-assumeutxo"]) {
+        size_t nColon = strAssume.find(':');
+        if (nColon == std::string::npos)
+            continue;
+        if (uint256(strAssume.substr(0, nColon)) == header.hashBlock && uint256(strAssume.substr(nColon + 1)) == hashSnapshot)
+            return true;
+    }
+    return false;
+}
+
+/** Check that a snapshot header is for this network and in a known format */
+static bool CheckTxOutSnapshotHeader(const CTxOutSnapshotHeader& header, std::string& strError)
+{
+    if (memcmp(header.pchMessageStart, Params().MessageStart(), sizeof(header.pchMessageStart)) != 0) {
+        strError = "Snapshot is for a different network";
+        return false;
+    }
+    if (header.nVersion != TXOUTSNAPSHOT_VERSION) {
+        strError = strprintf("Unsupported snapshot version %d", header.nVersion);
+        return false;
+    }
+    return true;
+}
+
+bool ReadTxOutSnapshotHeader(const std::string& strPath, CTxOutSnapshotHeader& header, std::string& strError)
+{
+    CAutoFile file(fopen(strPath.c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        strError = strprintf("Cannot open %s", strPath);
+        return false;
+    }
+    try {
+        file >> header;
+    } catch (const std::exception& e) {
+        strError = strprintf("Cannot read the snapshot header: %s", e.what());
+        return false;
+    }
+    return CheckTxOutSnapshotHeader(header, strError);
+}
+
+/**
+ * Read and check a snapshot; with fWrite, also store it in the databases.
+ * The caller checks the whole file before writing anything.
+ */
+static bool ProcessTxOutSnapshot(const std::string& strPath, bool fWrite, CTxOutSnapshotHeader& header, std::string& strError)
+{
+    CAutoFile file(fopen(strPath.c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        strError = strprintf("Cannot open %s", strPath);
+        return false;
+    }
+
+    try {
+        file >> header;
+        if (!CheckTxOutSnapshotHeader(header, strError))
+            return false;
+        if (!IsSnapshotAccepted(header)) {
+            strError = strprintf("Snapshot %s of block %s is not accepted by the chain parameters or -assumeutxo",
+                header.GetSnapshotHash().ToString(), header.hashBlock.ToString());
+            return false;
+        }
+
+        CHashWriter ssIndex(SER_GETHASH, 0);
+        CHashWriter ssCoins(SER_GETHASH, 0);
+        CCoinsCommitment commitment;
+        int nEntries = 0;
+        uint256 hashPrevEntry = 0;
+        uint256 hashPrevTx = 0;
+        CDataStream ssChunk(SER_DISK, CLIENT_VERSION);
+        char chType;
+        char chLastType = 'b';
+        unsigned int nCount;
+        while (true) {
+            boost::this_thread::interruption_point();
+            if (!ReadChunk(file, chType, nCount, ssChunk)) {
+                strError = "Snapshot chunk checksum mismatch";
+                return false;
+            }
+            if (chType == 'e')
+                break;
+            // Block index entries, then coins
+            if ((chType != 'b' && chType != 'c') || (chType == 'b' && chLastType == 'c')) {
+                strError = "Malformed snapshot";
+                return false;
+            }
+            chLastType = chType;
+
+            if (chType == 'b') {
+                CLevelDBBatch batch;
+                for (unsigned int i = 0; i < nCount; i++) {
+                    CDiskBlockIndex diskindex;
+                    ssChunk >> diskindex;
+                    uint256 hash = diskindex.GetBlockHash();
+                    if (diskindex.nHeight != nEntries || diskindex.hashPrev != hashPrevEntry ||
+                        (nEntries == 0 && hash != Params().HashGenesisBlock())) {
+                        strError = strprintf("Snapshot block index broken at height %d", nEntries);
+                        return false;
+                    }
+                    if (diskindex.nHeight <= Params().LAST_POW_BLOCK() && !CheckProofOfWork(hash, diskindex.nBits)) {
+                        strError = strprintf("Snapshot block index has invalid proof of work at height %d", nEntries);
+                        return false;
+                    }
+                    ssIndex << diskindex;
+                    if (fWrite)
+                        batch.Write(make_pair('b', hash), diskindex);
+                    hashPrevEntry = hash;
+                    nEntries++;
+                }
+                if (fWrite && !pblocktree->WriteBatch(batch)) {
+                    strError = "Cannot write the block index";
+                    return false;
+                }
+            } else {
+                CCoinsMap mapCoins;
+                CCoinsCommitment commitmentChunk;
+                for (unsigned int i = 0; i < nCount; i++) {
+                    uint256 txid;
+                    CCoins coins;
+                    ssChunk >> txid >> coins;
+                    // In database order, so every transaction appears once
+                    if ((hashPrevTx != 0 && memcmp(hashPrevTx.begin(), txid.begin(), txid.size()) >= 0) || coins.IsPruned()) {
+                        strError = "Malformed snapshot coins";
+                        return false;
+                    }
+                    commitmentChunk.AddCoins(txid, coins);
+                    ssCoins << txid << coins;
+                    if (fWrite) {
+                        CCoinsCacheEntry& entry = mapCoins[txid];
+                        entry.coins.swap(coins);
+                        entry.flags = CCoinsCacheEntry::DIRTY;
+                    }
+                    hashPrevTx = txid;
+                }
+                commitment += commitmentChunk;
+                if (fWrite && !pcoinsdbview->BatchWrite(mapCoins, uint256(0), commitmentChunk)) {
+                    strError = "Cannot write the chain state";
+                    return false;
+                }
+            }
+        }
+
+        if (nEntries != header.nHeight + 1 || hashPrevEntry != header.hashBlock || ssIndex.GetHash() != header.hashBlockIndex) {
+            strError = "Snapshot block index does not match its header";
+            return false;
+        }
+        if (commitment != header.commitment || ssCoins.GetHash() != header.hashCoins) {
+            strError = "Snapshot coins do not match its header";
+            return false;
+        }
+    } catch (const std::exception& e) {
+        strError = strprintf("Cannot read %s: %s", strPath, e.what());
+        return false;
+    }
+    return true;
+}
+
+bool LoadTxOutSnapshot(const std::string& strPath, std::string& strError)
+{
+    CTxOutSnapshotHeader header;
+    LogPrintf("Checking UTXO set snapshot %s...\n", strPath);
+    if (!ProcessTxOutSnapshot(strPath, false, header, strError))
+        return false;
+
+    LogPrintf("Loading UTXO set snapshot of block %s (height %d, %d transactions)...\n",
+        header.hashBlock.ToString(), header.nHeight, header.commitment.nTransactions);
+    // Marks the databases as incomplete until the end; a retry starts over
+    if (!pblocktree->WriteFlag("loadingtxoutset", true) ||
+        !ProcessTxOutSnapshot(strPath, true, header, strError))
+        return false;
+
+    CCoinsMap mapCoins;
+    if (!pcoinsdbview->BatchWrite(mapCoins, header.hashBlock, CCoinsCommitment())) {
+        strError = "Cannot write the chain state";
+        return false;
+    }
+    // No block data below the snapshot: the node continues like a pruned one
+    if (!pblocktree->WriteFlag("prunedblockfiles", true) ||
+        !pblocktree->WriteFlag("txindex", false) ||
+        !pblocktree->WriteFlag("addressindex", false) ||
+        !pblocktree->WriteFlag("spentindex", false) ||
+        !pblocktree->WriteFlag("loadingtxoutset", false)) {
+        strError = "Cannot write the block index";
+        return false;
+    }
+    LogPrintf("Loaded UTXO set snapshot of block %s\n", header.hashBlock.ToString());
+    return true;
+}
@@ -0,0 +1,77 @@
+// Copyright (c) 2018 The Basex developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXOUTSNAPSHOT_H
+#define BITCOIN_TXOUTSNAPSHOT_H
+
+#include "coins.h"
+#include "protocol.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <string>
+
+/** Version of the dumptxoutset file format */
+static const int TXOUTSNAPSHOT_VERSION = 1;
+
+/**
+ * Header of a UTXO set snapshot file. It is followed by checksummed chunks
+ * of the block index entries from the genesis block up to hashBlock ('b'),
+ * the coins ('c') and an empty end chunk ('e').
+ */
+class CTxOutSnapshotHeader
+{
+public:
+    unsigned char pchMessageStart[MESSAGE_START_SIZE];
+    int nVersion;
+    uint256 hashBlock;
+    int nHeight;
+    uint256 hashBlockIndex; //! hash of the block index entries in the file
+    uint256 hashCoins;      //! hash of the coins in the file, in order
+    CCoinsCommitment commitment;
+
+    CTxOutSnapshotHeader()
+    {
+        SetNull();
+    }
+
+    void SetNull();
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(FLATDATA(pchMessageStart));
+        READWRITE(this->nVersion);
+        READWRITE(hashBlock);
+        READWRITE(nHeight);
+        READWRITE(hashBlockIndex);
+        READWRITE(hashCoins);
+        READWRITE(commitment);
+    }
+
+    /**
+     * The hash a snapshot is accepted by: it covers both the block index and
+     * the coins. The coins commitment is a sum that can be collided, so the
+     * sequential hash of the coins is what authenticates them.
+     */
+    uint256 GetSnapshotHash() const;
+};
+
+/** Write the block index and the coins as of the current tip to strPath */
+bool DumpTxOutSnapshot(const std::string& strPath, CTxOutSnapshotHeader& header, std::string& strError);
+
+/** Read only the header of the snapshot at strPath, checking its network and version */
+bool ReadTxOutSnapshotHeader(const std::string& strPath, CTxOutSnapshotHeader& header, std::string& strError);
+
+/**
+ * Fill the empty block tree and coin databases from a snapshot. The snapshot
+ * must be one the chain parameters or -assumeutxo accept. This runs at
+ * startup, before the block index is loaded, and leaves the node in the
+ * state of a pruned node whose tip is the snapshot block.
+ */
+bool LoadTxOutSnapshot(const std::string& strPath, std::string& strError);
+
+#endif // BITCOIN_TXOUTSNAPSHOT_H
@@ -5,6 +5,10 @@
 
 #include "validationinterface.h"
 
+#include "primitives/block.h"
+
+#include <boost/foreach.hpp>
+
 static CMainSignals g_signals;
 
 CMainSignals& GetMainSignals()
@@ -14,8 +18,12 @@ CMainSignals& GetMainSignals()
 
 void RegisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
+    g_signals.BlockConnected.connect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1, _2));
     g_signals.SyncTransaction.connect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
+    g_signals.SyncBlockTransactions.connect(boost::bind(&CValidationInterface::SyncBlockTransactions, pwalletIn, _1, _2, _3));
     g_signals.NotifyTransactionLock.connect(boost::bind(&CValidationInterface::NotifyTransactionLock, pwalletIn, _1));
+    g_signals.NotifyMasternodeWinner.connect(boost::bind(&CValidationInterface::NotifyMasternodeWinner, pwalletIn, _1));
+    g_signals.NotifyBudgetVote.connect(boost::bind(&CValidationInterface::NotifyBudgetVote, pwalletIn, _1));
     g_signals.UpdatedTransaction.connect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
     g_signals.SetBestChain.connect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
     g_signals.Inventory.connect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
@@ -33,8 +41,12 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.Inventory.disconnect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
     g_signals.SetBestChain.disconnect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
     g_signals.UpdatedTransaction.disconnect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
+    g_signals.NotifyBudgetVote.disconnect(boost::bind(&CValidationInterface::NotifyBudgetVote, pwalletIn, _1));
+    g_signals.NotifyMasternodeWinner.disconnect(boost::bind(&CValidationInterface::NotifyMasternodeWinner, pwalletIn, _1));
     g_signals.NotifyTransactionLock.disconnect(boost::bind(&CValidationInterface::NotifyTransactionLock, pwalletIn, _1));
+    g_signals.SyncBlockTransactions.disconnect(boost::bind(&CValidationInterface::SyncBlockTransactions, pwalletIn, _1, _2, _3));
     g_signals.SyncTransaction.disconnect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
+    g_signals.BlockConnected.disconnect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1, _2));
     g_signals.UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
 }
 
@@ -46,11 +58,26 @@ void UnregisterAllValidationInterfaces() {
     g_signals.Inventory.disconnect_all_slots();
     g_signals.SetBestChain.disconnect_all_slots();
     g_signals.UpdatedTransaction.disconnect_all_slots();
+    g_signals.NotifyBudgetVote.disconnect_all_slots();
+    g_signals.NotifyMasternodeWinner.disconnect_all_slots();
     g_signals.NotifyTransactionLock.disconnect_all_slots();
+    g_signals.SyncBlockTransactions.disconnect_all_slots();
     g_signals.SyncTransaction.disconnect_all_slots();
+    g_signals.BlockConnected.disconnect_all_slots();
     g_signals.UpdatedBlockTip.disconnect_all_slots();
 }
 
 void SyncWithWallets(const CTransaction &tx, const CBlock *pblock = NULL) {
     g_signals.SyncTransaction(tx, pblock);
 }
+
+void SyncBlockWithWallets(const std::list<CTransaction> &txConflicted, const CBlock &block, bool fConnected) {
+    g_signals.SyncBlockTransactions(txConflicted, block, fConnected);
+}
+
+void CValidationInterface::SyncBlockTransactions(const std::list<CTransaction> &txConflicted, const CBlock &block, bool fConnected) {
+    BOOST_FOREACH (const CTransaction &tx, txConflicted)
+        SyncTransaction(tx, NULL);
+    BOOST_FOREACH (const CTransaction &tx, block.vtx)
+        SyncTransaction(tx, fConnected ? &block : NULL);
+}
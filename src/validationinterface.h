@@ -6,12 +6,16 @@
 #ifndef BITCOIN_VALIDATIONINTERFACE_H
 #define BITCOIN_VALIDATIONINTERFACE_H
 
+#include <list>
+
 #include <boost/signals2/signal.hpp>
 #include <boost/shared_ptr.hpp>
 
 class CBlock;
 struct CBlockLocator;
 class CBlockIndex;
+class CBudgetVote;
+class CMasternodePaymentWinner;
 class CReserveScript;
 class CTransaction;
 class CValidationInterface;
@@ -28,12 +32,18 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn);
 void UnregisterAllValidationInterfaces();
 /** Push an updated transaction to all registered wallets */
 void SyncWithWallets(const CTransaction& tx, const CBlock* pblock);
+/** Push the transactions of a connected or disconnected block, and those it conflicted, to all registered wallets */
+void SyncBlockWithWallets(const std::list<CTransaction>& txConflicted, const CBlock& block, bool fConnected);
 
 class CValidationInterface {
 protected:
     virtual void UpdatedBlockTip(const CBlockIndex *pindex) {}
+    virtual void BlockConnected(const CBlock &block, const CBlockIndex *pindex) {}
     virtual void SyncTransaction(const CTransaction &tx, const CBlock *pblock) {}
+    virtual void SyncBlockTransactions(const std::list<CTransaction> &txConflicted, const CBlock &block, bool fConnected);
     virtual void NotifyTransactionLock(const CTransaction &tx) {}
+    virtual void NotifyMasternodeWinner(const CMasternodePaymentWinner &winner) {}
+    virtual void NotifyBudgetVote(const CBudgetVote &vote) {}
     virtual void SetBestChain(const CBlockLocator &locator) {}
     virtual bool UpdatedTransaction(const uint256 &hash) { return false;}
     virtual void Inventory(const uint256 &hash) {}
@@ -50,10 +60,18 @@ protected:
 struct CMainSignals {
     /** Notifies listeners of updated block chain tip */
     boost::signals2::signal<void (const CBlockIndex *)> UpdatedBlockTip;
+    /** Notifies listeners of a block connected to the active chain, after its transactions were synced. */
+    boost::signals2::signal<void (const CBlock &, const CBlockIndex *)> BlockConnected;
     /** Notifies listeners of updated transaction data (transaction, and optionally the block it is found in. */
     boost::signals2::signal<void (const CTransaction &, const CBlock *)> SyncTransaction;
+    /** Notifies listeners of the transactions a block conflicted and of its own, which are in a block only if it was connected. */
+    boost::signals2::signal<void (const std::list<CTransaction> &, const CBlock &, bool)> SyncBlockTransactions;
     /** Notifies listeners of an updated transaction lock without new data. */
     boost::signals2::signal<void (const CTransaction &)> NotifyTransactionLock;
+    /** Notifies listeners of a new masternode payment winner vote. */
+    boost::signals2::signal<void (const CMasternodePaymentWinner &)> NotifyMasternodeWinner;
+    /** Notifies listeners of a new or updated budget proposal vote. */
+    boost::signals2::signal<void (const CBudgetVote &)> NotifyBudgetVote;
     /** Notifies listeners of an updated transaction without new data (for now: a coinbase potentially becoming visible). */
     boost::signals2::signal<bool (const uint256 &)> UpdatedTransaction;
     /** Notifies listeners of a new active block chain. */
@@ -61,7 +79,7 @@ struct CMainSignals {
     /** Notifies listeners about an inventory item being seen on the network. */
     boost::signals2::signal<void (const uint256 &)> Inventory;
     /** Tells listeners to broadcast their data. */
-    boost::signals2::signal<void (int64_t nBestBlockTime)> Broadcast;
+    boost::signals2::signal<void ()> Broadcast;
     /** Notifies listeners of a block validation result */
     boost::signals2::signal<void (const CBlock&, const CValidationState&)> BlockChecked;
     /** Notifies listeners that a key for mining is required (coinbase) */
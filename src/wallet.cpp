@@ -28,6 +28,7 @@
 #include <assert.h>
 
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 #include <boost/filesystem/operations.hpp>
 
@@ -89,13 +90,21 @@ CPubKey CWallet::GenerateNewKey()
     CKey secret;
     secret.MakeNewKey(fCompressed);
 
-    // Compressed public keys were introduced in version 0.6.0
-    if (fCompressed)
-        SetMinVersion(FEATURE_COMPRPUBKEY);
-
     CPubKey pubkey = secret.GetPubKey();
     assert(secret.VerifyPubKey(pubkey));
 
+    AddGeneratedKey(secret, pubkey);
+    return pubkey;
+}
+
+void CWallet::AddGeneratedKey(const CKey& secret, const CPubKey& pubkey)
+{
+    AssertLockHeld(cs_wallet); // mapKeyMetadata
+
+    // Compressed public keys were introduced in version 0.6.0
+    if (secret.IsCompressed())
+        SetMinVersion(FEATURE_COMPRPUBKEY);
+
     // Create new metadata
     int64_t nCreationTime = GetTime();
     mapKeyMetadata[pubkey.GetID()] = CKeyMetadata(nCreationTime);
@@ -103,8 +112,7 @@ CPubKey CWallet::GenerateNewKey()
         nTimeFirstKey = nCreationTime;
 
     if (!AddKeyPubKey(secret, pubkey))
-        throw std::runtime_error("CWallet::GenerateNewKey() : AddKey failed");
-    return pubkey;
+        throw std::runtime_error("CWallet::AddGeneratedKey() : AddKey failed");
 }
 
 bool CWallet::AddKeyPubKey(const CKey& secret, const CPubKey& pubkey)
@@ -438,6 +446,71 @@ bool CWallet::IsSpent(const uint256& hash, unsigned int n) const
     return false;
 }
 
+/**
+ * Outpoint is spent by a wallet transaction that is in the main chain,
+ * which only a reorg (and so an AddToWallet of the spender) can undo.
+ */
+bool CWallet::IsSpentConfirmed(const COutPoint& outpoint) const
+{
+    pair<TxSpends::const_iterator, TxSpends::const_iterator> range;
+    range = mapTxSpends.equal_range(outpoint);
+    for (TxSpends::const_iterator it = range.first; it != range.second; ++it) {
+        std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(it->second);
+        if (mit != mapWallet.end() && mit->second.GetDepthInMainChain(false) >= 1)
+            return true;
+    }
+    return false;
+}
+
+void CWallet::UpdateWalletCoin(const COutPoint& outpoint) const
+{
+    std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(outpoint.hash);
+    if (mit == mapWallet.end() || outpoint.n >= mit->second.vout.size()) {
+        mapWalletCoins.erase(outpoint);
+        return;
+    }
+    isminetype mine = IsMine(mit->second.vout[outpoint.n]);
+    if (mine == ISMINE_NO || IsSpentConfirmed(outpoint))
+        mapWalletCoins.erase(outpoint);
+    else
+        mapWalletCoins[outpoint] = mine;
+}
+
+/** Bring the wallet coin set up to date, rebuilding it if it was invalidated */
+void CWallet::UpdateWalletCoins() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    if (!fWalletCoinsValid) {
+        mapWalletCoins.clear();
+        setWalletCoinsDirty.clear();
+        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
+            for (unsigned int i = 0; i < it->second.vout.size(); i++)
+                UpdateWalletCoin(COutPoint(it->first, i));
+        }
+        fWalletCoinsValid = true;
+        return;
+    }
+
+    BOOST_FOREACH (const COutPoint& outpoint, setWalletCoinsDirty)
+        UpdateWalletCoin(outpoint);
+    setWalletCoinsDirty.clear();
+}
+
+/** Queue the outputs of a wallet transaction, and the outputs it spends, for UpdateWalletCoins */
+void CWallet::MarkWalletCoinsDirty(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    uint256 hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.vout.size(); i++)
+        setWalletCoinsDirty.insert(COutPoint(hash, i));
+    BOOST_FOREACH (const CTxIn& txin, wtx.vin) {
+        if (mapWallet.count(txin.prevout.hash))
+            setWalletCoinsDirty.insert(txin.prevout);
+    }
+}
+
 void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
 {
     mapTxSpends.insert(make_pair(outpoint, wtxid));
@@ -652,6 +725,25 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         BOOST_FOREACH (PAIRTYPE(const uint256, CWalletTx) & item, mapWallet)
             item.second.MarkDirty();
+        fBalanceCacheValid = false;
+        fWalletCoinsValid = false;
+    }
+}
+
+/**
+ * Queue a wallet transaction, and the wallet transactions it spends from,
+ * for re-evaluation by the next balance query.
+ */
+void CWallet::MarkBalanceDirty(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    setBalanceDirty.insert(wtx.GetHash());
+    BOOST_FOREACH (const CTxIn& txin, wtx.vin) {
+        map<uint256, CWalletTx>::iterator mi = mapWallet.find(txin.prevout.hash);
+        if (mi != mapWallet.end()) {
+            mi->second.MarkDirty();
+            setBalanceDirty.insert(mi->first);
+        }
     }
 }
 
@@ -663,6 +755,8 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         mapWallet[hash] = wtxIn;
         mapWallet[hash].BindWallet(this);
         AddToSpends(hash);
+        fBalanceCacheValid = false;
+        fWalletCoinsValid = false;
     } else {
         LOCK(cs_wallet);
         // Inserts only if not already there, returns tx inserted or tx found
@@ -743,6 +837,8 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
 
         // Break debit/credit balance caches:
         wtx.MarkDirty();
+        MarkBalanceDirty(wtx);
+        MarkWalletCoinsDirty(wtx);
 
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -795,14 +891,43 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
     }
 }
 
+/**
+ * Write the wallet transactions of one connected or disconnected block in a
+ * single database transaction, with cs_wallet held throughout. Only the disk
+ * writes are undone when this fails: mapWallet and the balance and coin
+ * caches have already been updated, so the node is shut down rather than left
+ * running with a wallet that no longer matches wallet.dat.
+ */
+void CWallet::SyncBlockTransactions(const std::list<CTransaction>& txConflicted, const CBlock& block, bool fConnected)
+{
+    LOCK2(cs_main, cs_wallet);
+    bool fCommitted = false;
+    try {
+        CDBBatch batch(strWalletFile);
+        CValidationInterface::SyncBlockTransactions(txConflicted, block, fConnected);
+        fCommitted = batch.Commit();
+    } catch (const std::exception& e) {
+        LogPrintf("SyncBlockTransactions : %s\n", e.what());
+    }
+    if (!fCommitted)
+        AbortNode(strprintf("Failed to write the wallet transactions of block %s", block.GetHash().ToString()));
+}
+
 void CWallet::EraseFromWallet(const uint256& hash)
 {
     if (!fFileBacked)
         return;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        map<uint256, CWalletTx>::iterator mi = mapWallet.find(hash);
+        if (mi != mapWallet.end()) {
+            // The outputs it spent count as unspent again
+            MarkBalanceDirty(mi->second);
+            mapWallet.erase(mi);
             CWalletDB(strWalletFile).EraseTx(hash);
+        }
+        setBalanceDirty.insert(hash);
+        fWalletCoinsValid = false;
     }
     return;
 }
@@ -990,46 +1115,251 @@ bool CWalletTx::WriteToDisk()
     return CWalletDB(pwallet->strWalletFile).WriteTx(GetHash(), *this);
 }
 
+namespace
+{
+/** A block read ahead by a rescan thread, with the transactions paying to the wallet flagged */
+struct CRescanBlock {
+    CBlockIndex* pindex;
+    bool fRead;
+    CBlock block;
+    std::vector<bool> vOutputMatch;
+};
+
+/**
+ * Rescan reader thread: read and deserialize every nStride'th block of the
+ * batch starting at nOffset, and flag the transactions with an output that
+ * is ours. This needs neither cs_main nor cs_wallet: the block files are
+ * append-only and the keystore is guarded by its own lock.
+ */
+void RescanReadBlocks(const CWallet* pwallet, std::vector<CRescanBlock>* pvBatch, size_t nOffset, size_t nStride)
+{
+    for (size_t i = nOffset; i < pvBatch->size(); i += nStride) {
+        boost::this_thread::interruption_point();
+        CRescanBlock& item = (*pvBatch)[i];
+        item.fRead = ReadBlockFromDisk(item.block, item.pindex);
+        if (!item.fRead)
+            continue;
+        item.vOutputMatch.resize(item.block.vtx.size());
+        for (size_t n = 0; n < item.block.vtx.size(); n++)
+            item.vOutputMatch[n] = pwallet->IsMine(item.block.vtx[n]);
+    }
+}
+
+/**
+ * The rescan reader threads, started once per scan. Each batch handed to
+ * Start() is split between them by RescanReadBlocks; the batch has to stay
+ * untouched until Wait() returned.
+ */
+class CRescanReaders
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable condWorker;
+    boost::condition_variable condDone;
+    boost::thread_group threads;
+    const CWallet* pwallet;
+    std::vector<CRescanBlock>* pvBatch;
+    //! counts the batches started, so that each thread reads every batch once
+    unsigned int nBatch;
+    //! threads still reading the current batch
+    int nRunning;
+    int nThreads;
+    bool fQuit;
+
+    void Loop(int nOffset)
+    {
+        RenameThread("basex-rescan");
+        unsigned int nBatchDone = 0;
+        while (true) {
+            std::vector<CRescanBlock>* pvWork;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (nBatch == nBatchDone && !fQuit)
+                    condWorker.wait(lock);
+                if (fQuit)
+                    return;
+                nBatchDone = nBatch;
+                pvWork = pvBatch;
+            }
+            RescanReadBlocks(pwallet, pvWork, nOffset, nThreads);
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                nRunning--;
+            }
+            condDone.notify_all();
+        }
+    }
+
+public:
+    CRescanReaders(const CWallet* pwalletIn, int nThreadsIn) : pwallet(pwalletIn), pvBatch(NULL), nBatch(0), nRunning(0), nThreads(nThreadsIn), fQuit(false)
+    {
+        for (int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&CRescanReaders::Loop, this, i));
+    }
+
+    ~CRescanReaders()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fQuit = true;
+        }
+        condWorker.notify_all();
+        threads.interrupt_all();
+        threads.join_all();
+    }
+
+    void Start(std::vector<CRescanBlock>* pvBatchIn)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            pvBatch = pvBatchIn;
+            nRunning = nThreads;
+            nBatch++;
+        }
+        condWorker.notify_all();
+    }
+
+    //! Wait for the batch last started, an interruption point
+    void Wait()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (nRunning > 0)
+            condDone.wait(lock);
+    }
+};
+
+/** Start reading the next batch of blocks to rescan into vBatch */
+void RescanStartBatch(const std::vector<CBlockIndex*>& vIndex, size_t& nPos, size_t nBatchSize, std::vector<CRescanBlock>& vBatch, CRescanReaders& readers)
+{
+    vBatch.clear();
+    size_t nEnd = std::min(vIndex.size(), nPos + nBatchSize);
+    if (nPos >= nEnd)
+        return;
+    vBatch.resize(nEnd - nPos);
+    for (size_t i = 0; nPos < nEnd; i++, nPos++) {
+        vBatch[i].pindex = vIndex[nPos];
+        vBatch[i].fRead = false;
+    }
+    readers.Start(&vBatch);
+}
+
+/**
+ * Whether a transaction may involve the wallet: it pays to us, is already
+ * in the wallet, or spends an output of a wallet transaction. This is a
+ * superset of what AddToWalletIfInvolvingMe accepts.
+ */
+bool IsRescanCandidate(const CTransaction& tx, bool fOutputMatch, const std::set<uint256>& setWalletTx)
+{
+    if (fOutputMatch || setWalletTx.count(tx.GetHash()))
+        return true;
+    BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+        if (setWalletTx.count(txin.prevout.hash))
+            return true;
+    }
+    return false;
+}
+}
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
+ *
+ * Blocks are read and matched against the wallet's keys by -rescanthreads
+ * reader threads, one batch ahead of the committing thread, with no locks
+ * held. cs_main and cs_wallet are only taken to add the candidates of a
+ * block to the wallet, so callers should not hold them across the call.
  */
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
     int ret = 0;
     int64_t nNow = GetTime();
 
-    CBlockIndex* pindex = pindexStart;
+    // Snapshot the blocks to scan and the transactions we already know about.
+    // setWalletTx grows as the scan finds transactions spending from us.
+    std::vector<CBlockIndex*> vIndex;
+    std::set<uint256> setWalletTx;
     {
         LOCK2(cs_main, cs_wallet);
 
         // no need to read and scan block, if block was created before
         // our wallet birthday (as adjusted for block time variability)
+        CBlockIndex* pindex = pindexStart;
         while (pindex && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - 7200)))
             pindex = chainActive.Next(pindex);
+        for (; pindex; pindex = chainActive.Next(pindex))
+            vIndex.push_back(pindex);
 
-        ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
-        while (pindex) {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
-
-            CBlock block;
-            ReadBlockFromDisk(block, pindex);
-            BOOST_FOREACH (CTransaction& tx, block.vtx) {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
-                    ret++;
-            }
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
+        BOOST_FOREACH (const PAIRTYPE(const uint256, CWalletTx) & item, mapWallet)
+            setWalletTx.insert(item.first);
+    }
+
+    ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
+    double dProgressStart = Checkpoints::GuessVerificationProgress(vIndex.empty() ? NULL : vIndex.front(), false);
+    double dProgressTip = Checkpoints::GuessVerificationProgress(vIndex.empty() ? NULL : vIndex.back(), false);
+
+    int nThreads = GetArg("-rescanthreads", DEFAULT_RESCAN_THREADS);
+    if (nThreads <= 0)
+        nThreads = boost::thread::hardware_concurrency();
+    nThreads = std::max(1, std::min(nThreads, MAX_RESCAN_THREADS));
+    size_t nBatchSize = nThreads * RESCAN_BLOCKS_PER_THREAD;
+
+    // Declared before the readers, which have to stop with the batches alive
+    std::vector<CRescanBlock> vBatch, vNext;
+    size_t nPos = 0;
+    try {
+        CRescanReaders readers(this, nThreads);
+        RescanStartBatch(vIndex, nPos, nBatchSize, vNext, readers);
+        while (!vNext.empty()) {
+            readers.Wait();
+            vBatch.swap(vNext);
+            RescanStartBatch(vIndex, nPos, nBatchSize, vNext, readers);
+
+            BOOST_FOREACH (const CRescanBlock& item, vBatch) {
+                CBlockIndex* pindex = item.pindex;
+                if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+                    ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+                if (GetTime() >= nNow + 60) {
+                    nNow = GetTime();
+                    LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
+                }
+
+                if (!item.fRead) {
+                    LogPrintf("ScanForWalletTransactions : failed to read block %s at height %d\n", pindex->GetBlockHash().ToString(), pindex->nHeight);
+                    continue;
+                }
+
+                const std::vector<CTransaction>& vtx = item.block.vtx;
+                bool fCandidate = false;
+                for (size_t n = 0; n < vtx.size() && !fCandidate; n++)
+                    fCandidate = IsRescanCandidate(vtx[n], item.vOutputMatch[n], setWalletTx);
+                if (!fCandidate)
+                    continue;
+
+                LOCK2(cs_main, cs_wallet);
+                // The block was read without cs_main; a reorganisation may have taken it off the chain since
+                if (!chainActive.Contains(pindex)) {
+                    LogPrintf("ScanForWalletTransactions : block %s at height %d left the active chain, skipping it\n", pindex->GetBlockHash().ToString(), pindex->nHeight);
+                    continue;
+                }
+                CDBBatch batch(strWalletFile);
+                for (size_t n = 0; n < vtx.size(); n++) {
+                    if (!IsRescanCandidate(vtx[n], item.vOutputMatch[n], setWalletTx))
+                        continue;
+                    if (AddToWalletIfInvolvingMe(vtx[n], &item.block, fUpdate))
+                        ret++;
+                    if (mapWallet.count(vtx[n].GetHash()))
+                        setWalletTx.insert(vtx[n].GetHash());
+                }
+                if (!batch.Commit())
+                    LogPrintf("ScanForWalletTransactions : failed to write the wallet transactions of block %s at height %d\n", pindex->GetBlockHash().ToString(), pindex->nHeight);
             }
         }
-        ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+    } catch (...) {
+        ShowProgress(_("Rescanning..."), 100);
+        throw;
     }
+    ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     return ret;
 }
 
@@ -1133,157 +1463,195 @@ void CWallet::ResendWalletTransactions()
  * @{
  */
 
-CAmount CWallet::GetBalance() const
+/**
+ * Recompute the contribution of one wallet transaction to the cached
+ * balances, using the same rules as the full mapWallet walk this replaces.
+ */
+void CWallet::UpdateBalanceContribution(const uint256& hash) const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
-        }
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    std::map<uint256, CWalletBalance>::iterator mi = mapBalanceContribution.find(hash);
+    if (mi != mapBalanceContribution.end()) {
+        balanceCached -= mi->second;
+        mapBalanceContribution.erase(mi);
     }
+    setBalanceVolatile.erase(hash);
 
-    return nTotal;
+    map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+    if (it == mapWallet.end())
+        return;
+    const CWalletTx* pcoin = &(*it).second;
+
+    bool fFinal = IsFinalTx(*pcoin);
+    bool fTrusted = pcoin->IsTrusted();
+    int nDepth = pcoin->GetDepthInMainChain();
+
+    CWalletBalance contribution;
+    if (fTrusted) {
+        contribution.nTrusted = pcoin->GetAvailableCredit();
+        contribution.nWatchOnlyTrusted = pcoin->GetAvailableWatchOnlyCredit();
+    }
+    if (!fFinal || (!fTrusted && nDepth == 0)) {
+        contribution.nUntrustedPending = pcoin->GetAvailableCredit();
+        contribution.nWatchOnlyUntrustedPending = pcoin->GetAvailableWatchOnlyCredit();
+    }
+    contribution.nImmature = pcoin->GetImmatureCredit();
+    contribution.nWatchOnlyImmature = pcoin->GetImmatureWatchOnlyCredit();
+
+    if (!contribution.IsNull()) {
+        mapBalanceContribution.insert(std::make_pair(hash, contribution));
+        balanceCached += contribution;
+    }
+
+    // A confirmed, final and mature transaction stays in its category until
+    // it is updated, spent from or disconnected, all of which mark it dirty.
+    if (!fFinal || nDepth < 1 || pcoin->GetBlocksToMaturity() > 0)
+        setBalanceVolatile.insert(hash);
 }
 
-CAmount CWallet::GetUnconfirmedBalance() const
+CWalletBalance CWallet::GetBalances() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableCredit();
-        }
+    LOCK2(cs_main, cs_wallet);
+    if (!fBalanceCacheValid) {
+        balanceCached = CWalletBalance();
+        mapBalanceContribution.clear();
+        setBalanceVolatile.clear();
+        setBalanceDirty.clear();
+        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+            UpdateBalanceContribution((*it).first);
+        fBalanceCacheValid = true;
+        return balanceCached;
     }
-    return nTotal;
+
+    std::set<uint256> setUpdate;
+    setUpdate.swap(setBalanceDirty);
+    setUpdate.insert(setBalanceVolatile.begin(), setBalanceVolatile.end());
+    BOOST_FOREACH (const uint256& hash, setUpdate)
+        UpdateBalanceContribution(hash);
+    return balanceCached;
+}
+
+CAmount CWallet::GetBalance() const
+{
+    return GetBalances().nTrusted;
+}
+
+CAmount CWallet::GetUnconfirmedBalance() const
+{
+    return GetBalances().nUntrustedPending;
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nImmature;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-
-    return nTotal;
+    return GetBalances().nWatchOnlyTrusted;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nWatchOnlyUntrustedPending;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nWatchOnlyImmature;
 }
 
 /**
  * populate vCoins with vector of available COutputs.
  */
+/** Transaction-level checks of AvailableCoins, sets nDepth if the outputs of pcoin may be spent */
+static bool IsAvailableWalletTx(const CWalletTx* pcoin, bool fOnlyConfirmed, bool fUseIX, int& nDepth)
+{
+    if (!CheckFinalTx(*pcoin))
+        return false;
+
+    if (fOnlyConfirmed && !pcoin->IsTrusted())
+        return false;
+
+    if ((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && pcoin->GetBlocksToMaturity() > 0)
+        return false;
+
+    nDepth = pcoin->GetDepthInMainChain(false);
+    // do not use IX for inputs that have less then 6 blockchain confirmations
+    if (fUseIX && nDepth < 6)
+        return false;
+
+    // We should not consider coins which aren't at least in our mempool
+    // It's possible for these to be conflicted via ancestors which we may never be able to detect
+    if (nDepth == 0 && !pcoin->InMempool())
+        return false;
+
+    return true;
+}
+
 void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const CCoinControl* coinControl, bool fIncludeZeroValue, AvailableCoinsType nCoinType, bool fUseIX) const
 {
     vCoins.clear();
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
-
-            if (!CheckFinalTx(*pcoin))
+        UpdateWalletCoins();
+
+        // Runs Check() on every masternode, refreshing their states
+        mnodeman.CountEnabled();
+
+        // The coin set is ordered by outpoint, so the outputs of a transaction
+        // are adjacent and the per-transaction checks run once for each.
+        const CWalletTx* pcoin = NULL;
+        bool fAvailable = false;
+        int nDepth = 0;
+        for (map<COutPoint, isminetype>::const_iterator it = mapWalletCoins.begin(); it != mapWalletCoins.end(); ++it) {
+            const uint256& wtxid = it->first.hash;
+            unsigned int i = it->first.n;
+
+            if (pcoin == NULL || pcoin->GetHash() != wtxid) {
+                map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(wtxid);
+                if (mi == mapWallet.end()) {
+                    pcoin = NULL;
+                    continue;
+                }
+                pcoin = &mi->second;
+                fAvailable = IsAvailableWalletTx(pcoin, fOnlyConfirmed, fUseIX, nDepth);
+            }
+            if (!fAvailable)
                 continue;
 
-            if (fOnlyConfirmed && !pcoin->IsTrusted())
-                continue;
+            bool found = false;
+            if (nCoinType == ONLY_NOT10000IFMN) {
+                found = !(fMasterNode && masternodeSigner.IsCollateralAmount(pcoin->vout[i].nValue));
+            } else if (nCoinType == ONLY_10000) {
+                found = masternodeSigner.IsCollateralAmount(pcoin->vout[i].nValue);
+            } else {
+                found = true;
+            }
+            if (!found) continue;
 
-            if ((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && pcoin->GetBlocksToMaturity() > 0)
+            isminetype mine = it->second;
+            if (IsSpent(wtxid, i))
                 continue;
-
-            int nDepth = pcoin->GetDepthInMainChain(false);
-            // do not use IX for inputs that have less then 6 blockchain confirmations
-            if (fUseIX && nDepth < 6)
+            if (mine == ISMINE_WATCH_ONLY)
                 continue;
 
-            // We should not consider coins which aren't at least in our mempool
-            // It's possible for these to be conflicted via ancestors which we may never be able to detect
-            if (nDepth == 0 && !pcoin->InMempool())
+            if (IsLockedCoin(wtxid, i) && nCoinType != ONLY_10000)
+                continue;
+            if (pcoin->vout[i].nValue <= 0 && !fIncludeZeroValue)
+                continue;
+            if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(wtxid, i))
                 continue;
 
-            mnodeman.CountEnabled();
-
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
-                bool found = false;
-                if (nCoinType == ONLY_NOT10000IFMN) {
-                    found = !(fMasterNode && masternodeSigner.IsCollateralAmount(pcoin->vout[i].nValue));
-                } if (nCoinType == ONLY_10000) {
-                    found = masternodeSigner.IsCollateralAmount(pcoin->vout[i].nValue);
-                } else {
-                    found = true;
-                }
-                if (!found) continue;
-
-                isminetype mine = IsMine(pcoin->vout[i]);
-                if (IsSpent(wtxid, i))
-                    continue;
-                if (mine == ISMINE_NO)
-                    continue;
-                if (mine == ISMINE_WATCH_ONLY)
-                    continue;
-
-                if (IsLockedCoin((*it).first, i) && nCoinType != ONLY_10000)
-                    continue;
-                if (pcoin->vout[i].nValue <= 0 && !fIncludeZeroValue)
-                    continue;
-                if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected((*it).first, i))
-                    continue;
-
-                bool fIsSpendable = false;
-                if ((mine & ISMINE_SPENDABLE) != ISMINE_NO)
-                    fIsSpendable = true;
-                if ((mine & ISMINE_MULTISIG) != ISMINE_NO)
-                    fIsSpendable = true;
-                vCoins.emplace_back(COutput(pcoin, i, nDepth, fIsSpendable));
-            }
+            bool fIsSpendable = false;
+            if ((mine & ISMINE_SPENDABLE) != ISMINE_NO)
+                fIsSpendable = true;
+            if ((mine & ISMINE_MULTISIG) != ISMINE_NO)
+                fIsSpendable = true;
+            vCoins.emplace_back(COutput(pcoin, i, nDepth, fIsSpendable));
         }
     }
 }
@@ -1308,13 +1676,68 @@ map<CBitcoinAddress, vector<COutput> > CWallet::AvailableCoinsByAddress(bool fCo
     return mapCoins;
 }
 
-static void ApproximateBestSubset(vector<pair<CAmount, pair<const CWalletTx*, unsigned int> > > vValue, const CAmount& nTotalLower, const CAmount& nTargetValue, vector<char>& vfBest, CAmount& nBest, int iterations = 1000)
+/** Budget, in coins visited, for all iterations of one ApproximateBestSubset run */
+static const int64_t MAX_KNAPSACK_WORK = 10000000;
+
+bool SelectCoinsBnB(const vector<pair<CAmount, pair<const CWalletTx*, unsigned int> > >& vValue, const CAmount& nTargetValue, const CAmount& nNoChange, vector<char>& vfBest, CAmount& nBest, int nMaxTries)
+{
+    // vRemaining[i] is the total of vValue[i..], for pruning branches that can't reach the target
+    vector<CAmount> vRemaining(vValue.size() + 1, 0);
+    for (size_t i = vValue.size(); i > 0; i--)
+        vRemaining[i - 1] = vRemaining[i] + vValue[i - 1].first;
+    if (vRemaining[0] < nTargetValue)
+        return false;
+
+    // Depth first, including a coin before excluding it. vfSelected holds the
+    // decisions for the coins before i and is clear from i on.
+    vector<char> vfSelected(vValue.size(), false);
+    CAmount nTotal = 0;
+    size_t i = 0;
+    bool fFound = false;
+    for (int nTries = 0; nTries < nMaxTries; nTries++) {
+        bool fBacktrack = false;
+        if (nTotal + vRemaining[i] < nTargetValue || nTotal >= nTargetValue + nNoChange) {
+            fBacktrack = true;
+        } else if (nTotal >= nTargetValue) {
+            if (!fFound || nTotal < nBest) {
+                fFound = true;
+                nBest = nTotal;
+                vfBest = vfSelected;
+                if (nBest == nTargetValue)
+                    break;
+            }
+            // Adding more coins only increases the excess
+            fBacktrack = true;
+        }
+
+        if (fBacktrack) {
+            // Exclude the last included coin and explore the branch without it
+            while (i > 0 && !vfSelected[i - 1])
+                i--;
+            if (i == 0)
+                break;
+            vfSelected[i - 1] = false;
+            nTotal -= vValue[i - 1].first;
+        } else {
+            vfSelected[i] = true;
+            nTotal += vValue[i].first;
+            i++;
+        }
+    }
+    return fFound;
+}
+
+static void ApproximateBestSubset(const vector<pair<CAmount, pair<const CWalletTx*, unsigned int> > >& vValue, const CAmount& nTotalLower, const CAmount& nTargetValue, vector<char>& vfBest, CAmount& nBest, int iterations = 1000)
 {
     vector<char> vfIncluded;
 
     vfBest.assign(vValue.size(), true);
     nBest = nTotalLower;
 
+    // Bound the run time on wallets with very many small coins
+    if (!vValue.empty())
+        iterations = std::max(1, (int)std::min((int64_t)iterations, MAX_KNAPSACK_WORK / (int64_t)vValue.size()));
+
     seed_insecure_rand();
 
     for (int nRep = 0; nRep < iterations && nBest != nTargetValue; nRep++) {
@@ -1393,7 +1816,7 @@ bool CWallet::MintableCoins()
     return false;
 }
 
-bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, vector<COutput> vCoins, set<pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const
+bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, const vector<COutput>& vCoins, set<pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const
 {
     setCoinsRet.clear();
     nValueRet = 0;
@@ -1405,14 +1828,19 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
     vector<pair<CAmount, pair<const CWalletTx*, unsigned int> > > vValue;
     CAmount nTotalLower = 0;
 
-    random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
+    // Visit the coins in random order without copying them
+    vector<unsigned int> vOrder(vCoins.size());
+    for (unsigned int i = 0; i < vOrder.size(); i++)
+        vOrder[i] = i;
+    random_shuffle(vOrder.begin(), vOrder.end(), GetRandInt);
 
     // try to find nondenom first to prevent unneeded spending of mixed coins
     for (unsigned int tryDenom = 0; tryDenom < 2; tryDenom++) {
         if (fDebug) LogPrint("selectcoins", "tryDenom: %d\n", tryDenom);
         vValue.clear();
         nTotalLower = 0;
-        BOOST_FOREACH (const COutput& output, vCoins) {
+        BOOST_FOREACH (unsigned int nCoin, vOrder) {
+            const COutput& output = vCoins[nCoin];
             if (!output.fSpendable)
                 continue;
 
@@ -1466,11 +1894,25 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
         break;
     }
 
-    // Solve subset sum by stochastic approximation
     sort(vValue.rbegin(), vValue.rend(), CompareValueOnly());
     vector<char> vfBest;
     CAmount nBest;
 
+    // Look for a subset that needs no change output first: CreateTransaction
+    // adds change below the dust threshold of a P2PKH output to the fee.
+    CAmount nNoChange = 3 * ::minRelayTxFee.GetFee(34 + 148);
+    if (SelectCoinsBnB(vValue, nTargetValue, nNoChange, vfBest, nBest)) {
+        for (unsigned int i = 0; i < vValue.size(); i++) {
+            if (vfBest[i]) {
+                setCoinsRet.insert(vValue[i].second);
+                nValueRet += vValue[i].first;
+            }
+        }
+        LogPrint("selectcoins", "CWallet::SelectCoinsMinConf branch and bound: %d coins - total %s\n", setCoinsRet.size(), FormatMoney(nBest));
+        return true;
+    }
+
+    // Solve subset sum by stochastic approximation
     ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest, 1000);
     if (nBest != nTargetValue && nTotalLower >= nTargetValue + CENT)
         ApproximateBestSubset(vValue, nTotalLower, nTargetValue + CENT, vfBest, nBest, 1000);
@@ -1631,6 +2073,10 @@ bool CWallet::CreateTransaction(const vector<pair<CScript, CAmount> >& vecSend,
     wtxNew.BindWallet(this);
     CMutableTransaction txNew;
 
+    // Derive the keys for the change address now, before cs_wallet is taken
+    if (!IsLocked())
+        RequestKeyPoolTopUp();
+
     {
         LOCK2(cs_main, cs_wallet);
         {
@@ -2005,10 +2451,8 @@ bool CWallet::CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey, std:
         LOCK2(cs_main, cs_wallet);
         LogPrintf("CommitTransaction:\n%s", wtxNew.ToString());
         {
-            // This is only to keep the database open to defeat the auto-flush for the
-            // duration of this scope.  This is the only place where this optimization
-            // maybe makes sense; please don't do it anywhere else.
-            CWalletDB* pwalletdb = fFileBacked ? new CWalletDB(strWalletFile, "r") : NULL;
+            // Commit the key pool and wallet updates of this send together
+            CDBBatch batch(strWalletFile);
 
             // Take key pair from key pool so it won't be used again
             reservekey.KeepKey();
@@ -2028,8 +2472,9 @@ bool CWallet::CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey, std:
                 NotifyTransactionChanged(this, txin.prevout.hash, CT_UPDATED);
                 updated_hahes.insert(txin.prevout.hash);
             }
-            if (fFileBacked)
-                delete pwalletdb;
+
+            if (!batch.Commit())
+                return error("CommitTransaction() : failed to write transaction %s to the wallet", wtxNew.GetHash().ToString());
         }
 
         // Track how many getdata requests our transaction gets
@@ -2195,13 +2640,16 @@ bool CWallet::NewKeyPool()
 {
     {
         LOCK(cs_wallet);
+        CDBBatch batch(strWalletFile);
         CWalletDB walletdb(strWalletFile);
         BOOST_FOREACH (int64_t nIndex, setKeyPool)
             walletdb.ErasePool(nIndex);
         setKeyPool.clear();
 
-        if (IsLocked())
+        if (IsLocked()) {
+            batch.Commit();
             return false;
+        }
 
         int64_t nKeys = max(GetArg("-keypool", 1000), (int64_t)0);
         for (int i = 0; i < nKeys; i++) {
@@ -2209,54 +2657,196 @@ bool CWallet::NewKeyPool()
             walletdb.WritePool(nIndex, CKeyPool(GenerateNewKey()));
             setKeyPool.insert(nIndex);
         }
+        if (!batch.Commit())
+            return error("CWallet::NewKeyPool : failed to write the new keys");
         LogPrintf("CWallet::NewKeyPool wrote %d new keys\n", nKeys);
     }
     return true;
 }
 
+namespace
+{
+/** Key derivation thread: make every nStride'th key of the batch starting at nOffset */
+void DeriveKeyPoolKeys(std::vector<std::pair<CKey, CPubKey> >* pvKeys, bool fCompressed, size_t nOffset, size_t nStride)
+{
+    for (size_t i = nOffset; i < pvKeys->size(); i += nStride) {
+        boost::this_thread::interruption_point();
+        CKey& secret = (*pvKeys)[i].first;
+        secret.MakeNewKey(fCompressed);
+        (*pvKeys)[i].second = secret.GetPubKey();
+        assert(secret.VerifyPubKey((*pvKeys)[i].second));
+    }
+}
+
+/** Derive a batch of new keys on up to nThreads threads. No wallet lock is needed. */
+void DeriveKeyPoolBatch(std::vector<std::pair<CKey, CPubKey> >& vKeys, bool fCompressed, int nThreads)
+{
+    if (nThreads <= 1 || vKeys.size() <= 1) {
+        DeriveKeyPoolKeys(&vKeys, fCompressed, 0, 1);
+        return;
+    }
+
+    size_t nStride = std::min((size_t)nThreads, vKeys.size());
+    boost::thread_group workers;
+    try {
+        for (size_t i = 0; i < nStride; i++)
+            workers.create_thread(boost::bind(&DeriveKeyPoolKeys, &vKeys, fCompressed, i, nStride));
+        workers.join_all();
+    } catch (...) {
+        workers.interrupt_all();
+        workers.join_all();
+        throw;
+    }
+}
+}
+
+/**
+ * Top up the key pool to kpSize (default -keypool) keys. New keys are
+ * derived in batches of KEYPOOL_BATCH_SIZE on -keypoolthreads threads
+ * without holding cs_wallet, which is only taken to add each batch to the
+ * keystore and write it in one database transaction. A top-up of more than
+ * one batch reports its progress through ShowProgress.
+ */
 bool CWallet::TopUpKeyPool(unsigned int kpSize)
 {
-    {
-        LOCK(cs_wallet);
+    unsigned int nTargetSize;
+    if (kpSize > 0)
+        nTargetSize = kpSize;
+    else
+        nTargetSize = max(GetArg("-keypool", 1000), (int64_t)0);
 
-        if (IsLocked())
-            return false;
+    int nThreads = GetArg("-keypoolthreads", DEFAULT_KEYPOOL_THREADS);
+    if (nThreads <= 0)
+        nThreads = boost::thread::hardware_concurrency();
+    nThreads = std::max(1, std::min(nThreads, MAX_KEYPOOL_THREADS));
 
-        CWalletDB walletdb(strWalletFile);
+    bool fResult = true;
+    unsigned int nFirstMissing = 0;
+    bool fShowProgress = false;
+    try {
+        while (true) {
+            unsigned int nMissing;
+            bool fCompressed;
+            {
+                LOCK(cs_wallet);
+                if (IsLocked()) {
+                    fResult = false;
+                    break;
+                }
+                if (setKeyPool.size() >= nTargetSize + 1)
+                    break;
+                nMissing = nTargetSize + 1 - setKeyPool.size();
+                fCompressed = CanSupportFeature(FEATURE_COMPRPUBKEY); // default to compressed public keys if we want 0.6.0 wallets
+            }
+            if (nFirstMissing == 0) {
+                nFirstMissing = nMissing;
+                fShowProgress = nMissing > KEYPOOL_BATCH_SIZE;
+                if (fShowProgress)
+                    ShowProgress(_("Generating keys..."), 0);
+            }
 
-        // Top up key pool
-        unsigned int nTargetSize;
-        if (kpSize > 0)
-            nTargetSize = kpSize;
-        else
-            nTargetSize = max(GetArg("-keypool", 1000), (int64_t)0);
+            RandAddSeedPerfmon();
+            std::vector<std::pair<CKey, CPubKey> > vKeys(std::min(nMissing, KEYPOOL_BATCH_SIZE));
+            DeriveKeyPoolBatch(vKeys, fCompressed, nThreads);
+
+            LOCK(cs_wallet);
+            if (IsLocked()) {
+                fResult = false;
+                break;
+            }
 
-        while (setKeyPool.size() < (nTargetSize + 1)) {
+            // Write the new keys and pool entries in one transaction
+            CDBBatch batch(strWalletFile);
+            CWalletDB walletdb(strWalletFile);
+
+            // Another thread may have topped up the pool meanwhile
             int64_t nEnd = 1;
-            if (!setKeyPool.empty())
-                nEnd = *(--setKeyPool.end()) + 1;
-            if (!walletdb.WritePool(nEnd, CKeyPool(GenerateNewKey())))
-                throw runtime_error("TopUpKeyPool() : writing generated key failed");
-            setKeyPool.insert(nEnd);
-            LogPrintf("keypool added key %d, size=%u\n", nEnd, setKeyPool.size());
-            double dProgress = 100.f * nEnd / (nTargetSize + 1);
-            std::string strMsg = strprintf(_("Loading wallet... (%3.2f %%)"), dProgress);
-            uiInterface.InitMessage(strMsg);
+            for (size_t i = 0; i < vKeys.size() && setKeyPool.size() < (nTargetSize + 1); i++) {
+                if (!setKeyPool.empty())
+                    nEnd = *(--setKeyPool.end()) + 1;
+                AddGeneratedKey(vKeys[i].first, vKeys[i].second);
+                if (!walletdb.WritePool(nEnd, CKeyPool(vKeys[i].second)))
+                    throw runtime_error("TopUpKeyPool() : writing generated key failed");
+                setKeyPool.insert(nEnd);
+            }
+            if (!batch.Commit())
+                throw runtime_error("TopUpKeyPool() : committing generated keys failed");
+            LogPrintf("keypool added keys up to %d, size=%u\n", nEnd, setKeyPool.size());
+            if (fShowProgress) {
+                unsigned int nLeft = setKeyPool.size() < nTargetSize + 1 ? nTargetSize + 1 - setKeyPool.size() : 0;
+                ShowProgress(_("Generating keys..."), std::max(1, std::min(99, (int)(100.0 * (nFirstMissing - std::min(nLeft, nFirstMissing)) / nFirstMissing))));
+            }
         }
+    } catch (...) {
+        if (fShowProgress)
+            ShowProgress(_("Generating keys..."), 100);
+        throw;
+    }
+    if (fShowProgress)
+        ShowProgress(_("Generating keys..."), 100); // hide progress dialog in GUI
+    return fResult;
+}
+
+void CWallet::RequestKeyPoolTopUp()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(csKeyPoolFiller);
+        if (!fKeyPoolFillerRunning) {
+            lock.unlock();
+            TopUpKeyPool();
+            return;
+        }
+        fKeyPoolFillerWake = true;
+    }
+    condKeyPoolFiller.notify_one();
+
+    // Don't make the caller wait for a full refill, just for the key it needs
+    bool fEmpty;
+    {
+        LOCK(cs_wallet);
+        fEmpty = setKeyPool.empty();
+    }
+    if (fEmpty)
+        TopUpKeyPool(1);
+}
+
+void CWallet::ThreadKeyPoolFiller()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(csKeyPoolFiller);
+        if (fKeyPoolFillerRunning)
+            return;
+        fKeyPoolFillerRunning = true;
+    }
+
+    try {
+        while (true) {
+            TopUpKeyPool();
+
+            boost::unique_lock<boost::mutex> lock(csKeyPoolFiller);
+            while (!fKeyPoolFillerWake)
+                condKeyPoolFiller.wait(lock);
+            fKeyPoolFillerWake = false;
+        }
+    } catch (...) {
+        boost::unique_lock<boost::mutex> lock(csKeyPoolFiller);
+        fKeyPoolFillerRunning = false;
+        throw;
     }
-    return true;
 }
 
 void CWallet::ReserveKeyFromKeyPool(int64_t& nIndex, CKeyPool& keypool)
 {
     nIndex = -1;
     keypool.vchPubKey = CPubKey();
+    // This may derive new keys, so callers should not hold cs_wallet. Those
+    // that must (CreateTransaction) top up the pool before taking it.
+    if (!IsLocked())
+        RequestKeyPoolTopUp();
+
     {
         LOCK(cs_wallet);
 
-        if (!IsLocked())
-            TopUpKeyPool();
-
         // Get the oldest key
         if (setKeyPool.empty())
             return;
@@ -2298,9 +2888,9 @@ bool CWallet::GetKeyFromPool(CPubKey& result)
 {
     int64_t nIndex = 0;
     CKeyPool keypool;
+    ReserveKeyFromKeyPool(nIndex, keypool);
     {
         LOCK(cs_wallet);
-        ReserveKeyFromKeyPool(nIndex, keypool);
         if (nIndex == -1) {
             if (IsLocked()) return false;
             result = GenerateNewKey();
@@ -32,6 +32,9 @@
 #include <utility>
 #include <vector>
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
 /**
  * Settings
  */
@@ -53,6 +56,22 @@ static const CAmount DEFAULT_TRANSACTION_MAXFEE = 1 * COIN;
 static const CAmount nHighTransactionMaxFeeWarning = 100 * nHighTransactionFeeWarning;
 //! Largest (in bytes) free transaction we're willing to create
 static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
+//! -rescanthreads default, 0 = one per core
+static const int DEFAULT_RESCAN_THREADS = 0;
+//! Maximum number of block reader threads used by a wallet rescan
+static const int MAX_RESCAN_THREADS = 8;
+//! Number of blocks read ahead per rescan thread before matches are committed
+static const int RESCAN_BLOCKS_PER_THREAD = 16;
+//! -keypoolfiller default
+static const bool DEFAULT_KEYPOOL_FILLER = true;
+//! -keypoolthreads default, 0 = one per core
+static const int DEFAULT_KEYPOOL_THREADS = 0;
+//! Maximum number of key derivation threads used to top up the key pool
+static const int MAX_KEYPOOL_THREADS = 8;
+//! Number of keys derived outside cs_wallet before they are written in one batch
+static const unsigned int KEYPOOL_BATCH_SIZE = 100;
+//! Maximum number of nodes the branch and bound coin selection explores
+static const int MAX_BNB_TRIES = 100000;
 
 class CAccountingEntry;
 class CCoinControl;
@@ -61,6 +80,14 @@ class CReserveKey;
 class CScript;
 class CWalletTx;
 
+/**
+ * Branch and bound search for a subset of vValue, sorted by descending value,
+ * whose total is at least nTargetValue and less than nTargetValue + nNoChange,
+ * so that the excess can go to the fee instead of a change output. The subset
+ * with the smallest excess found within nMaxTries steps is returned.
+ */
+bool SelectCoinsBnB(const std::vector<std::pair<CAmount, std::pair<const CWalletTx*, unsigned int> > >& vValue, const CAmount& nTargetValue, const CAmount& nNoChange, std::vector<char>& vfBest, CAmount& nBest, int nMaxTries = MAX_BNB_TRIES);
+
 /** (client) version numbers for particular wallet features */
 enum WalletFeature {
     FEATURE_BASE = 10500, // the earliest version new wallets supports (only useful for getinfo's clientversion output)
@@ -88,6 +115,45 @@ struct CompactTallyItem {
     }
 };
 
+/** Wallet balances by category, as returned by the CWallet::Get*Balance() accessors */
+struct CWalletBalance {
+    CAmount nTrusted;
+    CAmount nUntrustedPending;
+    CAmount nImmature;
+    CAmount nWatchOnlyTrusted;
+    CAmount nWatchOnlyUntrustedPending;
+    CAmount nWatchOnlyImmature;
+
+    CWalletBalance() : nTrusted(0), nUntrustedPending(0), nImmature(0), nWatchOnlyTrusted(0), nWatchOnlyUntrustedPending(0), nWatchOnlyImmature(0) {}
+
+    bool IsNull() const
+    {
+        return !nTrusted && !nUntrustedPending && !nImmature && !nWatchOnlyTrusted && !nWatchOnlyUntrustedPending && !nWatchOnlyImmature;
+    }
+
+    CWalletBalance& operator+=(const CWalletBalance& b)
+    {
+        nTrusted += b.nTrusted;
+        nUntrustedPending += b.nUntrustedPending;
+        nImmature += b.nImmature;
+        nWatchOnlyTrusted += b.nWatchOnlyTrusted;
+        nWatchOnlyUntrustedPending += b.nWatchOnlyUntrustedPending;
+        nWatchOnlyImmature += b.nWatchOnlyImmature;
+        return *this;
+    }
+
+    CWalletBalance& operator-=(const CWalletBalance& b)
+    {
+        nTrusted -= b.nTrusted;
+        nUntrustedPending -= b.nUntrustedPending;
+        nImmature -= b.nImmature;
+        nWatchOnlyTrusted -= b.nWatchOnlyTrusted;
+        nWatchOnlyUntrustedPending -= b.nWatchOnlyUntrustedPending;
+        nWatchOnlyImmature -= b.nWatchOnlyImmature;
+        return *this;
+    }
+};
+
 /** A key pool entry */
 class CKeyPool
 {
@@ -147,6 +213,16 @@ private:
     int64_t nNextResend;
     int64_t nLastResend;
 
+    /**
+     * Background key pool filler, guarded by csKeyPoolFiller: whether
+     * ThreadKeyPoolFiller runs for this wallet, and whether it has been asked
+     * to top the pool up again.
+     */
+    boost::mutex csKeyPoolFiller;
+    boost::condition_variable condKeyPoolFiller;
+    bool fKeyPoolFillerRunning;
+    bool fKeyPoolFillerWake;
+
     /**
      * Used to keep track of spent outpoints, and
      * detect and report conflicts (double-spends or
@@ -159,6 +235,37 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /**
+     * Balance cache. The contribution of every wallet transaction to the
+     * balances is kept in mapBalanceContribution and summed in balanceCached.
+     * A balance query only re-evaluates the transactions marked dirty since
+     * the last query and those whose category can change with the chain tip,
+     * the mempool or time (unconfirmed, non-final or immature ones).
+     */
+    mutable bool fBalanceCacheValid;
+    mutable CWalletBalance balanceCached;
+    mutable std::map<uint256, CWalletBalance> mapBalanceContribution;
+    mutable std::set<uint256> setBalanceVolatile;
+    mutable std::set<uint256> setBalanceDirty;
+    void UpdateBalanceContribution(const uint256& hash) const;
+    void MarkBalanceDirty(const CWalletTx& wtx);
+
+    /**
+     * Wallet coin set: the outputs of wallet transactions that are ours and
+     * not spent by a confirmed wallet transaction, with their IsMine type.
+     * Spends by unconfirmed transactions can still be conflicted away, so
+     * those outputs stay in the set and AvailableCoins checks IsSpent on them.
+     * Outputs touched by AddToWallet are queued in setWalletCoinsDirty and
+     * re-evaluated, under cs_main, by the next AvailableCoins call.
+     */
+    mutable bool fWalletCoinsValid;
+    mutable std::map<COutPoint, isminetype> mapWalletCoins;
+    mutable std::set<COutPoint> setWalletCoinsDirty;
+    bool IsSpentConfirmed(const COutPoint& outpoint) const;
+    void UpdateWalletCoin(const COutPoint& outpoint) const;
+    void UpdateWalletCoins() const;
+    void MarkWalletCoinsDirty(const CWalletTx& wtx);
+
 public:
     bool MintableCoins();
     bool SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, CAmount nTargetAmount) const;
@@ -232,7 +339,11 @@ public:
         nNextResend = 0;
         nLastResend = 0;
         nTimeFirstKey = 0;
+        fKeyPoolFillerRunning = false;
+        fKeyPoolFillerWake = false;
         fWalletUnlockStakingOnly = false;
+        fBalanceCacheValid = false;
+        fWalletCoinsValid = false;
 
         // Stake Settings
         nHashDrift = 45;
@@ -289,7 +400,7 @@ public:
 
     void AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed = true, const CCoinControl* coinControl = NULL, bool fIncludeZeroValue = false, AvailableCoinsType nCoinType = ALL_COINS, bool fUseIX = false) const;
     std::map<CBitcoinAddress, std::vector<COutput> > AvailableCoinsByAddress(bool fConfirmed = true, CAmount maxCoinValue = 0);
-    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, const std::vector<COutput>& vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
 
     /// Get 1000DASH output and keys which can be used for the Masternode
     bool GetMasternodeVinAndKeys(CTxIn& txinRet, CPubKey& pubKeyRet, CKey& keyRet, std::string strTxHash = "", std::string strOutputIndex = "");
@@ -308,6 +419,8 @@ public:
     //  keystore implementation
     // Generate a new key
     CPubKey GenerateNewKey();
+    //! Add a freshly generated key with its metadata, and save it to disk
+    void AddGeneratedKey(const CKey& secret, const CPubKey& pubkey);
 
     //! Adds a key to the store, and saves it to disk.
     bool AddKeyPubKey(const CKey& key, const CPubKey& pubkey);
@@ -377,11 +490,13 @@ public:
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet = false);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
+    void SyncBlockTransactions(const std::list<CTransaction>& txConflicted, const CBlock& block, bool fConnected);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     void EraseFromWallet(const uint256& hash);
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
     void ReacceptWalletTransactions();
     void ResendWalletTransactions();
+    CWalletBalance GetBalances() const;
     CAmount GetBalance() const;
     CAmount GetUnconfirmedBalance() const;
     CAmount GetImmatureBalance() const;
@@ -410,6 +525,10 @@ public:
 
     bool NewKeyPool();
     bool TopUpKeyPool(unsigned int kpSize = 0);
+    //! Wake the background key pool filler, or top up the key pool in place if it is not running
+    void RequestKeyPoolTopUp();
+    //! Keep the key pool topped up in the background, refilling it as it drains
+    void ThreadKeyPoolFiller();
     void ReserveKeyFromKeyPool(int64_t& nIndex, CKeyPool& keypool);
     void KeepKey(int64_t nIndex);
     void ReturnKey(int64_t nIndex);
@@ -42,6 +42,15 @@ isminetype IsMine(const CKeyStore& keystore, const CScript& scriptPubKey)
     if(keystore.HaveMultiSig(scriptPubKey))
         return ISMINE_MULTISIG;
 
+    // Common cases first, without building Solver's solutions. Watch-only
+    // and multisig scripts were handled above.
+    uint160 hash;
+    if (MatchPayToPubkeyHash(scriptPubKey, hash))
+        return keystore.HaveKey(CKeyID(hash)) ? ISMINE_SPENDABLE : ISMINE_NO;
+    CPubKey pubkey;
+    if (MatchPayToPubkey(scriptPubKey, pubkey))
+        return keystore.HaveKey(pubkey.GetID()) ? ISMINE_SPENDABLE : ISMINE_NO;
+
     vector<valtype> vSolutions;
     txnouttype whichType;
     if(!Solver(scriptPubKey, whichType, vSolutions)) {
@@ -11,17 +11,27 @@ CZMQAbstractNotifier::~CZMQAbstractNotifier()
     assert(!psocket);
 }
 
-bool CZMQAbstractNotifier::NotifyBlock(const CBlockIndex * /*CBlockIndex*/)
+bool CZMQAbstractNotifier::GetBlockMessage(const CBlock &/*block*/, const CBlockIndex * /*pindex*/, std::vector<unsigned char> &/*vData*/)
 {
-    return true;
+    return false;
 }
 
-bool CZMQAbstractNotifier::NotifyTransaction(const CTransaction &/*transaction*/)
+bool CZMQAbstractNotifier::GetTransactionMessage(const CTransaction &/*transaction*/, std::vector<unsigned char> &/*vData*/)
 {
-    return true;
+    return false;
 }
 
-bool CZMQAbstractNotifier::NotifyTransactionLock(const CTransaction &/*transaction*/)
+bool CZMQAbstractNotifier::GetTransactionLockMessage(const CTransaction &/*transaction*/, std::vector<unsigned char> &/*vData*/)
 {
-    return true;
+    return false;
+}
+
+bool CZMQAbstractNotifier::GetMasternodeWinnerMessage(const CMasternodePaymentWinner &/*winner*/, std::vector<unsigned char> &/*vData*/)
+{
+    return false;
+}
+
+bool CZMQAbstractNotifier::GetBudgetVoteMessage(const CBudgetVote &/*vote*/, std::vector<unsigned char> &/*vData*/)
+{
+    return false;
 }
@@ -7,15 +7,25 @@
 
 #include "zmqconfig.h"
 
+#include <vector>
+
 class CBlockIndex;
+class CBudgetVote;
+class CMasternodePaymentWinner;
 class CZMQAbstractNotifier;
 
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
 
+/**
+ * A notifier turns validation events into message bodies on the thread that
+ * raised them, and sends the queued messages later from the ZMQ publisher
+ * thread. The Get*Message functions return false for events the notifier
+ * does not publish.
+ */
 class CZMQAbstractNotifier
 {
 public:
-    CZMQAbstractNotifier() : psocket(0) { }
+    CZMQAbstractNotifier() : psocket(0), nSequence(0) { }
     virtual ~CZMQAbstractNotifier();
 
     template <typename T>
@@ -29,17 +39,28 @@ public:
     std::string GetAddress() const { return address; }
     void SetAddress(const std::string &a) { address = a; }
 
+    /** Sequence number for the next message of this notifier's topic */
+    uint32_t NextSequence() { return nSequence++; }
+
     virtual bool Initialize(void *pcontext) = 0;
     virtual void Shutdown() = 0;
 
-    virtual bool NotifyBlock(const CBlockIndex *pindex);
-    virtual bool NotifyTransaction(const CTransaction &transaction);
-    virtual bool NotifyTransactionLock(const CTransaction &transaction);
+    /** Send a queued message body; returns false if the notifier has failed */
+    virtual bool Publish(const std::vector<unsigned char> &vData, uint32_t nSequenceIn) = 0;
+
+    virtual bool GetBlockMessage(const CBlock &block, const CBlockIndex *pindex, std::vector<unsigned char> &vData);
+    virtual bool GetTransactionMessage(const CTransaction &transaction, std::vector<unsigned char> &vData);
+    virtual bool GetTransactionLockMessage(const CTransaction &transaction, std::vector<unsigned char> &vData);
+    virtual bool GetMasternodeWinnerMessage(const CMasternodePaymentWinner &winner, std::vector<unsigned char> &vData);
+    virtual bool GetBudgetVoteMessage(const CBudgetVote &vote, std::vector<unsigned char> &vData);
 
 protected:
     void *psocket;
     std::string type;
     std::string address;
+
+private:
+    uint32_t nSequence; // upcounting per topic sequence number
 };
 
 #endif // BITCOIN_ZMQ_ZMQABSTRACTNOTIFIER_H
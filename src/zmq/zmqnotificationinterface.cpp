@@ -10,12 +10,14 @@
 #include "streams.h"
 #include "util.h"
 
+#include <boost/bind.hpp>
+
 void zmqError(const char *str)
 {
     LogPrint("zmq", "zmq: Error: %s, errno=%s\n", str, zmq_strerror(errno));
 }
 
-CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(NULL)
+CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(NULL), nQueueBytes(0), nMaxQueueBytes(DEFAULT_ZMQ_QUEUE_SIZE << 20), nDropped(0), fRunning(false)
 {
 }
 
@@ -38,9 +40,11 @@ CZMQNotificationInterface* CZMQNotificationInterface::CreateWithArguments(const
     factories["pubhashblock"] = CZMQAbstractNotifier::Create<CZMQPublishHashBlockNotifier>;
     factories["pubhashtx"] = CZMQAbstractNotifier::Create<CZMQPublishHashTransactionNotifier>;
     factories["pubhashtxlock"] = CZMQAbstractNotifier::Create<CZMQPublishHashTransactionLockNotifier>;
+    factories["pubhashmasternodewinner"] = CZMQAbstractNotifier::Create<CZMQPublishHashMasternodeWinnerNotifier>;
     factories["pubrawblock"] = CZMQAbstractNotifier::Create<CZMQPublishRawBlockNotifier>;
     factories["pubrawtx"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionNotifier>;
     factories["pubrawtxlock"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionLockNotifier>;
+    factories["pubrawbudgetvote"] = CZMQAbstractNotifier::Create<CZMQPublishRawBudgetVoteNotifier>;
 
     for (std::map<std::string, CZMQNotifierFactory>::const_iterator i=factories.begin(); i!=factories.end(); ++i)
     {
@@ -61,6 +65,10 @@ CZMQNotificationInterface* CZMQNotificationInterface::CreateWithArguments(const
         notificationInterface = new CZMQNotificationInterface();
         notificationInterface->notifiers = notifiers;
 
+        std::map<std::string, std::string>::const_iterator j = args.find("-zmqpubqueuesize");
+        if (j != args.end())
+            notificationInterface->nMaxQueueBytes = std::max((int64_t)1, atoi64(j->second)) << 20;
+
         if (!notificationInterface->Initialize())
         {
             delete notificationInterface;
@@ -105,6 +113,9 @@ bool CZMQNotificationInterface::Initialize()
         return false;
     }
 
+    fRunning = true;
+    threadPublish = boost::thread(boost::bind(&CZMQNotificationInterface::ThreadPublish, this));
+
     return true;
 }
 
@@ -112,11 +123,22 @@ bool CZMQNotificationInterface::Initialize()
 void CZMQNotificationInterface::Shutdown()
 {
     LogPrint("zmq", "zmq: Shutdown notification interface\n");
+    if (threadPublish.joinable())
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            fRunning = false;
+            cond.notify_one();
+        }
+        threadPublish.join();
+    }
     if (pcontext)
     {
         for (std::list<CZMQAbstractNotifier*>::iterator i=notifiers.begin(); i!=notifiers.end(); ++i)
         {
             CZMQAbstractNotifier *notifier = *i;
+            if (setFailed.count(notifier))
+                continue;
             LogPrint("zmq", "   Shutdown notifier %s at %s\n", notifier->GetType(), notifier->GetAddress());
             notifier->Shutdown();
         }
@@ -126,53 +148,119 @@ void CZMQNotificationInterface::Shutdown()
     }
 }
 
-void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex)
+void CZMQNotificationInterface::Enqueue(CZMQAbstractNotifier *notifier, std::vector<unsigned char> &vData)
 {
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
+    boost::unique_lock<boost::mutex> lock(cs);
+    if (setFailed.count(notifier))
+        return;
+
+    // Dropped messages still take a sequence number, so subscribers see the gap
+    uint32_t nSequence = notifier->NextSequence();
+    size_t nBytes = sizeof(QueuedMessage) + vData.size();
+    if (nQueueBytes + nBytes > nMaxQueueBytes)
     {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyBlock(pindex))
+        if (nDropped++ == 0)
+            LogPrintf("zmq: Publish queue full (%u bytes), dropping messages\n", nQueueBytes);
+        LogPrint("zmq", "zmq: Dropped %s message %u\n", notifier->GetType(), nSequence);
+        return;
+    }
+
+    queue.push_back(QueuedMessage());
+    QueuedMessage &message = queue.back();
+    message.notifier = notifier;
+    message.nSequence = nSequence;
+    message.vData.swap(vData);
+    nQueueBytes += nBytes;
+    cond.notify_one();
+}
+
+void CZMQNotificationInterface::ThreadPublish()
+{
+    RenameThread("basex-zmqpub");
+    LogPrint("zmq", "zmq: Publisher thread started\n");
+
+    while (true)
+    {
+        QueuedMessage message;
         {
-            i++;
+            boost::unique_lock<boost::mutex> lock(cs);
+            while (fRunning && queue.empty())
+                cond.wait(lock);
+            // Messages queued before shutdown are still sent
+            if (queue.empty())
+                break;
+            message.notifier = queue.front().notifier;
+            message.nSequence = queue.front().nSequence;
+            message.vData.swap(queue.front().vData);
+            queue.pop_front();
+            nQueueBytes -= sizeof(QueuedMessage) + message.vData.size();
+            if (queue.empty() && nDropped > 0)
+            {
+                LogPrintf("zmq: Publish queue drained, %u messages were dropped\n", nDropped);
+                nDropped = 0;
+            }
+            if (setFailed.count(message.notifier))
+                continue;
         }
-        else
+
+        if (!message.notifier->Publish(message.vData, message.nSequence))
         {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
+            LogPrint("zmq", "zmq: Notifier %s failed, shutting it down\n", message.notifier->GetType());
+            message.notifier->Shutdown();
+            boost::unique_lock<boost::mutex> lock(cs);
+            setFailed.insert(message.notifier);
         }
     }
+
+    LogPrint("zmq", "zmq: Publisher thread exited\n");
+}
+
+void CZMQNotificationInterface::BlockConnected(const CBlock &block, const CBlockIndex *pindex)
+{
+    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); ++i)
+    {
+        std::vector<unsigned char> vData;
+        if ((*i)->GetBlockMessage(block, pindex, vData))
+            Enqueue(*i, vData);
+    }
 }
 
 void CZMQNotificationInterface::SyncTransaction(const CTransaction &tx, const CBlock *pblock)
 {
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
+    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); ++i)
     {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransaction(tx))
-        {
-            i++;
-        }
-        else
-        {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
-        }
+        std::vector<unsigned char> vData;
+        if ((*i)->GetTransactionMessage(tx, vData))
+            Enqueue(*i, vData);
     }
 }
 
 void CZMQNotificationInterface::NotifyTransactionLock(const CTransaction &tx)
 {
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
+    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); ++i)
     {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransactionLock(tx))
-        {
-            i++;
-        }
-        else
-        {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
-        }
+        std::vector<unsigned char> vData;
+        if ((*i)->GetTransactionLockMessage(tx, vData))
+            Enqueue(*i, vData);
+    }
+}
+
+void CZMQNotificationInterface::NotifyMasternodeWinner(const CMasternodePaymentWinner &winner)
+{
+    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); ++i)
+    {
+        std::vector<unsigned char> vData;
+        if ((*i)->GetMasternodeWinnerMessage(winner, vData))
+            Enqueue(*i, vData);
+    }
+}
+
+void CZMQNotificationInterface::NotifyBudgetVote(const CBudgetVote &vote)
+{
+    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); ++i)
+    {
+        std::vector<unsigned char> vData;
+        if ((*i)->GetBudgetVoteMessage(vote, vData))
+            Enqueue(*i, vData);
     }
 }
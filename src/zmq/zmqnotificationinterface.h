@@ -6,12 +6,23 @@
 #define BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 
 #include "validationinterface.h"
+#include <deque>
+#include <list>
 #include <string>
 #include <map>
+#include <set>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 class CBlockIndex;
 class CZMQAbstractNotifier;
 
+/** Default for -zmqpubqueuesize, in megabytes */
+static const unsigned int DEFAULT_ZMQ_QUEUE_SIZE = 64;
+
 class CZMQNotificationInterface : public CValidationInterface
 {
 public:
@@ -25,14 +36,38 @@ protected:
 
     // CValidationInterface
     void SyncTransaction(const CTransaction &tx, const CBlock *pblock);
-    void UpdatedBlockTip(const CBlockIndex *pindex);
+    void BlockConnected(const CBlock &block, const CBlockIndex *pindex);
     void NotifyTransactionLock(const CTransaction &tx);
+    void NotifyMasternodeWinner(const CMasternodePaymentWinner &winner);
+    void NotifyBudgetVote(const CBudgetVote &vote);
 
 private:
+    /** A message body waiting for the publisher thread */
+    struct QueuedMessage {
+        CZMQAbstractNotifier *notifier;
+        uint32_t nSequence;
+        std::vector<unsigned char> vData;
+    };
+
     CZMQNotificationInterface();
 
+    /** Queue a message for a notifier, or drop it if the queue is full */
+    void Enqueue(CZMQAbstractNotifier *notifier, std::vector<unsigned char> &vData);
+    /** Publisher thread */
+    void ThreadPublish();
+
     void *pcontext;
     std::list<CZMQAbstractNotifier*> notifiers;
+
+    boost::mutex cs;
+    boost::condition_variable cond;
+    std::deque<QueuedMessage> queue;
+    std::set<CZMQAbstractNotifier*> setFailed; //! notifiers shut down after a failed send
+    size_t nQueueBytes;
+    size_t nMaxQueueBytes;
+    uint64_t nDropped;
+    bool fRunning;
+    boost::thread threadPublish;
 };
 
 #endif // BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
@@ -5,17 +5,23 @@
 #include "chainparams.h"
 #include "zmqpublishnotifier.h"
 #include "main.h"
+#include "masternode-budget.h"
+#include "masternode-payments.h"
 #include "util.h"
 #include "crypto/common.h"
 
+#include <algorithm>
+
 static std::multimap<std::string, CZMQAbstractPublishNotifier*> mapPublishNotifiers;
 
-static const char *MSG_HASHBLOCK  = "hashblock";
-static const char *MSG_HASHTX     = "hashtx";
-static const char *MSG_HASHTXLOCK = "hashtxlock";
-static const char *MSG_RAWBLOCK   = "rawblock";
-static const char *MSG_RAWTX      = "rawtx";
-static const char *MSG_RAWTXLOCK = "rawtxlock";
+static const char *MSG_HASHBLOCK     = "hashblock";
+static const char *MSG_HASHTX        = "hashtx";
+static const char *MSG_HASHTXLOCK    = "hashtxlock";
+static const char *MSG_HASHMNWINNER  = "hashmasternodewinner";
+static const char *MSG_RAWBLOCK      = "rawblock";
+static const char *MSG_RAWTX         = "rawtx";
+static const char *MSG_RAWTXLOCK     = "rawtxlock";
+static const char *MSG_RAWBUDGETVOTE = "rawbudgetvote";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -126,89 +132,115 @@ void CZMQAbstractPublishNotifier::Shutdown()
     psocket = 0;
 }
 
-bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* data, size_t size)
+bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* data, size_t size, uint32_t nSequenceIn)
 {
     assert(psocket);
 
     /* send three parts, command & data & a LE 4byte sequence number */
     unsigned char msgseq[sizeof(uint32_t)];
-    WriteLE32(&msgseq[0], nSequence);
+    WriteLE32(&msgseq[0], nSequenceIn);
     int rc = zmq_send_multipart(psocket, command, strlen(command), data, size, msgseq, (size_t)sizeof(uint32_t), (void*)0);
     if (rc == -1)
         return false;
 
-    /* increment memory only sequence number after sending */
-    nSequence++;
-
     return true;
 }
 
-bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQAbstractPublishNotifier::Publish(const std::vector<unsigned char> &vData, uint32_t nSequenceIn)
+{
+    return SendMessage(topic, vData.empty() ? NULL : &vData[0], vData.size(), nSequenceIn);
+}
+
+// Hashes are published in the byte order they are displayed in
+static void HashMessage(const uint256 &hash, std::vector<unsigned char> &vData)
+{
+    vData.assign(hash.begin(), hash.end());
+    std::reverse(vData.begin(), vData.end());
+}
+
+template <typename T>
+static void RawMessage(const T &obj, std::vector<unsigned char> &vData)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss.reserve(::GetSerializeSize(obj, SER_NETWORK, PROTOCOL_VERSION));
+    ss << obj;
+    vData.assign(ss.begin(), ss.end());
+}
+
+CZMQPublishHashBlockNotifier::CZMQPublishHashBlockNotifier() : CZMQAbstractPublishNotifier(MSG_HASHBLOCK) { }
+
+bool CZMQPublishHashBlockNotifier::GetBlockMessage(const CBlock &/*block*/, const CBlockIndex *pindex, std::vector<unsigned char> &vData)
 {
     uint256 hash = pindex->GetBlockHash();
     LogPrint("zmq", "zmq: Publish hashblock %s\n", hash.GetHex());
-    char data[32];
-    for (unsigned int i = 0; i < 32; i++)
-        data[31 - i] = hash.begin()[i];
-    return SendMessage(MSG_HASHBLOCK, data, 32);
+    HashMessage(hash, vData);
+    return true;
 }
 
-bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+CZMQPublishHashTransactionNotifier::CZMQPublishHashTransactionNotifier() : CZMQAbstractPublishNotifier(MSG_HASHTX) { }
+
+bool CZMQPublishHashTransactionNotifier::GetTransactionMessage(const CTransaction &transaction, std::vector<unsigned char> &vData)
 {
     uint256 hash = transaction.GetHash();
     LogPrint("zmq", "zmq: Publish hashtx %s\n", hash.GetHex());
-    char data[32];
-    for (unsigned int i = 0; i < 32; i++)
-        data[31 - i] = hash.begin()[i];
-    return SendMessage(MSG_HASHTX, data, 32);
+    HashMessage(hash, vData);
+    return true;
 }
 
-bool CZMQPublishHashTransactionLockNotifier::NotifyTransactionLock(const CTransaction &transaction)
+CZMQPublishHashTransactionLockNotifier::CZMQPublishHashTransactionLockNotifier() : CZMQAbstractPublishNotifier(MSG_HASHTXLOCK) { }
+
+bool CZMQPublishHashTransactionLockNotifier::GetTransactionLockMessage(const CTransaction &transaction, std::vector<unsigned char> &vData)
 {
     uint256 hash = transaction.GetHash();
     LogPrint("zmq", "zmq: Publish hashtxlock %s\n", hash.GetHex());
-    char data[32];
-    for (unsigned int i = 0; i < 32; i++)
-        data[31 - i] = hash.begin()[i];
-    return SendMessage(MSG_HASHTXLOCK, data, 32);
+    HashMessage(hash, vData);
+    return true;
 }
 
-bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
-{
-    LogPrint("zmq", "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
+CZMQPublishHashMasternodeWinnerNotifier::CZMQPublishHashMasternodeWinnerNotifier() : CZMQAbstractPublishNotifier(MSG_HASHMNWINNER) { }
 
-// XX42    const Consensus::Params& consensusParams = Params().GetConsensus();
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    {
-        LOCK(cs_main);
-        CBlock block;
-// XX42        if(!ReadBlockFromDisk(block, pindex, consensusParams))
-        if(!ReadBlockFromDisk(block, pindex))
-        {
-            zmqError("Can't read block from disk");
-            return false;
-        }
+bool CZMQPublishHashMasternodeWinnerNotifier::GetMasternodeWinnerMessage(const CMasternodePaymentWinner &winner, std::vector<unsigned char> &vData)
+{
+    uint256 hash = winner.GetHash();
+    LogPrint("zmq", "zmq: Publish hashmasternodewinner %s\n", hash.GetHex());
+    HashMessage(hash, vData);
+    return true;
+}
 
-        ss << block;
-    }
+CZMQPublishRawBlockNotifier::CZMQPublishRawBlockNotifier() : CZMQAbstractPublishNotifier(MSG_RAWBLOCK) { }
 
-    return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
+bool CZMQPublishRawBlockNotifier::GetBlockMessage(const CBlock &block, const CBlockIndex *pindex, std::vector<unsigned char> &vData)
+{
+    LogPrint("zmq", "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
+    RawMessage(block, vData);
+    return true;
 }
 
-bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+CZMQPublishRawTransactionNotifier::CZMQPublishRawTransactionNotifier() : CZMQAbstractPublishNotifier(MSG_RAWTX) { }
+
+bool CZMQPublishRawTransactionNotifier::GetTransactionMessage(const CTransaction &transaction, std::vector<unsigned char> &vData)
 {
     uint256 hash = transaction.GetHash();
     LogPrint("zmq", "zmq: Publish rawtx %s\n", hash.GetHex());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << transaction;
-    return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
+    RawMessage(transaction, vData);
+    return true;
 }
 
-bool CZMQPublishRawTransactionLockNotifier::NotifyTransactionLock(const CTransaction &transaction)
+CZMQPublishRawTransactionLockNotifier::CZMQPublishRawTransactionLockNotifier() : CZMQAbstractPublishNotifier(MSG_RAWTXLOCK) { }
+
+bool CZMQPublishRawTransactionLockNotifier::GetTransactionLockMessage(const CTransaction &transaction, std::vector<unsigned char> &vData)
 {
     uint256 hash = transaction.GetHash();
     LogPrint("zmq", "zmq: Publish rawtxlock %s\n", hash.GetHex());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << transaction;
-    return SendMessage(MSG_RAWTXLOCK, &(*ss.begin()), ss.size());
+    RawMessage(transaction, vData);
+    return true;
+}
+
+CZMQPublishRawBudgetVoteNotifier::CZMQPublishRawBudgetVoteNotifier() : CZMQAbstractPublishNotifier(MSG_RAWBUDGETVOTE) { }
+
+bool CZMQPublishRawBudgetVoteNotifier::GetBudgetVoteMessage(const CBudgetVote &vote, std::vector<unsigned char> &vData)
+{
+    LogPrint("zmq", "zmq: Publish rawbudgetvote %s\n", vote.GetHash().GetHex());
+    RawMessage(vote, vData);
+    return true;
 }
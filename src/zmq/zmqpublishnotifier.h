@@ -12,9 +12,10 @@ class CBlockIndex;
 class CZMQAbstractPublishNotifier : public CZMQAbstractNotifier
 {
 private:
-    uint32_t nSequence; // upcounting per message sequence number
+    const char *topic;
 
 public:
+    CZMQAbstractPublishNotifier(const char *topicIn) : topic(topicIn) { }
 
     /* send zmq multipart message
        parts:
@@ -22,46 +23,67 @@ public:
           * data
           * message sequence number
     */
-    bool SendMessage(const char *command, const void* data, size_t size);
+    bool SendMessage(const char *command, const void* data, size_t size, uint32_t nSequenceIn);
 
     bool Initialize(void *pcontext);
     void Shutdown();
+    bool Publish(const std::vector<unsigned char> &vData, uint32_t nSequenceIn);
 };
 
 class CZMQPublishHashBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    CZMQPublishHashBlockNotifier();
+    bool GetBlockMessage(const CBlock &block, const CBlockIndex *pindex, std::vector<unsigned char> &vData);
 };
 
 class CZMQPublishHashTransactionNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransaction(const CTransaction &transaction);
+    CZMQPublishHashTransactionNotifier();
+    bool GetTransactionMessage(const CTransaction &transaction, std::vector<unsigned char> &vData);
 };
 
 class CZMQPublishHashTransactionLockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransactionLock(const CTransaction &transaction);
+    CZMQPublishHashTransactionLockNotifier();
+    bool GetTransactionLockMessage(const CTransaction &transaction, std::vector<unsigned char> &vData);
+};
+
+class CZMQPublishHashMasternodeWinnerNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    CZMQPublishHashMasternodeWinnerNotifier();
+    bool GetMasternodeWinnerMessage(const CMasternodePaymentWinner &winner, std::vector<unsigned char> &vData);
 };
 
 class CZMQPublishRawBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    CZMQPublishRawBlockNotifier();
+    bool GetBlockMessage(const CBlock &block, const CBlockIndex *pindex, std::vector<unsigned char> &vData);
 };
 
 class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransaction(const CTransaction &transaction);
+    CZMQPublishRawTransactionNotifier();
+    bool GetTransactionMessage(const CTransaction &transaction, std::vector<unsigned char> &vData);
 };
 
 class CZMQPublishRawTransactionLockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransactionLock(const CTransaction &transaction);
+    CZMQPublishRawTransactionLockNotifier();
+    bool GetTransactionLockMessage(const CTransaction &transaction, std::vector<unsigned char> &vData);
+};
+
+class CZMQPublishRawBudgetVoteNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    CZMQPublishRawBudgetVoteNotifier();
+    bool GetBudgetVoteMessage(const CBudgetVote &vote, std::vector<unsigned char> &vData);
 };
 
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H